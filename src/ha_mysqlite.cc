@@ -91,6 +91,7 @@
 
 #undef SAFE_MUTEX  // TODO: Necessary to use correct TABLE_SHARE::LOCK_ha_data->m_mutex.
                    // TODO: But should not be undefed.
+#include <algorithm>
 #include "ha_mysqlite.h"
 #include "pcache.h"
 #include "utils.h"
@@ -98,6 +99,10 @@
 #include "mysqlite_config.h"
 
 #include "sql_class.h"
+#include "key.h"
+
+/* Comment of discovered keys listing collations of SQLite index columns */
+#define SQLITE_KEY_COMMENT_PREFIX "SQLite collations: "
 
 
 /* Stuff for shares */
@@ -109,6 +114,15 @@ static handler *mysqlite_create_handler(handlerton *hton,
 
 handlerton *mysqlite_hton;
 
+/* System variables used by handler */
+static ulong srv_lock_wait_timeout= 0;
+static ulong srv_trace_level= mysqlite::TRACE_ERROR;
+static ulong srv_mrr_batch_rows= 1024;
+static ulong srv_parallel_scan_threads= 0;
+static my_bool srv_leaf_order_scan= TRUE;
+static my_bool srv_shared_scan= FALSE;
+static my_bool srv_decode_thread= FALSE;
+
 /* Interface to mysqld, to check system tables supported by SE */
 #ifndef MARIADB
 static const char* mysqlite_system_database();
@@ -154,6 +168,7 @@ struct ha_table_option_struct {
   bool huge;
   bool split;
   bool readonly;
+  bool immutable;
   bool sepindex;
   };
 
@@ -183,10 +198,11 @@ ha_create_table_option mysqlite_table_option_list[]=
   HA_TOPTION_NUMBER("ENDING", ending, -1, 0, INT_MAX32, 1),
   HA_TOPTION_NUMBER("COMPRESS", compressed, 0, 0, 2, 1),
 //HA_TOPTION_BOOL("COMPRESS", compressed, 0),
-  HA_TOPTION_BOOL("MAPPED", mapped, 0),
-  HA_TOPTION_BOOL("HUGE", huge, 0),
+  HA_TOPTION_BOOL("MAPPED", mapped, 1),  // mmap whole file. MAPPED=0 for buffer pool
+  HA_TOPTION_BOOL("HUGE", huge, 0),      // Map chunks of the file on demand
   HA_TOPTION_BOOL("SPLIT", split, 0),
   HA_TOPTION_BOOL("READONLY", readonly, 0),
+  HA_TOPTION_BOOL("IMMUTABLE", immutable, 0),  // READONLY, and the file never changes
   HA_TOPTION_BOOL("SEPINDEX", sepindex, 0),
   HA_TOPTION_END
 };
@@ -238,6 +254,17 @@ static PSI_mutex_info all_mysqlite_mutexes[]=
   { &mysqlite_key_mutex_Mysqlite_share_mutex, "Mysqlite_share::mutex", 0}
 };
 
+/*
+  fcntl() lock on SQLite DB file is not a rwlock of mysqld, but waits on it
+  are reported as rwlock wait events (one instance per table).
+*/
+static PSI_rwlock_key mysqlite_key_rwlock_flock;
+
+static PSI_rwlock_info all_mysqlite_rwlocks[]=
+{
+  { &mysqlite_key_rwlock_flock, "SqliteDb::flock", 0}
+};
+
 static void init_mysqlite_psi_keys()
 {
   const char* category= "mysqlite";
@@ -245,11 +272,136 @@ static void init_mysqlite_psi_keys()
 
   count= array_elements(all_mysqlite_mutexes);
   PSI_server->register_mutex(category, all_mysqlite_mutexes, count);
+
+  count= array_elements(all_mysqlite_rwlocks);
+  PSI_server->register_rwlock(category, all_mysqlite_rwlocks, count);
 }
 #else
 static void init_mysqlite_psi_keys() {}
 #endif
 
+
+/*
+  Lock statistics per table.
+
+  Entries are created by ha_mysqlite::open() and are never freed until
+  the plugin is unloaded. So handlers and SHOW STATUS refer to them
+  without holding mysqlite_mutex.
+
+  Exposed by SHOW STATUS as:
+    mysqlite_lock_<db>.<table>_{wait,hold}_{count,usec}
+    mysqlite_lock_<db>.<table>_{wait,hold}_histogram_{lt,ge}_<N>us
+    mysqlite_lock_<db>.<table>_timeouts
+*/
+#define LOCK_HIST_N_BUCKETS mysqlite::LatencyHistogram::N_BUCKETS
+
+struct Mysqlite_lock_stats {
+  char name[NAME_LEN * 2 + 2];  // "<db>.<table>"
+  uint name_length;
+  mysqlite::LockStats stats;
+#ifdef HAVE_PSI_INTERFACE
+  PSI_rwlock *psi;
+#endif
+  struct st_mysql_show_var status_vars[8];
+  struct st_mysql_show_var wait_hist_vars[LOCK_HIST_N_BUCKETS + 1];
+  struct st_mysql_show_var hold_hist_vars[LOCK_HIST_N_BUCKETS + 1];
+};
+
+// SHOW_LONGLONG variables directly point to atomic counters
+static_assert(sizeof(std::atomic<u64>) == sizeof(ulonglong),
+              "std::atomic<u64> cannot be shown as SHOW_LONGLONG");
+
+static HASH mysqlite_lock_stats;
+static char lock_hist_bucket_names[LOCK_HIST_N_BUCKETS][32];
+
+static uchar* mysqlite_lock_stats_get_key(Mysqlite_lock_stats *st, size_t *length,
+                                          my_bool not_used __attribute__((unused)))
+{
+  *length = st->name_length;
+  return (uchar *)st->name;
+}
+
+static void mysqlite_lock_stats_free(Mysqlite_lock_stats *st)
+{
+#ifdef HAVE_PSI_INTERFACE
+  if (st->psi) PSI_server->destroy_rwlock(st->psi);
+#endif
+  delete st;
+}
+
+static void init_lock_hist_bucket_names()
+{
+  for (int i = 0; i < LOCK_HIST_N_BUCKETS - 1; ++i)
+    my_snprintf(lock_hist_bucket_names[i], sizeof(lock_hist_bucket_names[i]),
+                "lt_%lluus", mysqlite::LatencyHistogram::bucket_upper_usec(i));
+  my_snprintf(lock_hist_bucket_names[LOCK_HIST_N_BUCKETS - 1],
+              sizeof(lock_hist_bucket_names[0]), "ge_%lluus",
+              mysqlite::LatencyHistogram::bucket_upper_usec(LOCK_HIST_N_BUCKETS - 2));
+}
+
+static void set_show_var(struct st_mysql_show_var *var, const char *name,
+                         const void *value, enum enum_mysql_show_type type)
+{
+  var->name = name;
+  var->value = (char *)value;
+  var->type = type;
+}
+
+static void init_hist_show_vars(struct st_mysql_show_var *vars,
+                                const mysqlite::LatencyHistogram &hist)
+{
+  for (int i = 0; i < LOCK_HIST_N_BUCKETS; ++i)
+    set_show_var(&vars[i], lock_hist_bucket_names[i],
+                 hist.bucket_counter(i), SHOW_LONGLONG);
+  set_show_var(&vars[LOCK_HIST_N_BUCKETS], NullS, NullS, SHOW_UNDEF);
+}
+
+static void init_lock_stats_show_vars(Mysqlite_lock_stats *st)
+{
+  struct st_mysql_show_var *v = st->status_vars;
+  set_show_var(v++, "wait_count", st->stats.wait.count_counter(), SHOW_LONGLONG);
+  set_show_var(v++, "wait_usec", st->stats.wait.total_usec_counter(), SHOW_LONGLONG);
+  set_show_var(v++, "wait_histogram", st->wait_hist_vars, SHOW_ARRAY);
+  set_show_var(v++, "hold_count", st->stats.hold.count_counter(), SHOW_LONGLONG);
+  set_show_var(v++, "hold_usec", st->stats.hold.total_usec_counter(), SHOW_LONGLONG);
+  set_show_var(v++, "hold_histogram", st->hold_hist_vars, SHOW_ARRAY);
+  set_show_var(v++, "timeouts", &st->stats.n_timeouts, SHOW_LONGLONG);
+  set_show_var(v++, NullS, NullS, SHOW_UNDEF);
+  init_hist_show_vars(st->wait_hist_vars, st->stats.wait);
+  init_hist_show_vars(st->hold_hist_vars, st->stats.hold);
+}
+
+/*
+  Get lock statistics of a table. Newly created if not exists yet.
+*/
+static Mysqlite_lock_stats *get_lock_stats(TABLE_SHARE *table_share)
+{
+  char name[NAME_LEN * 2 + 2];
+  uint name_length = my_snprintf(name, sizeof(name), "%s.%s",
+                                 table_share->db.str,
+                                 table_share->table_name.str);
+
+  mysql_mutex_lock(&mysqlite_mutex);
+  Mysqlite_lock_stats *st =
+    (Mysqlite_lock_stats *)my_hash_search(&mysqlite_lock_stats,
+                                          (const uchar *)name, name_length);
+  if (!st) {
+    st = new Mysqlite_lock_stats;
+    memcpy(st->name, name, name_length + 1);
+    st->name_length = name_length;
+#ifdef HAVE_PSI_INTERFACE
+    st->psi = PSI_server->init_rwlock(mysqlite_key_rwlock_flock, st);
+#endif
+    init_lock_stats_show_vars(st);
+    if (my_hash_insert(&mysqlite_lock_stats, (uchar *)st)) {
+      mysqlite_lock_stats_free(st);
+      st = NULL;
+    }
+  }
+  mysql_mutex_unlock(&mysqlite_mutex);
+  return st;
+}
+
 Mysqlite_share::Mysqlite_share()
 {
   thr_lock_init(&lock);
@@ -298,6 +450,13 @@ static int mysqlite_init_func(void *p)
   mysql_mutex_init(mysqlite_key_mutex, &mysqlite_mutex, MY_MUTEX_INIT_FAST);
   (void) my_hash_init(&mysqlite_open_tables, system_charset_info, 32, 0, 0,
                       (my_hash_get_key)mysqlite_get_key, 0, 0);
+  (void) my_hash_init(&mysqlite_lock_stats, system_charset_info, 32, 0, 0,
+                      (my_hash_get_key)mysqlite_lock_stats_get_key,
+                      (my_hash_free_key)mysqlite_lock_stats_free, 0);
+  init_lock_hist_bucket_names();
+
+  mysqlite::set_trace_level((mysqlite::trace_level)srv_trace_level);
+  mysqlite::trace_install_crash_handler();
 
   mysqlite_hton= (handlerton *)p;
   mysqlite_hton->state=                     SHOW_OPTION_YES;
@@ -321,7 +480,10 @@ static int mysqlite_init_func(void *p)
 
 static int mysqlite_done_func(void *p)
 {
+  mysqlite::trace_uninstall_crash_handler();
+  mysqlite::trace_shutdown();
   my_hash_free(&mysqlite_open_tables);
+  my_hash_free(&mysqlite_lock_stats);
   mysql_mutex_destroy(&mysqlite_mutex);
 
   // Page cache
@@ -408,7 +570,12 @@ static handler* mysqlite_create_handler(handlerton *hton,
 }
 
 ha_mysqlite::ha_mysqlite(handlerton *hton, TABLE_SHARE *table_arg)
-  :handler(hton, table_arg)
+  :handler(hton, table_arg), rows(NULL), idx_rows(NULL),
+   sqlite_schema_cookie(0), lock_stats(NULL), lock_acquired_usec(0),
+   mrr_batched(false), mrr_ranges_done(false), mrr_batch_pos(0),
+   keyread(false),
+   rnd_scan(false), scan_cache(false), pipeline(NULL), decoded_row(NULL),
+   pos_rows(NULL)
 {
 }
 
@@ -502,13 +669,404 @@ int ha_mysqlite::open(const char *name, int mode, uint test_if_locked)
 
   if (!(share = Mysqlite_share::get_share()))
     DBUG_RETURN(HA_ERR_OUT_OF_MEM);
+  if (!(lock_stats = get_lock_stats(table_share)))
+    DBUG_RETURN(HA_ERR_OUT_OF_MEM);
 
   thr_lock_data_init(&share->lock,&lock,NULL);
 
+  ref_length = sizeof(Rowid);  // position() stores rowid
+  load_sqlite_schema();
+  build_row_plan();
+
   DBUG_RETURN(0);
 }
 
 
+/*
+  Read the schema of the SQLite table and map MySQL keys to SQLite indexes.
+
+  Keys are defined by discovery (mysqlite_assisted_discovery()) from usable
+  SQLite indexes with the same names, and PRIMARY KEY from INTEGER PRIMARY
+  KEY. Without PRIMARY KEY, the server makes a UNIQUE key of NOT NULL
+  columns primary_key; it is mapped to its SQLite index as other keys.
+  A key is left unmapped (and unusable) when the SQLite DB file does not
+  have the index anymore.
+*/
+void ha_mysqlite::load_sqlite_schema()
+{
+  sqlite_tbl = TableDef();
+  sqlite_idx_of_key.assign(table_share->keys, (int)NO_SQLITE_INDEX);
+
+  if (!share->conn.is_opened()) return;
+
+  if (share->conn.rdlock_db(srv_lock_wait_timeout * 1000000) != MYSQLITE_OK) return;
+  sqlite_schema_cookie = share->conn.get_schema_cookie();
+  errstat res = share->conn.get_table_def(table_share->table_name.str, &sqlite_tbl);
+  share->conn.unlock_db();
+  if (res != MYSQLITE_OK) {
+    log_errstat(res);
+    return;
+  }
+
+  for (uint i = 0; i < table_share->keys; ++i) {
+    const KEY *key_info = &table_share->key_info[i];
+    if (i == table_share->primary_key && rowid_primary_key()) {
+      if (sqlite_tbl.rowid_colno >= 0 && !sqlite_tbl.without_rowid &&
+          key_info->user_defined_key_parts == 1 &&
+          (int)key_info->key_part[0].fieldnr - 1 == sqlite_tbl.rowid_colno)
+        sqlite_idx_of_key[i] = SQLITE_ROWID;
+      continue;
+    }
+
+    const IndexDef *idx = sqlite_tbl.find_index(key_info->name);
+    if (!idx || !idx->usable || key_info->user_defined_key_parts > idx->cols.size())
+      continue;
+
+    bool same_cols = true;
+    for (uint j = 0; j < key_info->user_defined_key_parts; ++j)
+      same_cols &= (int)key_info->key_part[j].fieldnr - 1 == idx->cols[j].colno;
+    if (same_cols)
+      sqlite_idx_of_key[i] = idx - &sqlite_tbl.indexes[0];
+  }
+}
+
+
+/*
+  Whether primary_key is the PRIMARY KEY discovery makes from INTEGER
+  PRIMARY KEY, rather than a UNIQUE key the server promoted.
+*/
+bool ha_mysqlite::rowid_primary_key() const
+{
+  return table_share && table_share->primary_key < table_share->keys &&
+    strcmp(table_share->key_info[table_share->primary_key].name,
+           primary_key_name) == 0;
+}
+
+
+/*
+  Read the schema again if another process changed it since
+  load_sqlite_schema(): root pages of the table and its indexes move when
+  they are recreated or vacuumed. Not while a cursor made from sqlite_tbl
+  is open. Read lock must be held.
+*/
+void ha_mysqlite::refresh_sqlite_schema()
+{
+  if (rows || idx_rows || !share->conn.is_opened()) return;
+  if (share->conn.get_schema_cookie() != sqlite_schema_cookie)
+    load_sqlite_schema();
+}
+
+
+/*
+  Plan how store_row() writes each column. Values fitting the column are
+  written at the offset of the field in the record: integers within the
+  range of an integer type, reals to a DOUBLE column without precision,
+  and UTF-8 text fitting a utf8 VARCHAR or TEXT column (any bytes for
+  binary ones). The others are converted by
+  Field::store() as before, which also truncates or clamps them with
+  warnings. Null bits of the columns are kept for set_null_bits().
+*/
+void ha_mysqlite::build_row_plan()
+{
+  row_plan.assign(table_share->fields, Col_plan());
+  blob_bufs.assign(table_share->fields, string());
+
+  for (Field **field=table->field ; *field ; field++) {
+    Col_plan &plan= row_plan[(*field)->field_index];
+    plan.field= *field;
+    if ((int)(*field)->field_index == sqlite_tbl.rowid_colno) {
+      // NULL in SQLite records, but never NULL as rowid
+      plan.write= COL_ROWID;
+      continue;
+    }
+
+    if ((*field)->null_ptr) {
+      plan.null_offset= (*field)->null_ptr - table->record[0];
+      plan.null_bit= (*field)->null_bit;
+    }
+
+    const CHARSET_INFO *cs= (*field)->charset();
+    bool utf8= my_charset_same(cs, &my_charset_utf8_bin);
+    switch ((*field)->real_type()) {
+    case MYSQL_TYPE_TINY:
+    case MYSQL_TYPE_SHORT:
+    case MYSQL_TYPE_INT24:
+    case MYSQL_TYPE_LONG:
+    case MYSQL_TYPE_LONGLONG:
+      {
+        uint bits= 8 * (*field)->pack_length();
+        plan.write= COL_INT;
+        plan.len_bytes= (*field)->pack_length();
+        if ((*field)->flags & UNSIGNED_FLAG) {
+          plan.min_int= 0;
+          plan.max_int= bits < 64 ? (1LL << bits) - 1 : LLONG_MAX;
+        } else {
+          plan.min_int= bits < 64 ? -(1LL << (bits - 1)) : LLONG_MIN;
+          plan.max_int= bits < 64 ? (1LL << (bits - 1)) - 1 : LLONG_MAX;
+        }
+      }
+      break;
+    case MYSQL_TYPE_DOUBLE:
+      if ((*field)->decimals() != NOT_FIXED_DEC || ((*field)->flags & UNSIGNED_FLAG))
+        break;  // Rounded or clamped by Field::store()
+      plan.write= COL_DOUBLE;
+      break;
+    case MYSQL_TYPE_VARCHAR:
+      if (!utf8 && cs != &my_charset_bin) break;
+      plan.write= COL_VARCHAR;
+      plan.len_bytes= static_cast<Field_varstring *>(*field)->length_bytes;
+      plan.max_bytes= (*field)->field_length;
+      plan.max_chars= (*field)->char_length();
+      plan.max_char_len= utf8 ? cs->mbmaxlen : 0;
+      break;
+    case MYSQL_TYPE_BLOB:
+      if (!utf8 && cs != &my_charset_bin) break;
+      plan.write= COL_BLOB;
+      plan.len_bytes= static_cast<Field_blob *>(*field)->pack_length_no_ptr();
+      plan.max_bytes= (1ULL << (8 * plan.len_bytes)) - 1;
+      plan.max_chars= UINT_MAX;  // Limited by bytes
+      plan.max_char_len= utf8 ? cs->mbmaxlen : 0;
+      break;
+    default:
+      break;
+    }
+  }
+}
+
+/*
+  Move the fields by diff from the record they point to. store_row() and
+  friends point them to buf while they store a row there, so that
+  Field::store() and the direct writes of row_plan go to buf.
+*/
+void ha_mysqlite::move_fields(my_ptrdiff_t diff)
+{
+  for (Field **field=table->field ; *field ; field++)
+    (*field)->move_field_offset(diff);
+}
+
+/*
+  Whether a column after the n_rec_cols columns of a record is NULL:
+  columns added by ALTER TABLE ADD COLUMN have their DEFAULT values.
+*/
+bool ha_mysqlite::added_col_is_null(size_t colno) const
+{
+  return colno >= sqlite_tbl.cols.size() ||
+    sqlite_tbl.cols[colno].dflt_type == MYSQLITE_NULL;
+}
+
+/*
+  Set the null bits of buf for the columns NULL in a record (nulls as
+  RowCursor::get_null_mask() returns), and of those after its n_rec_cols
+  columns without DEFAULT. Only the set bits of nulls are visited; NOT
+  NULL columns have no bit to set.
+*/
+void ha_mysqlite::set_null_bits(uchar *buf, const u64 *nulls, size_t n_rec_cols)
+{
+  size_t n_cols= MY_MIN(n_rec_cols, row_plan.size());
+  for (size_t w= 0; w * 64 < n_cols; w++) {
+    u64 bits= nulls[w];
+    if (n_cols - w * 64 < 64) bits&= (1ULL << (n_cols - w * 64)) - 1;
+    for (; bits; bits&= bits - 1) {
+      const Col_plan &plan= row_plan[w * 64 + __builtin_ctzll(bits)];
+      buf[plan.null_offset]|= plan.null_bit;
+    }
+  }
+  for (size_t colno= n_cols; colno < row_plan.size(); colno++) {
+    if (added_col_is_null(colno))
+      buf[row_plan[colno].null_offset]|= row_plan[colno].null_bit;
+  }
+}
+
+/*
+  Store NULL of a column to buf. NOT NULL columns have no null bit, and
+  get the default of their type instead of keeping the previous row's
+  value.
+*/
+void ha_mysqlite::store_null(const Col_plan &plan, uchar *buf)
+{
+  buf[plan.null_offset]|= plan.null_bit;
+  if (!plan.null_bit) plan.field->reset();
+}
+
+/*
+  Store an integer as row_plan says. Values out of the range of the
+  column are left to Field::store().
+*/
+void ha_mysqlite::store_int(const Col_plan &plan, longlong v)
+{
+  if (plan.write != COL_INT || v < plan.min_int || v > plan.max_int) {
+    plan.field->store(v, false);
+    return;
+  }
+
+  uchar *to= plan.field->ptr;  // Where Field::store() writes
+  switch (plan.len_bytes) {
+  case 1: *to= (uchar)v; break;
+  case 2: int2store(to, (uint16)v); break;
+  case 3: int3store(to, (uint32)v); break;
+  case 4: int4store(to, (uint32)v); break;
+  default: int8store(to, (ulonglong)v); break;
+  }
+}
+
+/*
+  Store a real as row_plan says. NaN is left to Field::store().
+*/
+void ha_mysqlite::store_double(const Col_plan &plan, double v)
+{
+  if (plan.write != COL_DOUBLE || isnan(v)) {
+    plan.field->store(v);
+    return;
+  }
+  float8store(plan.field->ptr, v);
+}
+
+/*
+  Store UTF-8 text as row_plan says. A COL_BLOB field points to p itself
+  if in_place (p stays valid until the next row is read), and otherwise
+  to a copy in blob_bufs[].
+*/
+void ha_mysqlite::store_text(const Col_plan &plan, const char *p, size_t len,
+                             bool in_place)
+{
+  bool fits= (plan.write == COL_VARCHAR || plan.write == COL_BLOB) &&
+    len <= plan.max_bytes &&
+    (!plan.max_char_len ||
+     mysqlite::utf8_fits((const u8 *)p, len, plan.max_chars, plan.max_char_len));
+  if (!fits) {
+    plan.field->store(p, len, &my_charset_utf8_unicode_ci);  // TODO: Japanese support
+    return;
+  }
+
+  uchar *to= plan.field->ptr;  // Where Field::store() writes
+  if (plan.write == COL_VARCHAR) {
+    if (plan.len_bytes == 1) *to= (uchar)len;
+    else int2store(to, (uint16)len);
+    memcpy(to + plan.len_bytes, p, len);
+    return;
+  }
+
+  if (!in_place) {
+    string &value= blob_bufs[plan.field->field_index];
+    value.assign(p, len);
+    p= value.data();
+  }
+  switch (plan.len_bytes) {
+  case 1: *to= (uchar)len; break;
+  case 2: int2store(to, (uint16)len); break;
+  case 3: int3store(to, (uint32)len); break;
+  default: int4store(to, (uint32)len); break;
+  }
+  memcpy(to + plan.len_bytes, &p, sizeof(p));
+}
+
+/*
+  Store a SQLite BLOB. Binary columns take its bytes as they are, and the
+  others convert them from binary.
+*/
+void ha_mysqlite::store_blob(const Col_plan &plan, const char *p, size_t len,
+                             bool in_place)
+{
+  if ((plan.write == COL_VARCHAR || plan.write == COL_BLOB) && !plan.max_char_len)
+    store_text(plan, p, len, in_place);
+  else
+    plan.field->store(p, len, &my_charset_bin);
+}
+
+
+/*
+  Whether SQLite orders a key part as MySQL does: ascending, and for
+  strings, by bytes on both sides (BINARY collation and a binary-sorted
+  MySQL collation). NULLs come first on both sides.
+*/
+static bool sqlite_orders_as_mysql(const Field *field, sqlite_collation coll, bool desc)
+{
+  if (desc) return false;
+  return field->result_type() != STRING_RESULT ||
+    (coll == COLL_BINARY && (field->charset()->state & MY_CS_BINSORT));
+}
+
+/*
+  Collation and order of key part j of a discovered key, from the key
+  comment written by mysql_ddl_of_sqlite_table(). Keys without the
+  comment are BINARY and ascending.
+*/
+static void discovered_key_part_order(const KEY *key_info, uint j,
+                                      /* out */
+                                      sqlite_collation *coll,
+                                      bool *desc)
+{
+  *coll = COLL_BINARY;
+  *desc = false;
+  if (!(key_info->flags & HA_USES_COMMENT)) return;
+
+  string comment(key_info->comment.str, key_info->comment.length);
+  size_t pos = strlen(SQLITE_KEY_COMMENT_PREFIX);
+  if (comment.compare(0, pos, SQLITE_KEY_COMMENT_PREFIX) != 0) return;
+  for (uint i = 0; i < j; ++i) {
+    pos = comment.find(", ", pos);
+    if (pos == string::npos) return;
+    pos += 2;
+  }
+  string part = comment.substr(pos, comment.find(", ", pos) - pos);
+  if (part.compare(0, 6, "NOCASE") == 0) *coll = COLL_NOCASE;
+  else if (part.compare(0, 5, "RTRIM") == 0) *coll = COLL_RTRIM;
+  *desc = part.find(" DESC") != string::npos;
+}
+
+/*
+  Equality lookups (HA_READ_NEXT) are always possible. Key parts are
+  readable in order (HA_READ_ORDER, HA_READ_RANGE and HA_READ_PREV) when
+  SQLite orders them as MySQL does (see sqlite_orders_as_mysql()), so
+  that ORDER BY ... LIMIT n reads only the first n entries of the index.
+  Rowids are integers in order.
+  Index entries hold the indexed columns as the table does, plus rowid
+  (HA_KEYREAD_ONLY, and HA_PRIMARY_KEY_IN_READ_INDEX when PRIMARY KEY is
+  INTEGER PRIMARY KEY).
+
+  Also called before open() by TABLE_SHARE initialization, which decides
+  covering keys and keys for ORDER BY. Keys are then as discovered (see
+  mysql_ddl_of_sqlite_table()): PRIMARY KEY is INTEGER PRIMARY KEY and
+  others are usable SQLite indexes, whose collations are in key comments.
+  A promoted primary_key is one of the latter (rowid_primary_key()).
+*/
+ulong ha_mysqlite::index_flags(uint inx, uint part, bool all_parts) const
+{
+  const ulong ordered_flags = HA_READ_PREV | HA_READ_ORDER | HA_READ_RANGE;
+  const ulong rowid_flags = HA_READ_NEXT | ordered_flags | HA_KEYREAD_ONLY;
+  const KEY *key_info = &table_share->key_info[inx];
+  ulong flags = HA_READ_NEXT | ordered_flags | HA_KEYREAD_ONLY |
+                HA_DO_INDEX_COND_PUSHDOWN;  // Checked on index entries
+
+  if (sqlite_idx_of_key.empty()) {
+    if (inx == table_share->primary_key && rowid_primary_key()) return rowid_flags;
+    for (uint j = all_parts ? 0 : part; j <= part; ++j) {
+      sqlite_collation coll;
+      bool desc;
+      discovered_key_part_order(key_info, j, &coll, &desc);
+      if (!sqlite_orders_as_mysql(key_info->key_part[j].field, coll, desc))
+        flags &= ~ordered_flags;
+    }
+    return flags;
+  }
+
+  if (inx >= sqlite_idx_of_key.size() || sqlite_idx_of_key[inx] == NO_SQLITE_INDEX)
+    return 0;
+  if (sqlite_idx_of_key[inx] == SQLITE_ROWID)
+    return rowid_flags;
+
+  const IndexDef &idx = sqlite_tbl.indexes[sqlite_idx_of_key[inx]];
+  if (part >= idx.cols.size()) return 0;
+
+  for (uint j = all_parts ? 0 : part; j <= part; ++j) {
+    if (!sqlite_orders_as_mysql(key_info->key_part[j].field,
+                                idx.cols[j].coll, idx.cols[j].desc))
+      flags &= ~ordered_flags;
+  }
+  return flags;
+}
+
+
 /**
   @brief
   Closes a table.
@@ -632,22 +1190,177 @@ int ha_mysqlite::delete_row(const uchar *buf)
 }
 
 
+/**
+  @brief
+  Prepares an index scan on the SQLite index of the key, or on the table
+  B-tree for INTEGER PRIMARY KEY.
+*/
+
+int ha_mysqlite::index_init(uint idx, bool sorted)
+{
+  DBUG_ENTER("ha_mysqlite::index_init");
+
+  active_index = idx;
+  refresh_sqlite_schema();
+  if (idx >= sqlite_idx_of_key.size() || sqlite_idx_of_key[idx] == NO_SQLITE_INDEX)
+    DBUG_RETURN(HA_ERR_WRONG_INDEX);
+
+  if (sqlite_idx_of_key[idx] == SQLITE_ROWID)
+    idx_rows = share->conn.rowid_scan(sqlite_tbl);
+  else
+    idx_rows = share->conn.index_scan(sqlite_tbl,
+                                      sqlite_tbl.indexes[sqlite_idx_of_key[idx]]);
+  if (!idx_rows) DBUG_RETURN(HA_ERR_WRONG_INDEX);
+  idx_rows->set_columns(&sqlite_tbl.cols);
+  update_entries_only();
+
+  DBUG_RETURN(0);
+}
+
+int ha_mysqlite::index_end()
+{
+  DBUG_ENTER("ha_mysqlite::index_end");
+
+  if (idx_rows) idx_rows->close();
+  idx_rows = NULL;
+  active_index = MAX_KEY;
+  mrr_batched = false;
+  mrr_batch.clear();
+
+  DBUG_RETURN(0);
+}
+
+
+/*
+  Convert the leading key parts of a MySQL key buffer into SQLite values.
+
+  Key parts are restored into record[1] and read through their Fields.
+  Strings are converted to UTF-8, which SQLite TEXT is stored in.
+  bufs owns the converted bytes sqlite_key points to.
+*/
+void ha_mysqlite::make_sqlite_key(uint keynr, const uchar *key, key_part_map keypart_map,
+                                  /* out */
+                                  vector<mysqlite::KeyValue> &sqlite_key,
+                                  vector<string> &bufs)
+{
+  KEY *key_info = &table->key_info[keynr];
+  uint n_parts = 0, key_len = 0;
+  for (; n_parts < key_info->user_defined_key_parts &&
+         (keypart_map & ((key_part_map)1 << n_parts)); ++n_parts)
+    key_len += key_info->key_part[n_parts].store_length;
+
+  key_restore(table->record[1], (uchar *)key, key_info, key_len);
+  my_ptrdiff_t diff = table->record[1] - table->record[0];
+  my_bitmap_map *org_bitmap = dbug_tmp_use_all_columns(table, table->read_set);
+
+  sqlite_key.clear();
+  bufs.assign(n_parts, string());
+  for (uint j = 0; j < n_parts; ++j) {
+    const KEY_PART_INFO *key_part = &key_info->key_part[j];
+    Field *field = key_part->field;
+
+    if (field->is_null_in_record(table->record[1])) {
+      sqlite_key.push_back(mysqlite::KeyValue::null_value());
+      continue;
+    }
+
+    field->move_field_offset(diff);
+    switch (field->result_type()) {
+    case INT_RESULT:
+      sqlite_key.push_back(mysqlite::KeyValue::of_int(field->val_int()));
+      break;
+    case REAL_RESULT:
+    case DECIMAL_RESULT:
+      sqlite_key.push_back(mysqlite::KeyValue::of_double(field->val_real()));
+      break;
+    default:
+      {
+        String val, utf8;
+        uint errors;
+        field->val_str(&val);
+        utf8.copy(val.ptr(), val.length(), val.charset(), &my_charset_utf8_bin, &errors);
+        bufs[j].assign(utf8.ptr(), utf8.length());
+        // Prefix key: only the first key_part->length bytes are in the key
+        u32 n_chars = (key_part->key_part_flag & HA_PART_KEY_SEG) ?
+          key_part->length / field->charset()->mbmaxlen : 0;
+        sqlite_key.push_back(mysqlite::KeyValue::of_text(bufs[j].data(), bufs[j].size(),
+                                                         n_chars));
+      }
+    }
+    field->move_field_offset(-diff);
+  }
+
+  dbug_tmp_restore_column_map(table->read_set, org_bitmap);
+}
+
+
+/* How index_read_map() goes on from entries of each seek_mode ICP rejects */
+static bool (mysqlite::KeyCursor::* const seek_step[])()= {
+  &mysqlite::KeyCursor::next_same,  // SEEK_EQ
+  &mysqlite::KeyCursor::next,       // SEEK_GE
+  &mysqlite::KeyCursor::next,       // SEEK_GT
+  &mysqlite::KeyCursor::prev_same,  // SEEK_LAST_EQ
+  &mysqlite::KeyCursor::prev,       // SEEK_LE
+  &mysqlite::KeyCursor::prev,       // SEEK_LT
+};
+
+
 /**
   @brief
   Positions an index cursor to the index specified in the handle. Fetches the
   row if available. If the key value is null, begin at the first key of the
   index.
+
+  @details
+  HA_READ_KEY_EXACT and HA_READ_PREFIX require an entry equal to the key;
+  HA_READ_KEY_OR_NEXT and HA_READ_AFTER_KEY start forward ranges.
+  HA_READ_PREFIX_LAST positions on the last entry equal to the key;
+  HA_READ_KEY_OR_PREV, HA_READ_PREFIX_LAST_OR_PREV and HA_READ_BEFORE_KEY
+  start backward ranges read by index_prev().
 */
 
 int ha_mysqlite::index_read_map(uchar *buf, const uchar *key,
-                               key_part_map keypart_map __attribute__((unused)),
-                               enum ha_rkey_function find_flag
-                               __attribute__((unused)))
+                               key_part_map keypart_map,
+                               enum ha_rkey_function find_flag)
 {
   int rc;
+  mysqlite::seek_mode mode;
+  vector<mysqlite::KeyValue> sqlite_key;
+  vector<string> bufs;
   DBUG_ENTER("ha_mysqlite::index_read");
   MYSQL_INDEX_READ_ROW_START(table_share->db.str, table_share->table_name.str);
-  rc= HA_ERR_WRONG_COMMAND;
+
+  switch (find_flag) {
+  case HA_READ_KEY_EXACT:
+  case HA_READ_PREFIX:
+    mode = mysqlite::SEEK_EQ;
+    break;
+  case HA_READ_KEY_OR_NEXT:
+    mode = mysqlite::SEEK_GE;
+    break;
+  case HA_READ_AFTER_KEY:
+    mode = mysqlite::SEEK_GT;
+    break;
+  case HA_READ_PREFIX_LAST:
+    mode = mysqlite::SEEK_LAST_EQ;
+    break;
+  case HA_READ_KEY_OR_PREV:
+  case HA_READ_PREFIX_LAST_OR_PREV:
+    mode = mysqlite::SEEK_LE;
+    break;
+  case HA_READ_BEFORE_KEY:
+    mode = mysqlite::SEEK_LT;
+    break;
+  default:
+    rc= HA_ERR_WRONG_COMMAND;
+    goto end;
+  }
+
+  make_sqlite_key(active_index, key, keypart_map, sqlite_key, bufs);
+  rc= read_idx_row(buf, idx_rows->seek(sqlite_key, mode), seek_step[mode],
+                   HA_ERR_KEY_NOT_FOUND);
+
+end:
   MYSQL_INDEX_READ_ROW_DONE(rc);
   DBUG_RETURN(rc);
 }
@@ -663,7 +1376,24 @@ int ha_mysqlite::index_next(uchar *buf)
   int rc;
   DBUG_ENTER("ha_mysqlite::index_next");
   MYSQL_INDEX_READ_ROW_START(table_share->db.str, table_share->table_name.str);
-  rc= HA_ERR_WRONG_COMMAND;
+  rc= read_idx_row(buf, idx_rows->next(), &mysqlite::KeyCursor::next);
+  MYSQL_INDEX_READ_ROW_DONE(rc);
+  DBUG_RETURN(rc);
+}
+
+
+/**
+  @brief
+  Used to read forward through the entries equal to the key of the last
+  index_read_map().
+*/
+
+int ha_mysqlite::index_next_same(uchar *buf, const uchar *key, uint keylen)
+{
+  int rc;
+  DBUG_ENTER("ha_mysqlite::index_next_same");
+  MYSQL_INDEX_READ_ROW_START(table_share->db.str, table_share->table_name.str);
+  rc= read_idx_row(buf, idx_rows->next_same(), &mysqlite::KeyCursor::next_same);
   MYSQL_INDEX_READ_ROW_DONE(rc);
   DBUG_RETURN(rc);
 }
@@ -679,7 +1409,7 @@ int ha_mysqlite::index_prev(uchar *buf)
   int rc;
   DBUG_ENTER("ha_mysqlite::index_prev");
   MYSQL_INDEX_READ_ROW_START(table_share->db.str, table_share->table_name.str);
-  rc= HA_ERR_WRONG_COMMAND;
+  rc= read_idx_row(buf, idx_rows->prev(), &mysqlite::KeyCursor::prev);
   MYSQL_INDEX_READ_ROW_DONE(rc);
   DBUG_RETURN(rc);
 }
@@ -700,7 +1430,7 @@ int ha_mysqlite::index_first(uchar *buf)
   int rc;
   DBUG_ENTER("ha_mysqlite::index_first");
   MYSQL_INDEX_READ_ROW_START(table_share->db.str, table_share->table_name.str);
-  rc= HA_ERR_WRONG_COMMAND;
+  rc= read_idx_row(buf, idx_rows->first(), &mysqlite::KeyCursor::next);
   MYSQL_INDEX_READ_ROW_DONE(rc);
   DBUG_RETURN(rc);
 }
@@ -721,7 +1451,7 @@ int ha_mysqlite::index_last(uchar *buf)
   int rc;
   DBUG_ENTER("ha_mysqlite::index_last");
   MYSQL_INDEX_READ_ROW_START(table_share->db.str, table_share->table_name.str);
-  rc= HA_ERR_WRONG_COMMAND;
+  rc= read_idx_row(buf, idx_rows->last(), &mysqlite::KeyCursor::prev);
   MYSQL_INDEX_READ_ROW_DONE(rc);
   DBUG_RETURN(rc);
 }
@@ -750,8 +1480,24 @@ int ha_mysqlite::rnd_init(bool scan)
     abort();    // TODO: More decent way to report SQLite db is not opened.
   }
 
-  rows = share->conn.table_fullscan(table_share->table_name.str);
-  my_assert(rows);
+  // Called twice without rnd_end()
+  stop_pipeline();
+  if (rows) rows->close();
+  rows= NULL;
+  refresh_sqlite_schema();
+  rnd_scan= scan;
+  // Table scans return rows in no particular order (HA_REC_NOT_IN_SEQ)
+  if (scan && srv_parallel_scan_threads > 1 && sqlite_tbl.root_pgno)
+    rows = share->conn.table_parallel_scan(sqlite_tbl, srv_parallel_scan_threads);
+  else if (scan && srv_shared_scan && sqlite_tbl.root_pgno)
+    rows = share->conn.table_shared_scan(sqlite_tbl);
+  else if (scan && srv_leaf_order_scan && sqlite_tbl.root_pgno)
+    rows = share->conn.table_leaf_order_scan(sqlite_tbl);
+  else
+    rows = share->conn.table_fullscan(table_share->table_name.str);
+  if (!rows) DBUG_RETURN(HA_ERR_NO_SUCH_TABLE);  // Dropped by another process
+  rows->set_columns(&sqlite_tbl.cols);
+  if (!cond_filter.empty()) rows->set_filter(&cond_filter);
 
   DBUG_RETURN(0);
 }
@@ -760,7 +1506,9 @@ int ha_mysqlite::rnd_end()
 {
   DBUG_ENTER("ha_mysqlite::rnd_end");
 
-  rows->close();
+  stop_pipeline();
+  if (rows) rows->close();
+  rows = NULL;
 
   DBUG_RETURN(0);
 }
@@ -809,44 +1557,275 @@ end:
 
 int ha_mysqlite::find_current_row(uchar *buf)
 {
+  if (!pipeline && rnd_scan && scan_cache && srv_decode_thread)
+    start_pipeline();
+  if (pipeline) {
+    if (!(decoded_row= pipeline->next())) return HA_ERR_END_OF_FILE;
+    return store_decoded_row(decoded_row, buf);
+  }
+
   if (!rows->next()) return HA_ERR_END_OF_FILE;
+  return store_row(rows, buf);
+}
 
-  /* Avoid asserts in ::store() for columns that are not going to be updated */
-  my_bitmap_map *org_bitmap = dbug_tmp_use_all_columns(table, table->write_set);
 
-  memset(buf, 0, table->s->null_bytes);  // TODO: Support NULL column
+/*
+  Let a thread run the table scan and decode the columns in read_set
+  ahead of rnd_next(), which then only stores them (see RowPipeline).
+  Started at the first rnd_next() after HA_EXTRA_CACHE, which tells
+  that the rows are read one after another.
+*/
+void ha_mysqlite::start_pipeline()
+{
+  pipeline_colnos.clear();
+  for (uint colno = 0; colno < row_plan.size(); colno++) {
+    if (row_plan[colno].write != COL_ROWID && bitmap_is_set(table->read_set, colno))
+      pipeline_colnos.push_back(colno);
+  }
+  pipeline= new mysqlite::RowPipeline(rows, pipeline_colnos);
+}
 
-  for (Field **field=table->field ; *field ; field++) {
-    int colno = (*field)->field_index;
-    if (bitmap_is_set(table->read_set, colno)) {
-      switch (rows->get_type(colno)) {
-      case MYSQLITE_INTEGER:
-        (*field)->store(rows->get_int(colno));
-        break;
-      case MYSQLITE_TEXT:
-        {
-          string s = rows->get_text(colno);
-          (*field)->store(s.c_str(), s.size(), &my_charset_utf8_unicode_ci);  // TODO: Japanese support
-        }
-        break;
-      default:
-        abort();
-      }
+void ha_mysqlite::stop_pipeline()
+{
+  delete pipeline;
+  pipeline= NULL;
+  decoded_row= NULL;
+  if (pos_rows) pos_rows->close();
+  pos_rows= NULL;
+}
+
+
+/*
+  Fill buf with a row decoded by the pipeline, as store_row() does.
+*/
+int ha_mysqlite::store_decoded_row(const mysqlite::DecodedRow *row, uchar *buf)
+{
+  my_bitmap_map *org_bitmap = dbug_tmp_use_all_columns(table, table->write_set);
+  my_ptrdiff_t diff= buf - table->record[0];
+  if (diff) move_fields(diff);
+
+  memset(buf, 0, table->s->null_bytes);
+  set_null_bits(buf, row->null_mask.data(), row->n_rec_cols);
+
+  int rowid_colno = sqlite_tbl.rowid_colno;
+  if (rowid_colno >= 0 && bitmap_is_set(table->read_set, rowid_colno))
+    row_plan[rowid_colno].field->store((longlong)row->rowid, false);
+
+  for (size_t i = 0; i < pipeline_colnos.size(); ++i) {
+    const Col_plan &plan = row_plan[pipeline_colnos[i]];
+    const mysqlite::DecodedValue &value = row->values[i];
+    switch (value.type) {
+    case MYSQLITE_NULL:
+      store_null(plan, buf);
+      break;
+    case MYSQLITE_INTEGER:
+      store_int(plan, value.i);
+      break;
+    case MYSQLITE_FLOAT:
+      store_double(plan, value.d);
+      break;
+    case MYSQLITE_TEXT:
+      store_text(plan, value.text.data(), value.text.size(), false);
+      break;
+    case MYSQLITE_BLOB:
+      store_blob(plan, value.text.data(), value.text.size(), false);
+      break;
     }
   }
 
+  if (diff) move_fields(-diff);
   dbug_tmp_restore_column_map(table->write_set, org_bitmap);
   return 0;
 }
 
 
-/**
-  @brief
-  position() is called after each call to rnd_next() if the data needs
-  to be ordered. You can do something like the following to store
-  the position:
-  @code
-  my_store_ptr(ref, ref_length, current_position);
+/*
+  Fill buf with the row cursor points.
+*/
+int ha_mysqlite::store_row(mysqlite::RowCursor *cursor, uchar *buf)
+{
+  /* Avoid asserts in ::store() for columns that are not going to be updated */
+  my_bitmap_map *org_bitmap = dbug_tmp_use_all_columns(table, table->write_set);
+
+  my_ptrdiff_t diff= buf - table->record[0];
+  if (diff) move_fields(diff);
+
+  memset(buf, 0, table->s->null_bytes);
+  size_t n_rec_cols;
+  const u64 *nulls = cursor->get_null_mask(&n_rec_cols);
+  set_null_bits(buf, nulls, n_rec_cols);
+
+  // Values on leaves stay where the whole file is mapped
+  bool in_place= share->conn.get_pcache_strategy() == PCACHE_MMAP;
+
+  for (uint colno = 0; colno < row_plan.size(); colno++) {
+    if (!bitmap_is_set(table->read_set, colno)) continue;
+    const Col_plan &plan = row_plan[colno];
+    if (plan.write == COL_ROWID) {
+      // INTEGER PRIMARY KEY is stored as NULL. Its value is rowid.
+      plan.field->store((longlong)cursor->get_rowid(), false);
+      continue;
+    }
+    if (colno < n_rec_cols ? (nulls[colno / 64] >> (colno % 64)) & 1
+                           : added_col_is_null(colno)) {
+      store_null(plan, buf);
+      continue;
+    }
+
+    mysqlite_type type = cursor->get_type(colno);
+    switch (type) {
+    case MYSQLITE_NULL:
+      break;
+    case MYSQLITE_INTEGER:
+      store_int(plan, cursor->get_int64(colno));
+      break;
+    case MYSQLITE_FLOAT:
+      store_double(plan, cursor->get_double(colno));
+      break;
+    case MYSQLITE_TEXT:
+    case MYSQLITE_BLOB:
+      {
+        u64 len;
+        bool on_page;
+        const char *p = (const char *)cursor->get_blob(colno, &len, &on_page);
+        if (type == MYSQLITE_TEXT)
+          store_text(plan, p, len, in_place && on_page);
+        else
+          store_blob(plan, p, len, in_place && on_page);
+      }
+      break;
+    }
+  }
+
+  if (diff) move_fields(-diff);
+  dbug_tmp_restore_column_map(table->write_set, org_bitmap);
+  return 0;
+}
+
+
+/*
+  SQLite index cursor of the active key. NULL for INTEGER PRIMARY KEY or
+  when no index scan is prepared.
+*/
+mysqlite::IndexCursor *ha_mysqlite::active_index_cursor() const
+{
+  if (!idx_rows || sqlite_idx_of_key[active_index] < 0) return NULL;
+  return static_cast<mysqlite::IndexCursor *>(idx_rows);
+}
+
+/*
+  Store the current row of an index scan. With HA_EXTRA_KEYREAD, rows of
+  a SQLite index are made from its entries.
+*/
+int ha_mysqlite::store_idx_row(uchar *buf)
+{
+  mysqlite::IndexCursor *entries = keyread ? active_index_cursor() : NULL;
+  return entries ? store_index_entry(entries, buf) : store_row(idx_rows, buf);
+}
+
+/*
+  Whether an index condition is pushed to the index being scanned.
+*/
+bool ha_mysqlite::idx_cond_active() const
+{
+  return pushed_idx_cond && pushed_idx_cond_keyno == active_index &&
+    active_index_cursor();
+}
+
+/*
+  Rows are read from index entries without the table (keyread), or after
+  the pushed index condition accepts their entries.
+*/
+void ha_mysqlite::update_entries_only()
+{
+  if (active_index_cursor())
+    active_index_cursor()->set_entries_only(keyread || idx_cond_active());
+}
+
+/*
+  Store the row of the current index entry, if found. The entries the
+  pushed index condition rejects are skipped by step, which moves the
+  cursor in the direction of the read, without reading their table rows.
+
+  @return 0, not_found if no entry is left (or the range ends), or an
+    error.
+*/
+int ha_mysqlite::read_idx_row(uchar *buf, bool found,
+                              bool (mysqlite::KeyCursor::*step)(),
+                              int not_found)
+{
+  if (!idx_cond_active()) return found ? store_idx_row(buf) : not_found;
+
+  mysqlite::IndexCursor *entries= active_index_cursor();
+  for (; found; found= (idx_rows->*step)()) {
+    store_index_entry(entries, buf);
+    switch (handler_index_cond_check(this)) {
+    case ICP_NO_MATCH:
+      break;
+    case ICP_MATCH:
+      if (keyread) return 0;
+      if (!entries->read_row()) return HA_ERR_CRASHED;
+      return store_row(idx_rows, buf);
+    case ICP_OUT_OF_RANGE:
+      return not_found;
+    case ICP_ABORTED_BY_USER:
+      return HA_ERR_ABORTED_BY_USER;
+    }
+  }
+  return not_found;
+}
+
+/*
+  Store the indexed columns of the current index entry, and its rowid to
+  INTEGER PRIMARY KEY. Other columns are left as they are.
+*/
+int ha_mysqlite::store_index_entry(mysqlite::IndexCursor *entries, uchar *buf)
+{
+  my_bitmap_map *org_bitmap = dbug_tmp_use_all_columns(table, table->write_set);
+  my_ptrdiff_t diff= buf - table->record[0];
+  if (diff) move_fields(diff);
+
+  memset(buf, 0, table->s->null_bytes);
+
+  const IndexDef &idx = sqlite_tbl.indexes[sqlite_idx_of_key[active_index]];
+  const vector<mysqlite::KeyValue> &values = entries->get_entry_values();
+  for (size_t j = 0; j < values.size(); ++j) {
+    const Col_plan &plan = row_plan[idx.cols[j].colno];
+    const mysqlite::KeyValue &v = values[j];
+    switch (v.type) {
+    case MYSQLITE_NULL:
+      store_null(plan, buf);
+      break;
+    case MYSQLITE_INTEGER:
+      store_int(plan, v.i);
+      break;
+    case MYSQLITE_FLOAT:
+      store_double(plan, v.d);
+      break;
+    case MYSQLITE_TEXT:
+      store_text(plan, (const char *)v.p, v.len, false);
+      break;
+    case MYSQLITE_BLOB:
+      store_blob(plan, (const char *)v.p, v.len, false);
+      break;
+    }
+  }
+  if (sqlite_tbl.rowid_colno >= 0)
+    table->field[sqlite_tbl.rowid_colno]->store((longlong)entries->get_rowid(), false);
+
+  if (diff) move_fields(-diff);
+  dbug_tmp_restore_column_map(table->write_set, org_bitmap);
+  return 0;
+}
+
+
+/**
+  @brief
+  position() is called after each call to rnd_next() if the data needs
+  to be ordered. You can do something like the following to store
+  the position:
+  @code
+  my_store_ptr(ref, ref_length, current_position);
   @endcode
 
   @details
@@ -856,6 +1835,9 @@ int ha_mysqlite::find_current_row(uchar *buf)
   current_position should be the offset. If it is a primary key like in
   BDB, then it needs to be a primary key.
 
+  MySQLite stores the 64-bit rowid of the row, which stays valid until the
+  SQLite table is modified.
+
   Called from filesort.cc, sql_select.cc, sql_delete.cc, and sql_update.cc.
 
   @see
@@ -864,6 +1846,13 @@ int ha_mysqlite::find_current_row(uchar *buf)
 void ha_mysqlite::position(const uchar *record)
 {
   DBUG_ENTER("ha_mysqlite::position");
+  if (inited != INDEX && decoded_row) {
+    // rows is ahead of the row rnd_next() returned
+    int8store(ref, decoded_row->rowid);
+    DBUG_VOID_RETURN;
+  }
+  mysqlite::RowCursor *cursor = (inited == INDEX) ? idx_rows : rows;
+  int8store(ref, cursor->get_rowid());
   DBUG_VOID_RETURN;
 }
 
@@ -883,13 +1872,29 @@ void ha_mysqlite::position(const uchar *record)
 */
 int ha_mysqlite::rnd_pos(uchar *buf, uchar *pos)
 {
-  log_msg("enter rnd_pos\n");
+  trace_event(mysqlite::TRACE_DEBUG, mysqlite::TRACE_EV_RND_POS, 0, 0);
 
   int rc;
   DBUG_ENTER("ha_mysqlite::rnd_pos");
   MYSQL_READ_ROW_START(table_share->db.str, table_share->table_name.str,
                        TRUE);
-  rc= HA_ERR_WRONG_COMMAND;
+  ha_statistic_increment(&SSV::ha_read_rnd_count);
+
+  // rows belongs to the decode thread while it runs
+  mysqlite::RowCursor *cursor= rows;
+  if (pipeline) {
+    if (!pos_rows) {
+      pos_rows= share->conn.table_fullscan(table_share->table_name.str);
+      pos_rows->set_columns(&sqlite_tbl.cols);
+    }
+    cursor= pos_rows;
+  }
+
+  // Descend the table B-tree to the rowid stored by position()
+  if (cursor->seek_rowid(uint8korr(pos)))
+    rc= store_row(cursor, buf);
+  else
+    rc= HA_ERR_KEY_NOT_FOUND;
   MYSQL_READ_ROW_DONE(rc);
   DBUG_RETURN(rc);
 }
@@ -940,6 +1945,311 @@ int ha_mysqlite::info(uint flag)
 }
 
 
+/**
+  @brief
+  Exact number of rows for COUNT(*) without WHERE (HA_HAS_RECORDS).
+
+  @details
+  Numbers of cells of the table leaves are summed up. Records are not
+  decoded, unlike counting rows returned by rnd_next().
+
+  Called from opt_sum.cc while the table is locked.
+*/
+ha_rows ha_mysqlite::records()
+{
+  DBUG_ENTER("ha_mysqlite::records");
+  // Called by opt_sum_query() before any scan is initialized
+  refresh_sqlite_schema();
+  if (!sqlite_tbl.root_pgno) DBUG_RETURN(HA_POS_ERROR);
+  DBUG_RETURN(share->conn.count_rows(sqlite_tbl));
+}
+
+
+/**
+  @brief
+  Push an index condition down to scans of keyno.
+
+  @details
+  idx_cond refers only to columns of the key. Index reads store each
+  entry into the record buffer and evaluate idx_cond there (see
+  read_idx_row()). The table B-tree is read only for the entries it
+  accepts, so rejected entries cost no random table page read.
+*/
+Item *ha_mysqlite::idx_cond_push(uint keyno, Item *idx_cond)
+{
+  DBUG_ENTER("ha_mysqlite::idx_cond_push");
+
+  if (keyno >= sqlite_idx_of_key.size() || sqlite_idx_of_key[keyno] < 0)
+    DBUG_RETURN(idx_cond);  // INTEGER PRIMARY KEY has no index entries
+
+  pushed_idx_cond_keyno= keyno;
+  pushed_idx_cond= idx_cond;
+  in_range_check_pushed_down= TRUE;
+  update_entries_only();
+
+  DBUG_RETURN(NULL);
+}
+
+void ha_mysqlite::cancel_pushed_idx_cond()
+{
+  DBUG_ENTER("ha_mysqlite::cancel_pushed_idx_cond");
+
+  handler::cancel_pushed_idx_cond();
+  update_entries_only();
+
+  DBUG_VOID_RETURN;
+}
+
+
+/*
+  Narrow filter down to the record values store_row() reads into field
+  unchanged: integers within the range of the column type, doubles into
+  DOUBLE without fixed decimals, and UTF-8 text fitting the length of
+  utf8 binary collation columns. The others are left to the server.
+
+  @return false if predicates on field are not pushed.
+*/
+static bool set_judged_values(Field *field, mysqlite::ColumnFilter *filter)
+{
+  filter->judge_null= field->maybe_null();
+  switch (field->real_type()) {
+  case MYSQL_TYPE_TINY:
+  case MYSQL_TYPE_SHORT:
+  case MYSQL_TYPE_INT24:
+  case MYSQL_TYPE_LONG:
+  case MYSQL_TYPE_LONGLONG:
+    {
+      uint bits= 8 * field->pack_length();
+      filter->judge_float= filter->judge_text= false;
+      if (field->flags & UNSIGNED_FLAG) {
+        filter->min_int= 0;
+        filter->max_int= bits < 64 ? (1LL << bits) - 1 : LLONG_MAX;
+      } else if (bits < 64) {
+        filter->min_int= -(1LL << (bits - 1));
+        filter->max_int= (1LL << (bits - 1)) - 1;
+      }
+    }
+    return true;
+  case MYSQL_TYPE_DOUBLE:
+    if (field->decimals() != NOT_FIXED_DEC) return false;  // Rounded
+    if (field->flags & UNSIGNED_FLAG) return false;  // Negatives clamped to 0
+    filter->judge_text= false;
+    filter->min_int= -(1LL << 53);  // Exact in double
+    filter->max_int= 1LL << 53;
+    return true;
+  case MYSQL_TYPE_VARCHAR:
+  case MYSQL_TYPE_STRING:
+  case MYSQL_TYPE_BLOB:
+    if (!my_charset_same(field->charset(), &my_charset_utf8_bin) ||
+        !(field->charset()->state & MY_CS_BINSORT))
+      return false;
+    filter->judge_int= filter->judge_float= false;
+    filter->max_chars= field->char_length();
+    filter->max_char_len= field->charset()->mbmaxlen;
+    filter->pad_space= true;
+    return true;
+  default:
+    return false;
+  }
+}
+
+/*
+  Constant operand of a pushed predicate on field. Only constants the
+  server compares with field as RowFilter does are accepted: numbers
+  with numeric columns and strings with text columns. DECIMAL constants
+  are compared exactly by the server, not as double.
+
+  @return false if item cannot be pushed.
+*/
+static bool const_filter_value(Field *field, Item *item,
+                               /* out */
+                               mysqlite::KeyValue *value,
+                               string *buf)
+{
+  if (!item->basic_const_item() || item->is_null()) return false;
+
+  if (field->result_type() == STRING_RESULT) {
+    if (item->result_type() != STRING_RESULT) return false;
+    String tmp, utf8, *val= item->val_str(&tmp);
+    uint errors;
+    if (!val) return false;
+    utf8.copy(val->ptr(), val->length(), val->charset(), &my_charset_utf8_bin, &errors);
+    if (errors) return false;
+    buf->assign(utf8.ptr(), utf8.length());
+    *value= mysqlite::KeyValue::of_text(buf->data(), buf->size());
+    return true;
+  }
+
+  switch (item->result_type()) {
+  case INT_RESULT:
+    if (item->unsigned_flag && item->val_int() < 0) return false;  // > LLONG_MAX
+    *value= mysqlite::KeyValue::of_int(item->val_int());
+    return true;
+  case REAL_RESULT:
+    *value= mysqlite::KeyValue::of_double(item->val_real());
+    return true;
+  default:
+    return false;
+  }
+}
+
+/*
+  Cut the LIKE pattern in filter->values[0] down to its literal prefix.
+
+  @return false if the pattern starts with a wildcard.
+*/
+static bool like_prefix(Item_func_like *like, mysqlite::ColumnFilter *filter)
+{
+  mysqlite::KeyValue &pattern= filter->values[0];
+  u64 len= 0;
+  for (; len < pattern.len; ++len) {
+    int c= pattern.p[len];
+    if (c == '%' || c == '_' || c == like->escape || c >= 0x80)
+      break;  // Non-ASCII escape characters are not looked for
+  }
+  pattern.len= len;
+  return len > 0;
+}
+
+/*
+  Add the predicates of cond RowFilter can check to cond_filter:
+  "column op constant" (=, <>, <, <=, >, >=), "column IN (constants)",
+  "column IS [NOT] NULL" and "column LIKE 'prefix...'" joined by AND.
+  Other parts of cond are skipped.
+*/
+void ha_mysqlite::push_cond(const COND *cond)
+{
+  Item *item= const_cast<COND *>(cond);
+
+  if (item->type() == Item::COND_ITEM) {
+    Item_cond *and_cond= static_cast<Item_cond *>(item);
+    if (and_cond->functype() != Item_func::COND_AND_FUNC) return;
+    List_iterator<Item> li(*and_cond->argument_list());
+    while ((item= li++)) push_cond(item);
+    return;
+  }
+  if (item->type() != Item::FUNC_ITEM) return;
+
+  Item_func *func= static_cast<Item_func *>(item);
+  Item **args= func->arguments();
+  uint field_arg= 0;
+  mysqlite::filter_op op;
+  switch (func->functype()) {
+  case Item_func::EQ_FUNC:    op= mysqlite::FILTER_EQ; break;
+  case Item_func::NE_FUNC:    op= mysqlite::FILTER_NE; break;
+  case Item_func::LT_FUNC:    op= mysqlite::FILTER_LT; break;
+  case Item_func::LE_FUNC:    op= mysqlite::FILTER_LE; break;
+  case Item_func::GT_FUNC:    op= mysqlite::FILTER_GT; break;
+  case Item_func::GE_FUNC:    op= mysqlite::FILTER_GE; break;
+  case Item_func::ISNULL_FUNC:    op= mysqlite::FILTER_IS_NULL; break;
+  case Item_func::ISNOTNULL_FUNC: op= mysqlite::FILTER_IS_NOT_NULL; break;
+  case Item_func::LIKE_FUNC:  op= mysqlite::FILTER_PREFIX; break;
+  case Item_func::IN_FUNC:
+    if (static_cast<Item_func_in *>(func)->negated) return;
+    op= mysqlite::FILTER_IN;
+    break;
+  default:
+    return;
+  }
+
+  // "constant op column"
+  if (op <= mysqlite::FILTER_GE && func->argument_count() == 2 &&
+      args[0]->basic_const_item()) {
+    static const mysqlite::filter_op swapped[]= {
+      mysqlite::FILTER_EQ, mysqlite::FILTER_NE,
+      mysqlite::FILTER_GT, mysqlite::FILTER_GE,
+      mysqlite::FILTER_LT, mysqlite::FILTER_LE,
+    };
+    field_arg= 1;
+    op= swapped[op];
+  }
+
+  Item *field_item= args[field_arg]->real_item();
+  if (field_item->type() != Item::FIELD_ITEM) return;
+  Field *field= static_cast<Item_field *>(field_item)->field;
+  if (field->table != table || (int)field->field_index == sqlite_tbl.rowid_colno)
+    return;  // INTEGER PRIMARY KEY is not in records
+
+  mysqlite::ColumnFilter filter(field->field_index, op);
+  if (op == mysqlite::FILTER_IS_NULL || op == mysqlite::FILTER_IS_NOT_NULL) {
+    filter.judge_null= field->maybe_null();
+    cond_filter.add(filter);
+    return;
+  }
+  if (op == mysqlite::FILTER_PREFIX && field->result_type() != STRING_RESULT) return;
+  if (!set_judged_values(field, &filter)) return;
+  // RowFilter compares strings as the utf8_bin column does, not as a
+  // predicate of another collation (COLLATE, _binary) would
+  if (field->result_type() == STRING_RESULT &&
+      func->compare_collation() != field->charset())
+    return;
+
+  vector<string> bufs(func->argument_count());
+  for (uint i= 0; i < func->argument_count(); ++i) {
+    mysqlite::KeyValue value;
+    if (i == field_arg) continue;
+    if (!const_filter_value(field, args[i], &value, &bufs[i])) return;
+    filter.values.push_back(value);
+  }
+  if (op == mysqlite::FILTER_PREFIX &&
+      !like_prefix(static_cast<Item_func_like *>(func), &filter))
+    return;
+  cond_filter.add(filter);  // Copies bufs
+}
+
+
+/**
+  @brief
+  Push a condition of WHERE down to table scans.
+
+  @details
+  The pushable predicates of cond (see push_cond()) are checked on SQLite
+  records by FullscanCursor::next(), so that rows they reject are skipped
+  before store_row() converts their columns.
+
+  A filter never rejects rows of values it is not sure about, but may
+  let rows through that fail the predicates. The whole cond is returned
+  for the server to evaluate on the rows left.
+*/
+const COND *ha_mysqlite::cond_push(const COND *cond)
+{
+  DBUG_ENTER("ha_mysqlite::cond_push");
+
+  cond_filter.clear();
+  push_cond(cond);
+  if (rows) rows->set_filter(cond_filter.empty() ? NULL : &cond_filter);
+
+  DBUG_RETURN(cond);
+}
+
+void ha_mysqlite::cond_pop()
+{
+  DBUG_ENTER("ha_mysqlite::cond_pop");
+
+  cond_filter.clear();
+  if (rows) rows->set_filter(NULL);
+
+  DBUG_VOID_RETURN;
+}
+
+
+/**
+  @brief
+  Called at the end of each statement. Pushed conditions are not kept
+  for the next statement.
+*/
+int ha_mysqlite::reset()
+{
+  DBUG_ENTER("ha_mysqlite::reset");
+
+  cond_filter.clear();
+  if (rows) rows->set_filter(NULL);
+  scan_cache= false;
+
+  DBUG_RETURN(0);
+}
+
+
 /**
   @brief
   extra() is called whenever the server wishes to send a hint to
@@ -952,6 +2262,24 @@ int ha_mysqlite::info(uint flag)
 int ha_mysqlite::extra(enum ha_extra_function operation)
 {
   DBUG_ENTER("ha_mysqlite::extra");
+
+  switch (operation) {
+  case HA_EXTRA_KEYREAD:
+  case HA_EXTRA_NO_KEYREAD:
+    // Index-only scan: the table B-tree is not read
+    keyread= operation == HA_EXTRA_KEYREAD;
+    update_entries_only();
+    break;
+  case HA_EXTRA_CACHE:
+  case HA_EXTRA_NO_CACHE:
+    // A running decode thread is kept until rnd_end(): rows it has
+    // decoded are not read again by the cursor.
+    scan_cache= operation == HA_EXTRA_CACHE;
+    break;
+  default:
+    break;
+  }
+
   DBUG_RETURN(0);
 }
 
@@ -1041,16 +2369,59 @@ int ha_mysqlite::external_lock(THD *thd, int lock_type)
   }
   if (!share->conn.is_opened()) return 0;
 
+  if (share->conn.is_immutable()) {
+    // Nobody changes the DB file. Reads need no lock (nor lock statistics).
+    if (lock_type == F_WRLCK) res = HA_ERR_TABLE_READONLY;
+    DBUG_RETURN(res);
+  }
+
+  mysqlite::LockStats *stats = &lock_stats->stats;
   if (lock_type == F_RDLCK) {
-    log_msg("ha_mysqlite::external_lock: Thread#%lu acquires read lock\n", pthread_self());
-    res = share->conn.rdlock_db();
+    u64 start_usec = mysqlite_now_usec();
+#ifdef HAVE_PSI_RWLOCK_INTERFACE
+    PSI_rwlock_locker_state psi_state;
+    PSI_rwlock_locker *psi_locker = lock_stats->psi ?
+      PSI_server->start_rwlock_rdwait(&psi_state, lock_stats->psi,
+                                      PSI_RWLOCK_READLOCK, __FILE__, __LINE__) :
+      NULL;
+#endif
+    errstat ret = share->conn.rdlock_db(srv_lock_wait_timeout * 1000000);
+#ifdef HAVE_PSI_RWLOCK_INTERFACE
+    if (psi_locker)
+      PSI_server->end_rwlock_rdwait(psi_locker, ret != MYSQLITE_OK);
+#endif
+    u64 now_usec = mysqlite_now_usec();
+    stats->wait.add(now_usec - start_usec);
+    if (ret == MYSQLITE_LOCK_TIMEOUT) {
+      stats->n_timeouts.fetch_add(1, std::memory_order_relaxed);
+      res = HA_ERR_LOCK_WAIT_TIMEOUT;
+    } else if (ret != MYSQLITE_OK) {
+      log_errstat(ret);
+      res = HA_ERR_INTERNAL_ERROR;
+    } else {
+      lock_acquired_usec = now_usec;
+    }
+    trace_event(mysqlite::TRACE_DEBUG, mysqlite::TRACE_EV_LOCK_RD,
+                now_usec - start_usec, ret);
   }
   else if (lock_type == F_UNLCK) {
-    log_msg("ha_mysqlite::external_lock: Thread#%lu releases its lock\n", pthread_self());
-    res = share->conn.unlock_db();
+    share->conn.unlock_db();
+    if (lock_acquired_usec) {
+      u64 hold_usec = mysqlite_now_usec() - lock_acquired_usec;
+      stats->hold.add(hold_usec);
+      lock_acquired_usec = 0;
+      trace_event(mysqlite::TRACE_DEBUG, mysqlite::TRACE_EV_UNLOCK, hold_usec, 0);
+#ifdef HAVE_PSI_RWLOCK_INTERFACE
+      if (lock_stats->psi) PSI_server->unlock_rwlock(lock_stats->psi);
+#endif
+    }
+  }
+  else if (lock_type == F_WRLCK && share->conn.is_read_only()) {
+    res = HA_ERR_TABLE_READONLY;
   }
   else if (lock_type == F_WRLCK) {
-    // TODO: update support
+    // Writes are not supported yet, so the read lock is not upgraded
+    trace_event(mysqlite::TRACE_DEBUG, mysqlite::TRACE_EV_LOCK_WR, 0, 0);
   }
 
   DBUG_RETURN(res);
@@ -1170,7 +2541,192 @@ ha_rows ha_mysqlite::records_in_range(uint inx, key_range *min_key,
                                      key_range *max_key)
 {
   DBUG_ENTER("ha_mysqlite::records_in_range");
-  DBUG_RETURN(10);                         // low number to force index usage
+  if (sqlite_idx_of_key[inx] != SQLITE_ROWID)
+    DBUG_RETURN(10);                       // low number to force index usage
+
+  // Inclusive rowid range
+  s64 min_rowid = LONGLONG_MIN, max_rowid = LONGLONG_MAX;
+  vector<mysqlite::KeyValue> sqlite_key;
+  vector<string> bufs;
+  if (min_key) {
+    make_sqlite_key(inx, min_key->key, min_key->keypart_map, sqlite_key, bufs);
+    if (sqlite_key[0].type != MYSQLITE_INTEGER) DBUG_RETURN(10);
+    min_rowid = sqlite_key[0].i;
+    if (min_key->flag == HA_READ_AFTER_KEY) {
+      if (min_rowid == LONGLONG_MAX) DBUG_RETURN(0);
+      ++min_rowid;
+    }
+  }
+  if (max_key) {
+    make_sqlite_key(inx, max_key->key, max_key->keypart_map, sqlite_key, bufs);
+    if (sqlite_key[0].type != MYSQLITE_INTEGER) DBUG_RETURN(10);
+    max_rowid = sqlite_key[0].i;
+    if (max_key->flag == HA_READ_BEFORE_KEY) {
+      if (max_rowid == LONGLONG_MIN) DBUG_RETURN(0);
+      --max_rowid;
+    }
+  }
+
+  DBUG_RETURN(share->conn.estimate_rowid_range(sqlite_tbl, min_rowid, max_rowid));
+}
+
+
+/**
+  @brief
+  Offers the batched MRR for equality lookups on a SQLite index or rowid
+  (Batched Key Access), unless rows must be returned in key order or
+  mysqlite_mrr_batch_rows is 0.
+*/
+ha_rows ha_mysqlite::multi_range_read_info(uint keyno, uint n_ranges, uint keys,
+                                           uint key_parts, uint *bufsz,
+                                           uint *flags, Cost_estimate *cost)
+{
+  ha_rows res= handler::multi_range_read_info(keyno, n_ranges, keys, key_parts,
+                                              bufsz, flags, cost);
+  if (srv_mrr_batch_rows > 0 && !(*flags & (HA_MRR_SORTED | HA_MRR_INDEX_ONLY)) &&
+      keyno < sqlite_idx_of_key.size() && sqlite_idx_of_key[keyno] != NO_SQLITE_INDEX)
+    *flags&= ~HA_MRR_USE_DEFAULT_IMPL;
+  return res;
+}
+
+
+/**
+  @brief
+  Starts reading rows of ranges given by seq.
+
+  @details
+  Unless mode has HA_MRR_USE_DEFAULT_IMPL, every range is an equality
+  lookup of its start_key. Rowids of matching rows are collected into a
+  batch of mysqlite_mrr_batch_rows rows, sorted and read in that order:
+  leaves of the batch are prefetched at once, and rows in the same leaf
+  are read one after another without descending the table B-tree again.
+  Rows are not returned in key order.
+*/
+int ha_mysqlite::multi_range_read_init(RANGE_SEQ_IF *seq, void *seq_init_param,
+                                       uint n_ranges, uint mode,
+                                       HANDLER_BUFFER *buf)
+{
+  DBUG_ENTER("ha_mysqlite::multi_range_read_init");
+
+  mrr_batched= !(mode & HA_MRR_USE_DEFAULT_IMPL);
+  if (!mrr_batched)
+    DBUG_RETURN(handler::multi_range_read_init(seq, seq_init_param, n_ranges,
+                                               mode, buf));
+
+  mrr_funcs= *seq;
+  mrr_iter= mrr_funcs.init(seq_init_param, n_ranges, mode);
+  mrr_ranges_done= false;
+  mrr_batch.clear();
+  mrr_batch_pos= 0;
+  DBUG_RETURN(0);
+}
+
+
+int ha_mysqlite::multi_range_read_next(range_id_t *range_info)
+{
+  int rc;
+  DBUG_ENTER("ha_mysqlite::multi_range_read_next");
+
+  if (!mrr_batched)
+    DBUG_RETURN(handler::multi_range_read_next(range_info));
+
+  for (;;) {
+    if (mrr_batch_pos == mrr_batch.size()) {
+      if (mrr_ranges_done) DBUG_RETURN(HA_ERR_END_OF_FILE);
+      fill_mrr_batch();
+      if (mrr_batch.empty()) DBUG_RETURN(HA_ERR_END_OF_FILE);
+    }
+
+    const pair<Rowid, range_id_t> &entry= mrr_batch[mrr_batch_pos++];
+    if (mrr_funcs.skip_record) {
+      uchar rowid[sizeof(Rowid)];
+      int8store(rowid, entry.first);
+      if (mrr_funcs.skip_record(mrr_iter, entry.second, rowid)) continue;
+    }
+    // Rowids looked up by INTEGER PRIMARY KEY may not exist. An index
+    // cursor keeps the rowid for store_row() and position().
+    mysqlite::IndexCursor *entries= active_index_cursor();
+    if (!(entries ? entries->read_row(entry.first)
+                  : idx_rows->seek_rowid(entry.first)))
+      continue;
+
+    *range_info= entry.second;
+    rc= store_row(idx_rows, table->record[0]);
+    DBUG_RETURN(rc);
+  }
+}
+
+
+int ha_mysqlite::multi_range_read_explain_info(uint mrr_mode, char *str,
+                                               size_t size)
+{
+  if (mrr_mode & HA_MRR_USE_DEFAULT_IMPL) return 0;
+
+  const char *msg= "Rowid-ordered scan";
+  size_t len= min(strlen(msg), size);
+  memcpy(str, msg, len);
+  return len;
+}
+
+
+/*
+  Order of rows in the table B-tree. Rowids are signed.
+*/
+static bool rowid_less(const pair<Rowid, range_id_t> &a,
+                       const pair<Rowid, range_id_t> &b)
+{
+  return (s64)a.first < (s64)b.first;
+}
+
+/*
+  Read the next batch of rowids from the remaining ranges.
+
+  For an index, the cursor walks entries equal to each key without
+  reading table rows. Rowids of INTEGER PRIMARY KEY are the keys
+  themselves and are checked when their rows are read.
+*/
+void ha_mysqlite::fill_mrr_batch()
+{
+  KEY_MULTI_RANGE range;
+  vector<mysqlite::KeyValue> sqlite_key;
+  vector<string> bufs;
+  bool by_rowid= sqlite_idx_of_key[active_index] == SQLITE_ROWID;
+  mysqlite::IndexCursor *entries= by_rowid ? NULL :
+    static_cast<mysqlite::IndexCursor *>(idx_rows);
+
+  mrr_batch.clear();
+  mrr_batch_pos= 0;
+  if (entries) entries->set_entries_only(true);
+
+  while (mrr_batch.size() < srv_mrr_batch_rows) {
+    if (mrr_funcs.next(mrr_iter, &range)) {
+      mrr_ranges_done= true;
+      break;
+    }
+    make_sqlite_key(active_index, range.start_key.key, range.start_key.keypart_map,
+                    sqlite_key, bufs);
+    if (by_rowid) {
+      if (sqlite_key[0].type == MYSQLITE_INTEGER)
+        mrr_batch.push_back(make_pair((Rowid)sqlite_key[0].i, range.ptr));
+      continue;
+    }
+    for (bool found= entries->seek(sqlite_key, mysqlite::SEEK_EQ); found;
+         found= entries->next_same()) {
+      if (idx_cond_active()) {
+        // Rows of rejected entries are not batched
+        store_index_entry(entries, table->record[0]);
+        if (handler_index_cond_check(this) != ICP_MATCH) continue;
+      }
+      mrr_batch.push_back(make_pair(entries->get_rowid(), range.ptr));
+    }
+  }
+
+  update_entries_only();
+
+  sort(mrr_batch.begin(), mrr_batch.end(), rowid_less);
+  vector<Rowid> rowids(mrr_batch.size());
+  for (size_t i= 0; i < mrr_batch.size(); ++i) rowids[i]= mrr_batch[i].first;
+  share->conn.prefetch_rowids(sqlite_tbl, rowids);
 }
 
 
@@ -1244,32 +2800,235 @@ static MYSQL_SYSVAR_ULONG(
   1000,
   0);
 
+static MYSQL_SYSVAR_ULONG(
+  lock_wait_timeout,
+  srv_lock_wait_timeout,
+  PLUGIN_VAR_RQCMDARG,
+  "Timeout in seconds to wait for a lock on SQLite DB file held by "
+  "other processes. 0 means waiting forever.",
+  NULL,
+  NULL,
+  0,
+  0,
+  365 * 24 * 3600,
+  0);
+
+static MYSQL_SYSVAR_ULONG(
+  mrr_batch_rows,
+  srv_mrr_batch_rows,
+  PLUGIN_VAR_RQCMDARG,
+  "Number of rows whose rowids are sorted at a time by Multi-Range Read "
+  "(Batched Key Access joins). 0 disables it.",
+  NULL,
+  NULL,
+  1024,
+  0,
+  1024 * 1024,
+  0);
+
+static MYSQL_SYSVAR_ULONG(
+  parallel_scan_threads,
+  srv_parallel_scan_threads,
+  PLUGIN_VAR_RQCMDARG,
+  "Number of threads reading a table in parallel for a full table scan. "
+  "Rows are then returned in no particular order. 0 or 1 disables it.",
+  NULL,
+  NULL,
+  0,
+  0,
+  64,
+  0);
+
+static MYSQL_SYSVAR_BOOL(
+  leaf_order_scan,
+  srv_leaf_order_scan,
+  PLUGIN_VAR_OPCMDARG,
+  "Read table leaves in page number order for a full table scan, "
+  "so that the file is read sequentially even if leaves are not in rowid "
+  "order. Rows are then returned in no particular order.",
+  NULL,
+  NULL,
+  TRUE);
+
+static MYSQL_SYSVAR_BOOL(
+  shared_scan,
+  srv_shared_scan,
+  PLUGIN_VAR_OPCMDARG,
+  "Let a full table scan start where another scan of the table is, and "
+  "wrap around to the leaves it missed, so that concurrent scans share "
+  "page reads. Rows are then returned in no particular order.",
+  NULL,
+  NULL,
+  FALSE);
+
+static MYSQL_SYSVAR_BOOL(
+  decode_thread,
+  srv_decode_thread,
+  PLUGIN_VAR_OPCMDARG,
+  "Let a thread run table scans the server reads with a record cache "
+  "(HA_EXTRA_CACHE) and decode rows ahead of it, on another core.",
+  NULL,
+  NULL,
+  FALSE);
+
+const char *trace_level_names[]=
+{
+  "OFF", "ERROR", "WARN", "INFO", "DEBUG", NullS
+};
+
+TYPELIB trace_level_typelib=
+{
+  array_elements(trace_level_names) - 1, "trace_level_typelib",
+  trace_level_names, NULL
+};
+
+static void update_trace_level(MYSQL_THD thd, struct st_mysql_sys_var *var,
+                               void *var_ptr, const void *save)
+{
+  srv_trace_level= *(const ulong *)save;
+  mysqlite::set_trace_level((mysqlite::trace_level)srv_trace_level);
+}
+
+static MYSQL_SYSVAR_ENUM(
+  trace_level,
+  srv_trace_level,
+  PLUGIN_VAR_RQCMDARG,
+  "Severity threshold of events recorded to the in-memory trace buffer "
+  "(and of messages written to the error log). "
+  "One of OFF, ERROR, WARN, INFO and DEBUG.",
+  NULL,
+  update_trace_level,
+  mysqlite::TRACE_ERROR,
+  &trace_level_typelib);
+
+static my_bool srv_trace_dump= FALSE;
+
+/*
+  SET GLOBAL mysqlite_trace_dump=ON writes trace buffers to the error log.
+  The variable itself stays OFF.
+*/
+static void update_trace_dump(MYSQL_THD thd, struct st_mysql_sys_var *var,
+                              void *var_ptr, const void *save)
+{
+  if (*(const my_bool *)save) mysqlite::trace_dump(STDERR_FILENO);
+}
+
+static MYSQL_SYSVAR_BOOL(
+  trace_dump,
+  srv_trace_dump,
+  PLUGIN_VAR_OPCMDARG,
+  "Set to ON to dump in-memory trace buffers of all threads to the error log.",
+  NULL,
+  update_trace_dump,
+  FALSE);
+
 static struct st_mysql_sys_var* mysqlite_system_variables[]= {
   MYSQL_SYSVAR(enum_var),
   MYSQL_SYSVAR(ulong_var),
+  MYSQL_SYSVAR(lock_wait_timeout),
+  MYSQL_SYSVAR(mrr_batch_rows),
+  MYSQL_SYSVAR(parallel_scan_threads),
+  MYSQL_SYSVAR(leaf_order_scan),
+  MYSQL_SYSVAR(shared_scan),
+  MYSQL_SYSVAR(decode_thread),
+  MYSQL_SYSVAR(trace_level),
+  MYSQL_SYSVAR(trace_dump),
   NULL
 };
 
 
-bool copy_sqlite_table_formats(/* out */
-                               vector<string> &table_names,
-                               vector<string> &ddls)
+/*
+  Quote an identifier with backticks for MySQL.
+*/
+static string quote_ident(const string &name)
+{
+  string quoted = "`";
+  for (size_t i = 0; i < name.size(); ++i) {
+    if (name[i] == '`') quoted += '`';
+    quoted += name[i];
+  }
+  return quoted + "`";
+}
+
+/*
+  Whether MySQL makes a BLOB/TEXT column of the SQLite column,
+  which can only be indexed by prefix.
+*/
+static bool is_mysql_blob_column(const ColumnDef &col)
 {
-  using namespace mysqlite;
+  if (col.type.empty()) return true;  // Declared as BLOB below
+  string upper = col.type;
+  for (size_t i = 0; i < upper.size(); ++i) upper[i] = toupper(upper[i]);
+  return upper.find("BLOB") != string::npos || upper.find("TEXT") != string::npos;
+}
 
-  Mysqlite_share *share = Mysqlite_share::get_share();
-  my_assert(share->conn.is_opened());
+/*
+  MySQL DDL of a SQLite table.
 
-  RowCursor *rows = share->conn.table_fullscan("sqlite_master");
-  my_assert(rows);
+  Columns keep their declared types (BLOB if omitted) and NOT NULL.
+  INTEGER PRIMARY KEY becomes a BIGINT PRIMARY KEY. Usable SQLite indexes
+  become keys with the same names, so that open() can map them back. BLOB/TEXT key parts are prefixes; such keys are not UNIQUE for
+  MySQL since prefixes of distinct values may be equal.
+
+  Tables are utf8_bin: SQLite stores TEXT in UTF-8 and compares it by bytes
+  (BINARY collation) unless declared otherwise. Keys on columns of other
+  collations or DESC get a comment such as
+  'SQLite collations: NOCASE, BINARY DESC'.
+*/
+static string mysql_ddl_of_sqlite_table(const TableDef &tbl)
+{
+  string ddl = "CREATE TABLE " + quote_ident(tbl.name) + " (";
+
+  for (size_t i = 0; i < tbl.cols.size(); ++i) {
+    const ColumnDef &col = tbl.cols[i];
+    if (i > 0) ddl += ", ";
+    if ((int)i == tbl.rowid_colno) {
+      ddl += quote_ident(col.name) + " BIGINT NOT NULL";  // 64-bit rowid
+    } else {
+      ddl += quote_ident(col.name) + " " + (col.type.empty() ? "BLOB" : col.type);
+      if (col.not_null) ddl += " NOT NULL";
+    }
+  }
+  if (tbl.rowid_colno >= 0)
+    ddl += ", PRIMARY KEY (" + quote_ident(tbl.cols[tbl.rowid_colno].name) + ")";
+
+  for (size_t i = 0; i < tbl.indexes.size(); ++i) {
+    const IndexDef &idx = tbl.indexes[i];
+    if (!idx.usable || idx.name.size() > NAME_CHAR_LEN) continue;
+
+    uint n_blob_parts = 0;
+    for (size_t j = 0; j < idx.cols.size(); ++j)
+      n_blob_parts += is_mysql_blob_column(tbl.cols[idx.cols[j].colno]);
+    uint prefix_len = n_blob_parts ?
+      MY_MIN(255, MAX_KEY_LENGTH / (4 * n_blob_parts)) : 0;
+
+    ddl += string(", ") + (idx.unique && !n_blob_parts ? "UNIQUE KEY " : "KEY ") +
+      quote_ident(idx.name) + " (";
+    string orders;
+    bool binary_asc = true;
+    for (size_t j = 0; j < idx.cols.size(); ++j) {
+      const ColumnDef &col = tbl.cols[idx.cols[j].colno];
+      if (j > 0) ddl += ", ";
+      ddl += quote_ident(col.name);
+      if (is_mysql_blob_column(col)) {
+        char len[16];
+        my_snprintf(len, sizeof(len), "(%u)", prefix_len);
+        ddl += len;
+      }
 
-  while (rows->next()) {
-    table_names.push_back(rows->get_text(SQLITE_MASTER_COLNO_NAME));
-    ddls.push_back(rows->get_text(SQLITE_MASTER_COLNO_SQL));
+      static const char *coll_names[] = {"BINARY", "NOCASE", "RTRIM"};
+      if (j > 0) orders += ", ";
+      orders += coll_names[idx.cols[j].coll];
+      if (idx.cols[j].desc) orders += " DESC";
+      binary_asc &= idx.cols[j].coll == COLL_BINARY && !idx.cols[j].desc;
+    }
+    ddl += ")";
+    // Read by index_flags() before open(). See discovered_key_part_order().
+    if (!binary_asc)
+      ddl += " COMMENT '" SQLITE_KEY_COMMENT_PREFIX + orders + "'";
   }
 
-  rows->close();
-  return true;
+  return ddl + ") DEFAULT CHARSET=utf8 COLLATE=utf8_bin";
 }
 
 #ifdef MARIADB
@@ -1289,6 +3048,10 @@ static int mysqlite_assisted_discovery(handlerton *hton, THD* thd,
   int b = 0;
   PTOS        topt= table_s->option_struct;
   const char *path=   topt->filename;
+  db_access access=   topt->immutable ? DB_IMMUTABLE :
+                      topt->readonly ? DB_READ_ONLY : DB_READ_WRITE;
+  pcache_strategy strategy= topt->huge ? PCACHE_MMAP_WINDOW :
+                            topt->mapped ? PCACHE_MMAP : PCACHE_PREAD;
   bool is_existing_db = false;
 
   // Open DB and Connection
@@ -1298,7 +3061,7 @@ static int mysqlite_assisted_discovery(handlerton *hton, THD* thd,
     return 1;
   }
   if (share->conn.is_opened()) share->conn.close();  // TODO: 2つ以上create tableするとおかしくなるね
-  errstat res = share->conn.open(path);
+  errstat res = share->conn.open(path, access, strategy);
   if (res == MYSQLITE_DB_FILE_NOT_FOUND) {
     // Newly create SQLite database file
     is_existing_db = false;
@@ -1315,28 +3078,28 @@ static int mysqlite_assisted_discovery(handlerton *hton, THD* thd,
   assert(is_existing_db);  // TODO: support new creation of db files
   if (is_existing_db) {
     PageCache *pcache = PageCache::get_instance();
-    pcache->rd_lock();
+    errstat lock_res = pcache->rd_lock();
+    if (lock_res != MYSQLITE_OK) {
+      log_errstat(lock_res);
+      return HA_ERR_INTERNAL_ERROR;
+    }
 
-    // Duplicate SQLite DDLs to MySQL
-    // TODO: ここで，TABLE_SHARE::table_name に入ってるDDLだけをsqlite_masterから取り出す必要がある
-    vector<string> table_names, ddls;
-    bool res2 = copy_sqlite_table_formats(table_names, ddls);
+    // Translate the SQLite schema of requested table to MySQL
+    TableDef tbl;
+    errstat res2 = share->conn.get_table_def(table_s->table_name.str, &tbl);
     pcache->unlock();
 
-    if (!res2) return HA_ERR_INTERNAL_ERROR;
-
-    // Create requested table
-    string *ddl = NULL;
-    for (unsigned int i = 0; i < table_names.size(); ++i) {
-      if (table_names[i] == table_s->table_name.str) {
-        ddl = &ddls[i];
-      }
+    if (res2 == MYSQLITE_NO_SUCH_TABLE) return HA_ERR_NO_SUCH_TABLE;
+    if (res2 != MYSQLITE_OK) {
+      log_errstat(res2);
+      return HA_ERR_INTERNAL_ERROR;
     }
-    if (!ddl) return HA_ERR_NO_SUCH_TABLE;
+
+    string ddl = mysql_ddl_of_sqlite_table(tbl);
     b = table_s->init_from_sql_statement_string(thd, true,
-                                                (*ddl).c_str(), (*ddl).size());
+                                                ddl.c_str(), ddl.size());
     if (b) {
-      log_msg("Error in creating table: %s\n", (*ddl).c_str());
+      log_msg("Error in creating table: %s\n", ddl.c_str());
       return b;
     }
   }
@@ -1356,9 +3119,36 @@ static int show_func_mysqlite(MYSQL_THD thd, struct st_mysql_show_var *var,
   return 0;
 }
 
+/*
+  Lock statistics of all tables.
+  Each table is shown as a nested array (see Mysqlite_lock_stats).
+*/
+static int show_func_mysqlite_lock(MYSQL_THD thd, struct st_mysql_show_var *var,
+                                   char *buf)
+{
+  struct st_mysql_show_var *tables = (struct st_mysql_show_var *)buf;
+  // buf is of SHOW_VAR_FUNC_BUFF_SIZE bytes. Last element is terminator.
+  ulong max_tables = SHOW_VAR_FUNC_BUFF_SIZE / sizeof(*tables) - 1;
+  ulong n = 0;
+
+  mysql_mutex_lock(&mysqlite_mutex);
+  for (ulong i = 0; i < mysqlite_lock_stats.records && n < max_tables; ++i) {
+    Mysqlite_lock_stats *st =
+      (Mysqlite_lock_stats *)my_hash_element(&mysqlite_lock_stats, i);
+    set_show_var(&tables[n++], st->name, st->status_vars, SHOW_ARRAY);
+  }
+  mysql_mutex_unlock(&mysqlite_mutex);
+  set_show_var(&tables[n], NullS, NullS, SHOW_UNDEF);
+
+  var->type= SHOW_ARRAY;
+  var->value= buf;
+  return 0;
+}
+
 static struct st_mysql_show_var func_status[]=
 {
   {"mysqlite_func_mysqlite",  (char *)show_func_mysqlite, SHOW_FUNC},
+  {"mysqlite_lock",  (char *)show_func_mysqlite_lock, SHOW_FUNC},
   {0,0,SHOW_UNDEF}
 };
 
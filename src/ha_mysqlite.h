@@ -37,13 +37,17 @@
 
 using namespace std;
 #include <string>
+#include <vector>
 #include "sqlite_format.h"
+#include "sqlite_ddl.h"
 #include "mysqlite_api.h"
+#include "lock_stats.h"
 
 #include "handler.h"                     /* handler */
 
 
 typedef struct ha_table_option_struct TOS, *PTOS;
+struct Mysqlite_lock_stats;
 
 /*
   Only for MariaDB
@@ -87,6 +91,64 @@ class ha_mysqlite: public handler
   Mysqlite_share *share;    ///< Shared lock info
 
   mysqlite::RowCursor *rows;  // rows currently fetching
+  mysqlite::KeyCursor *idx_rows;  // rows currently fetching by index
+
+  enum {
+    NO_SQLITE_INDEX = -1,
+    SQLITE_ROWID = -2,   // INTEGER PRIMARY KEY
+  };
+  TableDef sqlite_tbl;          ///< Schema of the SQLite table
+  u32 sqlite_schema_cookie;     ///< Schema cookie sqlite_tbl was read at
+  vector<int> sqlite_idx_of_key;  ///< sqlite_tbl.indexes[] of each MySQL key,
+                                  ///< NO_SQLITE_INDEX or SQLITE_ROWID.
+
+  /* How store_row() writes each column (see build_row_plan()) */
+  enum col_write {
+    COL_STORE= 0,       ///< Field::store()
+    COL_ROWID,          ///< INTEGER PRIMARY KEY: Field::store() of rowid
+    COL_INT,            ///< Integer types: little-endian bytes
+    COL_DOUBLE,         ///< DOUBLE: IEEE 754 bytes
+    COL_VARCHAR,        ///< VARCHAR: length and bytes
+    COL_BLOB,           ///< TEXT and BLOB: length and pointer to the value
+  };
+  struct Col_plan {
+    Field *field;
+    col_write write;
+    uint len_bytes;     ///< COL_INT: bytes of the value. COL_VARCHAR and
+                        ///< COL_BLOB: bytes of the length.
+    longlong min_int, max_int;  ///< COL_INT: range of the type
+    ulonglong max_bytes;  ///< Text: bytes the column holds
+    uint max_chars;     ///< Text: characters the column holds
+    uint max_char_len;  ///< Text: bytes of a UTF-8 character. 0 for binary.
+    uint null_offset;   ///< Of the null byte in a record
+    uchar null_bit;     ///< In the null byte. 0 if NOT NULL.
+  };
+  vector<Col_plan> row_plan;    ///< Of each field_index
+  vector<string> blob_bufs;     ///< Copies of COL_BLOB values of the row
+                                ///< stored last, which fields point to
+
+  Mysqlite_lock_stats *lock_stats;  ///< Lock statistics of this table
+  u64 lock_acquired_usec;           ///< When this handler acquired DB file lock
+
+  /* Batched Multi-Range Read (see multi_range_read_init()) */
+  bool mrr_batched;             ///< false when the default MRR is used
+  bool mrr_ranges_done;         ///< All ranges have been read into batches
+  vector<pair<Rowid, range_id_t> > mrr_batch;  ///< Rowids of a batch and
+                                               ///< their ranges, sorted
+  size_t mrr_batch_pos;         ///< Next entry of mrr_batch to return
+
+  bool keyread;                 ///< HA_EXTRA_KEYREAD: read key columns only
+  mysqlite::RowFilter cond_filter;  ///< Predicates of cond_push() checked
+                                    ///< by table scans
+
+  /* Decode thread of table scans (see start_pipeline()) */
+  bool rnd_scan;                ///< rnd_init(true): rows is a table scan
+  bool scan_cache;              ///< HA_EXTRA_CACHE: rows are read one after
+                                ///< another
+  mysqlite::RowPipeline *pipeline;  ///< Decodes rows ahead of rnd_next()
+  vector<int> pipeline_colnos;  ///< Decoded columns
+  const mysqlite::DecodedRow *decoded_row;  ///< Row of the last rnd_next()
+  mysqlite::RowCursor *pos_rows;  ///< rnd_pos() cursor while pipeline runs
 
 public:
   ha_mysqlite(handlerton *hton, TABLE_SHARE *table_arg);
@@ -103,7 +165,7 @@ public:
     The name of the index type that will be used for display.
     Don't implement this method unless you really have indexes.
    */
-  const char *index_type(uint inx) { return "HASH"; }
+  const char *index_type(uint inx) { return "BTREE"; }
 
   /** @brief
     The file extensions.
@@ -121,7 +183,10 @@ public:
       an engine that can only handle statement-based logging. This is
       used in testing.
     */
-    return HA_BINLOG_STMT_CAPABLE;
+    return HA_BINLOG_STMT_CAPABLE | HA_NULL_IN_KEY | HA_CAN_INDEX_BLOBS |
+      HA_REC_NOT_IN_SEQ | HA_HAS_RECORDS |
+      // Index entries have rowid, not the columns of a promoted UNIQUE key
+      (rowid_primary_key() ? HA_PRIMARY_KEY_IN_READ_INDEX : 0);
   }
 
   /** @brief
@@ -134,10 +199,7 @@ public:
     If all_parts is set, MySQL wants to know the flags for the combined
     index, up to and including 'part'.
   */
-  ulong index_flags(uint inx, uint part, bool all_parts) const
-  {
-    return 0;
-  }
+  ulong index_flags(uint inx, uint part, bool all_parts) const;
 
   /** @brief
     unireg.cc will call max_supported_record_length(), max_supported_keys(),
@@ -157,7 +219,7 @@ public:
     There is no need to implement ..._key_... methods if your engine doesn't
     support indexes.
    */
-  uint max_supported_keys()          const { return 0; }
+  uint max_supported_keys()          const { return MAX_KEY; }
 
   /** @brief
     unireg.cc will call this to make sure that the storage engine can handle
@@ -168,7 +230,7 @@ public:
     There is no need to implement ..._key_... methods if your engine doesn't
     support indexes.
    */
-  uint max_supported_key_parts()     const { return 0; }
+  uint max_supported_key_parts()     const { return MAX_REF_PARTS; }
 
   /** @brief
     unireg.cc will call this to make sure that the storage engine can handle
@@ -179,7 +241,13 @@ public:
     There is no need to implement ..._key_... methods if your engine doesn't
     support indexes.
    */
-  uint max_supported_key_length()    const { return 0; }
+  uint max_supported_key_length()    const { return MAX_KEY_LENGTH; }
+
+  /** @brief
+    SQLite indexes whole column values. Prefix keys of TEXT/BLOB columns
+    are compared only by their leading characters.
+   */
+  uint max_supported_key_part_length() const { return MAX_KEY_LENGTH; }
 
   /** @brief
     Called in test_quick_select to determine if indexes should be used.
@@ -226,6 +294,13 @@ public:
   */
   int delete_row(const uchar *buf);
 
+  /** @brief
+    We implement this in ha_mysqlite.cc. It's not an obligatory method;
+    skip it and and MySQL will treat it as not implemented.
+  */
+  int index_init(uint idx, bool sorted);
+  int index_end();
+
   /** @brief
     We implement this in ha_mysqlite.cc. It's not an obligatory method;
     skip it and and MySQL will treat it as not implemented.
@@ -239,6 +314,12 @@ public:
   */
   int index_next(uchar *buf);
 
+  /** @brief
+    We implement this in ha_mysqlite.cc. It's not an obligatory method;
+    skip it and and MySQL will treat it as not implemented.
+  */
+  int index_next_same(uchar *buf, const uchar *key, uint keylen);
+
   /** @brief
     We implement this in ha_mysqlite.cc. It's not an obligatory method;
     skip it and and MySQL will treat it as not implemented.
@@ -271,12 +352,42 @@ public:
   int rnd_pos(uchar *buf, uchar *pos);                          ///< required
   void position(const uchar *record);                           ///< required
   int info(uint);                                               ///< required
+  ha_rows records();
   int extra(enum ha_extra_function operation);
   int external_lock(THD *thd, int lock_type);                   ///< required
   int delete_all_rows(void);
   int truncate();
   ha_rows records_in_range(uint inx, key_range *min_key,
                            key_range *max_key);
+
+  /** @brief
+    Multi-Range Read. Equality lookups (Batched Key Access joins) are
+    collected into batches of rowids, which are read in rowid order.
+    Other uses fall back to the default implementation of handler.
+  */
+  ha_rows multi_range_read_info(uint keyno, uint n_ranges, uint keys,
+                                uint key_parts, uint *bufsz,
+                                uint *flags, Cost_estimate *cost);
+  int multi_range_read_init(RANGE_SEQ_IF *seq, void *seq_init_param,
+                            uint n_ranges, uint mode, HANDLER_BUFFER *buf);
+  int multi_range_read_next(range_id_t *range_info);
+  int multi_range_read_explain_info(uint mrr_mode, char *str, size_t size);
+
+  /** @brief
+    Engine condition pushdown. Simple predicates on columns are checked on
+    SQLite records during table scans (see cond_push()).
+  */
+  const COND *cond_push(const COND *cond);
+  void cond_pop();
+  int reset();
+
+  /** @brief
+    Index condition pushdown. Index entries are checked before the rows
+    of the table are read.
+  */
+  Item *idx_cond_push(uint keyno, Item *idx_cond);
+  void cancel_pushed_idx_cond();
+
   int delete_table(const char *from);
   int rename_table(const char * from, const char * to);
   int create(const char *name, TABLE *form,
@@ -287,6 +398,48 @@ public:
 
   int find_current_row(/* out */
                        uchar *buf);
+
+private:
+  void load_sqlite_schema();
+  bool rowid_primary_key() const;
+  void refresh_sqlite_schema();
+  void build_row_plan();
+  void move_fields(my_ptrdiff_t diff);
+  bool added_col_is_null(size_t colno) const;
+  void set_null_bits(uchar *buf, const u64 *nulls, size_t n_rec_cols);
+  void store_null(const Col_plan &plan, uchar *buf);
+  void store_int(const Col_plan &plan, longlong v);
+  void store_double(const Col_plan &plan, double v);
+  void store_text(const Col_plan &plan, const char *p, size_t len,
+                  bool in_place);
+  void store_blob(const Col_plan &plan, const char *p, size_t len,
+                  bool in_place);
+  void make_sqlite_key(uint keynr, const uchar *key, key_part_map keypart_map,
+                       /* out */
+                       vector<mysqlite::KeyValue> &sqlite_key,
+                       vector<string> &bufs);
+  int store_row(mysqlite::RowCursor *cursor,
+                /* out */
+                uchar *buf);
+  void start_pipeline();
+  void stop_pipeline();
+  int store_decoded_row(const mysqlite::DecodedRow *row,
+                        /* out */
+                        uchar *buf);
+  void fill_mrr_batch();
+  void push_cond(const COND *cond);
+  mysqlite::IndexCursor *active_index_cursor() const;
+  int store_idx_row(/* out */
+                    uchar *buf);
+  int store_index_entry(mysqlite::IndexCursor *entries,
+                        /* out */
+                        uchar *buf);
+  bool idx_cond_active() const;
+  void update_entries_only();
+  int read_idx_row(/* out */
+                   uchar *buf,
+                   bool found, bool (mysqlite::KeyCursor::*step)(),
+                   int not_found= HA_ERR_END_OF_FILE);
 };
 
 
@@ -0,0 +1,35 @@
+#include "lock_stats.h"
+
+
+namespace mysqlite {
+
+/***********************************************************************
+** LatencyHistogram class
+***********************************************************************/
+LatencyHistogram::LatencyHistogram()
+  : n_samples(0), sum_usec(0)
+{
+  for (int i = 0; i < N_BUCKETS; ++i) buckets[i] = 0;
+}
+
+void LatencyHistogram::add(u64 usec)
+{
+  buckets[bucket_of(usec)].fetch_add(1, std::memory_order_relaxed);
+  n_samples.fetch_add(1, std::memory_order_relaxed);
+  sum_usec.fetch_add(usec, std::memory_order_relaxed);
+}
+
+int LatencyHistogram::bucket_of(u64 usec)
+{
+  // bucket(i) holds [2^(i-1), 2^i), i.e. i == bit width of usec.
+  int i = usec == 0 ? 0 : 64 - __builtin_clzll(usec);
+  return i < N_BUCKETS ? i : N_BUCKETS - 1;
+}
+
+u64 LatencyHistogram::bucket_upper_usec(int i)
+{
+  if (i >= N_BUCKETS - 1) return 0;
+  return 1ULL << i;
+}
+
+}
@@ -0,0 +1,88 @@
+#ifndef _LOCK_STATS_H_
+#define _LOCK_STATS_H_
+
+
+#include <atomic>
+
+#include "mysqlite_types.h"
+
+
+namespace mysqlite {
+
+/*
+** Latency histogram whose buckets are powers of 2 in microseconds.
+**
+** bucket(0): [0us, 1us)
+** bucket(i): [2^(i-1)us, 2^i us)  (0 < i < N_BUCKETS - 1)
+** bucket(N_BUCKETS - 1): [2^(N_BUCKETS-2)us, infinity)
+**
+** Thread safe. add() is a few relaxed atomic increments so that
+** it can be called on every lock/unlock.
+*/
+class LatencyHistogram {
+  public:
+  static const int N_BUCKETS = 24;
+
+private:
+  std::atomic<u64> buckets[N_BUCKETS];
+  std::atomic<u64> n_samples;
+  std::atomic<u64> sum_usec;
+
+  public:
+  LatencyHistogram();
+
+  public:
+  void add(u64 usec);
+
+  public:
+  u64 count() const { return n_samples.load(std::memory_order_relaxed); }
+  u64 total_usec() const { return sum_usec.load(std::memory_order_relaxed); }
+  u64 bucket(int i) const { return buckets[i].load(std::memory_order_relaxed); }
+
+  /*
+  ** Bucket index for a sample of usec.
+  */
+  public:
+  static int bucket_of(u64 usec);
+
+  /*
+  ** Exclusive upper bound of bucket(i) in microseconds.
+  ** 0 for the last bucket (no upper bound).
+  */
+  public:
+  static u64 bucket_upper_usec(int i);
+
+  /*
+  ** Raw counters. Used to expose counters via SHOW STATUS without copying.
+  */
+  public:
+  const std::atomic<u64> *bucket_counter(int i) const { return &buckets[i]; }
+  const std::atomic<u64> *count_counter() const { return &n_samples; }
+  const std::atomic<u64> *total_usec_counter() const { return &sum_usec; }
+
+private:
+  LatencyHistogram(const LatencyHistogram&);
+  LatencyHistogram& operator=(const LatencyHistogram&);
+};
+
+
+/*
+** Statistics of DB file locks taken for a table.
+*/
+struct LockStats {
+  LatencyHistogram wait;        // Time to acquire a lock (fcntl(F_SETLKW) etc.)
+  LatencyHistogram hold;        // Time from acquiring a lock to releasing it
+  std::atomic<u64> n_timeouts;  // Lock requests given up after lock wait timeout
+
+  public:
+  LockStats() : n_timeouts(0) {}
+
+private:
+  LockStats(const LockStats&);
+  LockStats& operator=(const LockStats&);
+};
+
+}
+
+
+#endif /* _LOCK_STATS_H_ */
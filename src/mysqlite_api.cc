@@ -1,16 +1,53 @@
 using namespace std;
 #include <string>
+#include <algorithm>
 #include <fcntl.h>
+#include <math.h>
+#include <stdint.h>
 #include "mysqlite_api.h"
 #include "pcache.h"
 
 
 namespace mysqlite {
 
+/***********************************************************************
+** Static functions
+***********************************************************************/
+/*
+  Index of the child of a table interior page whose subtree can have rowid:
+  the first cell whose rowid >= rowid (left child has rowids <= the cell's),
+  or n_cell for the rightmost child.
+  Rowids are signed although read as u64 from varints.
+*/
+static Pgsz find_child_idx(TableInteriorPage *page, s64 rowid)
+{
+  struct TableInteriorPageCell cell;
+  Pgsz lo = 0, hi = page->get_n_cell();
+  while (lo < hi) {
+    Pgsz mid = lo + (hi - lo) / 2;
+    page->get_ith_cell(mid, &cell);
+    if ((s64)cell.rowid < rowid) lo = mid + 1;
+    else hi = mid;
+  }
+  return lo;
+}
+
+static int compare_bytes(const u8 *a, u64 a_len, const u8 *b, u64 b_len);
+
+static Pgno get_child_pgno(TableInteriorPage *page, Pgsz child_idx)
+{
+  if (child_idx == page->get_n_cell()) return page->get_rightmost_pg();
+  struct TableInteriorPageCell cell;
+  page->get_ith_cell(child_idx, &cell);
+  return cell.left_child_pgno;
+}
+
+
 /***********************************************************************
 ** Connection class
 ***********************************************************************/
-errstat Connection::open(const char * const db_path)
+errstat Connection::open(const char * const db_path, db_access access,
+                         pcache_strategy strategy)
 {
   errstat res;
 
@@ -20,7 +57,7 @@ errstat Connection::open(const char * const db_path)
 
   // Page cache
   PageCache *pcache = PageCache::get_instance();
-  res = pcache->open(db_path);
+  res = pcache->open(db_path, access, strategy);
 
   if (res == MYSQLITE_OK) {
     // succeeded in opening db_path (read-mode or write-mode)
@@ -38,10 +75,41 @@ bool Connection:: is_opened() const
   return pcache->is_opened();
 }
 
+bool Connection::is_read_only() const
+{
+  PageCache *pcache = PageCache::get_instance();
+  return pcache->is_read_only();
+}
+
+bool Connection::is_immutable() const
+{
+  PageCache *pcache = PageCache::get_instance();
+  return pcache->is_immutable();
+}
+
+pcache_strategy Connection::get_pcache_strategy() const
+{
+  PageCache *pcache = PageCache::get_instance();
+  return pcache->get_strategy();
+}
+
+u32 Connection::get_schema_cookie() const
+{
+  return DbHeader::get_schema_cookie();
+}
+
 void Connection::close()
 {
   PageCache *pcache = PageCache::get_instance();
   pcache->close();
+
+  {
+    std::lock_guard<std::mutex> lock(leaves_mutex);
+    leaves_cache.clear();
+  }
+  std::lock_guard<std::mutex> lock(catalog_mutex);
+  catalog.clear();
+  catalog_loaded = false;
 }
 
 RowCursor *Connection::table_fullscan(const char * const table)
@@ -51,21 +119,13 @@ RowCursor *Connection::table_fullscan(const char * const table)
     root_pgno = SQLITE_MASTER_ROOTPGNO;
   }
   else {
-    // Find root pgno of table from sqlite_master.
-    RowCursor *sqlite_master_rows = table_fullscan(SQLITE_MASTER_ROOTPGNO);
-    while (sqlite_master_rows->next()) {
-      string tbl_name =
-        sqlite_master_rows->get_text(SQLITE_MASTER_COLNO_TBL_NAME);
-      if (0 == strcmp(table, tbl_name.c_str())) {
-        root_pgno = sqlite_master_rows->get_int(SQLITE_MASTER_COLNO_ROOTPAGE);
-        break;
-      }
-    }
-    if (root_pgno == 0) {
+    std::lock_guard<std::mutex> lock(catalog_mutex);
+    const CatalogTable *entry = find_catalog_table(table);
+    if (!entry) {
       log_errstat(MYSQLITE_NO_SUCH_TABLE);
       return NULL;
     }
-    sqlite_master_rows->close();
+    root_pgno = entry->root_pgno;
   }
 
   return table_fullscan(root_pgno);
@@ -79,114 +139,465 @@ RowCursor *Connection::table_fullscan(Pgno tbl_root)
   return new FullscanCursor(tbl_root);
 }
 
-int Connection::rdlock_db()
+RowCursor *Connection::table_parallel_scan(const TableDef &tbl, size_t n_workers)
 {
-  PageCache *pcache = PageCache::get_instance();
-  pcache->rd_lock();
-  // log_msg("Connection::rdlock_db(): Thread#%lu locks db file\n",
-  //         pthread_self());
-  return 0;
+  return new ParallelScanCursor(tbl.root_pgno, n_workers);
 }
 
-int Connection::unlock_db()
+RowCursor *Connection::table_leaf_order_scan(const TableDef &tbl)
 {
-  PageCache *pcache = PageCache::get_instance();
-  pcache->unlock();
-  // log_msg("Connection::unlock_db(): Thread#%lu unlocks db file\n",
-  //         pthread_self());
-  return 0;
+  return new LeafOrderCursor(tbl.root_pgno, get_table_leaves(tbl));
 }
 
+RowCursor *Connection::table_shared_scan(const TableDef &tbl)
+{
+  vector<Pgno> leaves;
+  std::shared_ptr<ScanSync> sync;
+  get_table_leaves(tbl, &leaves, &sync);
+  return new LeafOrderCursor(tbl.root_pgno, leaves, sync);
+}
 
-/***********************************************************************
-** RowCursor class
-***********************************************************************/
-RowCursor::RowCursor(Pgno root_pgno)
-  : visit_path(1, BtreePathNode(root_pgno, 0)), cpa_idx(-1)
+/*
+  Leaves under root. Pages of a level are collected from the interior
+  pages of the level above; the leftmost page of each level tells whether
+  the level is of leaves, since all the leaves are at the same depth.
+*/
+static void collect_leaves(Pgno root,
+                           /* out */
+                           vector<Pgno> *leaves)
 {
+  vector<Pgno> level(1, root);
+  for (;;) {
+    BtreePage first_page(level[0]);
+    errstat ret = first_page.fetch();
+    my_assert(ret == MYSQLITE_OK);
+    if (TABLE_INTERIOR != first_page.get_btree_type()) break;
+
+    vector<Pgno> children;
+    for (size_t i = 0; i < level.size(); ++i) {
+      BtreePage page(level[i]);
+      ret = page.fetch();
+      my_assert(ret == MYSQLITE_OK);
+      if (TABLE_INTERIOR != page.get_btree_type()) {
+        log_errstat(MYSQLITE_CORRUPT_DB);
+        continue;
+      }
+      TableInteriorPage *interior_page = static_cast<TableInteriorPage *>(&page);
+      for (Pgsz j = 0; j <= interior_page->get_n_cell(); ++j)
+        children.push_back(get_child_pgno(interior_page, j));
+    }
+    level.swap(children);
+  }
+  leaves->swap(level);
 }
 
-mysqlite_type RowCursor::get_type(int colno) const
+vector<Pgno> Connection::get_table_leaves(const TableDef &tbl)
 {
-  // TODO: Now both get_type and get_(int|text|...) materializes RecordCell.
-  // TODO: So redundunt....
-  // TODO: use cache for record!!
-  TableLeafPage tbl_leaf_page(visit_path.back().pgno);
-  errstat ret = tbl_leaf_page.fetch();
-  my_assert(ret == MYSQLITE_OK);
+  vector<Pgno> leaves;
+  std::shared_ptr<ScanSync> sync;
+  get_table_leaves(tbl, &leaves, &sync);
+  return leaves;
+}
 
-  RecordCell cell;
-  if (!tbl_leaf_page.get_ith_cell(cpa_idx, &cell) &&
-      cell.has_overflow_pg()) {  //オーバフローページのために毎回こんなこと書かなきゃいけないのって割とこわい
-    u8 *payload_data = new u8[cell.payload_sz];
-    bool ret = tbl_leaf_page.get_ith_cell(cpa_idx, &cell, payload_data);
-    my_assert(ret);
+void Connection::get_table_leaves(const TableDef &tbl,
+                                  /* out */
+                                  vector<Pgno> *leaves,
+                                  std::shared_ptr<ScanSync> *sync)
+{
+  u32 fcc = DbHeader::get_file_change_counter();
+  {
+    std::lock_guard<std::mutex> lock(leaves_mutex);
+    map<Pgno, TableLeaves>::const_iterator it = leaves_cache.find(tbl.root_pgno);
+    if (it != leaves_cache.end() && it->second.file_change_counter == fcc) {
+      *leaves = it->second.leaves;
+      *sync = it->second.sync;
+      return;
+    }
   }
 
-  return sqlite_type_to_mysqlite_type(cell.payload.cols_type[colno]);
+  collect_leaves(tbl.root_pgno, leaves);
+  sort(leaves->begin(), leaves->end());
+
+  // Scans of the old leaves keep their own ScanSync
+  std::lock_guard<std::mutex> lock(leaves_mutex);
+  TableLeaves &cached = leaves_cache[tbl.root_pgno];
+  cached.file_change_counter = fcc;
+  cached.leaves = *leaves;
+  cached.sync = std::make_shared<ScanSync>();
+  *sync = cached.sync;
 }
 
-int RowCursor::get_int(int colno) const
+void Connection::load_catalog()
 {
-  // TODO: use cache for record!!
-  TableLeafPage tbl_leaf_page(visit_path.back().pgno);
-  errstat ret = tbl_leaf_page.fetch();
+  catalog.clear();
+  RowCursor *sqlite_master_rows = table_fullscan(SQLITE_MASTER_ROOTPGNO);
+  vector<pair<string, CatalogIndex> > index_rows;
+  while (sqlite_master_rows->next()) {
+    string type = sqlite_master_rows->get_text(SQLITE_MASTER_COLNO_TYPE);
+    string tbl_name = sqlite_master_rows->get_text(SQLITE_MASTER_COLNO_TBL_NAME);
+
+    if (type == "table") {
+      CatalogTable &entry = catalog[tbl_name];
+      entry.root_pgno = sqlite_master_rows->get_int(SQLITE_MASTER_COLNO_ROOTPAGE);
+      entry.sql = sqlite_master_rows->get_text(SQLITE_MASTER_COLNO_SQL);
+      entry.parsed = false;
+    } else if (type == "index") {
+      CatalogIndex idx;
+      idx.name = sqlite_master_rows->get_text(SQLITE_MASTER_COLNO_NAME);
+      idx.root_pgno = sqlite_master_rows->get_int(SQLITE_MASTER_COLNO_ROOTPAGE);
+      idx.sql = sqlite_master_rows->get_text(SQLITE_MASTER_COLNO_SQL);
+      index_rows.push_back(make_pair(tbl_name, idx));
+    }
+  }
+  sqlite_master_rows->close();
+
+  // Indexes may precede their tables in sqlite_master
+  for (size_t i = 0; i < index_rows.size(); ++i) {
+    unordered_map<string, CatalogTable>::iterator it = catalog.find(index_rows[i].first);
+    if (it != catalog.end()) it->second.indexes.push_back(index_rows[i].second);
+  }
+}
+
+Connection::CatalogTable *Connection::find_catalog_table(const char * const table)
+{
+  u32 cookie = DbHeader::get_schema_cookie();
+  if (!catalog_loaded || cookie != catalog_cookie) {
+    load_catalog();
+    catalog_loaded = true;
+    catalog_cookie = cookie;
+  }
+  unordered_map<string, CatalogTable>::iterator it = catalog.find(table);
+  return it == catalog.end() ? NULL : &it->second;
+}
+
+errstat Connection::parse_table_def(const CatalogTable &entry,
+                                    /* out */
+                                    TableDef *tbl)
+{
+  const vector<CatalogIndex> &index_rows = entry.indexes;
+  if (!parse_create_table(entry.sql, tbl)) return MYSQLITE_CORRUPT_DB;
+  tbl->root_pgno = entry.root_pgno;
+
+  for (size_t i = 0; i < index_rows.size(); ++i) {
+    if (index_rows[i].sql.empty()) {
+      // Index of UNIQUE or PRIMARY KEY constraint
+      for (size_t j = 0; j < tbl->indexes.size(); ++j) {
+        if (tbl->indexes[j].name == index_rows[i].name)
+          tbl->indexes[j].root_pgno = index_rows[i].root_pgno;
+      }
+    } else {
+      IndexDef idx;
+      if (!parse_create_index(index_rows[i].sql, *tbl, &idx)) {
+        log_msg("Cannot parse index DDL: %s\n", index_rows[i].sql.c_str());
+        continue;
+      }
+      idx.root_pgno = index_rows[i].root_pgno;
+      tbl->indexes.push_back(idx);
+    }
+  }
+
+  for (size_t i = 0; i < tbl->indexes.size(); ++i) {
+    IndexDef &idx = tbl->indexes[i];
+    // Records of a WITHOUT ROWID table's indexes end with PRIMARY KEY, not rowid
+    if (idx.root_pgno == 0 || tbl->without_rowid) idx.usable = false;
+  }
+  return MYSQLITE_OK;
+}
+
+errstat Connection::get_table_def(const char * const table,
+                                  /* out */
+                                  TableDef *tbl)
+{
+  std::lock_guard<std::mutex> lock(catalog_mutex);
+  CatalogTable *entry = find_catalog_table(table);
+  if (!entry) return MYSQLITE_NO_SUCH_TABLE;
+
+  if (!entry->parsed) {
+    entry->parse_res = parse_table_def(*entry, &entry->def);
+    entry->parsed = true;
+  }
+  if (entry->parse_res != MYSQLITE_OK) return entry->parse_res;
+  *tbl = entry->def;
+  return MYSQLITE_OK;
+}
+
+IndexCursor *Connection::index_scan(const TableDef &tbl, const IndexDef &idx)
+{
+  if (!idx.usable || tbl.without_rowid) return NULL;
+  return new IndexCursor(tbl.root_pgno, idx);
+}
+
+RowidCursor *Connection::rowid_scan(const TableDef &tbl)
+{
+  if (tbl.without_rowid) return NULL;
+  return new RowidCursor(tbl.root_pgno);
+}
+
+/*
+  Rows under a child of an interior page, guessed from the fanouts
+  of the pages on the path to a leaf through middle children.
+*/
+static u64 estimate_subtree_rows(Pgno pgno)
+{
+  u64 n_rows = 1;
+  for (;;) {
+    BtreePage page(pgno);
+    errstat ret = page.fetch();
+    my_assert(ret == MYSQLITE_OK);
+
+    if (TABLE_INTERIOR != page.get_btree_type())
+      return n_rows * page.get_n_cell();
+
+    TableInteriorPage *interior_page = static_cast<TableInteriorPage *>(&page);
+    Pgsz n_children = interior_page->get_n_cell() + 1;
+    n_rows *= n_children;
+    pgno = get_child_pgno(interior_page, n_children / 2);
+  }
+}
+
+u64 Connection::estimate_rowid_range(const TableDef &tbl, s64 min_rowid, s64 max_rowid)
+{
+  if (min_rowid > max_rowid) return 0;
+
+  Pgno pgno = tbl.root_pgno;
+  for (;;) {
+    BtreePage page(pgno);
+    errstat ret = page.fetch();
+    my_assert(ret == MYSQLITE_OK);
+
+    if (TABLE_LEAF == page.get_btree_type()) {
+      TableLeafPage *leaf_page = static_cast<TableLeafPage *>(&page);
+      u64 n_rows = 0;
+      for (Pgsz i = 0; i < leaf_page->get_n_cell(); ++i) {
+        s64 rowid = leaf_page->get_ith_cell_rowid(i);
+        if (min_rowid <= rowid && rowid <= max_rowid) ++n_rows;
+      }
+      return n_rows;
+    }
+    else if (TABLE_INTERIOR == page.get_btree_type()) {
+      TableInteriorPage *interior_page = static_cast<TableInteriorPage *>(&page);
+      Pgsz lo = find_child_idx(interior_page, min_rowid);
+      Pgsz hi = find_child_idx(interior_page, max_rowid);
+      if (lo == hi) {
+        pgno = get_child_pgno(interior_page, lo);
+        continue;
+      }
+      // Children between lo and hi are fully in the range. The boundary
+      // children are half covered on average.
+      return (hi - lo) * estimate_subtree_rows(get_child_pgno(interior_page, lo));
+    }
+    else {
+      log_errstat(MYSQLITE_CORRUPT_DB);
+      return 0;
+    }
+  }
+}
+
+/*
+  Prefetch children of an interior page which rowids [begin, end) fall in,
+  then recurse into them unless they are leaves.
+*/
+static void prefetch_subtree(Pgno pgno, const Rowid *begin, const Rowid *end,
+                             /* inout */
+                             u64 *n_leaves)
+{
+  PageCache *pcache = PageCache::get_instance();
+  BtreePage page(pgno);
+  errstat ret = page.fetch();
   my_assert(ret == MYSQLITE_OK);
 
-  RecordCell cell;
-  if (!tbl_leaf_page.get_ith_cell(cpa_idx, &cell) &&
-      cell.has_overflow_pg()) {  //オーバフローページのために毎回こんなこと書かなきゃいけないのって割とこわい
-    u8 *payload_data = new u8[cell.payload_sz];
-    bool ret = tbl_leaf_page.get_ith_cell(cpa_idx, &cell, payload_data);
-    my_assert(ret);
+  if (TABLE_LEAF == page.get_btree_type()) {
+    ++*n_leaves;
+    return;
   }
-  if (cell.payload.cols_type[colno] == ST_C0) {
-    return 0;
+  else if (TABLE_INTERIOR != page.get_btree_type()) {
+    log_errstat(MYSQLITE_CORRUPT_DB);
+    return;
   }
-  else if (cell.payload.cols_type[colno] == ST_C1) {
-    return 1;
+
+  // Split rowids by child. Left child of a cell has rowids <= the cell's.
+  TableInteriorPage *interior_page = static_cast<TableInteriorPage *>(&page);
+  vector<Pgno> children;
+  vector<const Rowid *> bounds(1, begin);
+  for (const Rowid *p = begin; p < end; ) {
+    Pgsz child_idx = find_child_idx(interior_page, (s64)*p);
+    const Rowid *q = end;
+    if (child_idx < interior_page->get_n_cell()) {
+      struct TableInteriorPageCell cell;
+      interior_page->get_ith_cell(child_idx, &cell);
+      for (q = p + 1; q < end && (s64)*q <= (s64)cell.rowid; ++q);
+    }
+    children.push_back(get_child_pgno(interior_page, child_idx));
+    bounds.push_back(q);
+    p = q;
   }
-  else {
-    return u8s_to_val<int>(&cell.payload.data[cell.payload.cols_offset[colno]],
-                           cell.payload.cols_len[colno]);
+
+  for (size_t i = 0; i < children.size(); ++i) pcache->prefetch(children[i]);
+
+  // Children of a page are all leaves or all interiors
+  BtreePage first_child(children[0]);
+  ret = first_child.fetch();
+  my_assert(ret == MYSQLITE_OK);
+  if (TABLE_LEAF == first_child.get_btree_type()) {
+    *n_leaves += children.size();
+    return;
   }
+  for (size_t i = 0; i < children.size(); ++i)
+    prefetch_subtree(children[i], bounds[i], bounds[i + 1], n_leaves);
 }
-string RowCursor::get_text(int colno) const
+
+u64 Connection::prefetch_rowids(const TableDef &tbl, const vector<Rowid> &rowids)
 {
-  // TODO: use cache for record!!
-  TableLeafPage tbl_leaf_page(visit_path.back().pgno);
-  errstat res = tbl_leaf_page.fetch();
-  my_assert(res == MYSQLITE_OK);
+  u64 n_leaves = 0;
+  if (!rowids.empty())
+    prefetch_subtree(tbl.root_pgno, &rowids[0], &rowids[0] + rowids.size(), &n_leaves);
+  return n_leaves;
+}
 
-  RecordCell cell;
-  if (!tbl_leaf_page.get_ith_cell(cpa_idx, &cell) &&
-      cell.has_overflow_pg()) {  //オーバフローページのために毎回こんなこと書かなきゃいけないのって割とこわい
-    u8 *payload_data = new u8[cell.payload_sz];
-    bool ret = tbl_leaf_page.get_ith_cell(cpa_idx, &cell, payload_data);
-    my_assert(ret);
+/*
+  Rows under pgno. Children of an interior page are prefetched before the
+  first of them is read.
+*/
+static u64 count_subtree_rows(Pgno pgno)
+{
+  PageCache *pcache = PageCache::get_instance();
+  BtreePage page(pgno);
+  errstat ret = page.fetch();
+  my_assert(ret == MYSQLITE_OK);
+
+  if (TABLE_LEAF == page.get_btree_type()) return page.get_n_cell();
+  else if (TABLE_INTERIOR != page.get_btree_type()) {
+    log_errstat(MYSQLITE_CORRUPT_DB);
+    return 0;
   }
 
-  // TODO: Cache... now memory leak
-  return string((char *)&cell.payload.data[cell.payload.cols_offset[colno]],
-                cell.payload.cols_len[colno]);  //これもシンタックスシュガーが欲しい
+  TableInteriorPage *interior_page = static_cast<TableInteriorPage *>(&page);
+  Pgsz n_children = interior_page->get_n_cell() + 1;
+  for (Pgsz i = 0; i < n_children; ++i)
+    pcache->prefetch(get_child_pgno(interior_page, i));
+
+  u64 n_rows = 0;
+  for (Pgsz i = 0; i < n_children; ++i)
+    n_rows += count_subtree_rows(get_child_pgno(interior_page, i));
+  return n_rows;
+}
+
+u64 Connection::count_rows(const TableDef &tbl)
+{
+  return count_subtree_rows(tbl.root_pgno);
+}
+
+errstat Connection::rdlock_db(u64 timeout_usec)
+{
+  PageCache *pcache = PageCache::get_instance();
+  return pcache->rd_lock(timeout_usec);
+}
+
+errstat Connection::upgrade_lock_db(u64 timeout_usec)
+{
+  PageCache *pcache = PageCache::get_instance();
+  return pcache->upgrade_lock(timeout_usec);
+}
+
+errstat Connection::unlock_db()
+{
+  PageCache *pcache = PageCache::get_instance();
+  pcache->unlock();
+  return MYSQLITE_OK;
 }
 
 
 /***********************************************************************
-** FullscanCursor class
+** RowCursor class
 ***********************************************************************/
-FullscanCursor::FullscanCursor(Pgno root_pgno)
-  : RowCursor(root_pgno)
+RowCursor::RowCursor(Pgno root_pgno)
+  : visit_path(1, BtreePathNode(root_pgno, 0)), cpa_idx(-1), filter(NULL),
+    cols(NULL), pinned_leaf(NULL), payload_pgno(0), payload_cell(0)
 {
 }
 
-FullscanCursor::~FullscanCursor()
+RowCursor::~RowCursor()
 {
+  delete pinned_leaf;
 }
 
-void FullscanCursor::close()
+/*
+  Pages of visit_path are on the path to the last visited row (or are the
+  root alone). A page has rowid in its subtree for sure when rowid is
+  between the first and the last rowids of a leaf, or is greater than the
+  first and not greater than the last separators of an interior page.
+
+  Pages are not modified while the cursor lives under the read lock,
+  so visit_path stays valid between probes.
+
+  @return  Index of the deepest such page in visit_path. 0 (root) if none.
+*/
+size_t RowCursor::finger_depth(s64 rowid) const
 {
-  delete this;
+  for (size_t depth = visit_path.size() - 1; depth > 0; --depth) {
+    BtreePage page(visit_path[depth].pgno);
+    errstat ret = page.fetch();
+    my_assert(ret == MYSQLITE_OK);
+
+    Pgsz n_cell = page.get_n_cell();
+    if (n_cell == 0) continue;
+
+    if (TABLE_LEAF == page.get_btree_type()) {
+      TableLeafPage *leaf_page = static_cast<TableLeafPage *>(&page);
+      if ((s64)leaf_page->get_ith_cell_rowid(0) <= rowid &&
+          rowid <= (s64)leaf_page->get_ith_cell_rowid(n_cell - 1))
+        return depth;
+    }
+    else if (TABLE_INTERIOR == page.get_btree_type()) {
+      TableInteriorPage *interior_page = static_cast<TableInteriorPage *>(&page);
+      struct TableInteriorPageCell first, last;
+      interior_page->get_ith_cell(0, &first);
+      interior_page->get_ith_cell(n_cell - 1, &last);
+      if ((s64)first.rowid < rowid && rowid <= (s64)last.rowid)
+        return depth;
+    }
+  }
+  return 0;
+}
+
+bool RowCursor::seek_rowid(Rowid rowid)
+{
+  visit_path.erase(visit_path.begin() + finger_depth(rowid) + 1, visit_path.end());
+
+  for (;;) {
+    BtreePage cur_page(visit_path.back().pgno);
+    errstat ret = cur_page.fetch();
+    my_assert(ret == MYSQLITE_OK);
+
+    if (TABLE_LEAF == cur_page.get_btree_type()) {
+      // Binary search for the first cell whose rowid >= rowid.
+      // Rowids are signed although read as u64 from varints.
+      Pgsz lo = 0, hi = cur_page.get_n_cell();
+      TableLeafPage *cur_leaf_page = static_cast<TableLeafPage *>(&cur_page);
+      while (lo < hi) {
+        Pgsz mid = lo + (hi - lo) / 2;
+        if ((s64)cur_leaf_page->get_ith_cell_rowid(mid) < (s64)rowid) lo = mid + 1;
+        else hi = mid;
+      }
+      if (lo < cur_leaf_page->get_n_cell() &&
+          cur_leaf_page->get_ith_cell_rowid(lo) == rowid) {
+        cpa_idx = lo;
+        return true;
+      }
+      cpa_idx = lo - 1;  // -1 (before the first cell) if lo == 0
+      return false;
+    }
+    else if (TABLE_INTERIOR == cur_page.get_btree_type()) {
+      TableInteriorPage *cur_interior_page = static_cast<TableInteriorPage *>(&cur_page);
+      Pgsz child_idx = find_child_idx(cur_interior_page, rowid);
+      visit_path.back().child_idx_to_visit = child_idx;
+      visit_path.push_back(BtreePathNode(get_child_pgno(cur_interior_page, child_idx), 0));
+    }
+    else {
+      log_errstat(MYSQLITE_CORRUPT_DB);
+      return false;
+    }
+  }
 }
 
 /*
@@ -194,36 +605,36 @@ void FullscanCursor::close()
   from a table whose root pgno is visit_path[0].pgno.
 
   This function is called recursively by itself.
-  Every call to next() follows to return (return next()).
+  Every call to next_in_table() follows to return (return next_in_table()).
   Since (interior|leaf) cells who have been visited are not
-  visited again, every call to next() has different RowCursor state.
+  visited again, every call has different RowCursor state.
 
   (1) When visit_path.back().pgno points at leaf page:
     - (1-1) If the leaf has more cell (record),
         point the cell by cpa_idx and return true.
     - (1-2) If the leaf does not have any cell (record),
         jump back to the direct parent (table interior) node
-        by visit_path.pop_back() and call next() recursively.
+        by visit_path.pop_back() and call next_in_table() recursively.
         Or if the leaf has no direct parent,
         return false since all records are already fetched.
   (2) When visit_path.back().pgno points at interior page:
     - (2-1) If the interior has more left child cell or rightmost child,
         jump to the child by visit_path.push_back()
-        and call next() recursively.
+        and call next_in_table() recursively.
     - (2-2) If the interior has no more child,
         jump back to the direct parent (table interior) node
-        by visit_path.pop_back() and call next() recursively.
+        by visit_path.pop_back() and call next_in_table() recursively.
         Or if the leaf has no direct parent,
         return false since all records are already fetched.
 
   Here, the procedure
   "jump back to the direct parent (table interior) node
-   by visit_path.pop_back() and call next() recursively.
+   by visit_path.pop_back() and call next_in_table() recursively.
    Or if the leaf has no direct parent,
    return false since all records are already fetched."
   is encapsulated as jump_to_parent_or_finish_traversal().
 */
-bool FullscanCursor::next()
+bool RowCursor::next_in_table()
 {
   BtreePage cur_page(visit_path.back().pgno);
   errstat ret = cur_page.fetch();
@@ -240,7 +651,7 @@ bool FullscanCursor::next()
       // (1-2) The leaf has no more cell
       cpa_idx = -1;
       return jump_to_parent_or_finish_traversal() ?
-        next() : false;
+        next_in_table() : false;
     }
   }
   else if (TABLE_INTERIOR == cur_page.get_btree_type()) {
@@ -254,21 +665,21 @@ bool FullscanCursor::next()
       cur_interior_page->get_ith_cell(visit_path.back().child_idx_to_visit,
                                       &cell);
       visit_path.push_back(BtreePathNode(cell.left_child_pgno, 0));
-      return next();
+      return next_in_table();
     } else if ((int)visit_path.back().child_idx_to_visit == n_cell) {
       // (2-1) The interior has rightmost child
       visit_path.push_back(BtreePathNode(cur_interior_page->get_rightmost_pg(), 0));
-      return next();
+      return next_in_table();
     } else {
       // (2-2) The interior has no more child
       return jump_to_parent_or_finish_traversal() ?
-        next() : false;
+        next_in_table() : false;
     }
   }
   else abort();  // cur_page.get_btree_type() == TABLE_LEAF || TABLE_INTERIOR
 }
 
-bool FullscanCursor::jump_to_parent_or_finish_traversal()
+bool RowCursor::jump_to_parent_or_finish_traversal()
 {
   my_assert(visit_path.size() >= 1);
   if (visit_path.size() == 1) return false;  // finish traversal
@@ -278,9 +689,1253 @@ bool FullscanCursor::jump_to_parent_or_finish_traversal()
   return true;
 }
 
+/*
+  Go down to the last row in the subtree of visit_path.back().
+*/
+bool RowCursor::descend_rightmost()
+{
+  for (;;) {
+    BtreePage cur_page(visit_path.back().pgno);
+    errstat ret = cur_page.fetch();
+    my_assert(ret == MYSQLITE_OK);
 
-/***********************************************************************
-** Functions
-***********************************************************************/
+    Pgsz n_cell = cur_page.get_n_cell();
+    if (TABLE_LEAF == cur_page.get_btree_type()) {
+      cpa_idx = n_cell - 1;  // -1 for an empty root leaf
+      return n_cell > 0;
+    }
+    else if (TABLE_INTERIOR == cur_page.get_btree_type()) {
+      TableInteriorPage *cur_interior_page = static_cast<TableInteriorPage *>(&cur_page);
+      visit_path.back().child_idx_to_visit = n_cell;
+      visit_path.push_back(BtreePathNode(cur_interior_page->get_rightmost_pg(), 0));
+    }
+    else {
+      log_errstat(MYSQLITE_CORRUPT_DB);
+      return false;
+    }
+  }
+}
+
+bool RowCursor::last_in_table()
+{
+  visit_path.erase(visit_path.begin() + 1, visit_path.end());
+  return descend_rightmost();
+}
+
+/*
+  Traverse leaves from right to left.
+
+  (1) If the leaf has a cell before cpa_idx, point it.
+  (2) Otherwise climb to the nearest interior page having a child before
+      the one visited, and go down to the last row of that child.
+      Return false if there is no such page.
+*/
+bool RowCursor::prev_in_table()
+{
+  // (1)
+  if (cpa_idx != (Pgsz)-1 && cpa_idx > 0) {
+    --cpa_idx;
+    return true;
+  }
+
+  // (2)
+  cpa_idx = -1;
+  for (;;) {
+    if (visit_path.size() == 1) return false;
+    visit_path.pop_back();
+    if (visit_path.back().child_idx_to_visit > 0) break;
+  }
+  TableInteriorPage parent_page(visit_path.back().pgno);
+  errstat ret = parent_page.fetch();
+  my_assert(ret == MYSQLITE_OK);
+  Pgno child_pgno = get_child_pgno(&parent_page, --visit_path.back().child_idx_to_visit);
+  visit_path.push_back(BtreePathNode(child_pgno, 0));
+  return descend_rightmost();
+}
+
+const Payload &RowCursor::current_payload() const
+{
+  Pgno pgno = visit_path.back().pgno;
+  if (payload_pgno == pgno && payload_cell == cpa_idx) return payload;
+
+  if (!pinned_leaf || pinned_leaf->pgno != pgno) {
+    delete pinned_leaf;
+    pinned_leaf = new TableLeafPage(pgno);
+    errstat ret = pinned_leaf->fetch();
+    my_assert(ret == MYSQLITE_OK);
+  }
+
+  RecordCell cell;
+  if (!pinned_leaf->get_ith_cell(cpa_idx, &cell) &&
+      cell.has_overflow_pg()) {
+    overflow_buf.resize(cell.payload_sz);
+    bool ret = pinned_leaf->get_ith_cell(cpa_idx, &cell, &overflow_buf[0]);
+    my_assert(ret);
+  }
+  swap(payload, cell.payload);
+  payload_pgno = pgno;
+  payload_cell = cpa_idx;
+  return payload;
+}
+
+/*
+** Column colno if it is not in the record but has a DEFAULT value.
+*/
+const ColumnDef *RowCursor::added_column(const Payload &rec, int colno) const
+{
+  if ((size_t)colno < rec.cols_type.size() || !cols || (size_t)colno >= cols->size())
+    return NULL;
+  const ColumnDef *col = &(*cols)[colno];
+  return col->dflt_type == MYSQLITE_NULL ? NULL : col;
+}
+
+mysqlite_type RowCursor::get_type(int colno) const
+{
+  const Payload &rec = current_payload();
+  if ((size_t)colno >= rec.cols_type.size()) {
+    const ColumnDef *col = added_column(rec, colno);
+    return col ? col->dflt_type : MYSQLITE_NULL;
+  }
+  return sqlite_type_to_mysqlite_type(rec.cols_type[colno]);
+}
+
+bool RowCursor::is_null(int colno) const
+{
+  const Payload &rec = current_payload();
+  if ((size_t)colno >= rec.cols_type.size()) return !added_column(rec, colno);
+  return (rec.null_mask[colno / 64] >> (colno % 64)) & 1;
+}
+
+const u64 *RowCursor::get_null_mask(size_t *n_cols) const
+{
+  const Payload &rec = current_payload();
+  *n_cols = rec.cols_type.size();
+  return rec.null_mask.data();
+}
+
+s64 RowCursor::get_int64(int colno) const
+{
+  const Payload &rec = current_payload();
+  if ((size_t)colno >= rec.cols_type.size()) {
+    const ColumnDef *col = added_column(rec, colno);
+    if (!col) return 0;
+    return col->dflt_type == MYSQLITE_FLOAT ? (s64)col->dflt_double : col->dflt_int;
+  }
+  return rec.get_int(colno);
+}
+
+double RowCursor::get_double(int colno) const
+{
+  const Payload &rec = current_payload();
+  if ((size_t)colno >= rec.cols_type.size()) {
+    const ColumnDef *col = added_column(rec, colno);
+    if (!col) return 0;
+    return col->dflt_type == MYSQLITE_FLOAT ? col->dflt_double : (double)col->dflt_int;
+  }
+  if (rec.cols_type[colno] == ST_FLOAT) return rec.get_double(colno);
+  return (double)rec.get_int(colno);
+}
+
+Rowid RowCursor::get_rowid() const
+{
+  TableLeafPage tbl_leaf_page(visit_path.back().pgno);
+  errstat ret = tbl_leaf_page.fetch();
+  my_assert(ret == MYSQLITE_OK);
+
+  return tbl_leaf_page.get_ith_cell_rowid(cpa_idx);
+}
+
+string RowCursor::get_text(int colno) const
+{
+  u64 len;
+  const u8 *p = get_blob(colno, &len);
+  return string((const char *)p, len);
+}
+
+const u8 *RowCursor::get_blob(int colno, u64 *len, bool *on_page) const
+{
+  const Payload &rec = current_payload();
+  if ((size_t)colno >= rec.cols_type.size()) {
+    const ColumnDef *col = added_column(rec, colno);
+    if (on_page) *on_page = false;
+    if (!col) {
+      *len = 0;
+      return NULL;
+    }
+    *len = col->dflt_bytes.size();
+    return (const u8 *)col->dflt_bytes.data();
+  }
+  *len = rec.cols_len[colno];
+  if (on_page) *on_page = rec.data != overflow_buf.data();
+  return &rec.data[rec.cols_offset[colno]];
+}
+
+bool RowCursor::rejected_by_filter() const
+{
+  if (!filter) return false;
+  return filter->rejects(current_payload());
+}
+
+
+/***********************************************************************
+** FullscanCursor class
+***********************************************************************/
+FullscanCursor::FullscanCursor(Pgno root_pgno)
+  : RowCursor(root_pgno)
+{
+}
+
+FullscanCursor::~FullscanCursor()
+{
+}
+
+void FullscanCursor::close()
+{
+  delete this;
+}
+
+bool FullscanCursor::next()
+{
+  while (next_in_table()) {
+    if (!rejected_by_filter()) return true;
+  }
+  return false;
+}
+
+
+/***********************************************************************
+** ParallelScanCursor class
+***********************************************************************/
+
+/*
+  Cursor of a worker, walking a subtree of the table B-tree.
+*/
+class SubtreeCursor : public RowCursor {
+  public:
+  SubtreeCursor(Pgno root_pgno) : RowCursor(root_pgno) {}
+
+  public:
+  bool next() {
+    while (next_in_table()) {
+      if (!rejected_by_filter()) return true;
+    }
+    return false;
+  }
+
+  public:
+  void close() {}
+
+  public:
+  Pgno get_leaf() const { return visit_path.back().pgno; }
+  public:
+  Pgsz get_cell() const { return cpa_idx; }
+};
+
+ParallelScanCursor::ParallelScanCursor(Pgno tbl_root, size_t n_workers)
+  : RowCursor(tbl_root), tbl_root(tbl_root), next_subtree(0),
+    n_workers(n_workers), n_running(0), stopping(false), cur_pos(0)
+{
+  subtrees.push_back(tbl_root);
+  for (int level = 1; level <= 2; ++level) {
+    if (subtrees.size() >= n_workers * PARALLEL_SCAN_SUBTREES_PER_WORKER) break;
+
+    vector<Pgno> children;
+    for (size_t i = 0; i < subtrees.size(); ++i) {
+      BtreePage page(subtrees[i]);
+      errstat ret = page.fetch();
+      my_assert(ret == MYSQLITE_OK);
+
+      if (TABLE_INTERIOR != page.get_btree_type()) {
+        children.push_back(subtrees[i]);
+        continue;
+      }
+      TableInteriorPage *interior_page = static_cast<TableInteriorPage *>(&page);
+      for (Pgsz j = 0; j <= interior_page->get_n_cell(); ++j)
+        children.push_back(get_child_pgno(interior_page, j));
+    }
+    subtrees.swap(children);
+  }
+  if (this->n_workers > subtrees.size()) this->n_workers = subtrees.size();
+  cur.pgno = 0;
+}
+
+ParallelScanCursor::~ParallelScanCursor()
+{
+  stop();
+}
+
+void ParallelScanCursor::close()
+{
+  delete this;
+}
+
+/*
+  Let workers quit and wait for them.
+*/
+void ParallelScanCursor::stop()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  not_full.notify_all();
+  for (size_t i = 0; i < workers.size(); ++i) workers[i].join();
+  workers.clear();
+}
+
+bool ParallelScanCursor::next()
+{
+  if (workers.empty() && !stopping) {
+    n_running = n_workers;
+    for (size_t i = 0; i < n_workers; ++i)
+      workers.push_back(std::thread(&ParallelScanCursor::work, this));
+  }
+
+  if (++cur_pos >= cur.cells.size()) {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (queue.empty() && n_running > 0) not_empty.wait(lock);
+    if (queue.empty()) return false;
+    cur.pgno = queue.front().pgno;
+    cur.cells.swap(queue.front().cells);
+    queue.pop_front();
+    cur_pos = 0;
+    not_full.notify_one();
+  }
+
+  // Path from the root, so that seek_rowid() finds rows from here
+  visit_path.erase(visit_path.begin() + 1, visit_path.end());
+  if (cur.pgno != tbl_root) visit_path.push_back(BtreePathNode(cur.pgno, 0));
+  cpa_idx = cur.cells[cur_pos];
+  return true;
+}
+
+void ParallelScanCursor::work()
+{
+  LeafRows rows;
+  bool stopped = false;
+
+  while (!stopped) {
+    size_t i = next_subtree++;
+    if (i >= subtrees.size()) break;
+
+    SubtreeCursor subtree(subtrees[i]);
+    subtree.set_filter(filter);
+    rows.pgno = 0;
+    while (!stopped && subtree.next()) {
+      if (subtree.get_leaf() != rows.pgno) {
+        stopped = !push(&rows);
+        rows.pgno = subtree.get_leaf();
+      }
+      rows.cells.push_back(subtree.get_cell());
+    }
+    if (!stopped) stopped = !push(&rows);
+  }
+
+  std::lock_guard<std::mutex> lock(mutex);
+  --n_running;
+  not_empty.notify_all();
+}
+
+/*
+  Queue rows of a leaf, if any. Blocks while the queue is full.
+
+  @return false if close() is stopping workers.
+*/
+bool ParallelScanCursor::push(LeafRows *rows)
+{
+  if (rows->cells.empty()) return true;
+
+  std::unique_lock<std::mutex> lock(mutex);
+  while (!stopping && queue.size() >= PARALLEL_SCAN_QUEUE_LEAVES) not_full.wait(lock);
+  if (stopping) return false;
+  queue.push_back(LeafRows());
+  queue.back().pgno = rows->pgno;
+  queue.back().cells.swap(rows->cells);
+  rows->cells.clear();
+  not_empty.notify_one();
+  return true;
+}
+
+/***********************************************************************
+** LeafOrderCursor class
+***********************************************************************/
+LeafOrderCursor::LeafOrderCursor(Pgno tbl_root, const vector<Pgno> &leaves,
+                                 std::shared_ptr<ScanSync> sync)
+  : RowCursor(tbl_root), tbl_root(tbl_root), leaves(leaves), leaf_idx(0),
+    n_leaves_left(leaves.size()), sync(sync)
+{
+  // Join the other shared scans where they are
+  if (sync && sync->n_scans++ > 0 && !leaves.empty())
+    leaf_idx = sync->leaf_idx % leaves.size();
+
+  PageCache *pcache = PageCache::get_instance();
+  for (size_t i = 1; i < leaves.size() && i < LEAF_ORDER_PREFETCH_LEAVES; ++i)
+    pcache->prefetch(leaves[(leaf_idx + i) % leaves.size()]);
+  if (!leaves.empty()) point_leaf();
+}
+
+LeafOrderCursor::~LeafOrderCursor()
+{
+  if (sync) --sync->n_scans;
+}
+
+void LeafOrderCursor::close()
+{
+  delete this;
+}
+
+/*
+  Point just before the first cell of leaves[leaf_idx], with the path from
+  the root so that seek_rowid() finds rows from here.
+*/
+void LeafOrderCursor::point_leaf()
+{
+  visit_path.erase(visit_path.begin() + 1, visit_path.end());
+  if (leaves[leaf_idx] != tbl_root)
+    visit_path.push_back(BtreePathNode(leaves[leaf_idx], 0));
+  cpa_idx = -1;
+  if (sync) sync->leaf_idx = leaf_idx;
+
+  if (n_leaves_left >= LEAF_ORDER_PREFETCH_LEAVES) {
+    size_t ahead = (leaf_idx + LEAF_ORDER_PREFETCH_LEAVES - 1) % leaves.size();
+    PageCache::get_instance()->prefetch(leaves[ahead]);
+  }
+}
+
+bool LeafOrderCursor::next()
+{
+  while (n_leaves_left > 0) {
+    BtreePage page(leaves[leaf_idx]);
+    errstat ret = page.fetch();
+    my_assert(ret == MYSQLITE_OK);
+    Pgsz n_cell = page.get_n_cell();
+
+    while (++cpa_idx < n_cell) {
+      if (!rejected_by_filter()) return true;
+    }
+    if (--n_leaves_left > 0) {
+      if (++leaf_idx == leaves.size()) leaf_idx = 0;  // Wrap around
+      point_leaf();
+    }
+  }
+  return false;
+}
+
+/***********************************************************************
+** RowPipeline class
+***********************************************************************/
+
+/*
+  Wait of a side of RowPipeline for the other: yield the CPU for a while,
+  then sleep so that a stalled peer does not keep a core busy.
+*/
+static void pipeline_wait(unsigned *n_waits)
+{
+  if (++*n_waits < 64) std::this_thread::yield();
+  else usleep(50);
+}
+
+RowPipeline::RowPipeline(RowCursor *rows, const vector<int> &colnos)
+  : rows(rows), colnos(colnos), slots(ROW_PIPELINE_SLOTS),
+    head(0), tail(0), done(false), stopping(false), holding(false)
+{
+  for (size_t i = 0; i < slots.size(); ++i)
+    slots[i].values.resize(colnos.size());
+  producer = std::thread(&RowPipeline::produce, this);
+}
+
+RowPipeline::~RowPipeline()
+{
+  stopping.store(true, std::memory_order_relaxed);
+  producer.join();
+}
+
+const DecodedRow *RowPipeline::next()
+{
+  size_t h = head.load(std::memory_order_relaxed);
+  if (holding) head.store(++h, std::memory_order_release);
+  holding = false;
+
+  unsigned n_waits = 0;
+  while (tail.load(std::memory_order_acquire) == h) {
+    // done is set after the last row, so tail is read again
+    if (done.load(std::memory_order_acquire) &&
+        tail.load(std::memory_order_acquire) == h)
+      return NULL;
+    pipeline_wait(&n_waits);
+  }
+  holding = true;
+  return &slots[h % ROW_PIPELINE_SLOTS];
+}
+
+void RowPipeline::produce()
+{
+  while (!stopping.load(std::memory_order_relaxed)) {
+    size_t t = tail.load(std::memory_order_relaxed);
+    unsigned n_waits = 0;
+    while (t - head.load(std::memory_order_acquire) == ROW_PIPELINE_SLOTS) {
+      if (stopping.load(std::memory_order_relaxed)) return;
+      pipeline_wait(&n_waits);
+    }
+
+    if (!rows->next()) break;
+    decode(&slots[t % ROW_PIPELINE_SLOTS]);
+    tail.store(t + 1, std::memory_order_release);
+  }
+  done.store(true, std::memory_order_release);
+}
+
+void RowPipeline::decode(DecodedRow *row)
+{
+  row->rowid = rows->get_rowid();
+  const u64 *nulls = rows->get_null_mask(&row->n_rec_cols);
+  row->null_mask.assign(nulls, nulls + (row->n_rec_cols + 63) / 64);
+  for (size_t i = 0; i < colnos.size(); ++i) {
+    DecodedValue &v = row->values[i];
+    v.type = rows->get_type(colnos[i]);
+    switch (v.type) {
+    case MYSQLITE_INTEGER:
+      v.i = rows->get_int64(colnos[i]);
+      break;
+    case MYSQLITE_FLOAT:
+      v.d = rows->get_double(colnos[i]);
+      break;
+    case MYSQLITE_TEXT:
+    case MYSQLITE_BLOB:
+      {
+        u64 len;
+        const u8 *p = rows->get_blob(colnos[i], &len);
+        v.text.assign((const char *)p, len);
+      }
+      break;
+    case MYSQLITE_NULL:
+      break;
+    }
+  }
+}
+
+/***********************************************************************
+** RowidCursor class
+***********************************************************************/
+RowidCursor::RowidCursor(Pgno tbl_root)
+  : KeyCursor(tbl_root)
+{
+}
+
+RowidCursor::~RowidCursor()
+{
+}
+
+void RowidCursor::close()
+{
+  delete this;
+}
+
+bool RowidCursor::first()
+{
+  return seek_rowid((Rowid)INT64_MIN) || next_in_table();
+}
+
+bool RowidCursor::last()
+{
+  return last_in_table();
+}
+
+bool RowidCursor::seek(const vector<KeyValue> &key, seek_mode mode)
+{
+  if (key.empty()) return first();
+
+  s64 rowid;
+  switch (key[0].type) {
+  case MYSQLITE_INTEGER:
+    rowid = key[0].i;
+    break;
+  case MYSQLITE_FLOAT:
+    // No rowid between floor(d) and ceil(d)
+    if (key[0].d != floor(key[0].d)) {
+      switch (mode) {
+      case SEEK_EQ: case SEEK_LAST_EQ: return false;
+      case SEEK_GE: case SEEK_GT: mode = SEEK_GE; break;
+      case SEEK_LE: case SEEK_LT: mode = SEEK_LT; break;
+      }
+    }
+    rowid = (s64)ceil(key[0].d);
+    break;
+  case MYSQLITE_NULL:
+    // NULL is less than any rowid
+    switch (mode) {
+    case SEEK_GE: case SEEK_GT: return first();
+    default: return false;
+    }
+  default:
+    // TEXT and BLOB are greater than any rowid
+    switch (mode) {
+    case SEEK_LE: case SEEK_LT: return last();
+    default: return false;
+    }
+  }
+
+  switch (mode) {
+  case SEEK_EQ:
+  case SEEK_LAST_EQ:
+    return seek_rowid(rowid);
+  case SEEK_GE:
+    return seek_rowid(rowid) || next_in_table();
+  case SEEK_GT:
+    seek_rowid(rowid);
+    return next_in_table();
+  case SEEK_LE:
+    // A miss leaves the cursor on the row before rowid if it is in the leaf
+    return seek_rowid(rowid) || cpa_idx != (Pgsz)-1 || prev_in_table();
+  case SEEK_LT:
+    if (seek_rowid(rowid)) return prev_in_table();
+    return cpa_idx != (Pgsz)-1 || prev_in_table();
+  }
+  return false;
+}
+
+bool RowidCursor::next()
+{
+  return next_in_table();
+}
+
+bool RowidCursor::prev()
+{
+  return prev_in_table();
+}
+
+bool RowidCursor::next_same()
+{
+  return false;
+}
+
+bool RowidCursor::prev_same()
+{
+  return false;
+}
+
+
+/***********************************************************************
+** IndexCursor class
+***********************************************************************/
+IndexCursor::IndexCursor(Pgno tbl_root, const IndexDef &idx)
+  : KeyCursor(tbl_root), idx(idx), rowid(0), entries_only(false)
+{
+}
+
+IndexCursor::~IndexCursor()
+{
+}
+
+void IndexCursor::close()
+{
+  delete this;
+}
+
+bool IndexCursor::first()
+{
+  key.clear();
+  idx_path.assign(1, BtreePathNode(idx.root_pgno, 0));
+  return descend_leftmost() && load_entry();
+}
+
+bool IndexCursor::last()
+{
+  key.clear();
+  idx_path.assign(1, BtreePathNode(idx.root_pgno, 0));
+  return descend_rightmost() && load_entry();
+}
+
+/*
+  Backward modes find the entry just before the first one greater than
+  (SEEK_LAST_EQ, SEEK_LE) or not less than (SEEK_LT) key.
+*/
+bool IndexCursor::seek(const vector<KeyValue> &key, seek_mode mode)
+{
+  my_assert(key.size() <= idx.cols.size());
+
+  // Own TEXT and BLOB bytes, which next_same() compares later
+  this->key = key;
+  key_bufs.resize(key.size());
+  for (size_t j = 0; j < key.size(); ++j) {
+    if (key[j].type == MYSQLITE_TEXT || key[j].type == MYSQLITE_BLOB) {
+      key_bufs[j].assign((const char *)key[j].p, key[j].len);
+      this->key[j].p = (const u8 *)key_bufs[j].data();
+    }
+  }
+
+  bool found;
+  switch (mode) {
+  case SEEK_EQ:
+    return find_entry(SEEK_GE) && cmp_cur_entry() == 0 && load_entry();
+  case SEEK_GE:
+  case SEEK_GT:
+    return find_entry(mode) && load_entry();
+  case SEEK_LAST_EQ:
+  case SEEK_LE:
+  case SEEK_LT:
+    if (find_entry(mode == SEEK_LT ? SEEK_GE : SEEK_GT)) {
+      found = retreat();
+    } else {
+      idx_path.assign(1, BtreePathNode(idx.root_pgno, 0));
+      found = descend_rightmost();
+    }
+    if (!found) return false;
+    if (mode == SEEK_LAST_EQ && cmp_cur_entry() != 0) return false;
+    return load_entry();
+  }
+  return false;
+}
+
+/*
+  Binary search in each page from the root (or the page of the last
+  path finger_depth() finds) for the first cell not less than (SEEK_GE)
+  or greater than (SEEK_GT) key.
+
+  In a leaf, the cell is the answer.
+  In an interior page, the answer is in the left child of the cell or
+  is the cell itself. The latter is the case when the left child has
+  no such entry: ascend() then climbs back to the cell.
+
+  The table row is not read.
+*/
+bool IndexCursor::find_entry(seek_mode mode)
+{
+  if (idx_path.empty()) idx_path.assign(1, BtreePathNode(idx.root_pgno, 0));
+  idx_path.erase(idx_path.begin() + finger_depth(mode) + 1, idx_path.end());
+  for (;;) {
+    IndexPage cur_page(idx_path.back().pgno);
+    errstat ret = cur_page.fetch();
+    my_assert(ret == MYSQLITE_OK);
+
+    Pgsz n_cell = cur_page.get_n_cell();
+    Pgsz lo = 0, hi = n_cell;
+    while (lo < hi) {
+      Pgsz mid = lo + (hi - lo) / 2;
+      RecordCell cell;
+      if (!read_ith_entry(cur_page, mid, &cell)) return false;
+      int cmp = cmp_key(cell.payload);
+      if (mode == SEEK_GT ? cmp > 0 : cmp >= 0) hi = mid;
+      else lo = mid + 1;
+    }
+    idx_path.back().child_idx_to_visit = lo;
+
+    if (cur_page.is_leaf()) {
+      if (lo == n_cell && !ascend()) return false;
+      break;
+    }
+    idx_path.push_back(BtreePathNode(lo < n_cell ?
+                                     cur_page.get_ith_cell_left_child(lo) :
+                                     cur_page.get_rightmost_pg(),
+                                     0));
+  }
+  return true;
+}
+
+bool IndexCursor::next()
+{
+  return advance() && load_entry();
+}
+
+bool IndexCursor::prev()
+{
+  return retreat() && load_entry();
+}
+
+bool IndexCursor::next_same()
+{
+  return advance() && cmp_cur_entry() == 0 && load_entry();
+}
+
+bool IndexCursor::prev_same()
+{
+  return retreat() && cmp_cur_entry() == 0 && load_entry();
+}
+
+/*
+** Index of the deepest page in idx_path whose first entry is before and
+** last entry is at or after the seek() target: the target is then in the
+** subtree of the page. 0 (root) if none.
+**
+** Keeping idx_path between seek()s makes probes close to each other
+** (sorted keys of a join) cheap.
+*/
+size_t IndexCursor::finger_depth(seek_mode mode)
+{
+  for (size_t depth = idx_path.size() - 1; depth > 0; --depth) {
+    IndexPage page(idx_path[depth].pgno);
+    errstat ret = page.fetch();
+    my_assert(ret == MYSQLITE_OK);
+
+    Pgsz n_cell = page.get_n_cell();
+    if (n_cell == 0) continue;
+
+    RecordCell cell;
+    if (!read_ith_entry(page, 0, &cell)) return 0;
+    int cmp = cmp_key(cell.payload);
+    if (mode == SEEK_GT ? cmp > 0 : cmp >= 0) continue;  // Target may be before the page
+
+    if (!read_ith_entry(page, n_cell - 1, &cell)) return 0;
+    cmp = cmp_key(cell.payload);
+    if (mode == SEEK_GT ? cmp > 0 : cmp >= 0) return depth;
+  }
+  return 0;
+}
+
+/*
+** Move to the next entry in the index B-tree without reading the table.
+*/
+bool IndexCursor::advance()
+{
+  if (idx_path.empty()) return false;
+
+  IndexPage cur_page(idx_path.back().pgno);
+  errstat ret = cur_page.fetch();
+  my_assert(ret == MYSQLITE_OK);
+
+  Pgsz i = ++idx_path.back().child_idx_to_visit;
+  if (cur_page.is_leaf()) {
+    return i < cur_page.get_n_cell() || ascend();
+  } else {
+    // Entries after an interior cell start from the next child
+    idx_path.push_back(BtreePathNode(i < cur_page.get_n_cell() ?
+                                     cur_page.get_ith_cell_left_child(i) :
+                                     cur_page.get_rightmost_pg(),
+                                     0));
+    return descend_leftmost();
+  }
+}
+
+/*
+** Move to the previous entry in the index B-tree without reading the table.
+**
+** Entries of an interior page are ordered as
+** child 0, cell 0, child 1, cell 1, ..., cell n-1, child n (rightmost).
+*/
+bool IndexCursor::retreat()
+{
+  if (idx_path.empty()) return false;
+
+  IndexPage cur_page(idx_path.back().pgno);
+  errstat ret = cur_page.fetch();
+  my_assert(ret == MYSQLITE_OK);
+
+  Pgsz i = idx_path.back().child_idx_to_visit;
+  if (!cur_page.is_leaf()) {
+    // Entries before an interior cell are in its left child
+    idx_path.push_back(BtreePathNode(cur_page.get_ith_cell_left_child(i), 0));
+    return descend_rightmost();
+  }
+  if (i > 0) {
+    --idx_path.back().child_idx_to_visit;
+    return true;
+  }
+
+  // Climb to the interior cell preceding the subtree just visited
+  for (;;) {
+    idx_path.pop_back();
+    if (idx_path.empty()) return false;
+    if (idx_path.back().child_idx_to_visit > 0) {
+      --idx_path.back().child_idx_to_visit;
+      return true;
+    }
+  }
+}
+
+/*
+** Go down to the last entry in the subtree of idx_path.back().
+*/
+bool IndexCursor::descend_rightmost()
+{
+  for (;;) {
+    IndexPage cur_page(idx_path.back().pgno);
+    errstat ret = cur_page.fetch();
+    my_assert(ret == MYSQLITE_OK);
+
+    Pgsz n_cell = cur_page.get_n_cell();
+    if (cur_page.is_leaf()) {
+      idx_path.back().child_idx_to_visit = n_cell - 1;
+      if (n_cell > 0) return true;
+      idx_path.clear();  // Only a root leaf can be empty
+      return false;
+    }
+    idx_path.back().child_idx_to_visit = n_cell;
+    idx_path.push_back(BtreePathNode(cur_page.get_rightmost_pg(), 0));
+  }
+}
+
+/*
+** Go down to the first entry in the subtree of idx_path.back().
+*/
+bool IndexCursor::descend_leftmost()
+{
+  for (;;) {
+    IndexPage cur_page(idx_path.back().pgno);
+    errstat ret = cur_page.fetch();
+    my_assert(ret == MYSQLITE_OK);
+
+    idx_path.back().child_idx_to_visit = 0;
+    if (cur_page.is_leaf()) {
+      return cur_page.get_n_cell() > 0 || ascend();  // Only a root leaf can be empty
+    }
+    idx_path.push_back(BtreePathNode(cur_page.get_n_cell() > 0 ?
+                                     cur_page.get_ith_cell_left_child(0) :
+                                     cur_page.get_rightmost_pg(),
+                                     0));
+  }
+}
+
+/*
+** Climb to the interior cell following the subtree just visited.
+**
+** @return false if no entry is left.
+*/
+bool IndexCursor::ascend()
+{
+  for (;;) {
+    idx_path.pop_back();
+    if (idx_path.empty()) return false;
+
+    IndexPage cur_page(idx_path.back().pgno);
+    errstat ret = cur_page.fetch();
+    my_assert(ret == MYSQLITE_OK);
+    if (idx_path.back().child_idx_to_visit < cur_page.get_n_cell()) return true;
+  }
+}
+
+/*
+** Point the table row of the current entry.
+*/
+bool IndexCursor::load_entry()
+{
+  IndexPage cur_page(idx_path.back().pgno);
+  errstat ret = cur_page.fetch();
+  my_assert(ret == MYSQLITE_OK);
+
+  RecordCell cell;
+  if (!read_ith_entry(cur_page, idx_path.back().child_idx_to_visit, &cell)) return false;
+  rowid = cell.rowid;
+  return entries_only || read_row();
+}
+
+bool IndexCursor::read_row()
+{
+  if (idx_path.empty()) return false;
+  if (!seek_rowid(rowid)) {
+    log_msg("Index %s has rowid %lld missing in table\n", idx.name.c_str(), (s64)rowid);
+    log_errstat(MYSQLITE_CORRUPT_DB);
+    return false;
+  }
+  return true;
+}
+
+bool IndexCursor::read_row(Rowid rowid)
+{
+  if (!seek_rowid(rowid)) return false;
+  this->rowid = rowid;
+  return true;
+}
+
+const vector<KeyValue> &IndexCursor::get_entry_values()
+{
+  entry_values.clear();
+  if (idx_path.empty()) return entry_values;
+
+  IndexPage cur_page(idx_path.back().pgno);
+  errstat ret = cur_page.fetch();
+  my_assert(ret == MYSQLITE_OK);
+
+  RecordCell cell;
+  if (!read_ith_entry(cur_page, idx_path.back().child_idx_to_visit, &cell))
+    return entry_values;
+
+  // Copy the record since the page is released on return
+  entry_buf.assign(cell.payload.data, cell.payload.data + cell.payload_sz);
+  for (size_t j = 0; j < idx.cols.size() && j < cell.payload.cols_type.size(); ++j) {
+    KeyValue v = record_value(cell.payload, j);
+    if (v.p) v.p = &entry_buf[0] + (v.p - cell.payload.data);
+    entry_values.push_back(v);
+  }
+  return entry_values;
+}
+
+/*
+** cell->payload is valid while page is fetched and until the next call.
+*/
+bool IndexCursor::read_ith_entry(const IndexPage &page, Pgsz i,
+                                 /* out */
+                                 RecordCell *cell)
+{
+  if (!page.get_ith_cell(i, cell)) {
+    if (!cell->has_overflow_pg()) return false;
+    overflow_buf.resize(cell->payload_sz);
+    page.get_ith_cell(i, cell, &overflow_buf[0]);
+  }
+  return true;
+}
+
+int IndexCursor::cmp_key(const Payload &payload) const
+{
+  for (size_t j = 0; j < key.size(); ++j) {
+    int cmp = compare_key_value(record_value(payload, j), key[j], idx.cols[j].coll);
+    if (cmp != 0) return idx.cols[j].desc ? -cmp : cmp;
+  }
+  return 0;
+}
+
+int IndexCursor::cmp_cur_entry()
+{
+  IndexPage cur_page(idx_path.back().pgno);
+  errstat ret = cur_page.fetch();
+  my_assert(ret == MYSQLITE_OK);
+
+  RecordCell cell;
+  if (!read_ith_entry(cur_page, idx_path.back().child_idx_to_visit, &cell)) return -1;
+  return cmp_key(cell.payload);
+}
+
+
+/***********************************************************************
+** RowFilter class
+***********************************************************************/
+void RowFilter::add(const ColumnFilter &filter)
+{
+  filters.push_back(filter);
+  vector<KeyValue> &values = filters.back().values;
+  for (size_t i = 0; i < values.size(); ++i) {
+    if (!values[i].p) continue;
+    bufs.push_back(string((const char *)values[i].p, values[i].len));
+    values[i].p = (const u8 *)bufs.back().data();
+  }
+}
+
+void RowFilter::clear()
+{
+  filters.clear();
+  bufs.clear();
+}
+
+bool utf8_fits(const u8 *p, u64 len, u64 max_chars, u32 max_char_len)
+{
+  u64 n_chars = 0;
+  for (u64 i = 0; i < len; ++n_chars) {
+    u32 char_len = p[i] < 0x80 ? 1 : p[i] < 0xc2 ? 0 :
+                   p[i] < 0xe0 ? 2 : p[i] < 0xf0 ? 3 : p[i] < 0xf5 ? 4 : 0;
+    if (char_len == 0 || char_len > max_char_len || i + char_len > len) return false;
+    for (u32 k = 1; k < char_len; ++k)
+      if ((p[i + k] & 0xc0) != 0x80) return false;
+    i += char_len;
+  }
+  return n_chars <= max_chars;
+}
+
+static bool is_judged(const ColumnFilter &f, const KeyValue &v)
+{
+  switch (v.type) {
+  case MYSQLITE_NULL:    return f.judge_null;
+  case MYSQLITE_INTEGER: return f.judge_int && v.i >= f.min_int && v.i <= f.max_int;
+  case MYSQLITE_FLOAT:   return f.judge_float;
+  case MYSQLITE_TEXT:
+    return f.judge_text && utf8_fits(v.p, v.len, f.max_chars, f.max_char_len);
+  case MYSQLITE_BLOB:    return false;
+  }
+  return false;
+}
+
+static bool is_number(mysqlite_type type)
+{
+  return type == MYSQLITE_INTEGER || type == MYSQLITE_FLOAT;
+}
+
+/*
+** Compare as if the shorter one is padded with spaces.
+*/
+static int compare_padded(const u8 *a, u64 a_len, const u8 *b, u64 b_len)
+{
+  u64 len = min(a_len, b_len);
+  int cmp = memcmp(a, b, len);
+  if (cmp != 0) return cmp;
+  int sign = a_len > b_len ? 1 : -1;
+  const u8 *rest = a_len > b_len ? a : b;
+  for (u64 i = len; i < max(a_len, b_len); ++i) {
+    if (rest[i] != ' ') return rest[i] < ' ' ? -sign : sign;
+  }
+  return 0;
+}
+
+/*
+** @return false if rec and value are not comparable by filters.
+*/
+static bool filter_compare(const ColumnFilter &f, const KeyValue &rec,
+                           const KeyValue &value,
+                           /* out */
+                           int *cmp)
+{
+  if (is_number(rec.type) && is_number(value.type)) {
+    *cmp = compare_key_value(rec, value, COLL_BINARY);
+    return true;
+  }
+  if (rec.type == MYSQLITE_TEXT && value.type == MYSQLITE_TEXT) {
+    *cmp = f.pad_space ? compare_padded(rec.p, rec.len, value.p, value.len) :
+                         compare_bytes(rec.p, rec.len, value.p, value.len);
+    return true;
+  }
+  return false;
+}
+
+static bool filter_rejects(const ColumnFilter &f, const Payload &payload)
+{
+  if ((size_t)f.colno >= payload.cols_type.size()) return false;  // Column added later
+  KeyValue rec = record_value(payload, f.colno);
+  if (!is_judged(f, rec)) return false;
+
+  switch (f.op) {
+  case FILTER_IS_NULL:
+    return rec.type != MYSQLITE_NULL;
+  case FILTER_IS_NOT_NULL:
+    return rec.type == MYSQLITE_NULL;
+  default:
+    break;
+  }
+  if (rec.type == MYSQLITE_NULL) return true;
+
+  int cmp;
+  switch (f.op) {
+  case FILTER_IN:
+    for (size_t i = 0; i < f.values.size(); ++i) {
+      if (!filter_compare(f, rec, f.values[i], &cmp) || cmp == 0) return false;
+    }
+    return true;
+  case FILTER_PREFIX:
+    if (rec.type != MYSQLITE_TEXT || f.values[0].type != MYSQLITE_TEXT) return false;
+    return rec.len < f.values[0].len || memcmp(rec.p, f.values[0].p, f.values[0].len) != 0;
+  default:
+    break;
+  }
+
+  if (!filter_compare(f, rec, f.values[0], &cmp)) return false;
+  switch (f.op) {
+  case FILTER_EQ: return cmp != 0;
+  case FILTER_NE: return cmp == 0;
+  case FILTER_LT: return cmp >= 0;
+  case FILTER_LE: return cmp > 0;
+  case FILTER_GT: return cmp <= 0;
+  case FILTER_GE: return cmp < 0;
+  default:        return false;
+  }
+}
+
+bool RowFilter::rejects(const Payload &payload) const
+{
+  for (size_t i = 0; i < filters.size(); ++i) {
+    if (filter_rejects(filters[i], payload)) return true;
+  }
+  return false;
+}
+
+
+/***********************************************************************
+** Functions
+***********************************************************************/
+KeyValue record_value(const Payload &payload, int colno)
+{
+  const u8 *p = &payload.data[payload.cols_offset[colno]];
+  switch (payload.cols_type[colno]) {
+  case ST_NULL:
+    return KeyValue::null_value();
+  case ST_FLOAT:
+    return KeyValue::of_double(payload.get_double(colno));
+  case ST_TEXT:
+    return KeyValue::of_text(p, payload.cols_len[colno]);
+  case ST_BLOB:
+    return KeyValue::of_blob(p, payload.cols_len[colno]);
+  default:
+    return KeyValue::of_int(payload.get_int(colno));
+  }
+}
+
+/*
+** Storage class rank in SQLite's sort order
+*/
+static int value_class(mysqlite_type type)
+{
+  switch (type) {
+  case MYSQLITE_NULL:    return 0;
+  case MYSQLITE_INTEGER:
+  case MYSQLITE_FLOAT:   return 1;
+  case MYSQLITE_TEXT:    return 2;
+  case MYSQLITE_BLOB:    return 3;
+  }
+  return 0;
+}
+
+static int compare_bytes(const u8 *a, u64 a_len, const u8 *b, u64 b_len)
+{
+  int cmp = memcmp(a, b, min(a_len, b_len));
+  if (cmp != 0) return cmp;
+  return a_len < b_len ? -1 : a_len > b_len;
+}
+
+/*
+** Bytes of the first n_chars UTF-8 characters of p.
+*/
+static u64 utf8_prefix_len(const u8 *p, u64 len, u32 n_chars)
+{
+  u64 i = 0;
+  for (u32 c = 0; c < n_chars && i < len; ++c) {
+    ++i;
+    while (i < len && (p[i] & 0xc0) == 0x80) ++i;  // continuation bytes
+  }
+  return i;
+}
+
+static int compare_text(const u8 *a, u64 a_len, const u8 *b, u64 b_len,
+                        sqlite_collation coll)
+{
+  switch (coll) {
+  case COLL_NOCASE:
+    for (u64 i = 0; i < a_len && i < b_len; ++i) {
+      int ca = (a[i] >= 'A' && a[i] <= 'Z') ? a[i] + ('a' - 'A') : a[i];
+      int cb = (b[i] >= 'A' && b[i] <= 'Z') ? b[i] + ('a' - 'A') : b[i];
+      if (ca != cb) return ca - cb;
+    }
+    return a_len < b_len ? -1 : a_len > b_len;
+  case COLL_RTRIM:
+    while (a_len > 0 && a[a_len - 1] == ' ') --a_len;
+    while (b_len > 0 && b[b_len - 1] == ' ') --b_len;
+    return compare_bytes(a, a_len, b, b_len);
+  case COLL_BINARY:
+    break;
+  }
+  return compare_bytes(a, a_len, b, b_len);
+}
+
+int compare_key_value(const KeyValue &rec, const KeyValue &key, sqlite_collation coll)
+{
+  int rec_class = value_class(rec.type), key_class = value_class(key.type);
+  if (rec_class != key_class) return rec_class - key_class;
+
+  switch (rec.type) {
+  case MYSQLITE_NULL:
+    return 0;
+  case MYSQLITE_INTEGER:
+  case MYSQLITE_FLOAT:
+    if (rec.type == MYSQLITE_INTEGER && key.type == MYSQLITE_INTEGER) {
+      return rec.i < key.i ? -1 : rec.i > key.i;
+    } else {
+      double a = rec.type == MYSQLITE_INTEGER ? (double)rec.i : rec.d;
+      double b = key.type == MYSQLITE_INTEGER ? (double)key.i : key.d;
+      return a < b ? -1 : a > b;
+    }
+  case MYSQLITE_TEXT:
+    {
+      u64 rec_len = key.n_chars ? utf8_prefix_len(rec.p, rec.len, key.n_chars) : rec.len;
+      return compare_text(rec.p, rec_len, key.p, key.len, coll);
+    }
+  case MYSQLITE_BLOB:
+    return compare_bytes(rec.p, rec.len, key.p, key.len);
+  }
+  return 0;
+}
 
 }
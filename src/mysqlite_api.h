@@ -2,15 +2,171 @@
 #define _MYSQLITE_API_H_
 
 
+#include <limits.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
 #include "mysqlite_types.h"
 #include "sqlite_format.h"
+#include "sqlite_ddl.h"
 
 namespace mysqlite {
 
+/***********************************************************************
+** Types
+***********************************************************************/
+
+/*
+** Value to be compared with SQLite record columns (search key of index).
+*/
+struct KeyValue {
+  mysqlite_type type;
+  s64 i;          // MYSQLITE_INTEGER
+  double d;       // MYSQLITE_FLOAT
+  const u8 *p;    // MYSQLITE_TEXT and MYSQLITE_BLOB
+  u64 len;
+  u32 n_chars;    // MYSQLITE_TEXT: Only the first n_chars characters of
+                  // record values are compared (prefix key).
+                  // 0 to compare whole values.
+
+  public:
+  static KeyValue null_value() {
+    KeyValue v = {MYSQLITE_NULL, 0, 0, NULL, 0, 0};
+    return v;
+  }
+  static KeyValue of_int(s64 i) {
+    KeyValue v = {MYSQLITE_INTEGER, i, 0, NULL, 0, 0};
+    return v;
+  }
+  static KeyValue of_double(double d) {
+    KeyValue v = {MYSQLITE_FLOAT, 0, d, NULL, 0, 0};
+    return v;
+  }
+  static KeyValue of_text(const void *p, u64 len, u32 n_chars = 0) {
+    KeyValue v = {MYSQLITE_TEXT, 0, 0, (const u8 *)p, len, n_chars};
+    return v;
+  }
+  static KeyValue of_blob(const void *p, u64 len) {
+    KeyValue v = {MYSQLITE_BLOB, 0, 0, (const u8 *)p, len, 0};
+    return v;
+  }
+};
+
+/*
+** Where IndexCursor::seek() positions.
+*/
+typedef enum seek_mode {
+  SEEK_EQ,   // First entry equal to key (fails if none)
+  SEEK_GE,   // First entry equal to or greater than key
+  SEEK_GT,   // First entry greater than key
+  SEEK_LAST_EQ,  // Last entry equal to key (fails if none)
+  SEEK_LE,   // Last entry equal to or less than key
+  SEEK_LT,   // Last entry less than key
+} seek_mode;
+
+/*
+** Test of ColumnFilter.
+*/
+typedef enum filter_op {
+  FILTER_EQ,
+  FILTER_NE,
+  FILTER_LT,
+  FILTER_LE,
+  FILTER_GT,
+  FILTER_GE,
+  FILTER_IN,           // Equal to one of values
+  FILTER_IS_NULL,
+  FILTER_IS_NOT_NULL,
+  FILTER_PREFIX,       // TEXT starting with values[0] (LIKE 'abc%')
+} filter_op;
+
+/*
+** Predicate "column op values" on SQLite records (see RowFilter).
+**
+** A filter only judges record values the caller would read unchanged:
+** the others pass, and the caller checks them itself. By default every
+** INTEGER, FLOAT and TEXT value is judged; callers narrow it down to
+** what their own column types hold exactly.
+*/
+struct ColumnFilter {
+  int colno;                // Column number in the record
+  filter_op op;
+  vector<KeyValue> values;  // Operands. Empty for FILTER_IS_[NOT_]NULL.
+                            // Numbers are compared with INTEGER and FLOAT,
+                            // TEXT with TEXT. Other pairs are not judged.
+
+  bool judge_null;          // NULL is never equal, less nor greater
+  bool judge_int;           // INTEGER in [min_int, max_int]
+  s64 min_int, max_int;
+  bool judge_float;
+  bool judge_text;          // Well-formed UTF-8 TEXT of at most max_chars
+  u64 max_chars;            // characters, each of at most max_char_len
+  u32 max_char_len;         // bytes
+  bool pad_space;           // TEXT compared as if padded with spaces
+                            // (MySQL PAD SPACE collations). Otherwise
+                            // compared bytewise.
+
+  public:
+  ColumnFilter(int colno, filter_op op)
+    : colno(colno), op(op),
+      judge_null(true),
+      judge_int(true), min_int(LLONG_MIN), max_int(LLONG_MAX),
+      judge_float(true),
+      judge_text(true), max_chars(~0ULL), max_char_len(4),
+      pad_space(false)
+  {}
+};
+
+
 /***********************************************************************
 ** Classes
 ***********************************************************************/
 
+/*
+** Conjunction of ColumnFilters, evaluated on record bytes before any
+** value is converted.
+*/
+class RowFilter {
+private:
+  vector<ColumnFilter> filters;
+  list<string> bufs;        // Own TEXT and BLOB bytes of filter values
+
+  public:
+  RowFilter() {}
+
+  /*
+  ** Add a filter. TEXT and BLOB values are copied.
+  */
+  public:
+  void add(const ColumnFilter &filter);
+
+  public:
+  bool empty() const { return filters.empty(); }
+  public:
+  size_t size() const { return filters.size(); }
+  public:
+  void clear();
+
+  /*
+  ** @return true only if a filter is surely false for the record.
+  **   Values a filter does not judge never reject records.
+  */
+  public:
+  bool rejects(const Payload &payload) const;
+
+  private:
+  RowFilter(const RowFilter &);
+  RowFilter &operator=(const RowFilter &);
+};
+
+
 /*
 ** Used to iterate table cursor.
 ** Used by both fullscan and index scan.
@@ -26,6 +182,19 @@ protected:
                //   |   |
                //   +-2 +-1
   Pgsz cpa_idx;    // Cell Pointer Array index
+  const RowFilter *filter;  // set_filter()
+  const vector<ColumnDef> *cols;  // set_columns()
+
+private:
+  /* Row read by the getters */
+  mutable TableLeafPage *pinned_leaf;  // Leaf of the row, kept pinned
+  mutable Pgno payload_pgno;   // Where payload is from.
+  mutable Pgsz payload_cell;   // payload_pgno is 0 if none.
+  mutable Payload payload;
+  mutable vector<u8> overflow_buf;  // payload.data of a row with overflow
+                                    // pages
+
+protected:
 
   /*
   ** Whether to have remnant rows
@@ -41,20 +210,139 @@ protected:
 
   /*
   ** Cell value getter.
+  **
+  ** The record of the current row is parsed once and shared by the
+  ** getters until the cursor moves. Columns after the last one in the
+  ** record (added by ALTER TABLE ADD COLUMN) have their DEFAULT values
+  ** (see set_columns()).
   */
   public:
   mysqlite_type get_type(int colno) const;
   public:
-  int get_int(int colno) const;
+  bool is_null(int colno) const;
+
+  /*
+  ** NULL columns of the current row, found while the record header is
+  ** parsed: bit colno % 64 of retval[colno / 64] is set for NULL.
+  ** Columns from *n_cols on are not in the record, and have their
+  ** DEFAULT values.
+  */
+  public:
+  const u64 *get_null_mask(/* out */ size_t *n_cols) const;
+
+  /*
+  ** Integer column. get_int() truncates it to int.
+  */
+  public:
+  s64 get_int64(int colno) const;
+  public:
+  int get_int(int colno) const { return (int)get_int64(colno); }
+
+  /*
+  ** REAL column. An INTEGER column is converted.
+  */
+  public:
+  double get_double(int colno) const;
+
   public:
   string get_text(int colno) const;
 
+  /*
+  ** TEXT or BLOB column without copying it.
+  **
+  ** A value of a row without overflow pages points into its leaf, which
+  ** is kept pinned in the page cache. Otherwise the row is assembled
+  ** once into a buffer of the cursor, reused by later rows. Either is
+  ** valid until a getter reads another row or the cursor is closed.
+  **
+  ** @param on_page  Set to whether retval points into the leaf.
+  */
+  public:
+  const u8 *get_blob(int colno,
+                     /* out */
+                     u64 *len, bool *on_page = NULL) const;
+
+  /*
+  ** Rowid of the current row. Passed to seek_rowid() to revisit the row.
+  */
+  public:
+  virtual Rowid get_rowid() const;
+
+  /*
+  ** Point the row whose rowid is rowid by descending the table B-tree
+  ** with binary searches. O(log n) page reads.
+  **
+  ** The descent starts from the deepest page of visit_path whose rowids
+  ** surround rowid (finger search), so probes close to the previous one
+  ** read only a leaf or a few pages near it.
+  **
+  ** @return false if no row has rowid.
+  **   The cursor is then placed just before the first row with larger
+  **   rowid, so that FullscanCursor::next() points it.
+  */
+  public:
+  bool seek_rowid(Rowid rowid);
+
+  /*
+  ** next() of table scans (FullscanCursor, ParallelScanCursor and
+  ** LeafOrderCursor) skips rows filter rejects, without reading them
+  ** into the caller. Other cursors ignore it. NULL to remove.
+  ** filter must outlive the cursor or be removed first.
+  */
+  public:
+  void set_filter(const RowFilter *filter) { this->filter = filter; }
+
+  /*
+  ** Columns of the table, whose DEFAULT values the getters return for
+  ** columns not in the record, as SQLite does. Without them (NULL, the
+  ** default) such columns are NULL. cols must outlive the cursor or be
+  ** removed first.
+  */
+  public:
+  void set_columns(const vector<ColumnDef> *cols) { this->cols = cols; }
+
   public:
-  virtual ~RowCursor() {}
+  virtual ~RowCursor();
+
+  private:
+  const ColumnDef *added_column(const Payload &rec, int colno) const;
 
   protected:
   RowCursor(Pgno root_pgno);
 
+  /*
+  ** Point the next row in rowid order by walking the table B-tree
+  ** along visit_path.
+  */
+  protected:
+  bool next_in_table();
+
+  /*
+  ** Point the previous row in rowid order, or the last row.
+  ** Mirrors of next_in_table().
+  */
+  protected:
+  bool prev_in_table();
+  protected:
+  bool last_in_table();
+
+  /*
+  ** Whether filter rejects the current row.
+  */
+  protected:
+  bool rejected_by_filter() const;
+
+  /*
+  ** Record of the current row, parsed at its first getter call.
+  */
+  private:
+  const Payload &current_payload() const;
+
+  private:
+  bool jump_to_parent_or_finish_traversal();
+  bool descend_rightmost();
+  size_t finger_depth(s64 rowid) const;
+
 };
 
 /*
@@ -80,9 +368,420 @@ class FullscanCursor : public RowCursor {
 
   public:
   virtual ~FullscanCursor();
+};
+
+
+/*
+** TODO: Move this class to other file so that user cannot see it.
+** Users do not directly use this class.
+**
+** Used to iterate table rows with worker threads, in no particular order.
+**
+** The table B-tree is split at its first interior level into subtrees,
+** which are contiguous rowid ranges, or at the second level when the
+** first has fewer than PARALLEL_SCAN_SUBTREES_PER_WORKER subtrees per
+** worker. Workers take subtrees one by one, walk their leaves and test
+** rows with the filter (see RowCursor::set_filter()). Positions of the
+** passing rows go through a bounded queue, one batch per leaf; next()
+** points them, and get_*() read them from pages the workers brought
+** into the page cache.
+**
+** Workers start at the first next() and run under the read lock of the
+** caller, which must be held until close().
+*/
+class ParallelScanCursor : public RowCursor {
+private:
+  enum {
+    PARALLEL_SCAN_SUBTREES_PER_WORKER = 4,
+    PARALLEL_SCAN_QUEUE_LEAVES = 64,   // Bound of queue
+  };
+  struct LeafRows {
+    Pgno pgno;
+    vector<Pgsz> cells;      // Cells of passing rows
+  };
+
+  Pgno tbl_root;
+  vector<Pgno> subtrees;     // Roots of subtrees in rowid order
+  std::atomic<size_t> next_subtree;  // Next subtree a worker takes
+  size_t n_workers;
+  vector<std::thread> workers;
+  std::mutex mutex;          // Protects the members below
+  std::condition_variable not_empty, not_full;
+  std::deque<LeafRows> queue;
+  size_t n_running;          // Workers not finished yet
+  bool stopping;             // close() asks workers to quit
+  LeafRows cur;              // Leaf being pointed by next()
+  size_t cur_pos;
+
+  public:
+  ParallelScanCursor(Pgno tbl_root, size_t n_workers);
+
+  public:
+  void close();
+
+  public:
+  bool next();
+
+  /*
+  ** Number of subtrees the table is split into.
+  */
+  public:
+  size_t get_n_subtrees() const { return subtrees.size(); }
+
+  public:
+  virtual ~ParallelScanCursor();
 
   private:
-  bool jump_to_parent_or_finish_traversal();
+  void work();
+  bool push(LeafRows *rows);
+  void stop();
+};
+
+
+/*
+** Progress of the shared scans of a table (see LeafOrderCursor).
+*/
+struct ScanSync {
+  std::atomic<size_t> leaf_idx;  // Leaf the last reporting scan moved to
+  std::atomic<int> n_scans;      // Shared scans in progress
+
+  public:
+  ScanSync() : leaf_idx(0), n_scans(0) {}
+};
+
+
+/*
+** TODO: Move this class to other file so that user cannot see it.
+** Users do not directly use this class.
+**
+** Used to iterate table rows in the physical order of leaves.
+**
+** Leaves are visited in ascending page number order, which is the order
+** of the file, instead of rowid order (see Connection::get_table_leaves()).
+** A file whose pages got shuffled by updates is then read sequentially,
+** and the next LEAF_ORDER_PREFETCH_LEAVES leaves are prefetched ahead.
+** Rows within a leaf are in rowid order.
+**
+** A shared scan (sync is given) starts at the leaf where another shared
+** scan of the table is, if any, reads up to the last leaf and wraps
+** around to the leaves it missed. Concurrent scans then read each page
+** at about the same time, so that one fetch serves them all.
+*/
+class LeafOrderCursor : public RowCursor {
+private:
+  enum {
+    LEAF_ORDER_PREFETCH_LEAVES = 16,
+  };
+
+  Pgno tbl_root;
+  vector<Pgno> leaves;       // Sorted page numbers of leaves
+  size_t leaf_idx;           // Leaf being pointed by next()
+  size_t n_leaves_left;      // Including leaf_idx
+  std::shared_ptr<ScanSync> sync;  // NULL unless shared
+
+  public:
+  LeafOrderCursor(Pgno tbl_root, const vector<Pgno> &leaves,
+                  std::shared_ptr<ScanSync> sync = NULL);
+
+  public:
+  void close();
+
+  public:
+  bool next();
+
+  public:
+  virtual ~LeafOrderCursor();
+
+  private:
+  void point_leaf();
+};
+
+
+/*
+** Used to iterate table rows in the order of a key:
+** an index (IndexCursor) or rowid (RowidCursor).
+*/
+class KeyCursor : public RowCursor {
+
+  /*
+  ** Point the first row in the key order.
+  **
+  ** @return false if the table is empty.
+  */
+  public:
+  virtual bool first() = 0;
+
+  /*
+  ** Point the last row in the key order.
+  **
+  ** @return false if the table is empty.
+  */
+  public:
+  virtual bool last() = 0;
+
+  /*
+  ** Point the previous row in the key order.
+  */
+  public:
+  virtual bool prev() = 0;
+
+  /*
+  ** Point a row by the leading key.size() columns of the key.
+  ** key[j] is compared with the j-th column following its collation
+  ** and order (DESC).
+  **
+  ** @return false if no row is found.
+  */
+  public:
+  virtual bool seek(const vector<KeyValue> &key, seek_mode mode) = 0;
+
+  /*
+  ** Point the next row only if its key equals to the key of the last seek().
+  */
+  public:
+  virtual bool next_same() = 0;
+
+  /*
+  ** Point the previous row only if its key equals to the key of the last
+  ** seek(). Used after SEEK_LAST_EQ.
+  */
+  public:
+  virtual bool prev_same() = 0;
+
+  protected:
+  KeyCursor(Pgno root_pgno) : RowCursor(root_pgno) {}
+};
+
+
+/*
+** Used to iterate table rows in the order of an index.
+**
+** The cursor walks the index B-tree and points the table row of
+** each entry, so that get_*() read table columns.
+*/
+class IndexCursor : public KeyCursor {
+private:
+  IndexDef idx;
+  vector<BtreePathNode> idx_path;  // Path to the current index entry.
+               // child_idx_to_visit of the last node is the cell
+               // of the entry. Others are children being visited
+               // (n_cell means the rightmost child).
+               // Empty when no entry is left.
+  vector<KeyValue> key;      // Key of the last seek()
+  vector<string> key_bufs;   // Owns TEXT and BLOB bytes of key
+  vector<u8> overflow_buf;   // Index record spanning overflow pages
+  Rowid rowid;               // of the current entry
+  bool entries_only;         // Do not point table rows (set_entries_only())
+  vector<KeyValue> entry_values;  // get_entry_values()
+  vector<u8> entry_buf;      // Owns TEXT and BLOB bytes of entry_values
+
+  public:
+  IndexCursor(Pgno tbl_root, const IndexDef &idx);
+
+  public:
+  bool first();
+
+  public:
+  bool last();
+
+  public:
+  bool seek(const vector<KeyValue> &key, seek_mode mode);
+
+  public:
+  bool next();
+
+  public:
+  bool prev();
+
+  public:
+  bool next_same();
+
+  public:
+  bool prev_same();
+
+  public:
+  Rowid get_rowid() const { return rowid; }
+
+  /*
+  ** When on, the cursor walks index entries without pointing their table
+  ** rows: get_rowid() is valid but get_*() must not be called.
+  ** Used to collect rowids first and read rows in rowid order afterwards,
+  ** or to check entries before reading their rows with read_row().
+  */
+  public:
+  void set_entries_only(bool on) { entries_only = on; }
+
+  /*
+  ** Point the table row of the current entry, which set_entries_only()
+  ** skipped.
+  **
+  ** @return false if no entry is pointed or the table has no row of it.
+  */
+  public:
+  bool read_row();
+
+  /*
+  ** Point the table row of rowid, collected earlier from an entry with
+  ** get_rowid(). get_rowid() returns rowid afterwards, while the entry
+  ** stays where it is.
+  **
+  ** @return false if the table has no row of rowid.
+  */
+  public:
+  bool read_row(Rowid rowid);
+
+  /*
+  ** Indexed columns of the current entry, in the order of IndexDef::cols.
+  ** Valid until the cursor moves. Index-only scans read rows from here
+  ** without the table B-tree.
+  **
+  ** @return empty if no entry is pointed.
+  */
+  public:
+  const vector<KeyValue> &get_entry_values();
+
+  public:
+  void close();
+
+  public:
+  virtual ~IndexCursor();
+
+  private:
+  bool descend_leftmost();
+  bool descend_rightmost();
+  bool ascend();
+  bool advance();
+  bool retreat();
+  bool find_entry(seek_mode mode);
+  size_t finger_depth(seek_mode mode);
+  bool load_entry();
+  bool read_ith_entry(const IndexPage &page, Pgsz i, /* out */ RecordCell *cell);
+  int cmp_key(const Payload &payload) const;
+  int cmp_cur_entry();
+};
+
+
+/*
+** Used to iterate table rows in rowid order, which is the order of
+** INTEGER PRIMARY KEY.
+**
+** seek() takes a single value compared with rowids. It descends the
+** table B-tree and next() walks the leaves from there.
+*/
+class RowidCursor : public KeyCursor {
+
+  public:
+  RowidCursor(Pgno tbl_root);
+
+  public:
+  bool first();
+
+  public:
+  bool last();
+
+  public:
+  bool seek(const vector<KeyValue> &key, seek_mode mode);
+
+  public:
+  bool next();
+
+  public:
+  bool prev();
+
+  /*
+  ** Rowids are unique. Always false.
+  */
+  public:
+  bool next_same();
+  public:
+  bool prev_same();
+
+  public:
+  void close();
+
+  public:
+  virtual ~RowidCursor();
+};
+
+
+/*
+** Values of a row decoded by RowPipeline.
+*/
+struct DecodedValue {
+  mysqlite_type type;
+  s64 i;          // MYSQLITE_INTEGER
+  double d;       // MYSQLITE_FLOAT
+  string text;    // MYSQLITE_TEXT and MYSQLITE_BLOB. Its buffer is reused
+                  // by later rows.
+};
+
+struct DecodedRow {
+  Rowid rowid;
+  vector<DecodedValue> values;  // Of RowPipeline's colnos, in that order
+  vector<u64> null_mask;        // Of all columns, as RowCursor::get_null_mask()
+  size_t n_rec_cols;            // Columns in the record
+};
+
+
+/*
+** Runs a RowCursor on a producer thread, which decodes the columns of
+** each row ahead of the caller of next() (the consumer).
+**
+** Rows are passed through a ring of ROW_PIPELINE_SLOTS slots without
+** locks: only the producer advances tail and only the consumer advances
+** head. A side waiting for the other spins with yield, then sleeps.
+** Slots are reused, so that TEXT buffers are allocated only while they
+** grow.
+**
+** The cursor must not be used by others until the pipeline is deleted.
+** Read lock must be held by the caller meanwhile.
+*/
+class RowPipeline {
+private:
+  enum {
+    ROW_PIPELINE_SLOTS = 256,   // Power of 2
+  };
+
+  RowCursor *rows;
+  vector<int> colnos;
+  vector<DecodedRow> slots;
+  std::atomic<size_t> head;     // Next slot to consume
+  std::atomic<size_t> tail;     // Next slot to produce
+  std::atomic<bool> done;       // Producer has no more rows
+  std::atomic<bool> stopping;   // Destructor asks producer to quit
+  bool holding;                 // Consumer is reading slots[head]
+  std::thread producer;
+
+  /*
+  ** Start the producer.
+  **
+  ** @param colnos  Columns to decode. Rowid is always decoded.
+  */
+  public:
+  RowPipeline(RowCursor *rows, const vector<int> &colnos);
+
+  /*
+  ** The next row. The previous one is released.
+  **
+  ** @return NULL if no row is left. Otherwise valid until the next call.
+  */
+  public:
+  const DecodedRow *next();
+
+  /*
+  ** Stop the producer. Rows it has decoded are discarded, and the
+  ** cursor points one of them or after them.
+  */
+  public:
+  ~RowPipeline();
+
+  private:
+  void produce();
+  void decode(DecodedRow *row);
+
+  private:
+  RowPipeline(const RowPipeline &);
+  RowPipeline &operator=(const RowPipeline &);
 };
 
 
@@ -91,26 +790,71 @@ class FullscanCursor : public RowCursor {
 */
 class Connection {
 private:
+  struct TableLeaves {
+    u32 file_change_counter;   // When leaves were collected
+    vector<Pgno> leaves;
+    std::shared_ptr<ScanSync> sync;  // Shared scans of the leaves
+  };
+  struct CatalogIndex {
+    string name;
+    Pgno root_pgno;
+    string sql;   // Empty for sqlite_autoindex_*
+  };
+  struct CatalogTable {
+    Pgno root_pgno;
+    string sql;
+    vector<CatalogIndex> indexes;
+    bool parsed;        // def and parse_res are set at the first
+    errstat parse_res;  // get_table_def()
+    TableDef def;
+  };
+
   unsigned int refcnt_rdlock_db;
   FILE *f_db;   // TODO: handler socket とかからMAIIなファイルオブジェクトパクる
+  std::mutex leaves_mutex;   // Protects leaves_cache
+  std::map<Pgno, TableLeaves> leaves_cache;  // Key is root pgno of a table
+  std::mutex catalog_mutex;  // Protects catalog*
+  bool catalog_loaded;
+  u32 catalog_cookie;        // Schema cookie when catalog was loaded
+  std::unordered_map<string, CatalogTable> catalog;  // Key is table name
 
   public:
   Connection()
     : refcnt_rdlock_db(0),
-      f_db(NULL)
+      f_db(NULL),
+      catalog_loaded(false),
+      catalog_cookie(0)
   {}
 
   /*
   ** Open a connection to a db
   **
+  ** @param access  DB_READ_ONLY or DB_IMMUTABLE to open db_path read-only.
+  **   DB_IMMUTABLE also skips file locks (rdlock_db() etc. are no-ops).
+  ** @param strategy  How to read pages (mmap or buffer pool).
+  **
   ** @note
   ** Connection::close() must be used afterwards.
   */
   public:
-  errstat open(const char * const db_path);
+  errstat open(const char * const db_path, db_access access = DB_READ_WRITE,
+               pcache_strategy strategy = PCACHE_MMAP);
 
   public:
   bool is_opened() const;
+  public:
+  bool is_read_only() const;
+  public:
+  bool is_immutable() const;
+  public:
+  pcache_strategy get_pcache_strategy() const;
+
+  /*
+  ** Changes whenever any process changes the schema. Read lock must be
+  ** held.
+  */
+  public:
+  u32 get_schema_cookie() const;
 
   /*
   ** Close connection
@@ -127,26 +871,192 @@ private:
   private:
   RowCursor *table_fullscan(Pgno tbl_root);
 
+  /*
+  ** Fullscan table by n_workers threads (see ParallelScanCursor).
+  ** Read lock must be held until retval is closed.
+  ** retval must call RowCursor::close()
+  */
+  public:
+  RowCursor *table_parallel_scan(const TableDef &tbl, size_t n_workers);
+
+  /*
+  ** Fullscan table leaf by leaf in page number order (see LeafOrderCursor).
+  ** Read lock must be held until retval is closed.
+  ** retval must call RowCursor::close()
+  */
+  public:
+  RowCursor *table_leaf_order_scan(const TableDef &tbl);
+
+  /*
+  ** Fullscan table joining other shared scans of it (see LeafOrderCursor).
+  ** Rows are in no particular order.
+  ** Read lock must be held until retval is closed.
+  ** retval must call RowCursor::close()
+  */
+  public:
+  RowCursor *table_shared_scan(const TableDef &tbl);
+
+  /*
+  ** Page numbers of the leaves of a table in ascending order.
+  ** Read lock must be held.
+  **
+  ** They are collected from interior pages only; a leaf is never read
+  ** except the leftmost, which tells the height of the B-tree. The list
+  ** is cached per table until the file change counter changes, since
+  ** any write may split or merge leaves.
+  */
+  public:
+  vector<Pgno> get_table_leaves(const TableDef &tbl);
+  private:
+  void get_table_leaves(const TableDef &tbl,
+                        /* out */
+                        vector<Pgno> *leaves,
+                        std::shared_ptr<ScanSync> *sync);
+
+  /*
+  ** Read schema of a table and its indexes from sqlite_master.
+  ** Read lock must be held.
+  **
+  ** sqlite_master is read into a catalog of the tables once, and again
+  ** only after the schema cookie changes. DDL of a table is parsed at
+  ** the first call for it.
+  **
+  ** @returns MYSQLITE_OK, MYSQLITE_NO_SUCH_TABLE or MYSQLITE_CORRUPT_DB
+  **   (DDL not parsable).
+  */
+  public:
+  errstat get_table_def(const char * const table,
+                        /* out */
+                        TableDef *tbl);
+
+  /*
+  ** Catalog entry of table, after the catalog is reloaded if the schema
+  ** changed. catalog_mutex and read lock must be held.
+  **
+  ** @return NULL if no such table.
+  */
+  private:
+  CatalogTable *find_catalog_table(const char * const table);
+  private:
+  void load_catalog();
+
+  /*
+  ** Parse DDL of a table and its indexes as sqlite_master has them.
+  */
+  private:
+  static errstat parse_table_def(const CatalogTable &entry,
+                                 /* out */
+                                 TableDef *tbl);
+
+  /*
+  ** Scan table rows in the order of idx.
+  ** retval must call RowCursor::close()
+  **
+  ** @return NULL if idx is not usable.
+  */
+  public:
+  IndexCursor *index_scan(const TableDef &tbl, const IndexDef &idx);
+
+  /*
+  ** Scan table rows in rowid order.
+  ** retval must call RowCursor::close()
+  **
+  ** @return NULL for WITHOUT ROWID tables.
+  */
+  public:
+  RowidCursor *rowid_scan(const TableDef &tbl);
+
+  /*
+  ** Estimate the number of rows whose rowid is in [min_rowid, max_rowid]
+  ** from rowids of table interior cells (separators). Read lock must be
+  ** held.
+  **
+  ** Pages are read only down to where the range spans several children.
+  ** Ranges within a leaf are counted exactly.
+  */
+  public:
+  u64 estimate_rowid_range(const TableDef &tbl, s64 min_rowid, s64 max_rowid);
+
+  /*
+  ** Ask the page cache to read ahead the leaves holding rowids, so that
+  ** following RowCursor::seek_rowid()s of them do not wait for I/O one
+  ** by one. Read lock must be held.
+  **
+  ** rowids must be sorted (as signed integers). They are grouped by
+  ** child in one descent of the table B-tree: every interior page on
+  ** the way is read once, and all the children of a page are prefetched
+  ** before the first of them is read.
+  **
+  ** @return the number of distinct leaves rowids fall in.
+  */
+  public:
+  u64 prefetch_rowids(const TableDef &tbl, const vector<Rowid> &rowids);
+
+  /*
+  ** Exact number of rows in a table: the sum of the numbers of cells of
+  ** its leaves. Only page headers and interior cells are read, never
+  ** records. Read lock must be held.
+  */
+  public:
+  u64 count_rows(const TableDef &tbl);
+
   /*
     Read lock to SQLite DB file.
     Thread safe functions.
 
-    @returns HA_*
+    @param timeout_usec  Give up after this time. 0 means waiting forever.
+
+    @returns MYSQLITE_OK, MYSQLITE_LOCK_TIMEOUT or MYSQLITE_IO_ERR
    */
   public:
-  int rdlock_db();
+  errstat rdlock_db(u64 timeout_usec = 0);
+
+  /*
+    Upgrade read lock to write lock.
+    Thread safe functions.
+
+    @returns MYSQLITE_OK, MYSQLITE_LOCK_TIMEOUT, MYSQLITE_IO_ERR or
+      MYSQLITE_READONLY
+   */
+  public:
+  errstat upgrade_lock_db(u64 timeout_usec = 0);
 
   /*
     Unlock to SQLite DB file.
     Thread safe functions.
 
-    @returns HA_*
+    @returns MYSQLITE_OK
    */
   public:
-  int unlock_db();
+  errstat unlock_db();
 };
 
 
+
+/***********************************************************************
+** Functions
+***********************************************************************/
+
+/*
+** Compare a record column with a key value as SQLite does:
+** NULL < INTEGER and FLOAT (numerically) < TEXT (by coll) < BLOB (memcmp).
+**
+** @return negative, 0 or positive if rec is less than, equal to or
+**   greater than key.
+*/
+int compare_key_value(const KeyValue &rec, const KeyValue &key, sqlite_collation coll);
+
+/*
+** Column colno of a record as KeyValue. TEXT and BLOB point into payload.
+*/
+KeyValue record_value(const Payload &payload, int colno);
+
+/*
+** Whether p is well-formed UTF-8 of at most max_chars characters, each of
+** at most max_char_len bytes.
+*/
+bool utf8_fits(const u8 *p, u64 len, u64 max_chars, u32 max_char_len);
+
 }
 
 
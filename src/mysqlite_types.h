@@ -22,6 +22,9 @@
 #define DBHDR_FCC_OFFSET 24
 #define DBHDR_FCC_LEN 4
 
+#define DBHDR_SCHEMA_COOKIE_OFFSET 40
+#define DBHDR_SCHEMA_COOKIE_LEN 4
+
 #define PAGE_MIN_SZ 512
 #define PAGE_MAX_SZ 65536
 
@@ -99,8 +102,30 @@ enum errstat {
   MYSQLITE_CONNECTION_ALREADY_OPEN,
   MYSQLITE_FLOCK_NEEDED,
   MYSQLITE_CANNOT_OPEN_DB_FILE,
+  MYSQLITE_LOCK_TIMEOUT,
+  MYSQLITE_READONLY,
 };
 
+/*
+  How to open a SQLite DB file.
+
+  @see http://www.sqlite.org/uri.html ('immutable' query parameter)
+*/
+typedef enum db_access {
+  DB_READ_WRITE = 0,
+  DB_READ_ONLY,   // Opened O_RDONLY and mapped PROT_READ. Still locked since other processes may write.
+  DB_IMMUTABLE,   // DB_READ_ONLY, and the file never changes. No file locks at all.
+} db_access;
+
+/*
+  How PageCache reads pages of a SQLite DB file.
+*/
+typedef enum pcache_strategy {
+  PCACHE_MMAP = 0,  // Map whole file (PageCacheMmap)
+  PCACHE_PREAD,     // Buffer pool filled by pread(2) (PageCacheMalloc)
+  PCACHE_MMAP_WINDOW,  // Map fixed size chunks on demand (PageCacheMmapWindow)
+} pcache_strategy;
+
 /*
   SQLite internal types
 */
@@ -130,6 +155,17 @@ typedef enum sqlite_type {
   ST_TEXT,   /* >= 13, odd  */
 } sqlite_type;
 
+/*
+  Built-in collating sequences of SQLite.
+
+  @see http://www.sqlite.org/datatype3.html#collation
+*/
+typedef enum sqlite_collation {
+  COLL_BINARY = 0,  // memcmp()
+  COLL_NOCASE,      // ASCII case-insensitive
+  COLL_RTRIM,       // BINARY ignoring trailing spaces
+} sqlite_collation;
+
 static inline mysqlite_type sqlite_type_to_mysqlite_type(sqlite_type st)
 {
   switch (st) {
@@ -141,10 +177,9 @@ static inline mysqlite_type sqlite_type_to_mysqlite_type(sqlite_type st)
   case ST_INT16:
   case ST_INT24:
   case ST_INT32:
-    return MYSQLITE_INTEGER;
   case ST_INT48:
   case ST_INT64:
-    abort();  // TODO: support 64bit column int value.
+    return MYSQLITE_INTEGER;
   case ST_FLOAT:
     return MYSQLITE_FLOAT;
   case ST_BLOB:
@@ -0,0 +1,217 @@
+#include <fcntl.h>
+#include <cerrno>
+#include <string.h>
+
+#include "pcache.h"
+#include "mysqlite_config.h"
+
+
+/***********************************************************************
+ ** PageCache class
+ ***********************************************************************/
+PageCache::PageCache()
+  : sqlite_db(), backend(), lock_state(UNLOCKED), n_reader(0),
+    access(DB_READ_WRITE), strategy(PCACHE_MMAP)
+{
+}
+
+PageCache::~PageCache()
+{
+}
+
+errstat PageCache::open(const char * const path, db_access access,
+                        pcache_strategy strategy)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+
+  assert(!is_opened());  // TODO: support 2 or more DB open
+  sqlite_db.reset(new SqliteDb(path, access != DB_READ_WRITE));
+
+  if (sqlite_db->mode() == SqliteDb::FAIL) {
+    return MYSQLITE_CANNOT_OPEN_DB_FILE;
+  }
+
+  switch (strategy) {
+  case PCACHE_MMAP:
+    backend.reset(new PageCacheMmap());
+    break;
+  case PCACHE_PREAD:
+    backend.reset(new PageCacheMalloc(MYSQLITE_PCACHE_SZ));
+    break;
+  case PCACHE_MMAP_WINDOW:
+    backend.reset(new PageCacheMmapWindow(MYSQLITE_MMAP_CHUNK_SZ,
+                                          max<u64>(MYSQLITE_PCACHE_SZ / MYSQLITE_MMAP_CHUNK_SZ, 1)));
+    break;
+  default:
+    abort();
+  }
+  errstat res = backend->open(*sqlite_db, access);
+  if (res != MYSQLITE_OK) {
+    backend.reset();
+    sqlite_db.reset();
+    return res;
+  }
+  this->access = access;
+  this->strategy = strategy;
+
+  // Nobody writes to an immutable DB. Regard it as always read-locked.
+  if (access == DB_IMMUTABLE) lock_state = RD_LOCKED;
+
+  return MYSQLITE_OK;
+}
+
+void PageCache::close()
+{
+  std::lock_guard<std::mutex> lock(mutex);
+
+  assert(is_opened());
+  backend->close();
+  backend.reset();
+  if (access == DB_IMMUTABLE) lock_state = UNLOCKED;
+  access = DB_READ_WRITE;
+  sqlite_db.reset();  // TODO: そもそもこんなの書かないで済むようにするためのRAII．
+                     // pcache自体がRAIIじゃないとうまみがない
+}
+
+bool PageCache::is_opened() const
+{
+  return sqlite_db && sqlite_db->mode() != SqliteDb::FAIL;
+}
+
+bool PageCache::is_read_only() const
+{
+  return access != DB_READ_WRITE;
+}
+
+bool PageCache::is_immutable() const
+{
+  return access == DB_IMMUTABLE;
+}
+
+pcache_strategy PageCache::get_strategy() const
+{
+  return strategy;
+}
+
+u8 * PageCache::fetch(Pgno pgno)
+{
+  my_assert(pgno >= 1);
+  my_assert(is_rd_locked() || is_wr_locked());
+  return backend->fetch(pgno);
+}
+
+void PageCache::prefetch(Pgno pgno)
+{
+  my_assert(pgno >= 1);
+  my_assert(is_rd_locked() || is_wr_locked());
+  backend->prefetch(pgno);
+}
+
+void PageCache::release(Pgno pgno)
+{
+  if (!backend) return;  // Page object outlived close()
+  backend->release(pgno);
+}
+
+/**
+ * Set fcntl() lock on whole DB file.
+ *
+ * Without timeout, F_SETLKW blocks until the lock is acquired.
+ * With timeout, F_SETLK is retried with exponential backoff (at most 10ms)
+ * until timeout_usec passes. Both are retried when a signal interrupts
+ * them.
+ *
+ * @return MYSQLITE_OK, MYSQLITE_LOCK_TIMEOUT, or MYSQLITE_IO_ERR if fcntl()
+ *   fails otherwise (ENOLCK, EDEADLK ...).
+ */
+static errstat set_flock(int fd, short type, u64 timeout_usec)
+{
+  struct flock flock;
+  flock.l_whence = SEEK_SET;
+  flock.l_start = 0;
+  flock.l_len = 0;
+  flock.l_type = type;
+
+  if (timeout_usec == 0) {
+    while (fcntl(fd, F_SETLKW, &flock) != 0) {
+      if (errno != EINTR) {
+        log_msg("fcntl(F_SETLKW) failed: %s\n", strerror(errno));
+        return MYSQLITE_IO_ERR;
+      }
+    }
+    return MYSQLITE_OK;
+  }
+
+  u64 deadline = mysqlite_now_usec() + timeout_usec;
+  for (u64 backoff_usec = 100; ; backoff_usec = min<u64>(backoff_usec * 2, 10000)) {
+    if (fcntl(fd, F_SETLK, &flock) == 0) return MYSQLITE_OK;
+    if (errno != EACCES && errno != EAGAIN && errno != EINTR) {
+      log_msg("fcntl(F_SETLK) failed: %s\n", strerror(errno));
+      return MYSQLITE_IO_ERR;
+    }
+    u64 now = mysqlite_now_usec();
+    if (now >= deadline) return MYSQLITE_LOCK_TIMEOUT;
+    usleep(min<u64>(backoff_usec, deadline - now));
+  }
+}
+
+/**
+ * Read locks of threads share one fcntl() lock by reference counter.
+ */
+errstat PageCache::rd_lock(u64 timeout_usec)
+{
+  if (is_immutable()) return MYSQLITE_OK;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  if (n_reader == 0) {
+    errstat ret = set_flock(sqlite_db->fd(), F_RDLCK, timeout_usec);
+    if (ret != MYSQLITE_OK) return ret;
+    // The file may have been modified while unlocked
+    backend->revalidate();
+    lock_state = RD_LOCKED;
+  }
+  ++n_reader;
+  return MYSQLITE_OK;
+}
+
+errstat PageCache::upgrade_lock(u64 timeout_usec)
+{
+  assert(is_rd_locked());
+  if (is_read_only()) return MYSQLITE_READONLY;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  errstat ret = set_flock(sqlite_db->fd(), F_WRLCK, timeout_usec);
+  if (ret != MYSQLITE_OK) return ret;
+  lock_state = WR_LOCKED;
+  return MYSQLITE_OK;
+}
+
+void PageCache::unlock()
+{
+  assert(is_rd_locked() || is_wr_locked());
+  if (is_immutable()) return;
+
+  struct flock flock;
+  flock.l_whence = SEEK_SET;
+  flock.l_start = 0;
+  flock.l_len = 0;
+  flock.l_type = F_UNLCK;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  --n_reader;
+  if (n_reader == 0) {
+    // fcntl() locks are per process. Release it after the last reader.
+    fcntl(sqlite_db->fd(), F_SETLKW, &flock);
+    lock_state = UNLOCKED;
+  }
+}
+
+bool PageCache::is_rd_locked() const
+{
+  return lock_state == PageCache::RD_LOCKED;
+}
+
+bool PageCache::is_wr_locked() const
+{
+  return lock_state == PageCache::WR_LOCKED;
+}
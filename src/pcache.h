@@ -2,11 +2,114 @@
 #define _PCACHE_H_
 
 
-#if MYSQLITE_USE_MMAP
+#if (__GNUC__ >= 4 && __GNUC_MINOR__ >= 5)  // See: http://www.mail-archive.com/gcc-bugs@gcc.gnu.org/msg270025.html
+#include <memory>
+#else // (gcc < 4.5)
+#include <bits/unique_ptr.h>
+#endif
+
+#include <mutex>
+
+#include "mysqlite_types.h"
+#include "utils.h"
+#include "pcache_backend.h"
 #include "pcache_mmap.h"
-#else
+#include "pcache_mmap_window.h"
 #include "pcache_malloc.h"
-#endif
+
+
+/**
+ * PageCache
+ *
+ * Owns a SQLite DB file and its fcntl() locks.
+ * Page contents are provided by a backend chosen on open() (see pcache_strategy).
+ */
+class PageCache {
+private:
+  std::unique_ptr<SqliteDb> sqlite_db;
+  std::unique_ptr<PageCacheBackend> backend;
+  enum {
+    UNLOCKED,
+    RD_LOCKED,
+    WR_LOCKED,
+  } lock_state;
+  int n_reader;  // reference counter for read locks
+  db_access access;
+  pcache_strategy strategy;
+  std::mutex mutex;
+
+  public:
+  static PageCache *get_instance() {
+    static PageCache instance;
+    return &instance;
+  }
+
+  /**
+   * Initialization
+   *
+   * Called when new SQLite DB is attached
+   *
+   * @param access  DB_READ_ONLY and DB_IMMUTABLE map the file PROT_READ.
+   *   DB_IMMUTABLE also skips all fcntl() locks: the DB is regarded as
+   *   read-locked from open() to close().
+   * @param strategy  How to read pages.
+   */
+  public:
+  errstat open(const char * const path, db_access access = DB_READ_WRITE,
+               pcache_strategy strategy = PCACHE_MMAP);
+  void close();
+  bool is_opened() const;
+  bool is_read_only() const;
+  bool is_immutable() const;
+  pcache_strategy get_strategy() const;
+
+  /**
+   * Fetch a page.
+   * Locks must be held before reading/writing to returned pointer.
+   *
+   * The page is pinned on the cache until release(pgno) is called.
+   * Page class does it automatically.
+   *
+   * @return pointer to page contents. NULL on I/O error.
+   */
+  public:
+  u8 *fetch(Pgno pgno);
+  void release(Pgno pgno);
+
+  /**
+   * Hint that pgno will be fetched soon. Returns without waiting for I/O.
+   */
+  public:
+  void prefetch(Pgno pgno);
+
+  /**
+   * Locks
+   *
+   * @param timeout_usec  Give up acquiring fcntl() lock after this time.
+   *   0 means waiting forever.
+   *
+   * @return MYSQLITE_LOCK_TIMEOUT if timeout_usec has passed before the lock
+   *   is acquired.
+   *   MYSQLITE_IO_ERR if fcntl() fails for another reason.
+   *   MYSQLITE_READONLY if upgrade_lock() is called for a read-only DB.
+   *
+   * For an immutable DB, these are no-ops and do not take any mutex.
+   */
+  public:
+  errstat rd_lock(u64 timeout_usec = 0);
+  errstat upgrade_lock(u64 timeout_usec = 0);  // rd_lock -> wr_lock
+  void unlock();
+  bool is_rd_locked() const;
+  bool is_wr_locked() const;
+
+  public:
+  PageCache();
+  ~PageCache();
+
+  private:
+  PageCache(const PageCache&);
+  PageCache& operator=(const PageCache&);
+};
 
 
 #endif /* _PCACHE_H_ */
@@ -0,0 +1,57 @@
+#ifndef _PCACHE_BACKEND_H_
+#define _PCACHE_BACKEND_H_
+
+
+#include "mysqlite_types.h"
+#include "utils.h"
+
+
+/**
+ * I/O strategy of PageCache.
+ *
+ * PageCache (pcache.h) owns a DB file and its locks, and asks one of
+ * PageCacheBackend implementations for page contents.
+ * Backend is chosen per DB file on PageCache::open() (see pcache_strategy).
+ */
+class PageCacheBackend {
+  /**
+   * Called after db is opened.
+   *
+   * @return MYSQLITE_OK or MYSQLITE_IO_ERR, MYSQLITE_OUT_OF_MEMORY
+   */
+  public:
+  virtual errstat open(const SqliteDb &db, db_access access) = 0;
+  virtual void close() = 0;
+
+  /**
+   * Pointer to page contents.
+   *
+   * The page is pinned until release(pgno) is called: backends must
+   * not reuse its memory for another page in between.
+   * Each fetch() must be paired with a release().
+   */
+  public:
+  virtual u8 *fetch(Pgno pgno) = 0;
+  virtual void release(Pgno pgno) = 0;
+
+  /**
+   * Called when the DB file is locked by this process after it has been
+   * unlocked for a while, so that other processes might have modified it.
+   * Backends which copy pages must drop stale ones here.
+   */
+  public:
+  virtual void revalidate() = 0;
+
+  /**
+   * Hint that pgno will be fetched soon, so that its read can overlap
+   * with other work. Never blocks on I/O.
+   */
+  public:
+  virtual void prefetch(Pgno pgno) = 0;
+
+  public:
+  virtual ~PageCacheBackend() {}
+};
+
+
+#endif /* _PCACHE_BACKEND_H_ */
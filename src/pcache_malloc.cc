@@ -1,35 +1,174 @@
+#include <fcntl.h>
+#include <cerrno>
+
 #include "pcache_malloc.h"
-#include "sqlite_format.h"
 
 
 /***********************************************************************
- ** PageCache class
+ ** PageCacheMalloc class
  ***********************************************************************/
-errstat PageCache::refresh(FILE *f_db)  // TODO: MAIIなファイルオブジェクト
+PageCacheMalloc::PageCacheMalloc(u64 pcache_sz)
+  : pcache_sz(pcache_sz), pgsz(0), fd(-1), the_cache(NULL),
+    clock_hand(0), file_change_counter(0)
 {
-  assert(f_db);
-  if (this->f_db && this->f_db != f_db) {
-    // fclose(this->f_db);  // TODO: fclose()するとdouble freeになる．
-                            // TODO: refresh()ってのを呼ばないとcloseされないのってそもそもどうなの
-  }
-  this->f_db = f_db;
+}
+
+PageCacheMalloc::~PageCacheMalloc()
+{
+  if (the_cache) close();
+}
 
-  errstat res = MYSQLITE_OK;
+static u32 read_file_change_counter(int fd)
+{
+  u8 fcc[DBHDR_FCC_LEN];
+  if (pread(fd, fcc, DBHDR_FCC_LEN, DBHDR_FCC_OFFSET) != DBHDR_FCC_LEN) return 0;
+  return u8s_to_val<u32>(fcc, DBHDR_FCC_LEN);
+}
+
+errstat PageCacheMalloc::open(const SqliteDb &db, db_access access)
+{
+  fd = db.fd();
 
   // Check page size of db_path.
-  // Note that pcache(0) does not have page#1 data yet.
-  // Directly read DB file.
+  // Note that no page is on the pool yet. Directly read DB file.
   u8 pgsz_data[DBHDR_PGSZ_LEN];
-  mysqlite_fread(pgsz_data, DBHDR_PGSZ_OFFSET, DBHDR_PGSZ_LEN, f_db);
+  if (pread(fd, pgsz_data, DBHDR_PGSZ_LEN, DBHDR_PGSZ_OFFSET) != DBHDR_PGSZ_LEN)
+    return MYSQLITE_IO_ERR;
   pgsz = u8s_to_val<Pgsz>(pgsz_data, DBHDR_PGSZ_LEN);
 
-  // 0-fill memory
-  n_pg = (pcache_sz / pgsz) + 1;
-  memset(pcache_idx, 0, pcache_idx_sz());
+  // No need to have more frames than pages
+  u64 n = min<u64>(pcache_sz / pgsz, db.file_size() / pgsz);
+  n = max<u64>(n, PCACHE_MIN_FRAMES);
+  the_cache = new (std::nothrow) u8[n * pgsz];  // TODO: more sophisticated mem allocation
+                                                // (see InnoDB's ut_malloc())
+  if (!the_cache) return MYSQLITE_OUT_OF_MEMORY;
+  Frame empty = {0, 0, false};
+  frames.assign(n, empty);
+  frame_of.clear();
+  clock_hand = 0;
+
+  // Put DB page#1 onto frames[0], pinned forever
+  errstat res = read_page(0, SQLITE_MASTER_ROOTPGNO);
+  if (res != MYSQLITE_OK) return res;
+  frames[0].n_pin = 1;
+  file_change_counter = u8s_to_val<u32>(&frame_data(0)[DBHDR_FCC_OFFSET], DBHDR_FCC_LEN);
 
-  // Put DB page#1 onto pcache(0)
-  pcache_idx[0] = SQLITE_MASTER_ROOTPGNO;
-  mysqlite_fread(&the_cache[0], 0, pgsz, f_db);
+  return MYSQLITE_OK;
+}
+
+void PageCacheMalloc::close()
+{
+  delete [] the_cache;
+  the_cache = NULL;
+  frames.clear();
+  frame_of.clear();
+  fd = -1;
+}
+
+/*
+** Read page#pgno into frames[i]. mutex must be held.
+**
+** TODO: pread(2) under the mutex serializes cache misses.
+*/
+errstat PageCacheMalloc::read_page(u32 i, Pgno pgno)
+{
+  ssize_t n = pread(fd, frame_data(i), pgsz, (off_t)pgsz * (pgno - 1));
+  if (n != pgsz) {
+    char err[256];
+    log_msg("pread() fails for page#%u. %s\n", pgno,
+            n < 0 ? strerror_r(errno, err, 256) : "Short read");
+    return MYSQLITE_IO_ERR;
+  }
+  if (frames[i].pgno) frame_of.erase(frames[i].pgno);
+  frames[i].pgno = pgno;
+  frames[i].n_pin = 0;
+  frames[i].referenced = true;
+  frame_of[pgno] = i;
+  return MYSQLITE_OK;
+}
+
+/*
+** CLOCK. Returns n_frames() if all frames are pinned. mutex must be held.
+*/
+u32 PageCacheMalloc::find_victim()
+{
+  for (u32 step = 0; step < 2 * n_frames(); ++step) {
+    u32 i = clock_hand;
+    clock_hand = (clock_hand + 1) % n_frames();
+    Frame &f = frames[i];
+    if (f.n_pin > 0) continue;
+    if (!f.referenced) return i;
+    f.referenced = false;
+  }
+  return n_frames();
+}
 
-  return res;
+u8 *PageCacheMalloc::fetch(Pgno pgno)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+
+  std::unordered_map<Pgno, u32>::const_iterator it = frame_of.find(pgno);
+  if (it != frame_of.end()) {
+    // Page#pgno is already on cache
+    Frame &f = frames[it->second];
+    ++f.n_pin;
+    f.referenced = true;
+    return frame_data(it->second);
+  }
+
+  // Page#pgno should be read(2) from DB file
+  // TODO: cache eviction algorithm is necessary after writing support.
+  // TODO: currently just overwrite the cache page without checking if the page is dirty.
+  u32 i = find_victim();
+  if (i == n_frames()) {
+    log_msg("All of %u page cache frames are pinned\n", n_frames());
+    return NULL;
+  }
+  if (read_page(i, pgno) != MYSQLITE_OK) return NULL;
+  frames[i].n_pin = 1;
+  return frame_data(i);
+}
+
+void PageCacheMalloc::release(Pgno pgno)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+
+  std::unordered_map<Pgno, u32>::const_iterator it = frame_of.find(pgno);
+  my_assert(it != frame_of.end());
+  Frame &f = frames[it->second];
+  my_assert(f.n_pin > 0);
+  --f.n_pin;
+}
+
+void PageCacheMalloc::revalidate()
+{
+  std::lock_guard<std::mutex> lock(mutex);
+
+  u32 fcc = read_file_change_counter(fd);
+  if (fcc == file_change_counter) return;
+
+  // Other process has modified DB file. Drop all pages but page#1,
+  // which is re-read in place.
+  for (u32 i = 1; i < n_frames(); ++i) {
+    assert(frames[i].n_pin == 0);  // No page is used while unlocked
+    if (frames[i].pgno) frame_of.erase(frames[i].pgno);
+    frames[i].pgno = 0;
+    frames[i].referenced = false;
+  }
+  if (read_page(0, SQLITE_MASTER_ROOTPGNO) == MYSQLITE_OK) {
+    frames[0].n_pin = 1;
+    file_change_counter = fcc;
+  }
+}
+
+void PageCacheMalloc::prefetch(Pgno pgno)
+{
+  if (is_cached(pgno)) return;
+  posix_fadvise(fd, (off_t)pgsz * (pgno - 1), pgsz, POSIX_FADV_WILLNEED);
+}
+
+bool PageCacheMalloc::is_cached(Pgno pgno)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  return frame_of.find(pgno) != frame_of.end();
 }
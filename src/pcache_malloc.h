@@ -2,129 +2,96 @@
 #define _PCACHE_MALLOC_H_
 
 
+#include <mutex>
+#include <unordered_map>
+
 #include "mysqlite_types.h"
 #include "utils.h"
+#include "pcache_backend.h"
 
 
-#define PCACHE_MIN_SZ PAGE_MAX_SZ
+// Lower bound of the number of frames.
+// Pages pinned at the same time (B-tree depth x concurrent cursors) must fit.
+#define PCACHE_MIN_FRAMES 64
 
 
 /**
  * PageCache by malloc
+ *
+ * Buffer pool of pages read by pread(2).
+ * Used for DB files which should not be mapped, e.g. cold archives much
+ * larger than memory. Only up to pcache_sz bytes of pages are kept and
+ * unpinned pages are evicted by CLOCK.
+ *
+ * Page#1 (DB header) is always on the pool.
  */
-class PageCacheMalloc : public PageCache {
+class PageCacheMalloc : public PageCacheBackend {
 private:
-  u64 pcache_sz;  // unique to a mysqld process
-  Pgno n_pg;      // (pcache_sz / pgsze) + 1
-  Pgsz pgsz;      // decided by each SQLite DB file
-  u8 *the_cache;  // unique to a mysqld process
-  Pgno *pcache_idx;  // Uneque to a mysqld process.
-                     // pcache_idx[i] == j means page#j of SQLite DB
-                     // is on pcache(i).
-                     // pcache_idx[0] == 1 always suffices.
-                     // TODO: compression
-  FILE *f_db;
-
-  /**
-   * Initialization
-   *
-   * Called when new SQLite DB is attached
-   */
-  public:
-  errstat refresh(FILE *f_db);
+  struct Frame {
+    Pgno pgno;        // 0 if the frame is empty
+    u32 n_pin;
+    bool referenced;  // CLOCK reference bit
+  };
+
+  u64 pcache_sz;
+  Pgsz pgsz;        // decided by each SQLite DB file
+  int fd;
+  u8 *the_cache;    // n_frames() * pgsz bytes
+  vector<Frame> frames;
+  std::unordered_map<Pgno, u32> frame_of;  // pgno -> index of frames
+  u32 clock_hand;
+  u32 file_change_counter;  // of page#1 on the pool
+  std::mutex mutex;
 
   /**
-   * Allocate heap
-   *
-   * Called when mysqld and MySQLite have started.
+   * @param pcache_sz  Max bytes of pages to cache.
    */
   public:
-  void alloc(u64 pcache_sz) {
-    my_assert(PCACHE_MIN_SZ <= pcache_sz);
-    this->pcache_sz = pcache_sz;
-    the_cache = new u8[pcache_sz + pcache_idx_sz()]; // TODO: more sophisticated mem allocation
-                                                     // (see InnoDB's ut_malloc())
-    pcache_idx = (Pgno *)(the_cache + pcache_sz);
-  }
+  PageCacheMalloc(u64 pcache_sz);
+  ~PageCacheMalloc();
 
-  /**
-   * Free heap
-   *
-   * Called when MySQLite and mysqld end.
-   */
   public:
-  void free() {
-    if (f_db) {
-      fclose(f_db);
-      f_db = NULL;
-    }
-    delete [] the_cache;
-  }
-
-  /**
-   * The number of elements of the_cache is "(pcache_sz / 512) + 1"
-   * since 512 is the least page size of SQLite.
-   * Therefore, len(pcache_idx) >= n_pg always suffices.
-   */
-  private:
-  u64 pcache_idx_sz() const {
-    return sizeof(Pgno) * ((pcache_sz / PAGE_MIN_SZ) + 1);
-  }
+  errstat open(const SqliteDb &db, db_access access);
+  void close();
 
   /**
    * Fetch page
    *
    * If the specified page is on the page cache, it is returned.
    * Otherwise, the page is read from DB file onto page cache and it is returned.
+   *
+   * @return NULL if all frames are pinned or pread(2) fails.
    */
   public:
-  u8 *fetch(Pgno pgno) const {
-    my_assert(pgno >= 1);
-    my_assert(is_ready());
-
-    Pgno pcno = pgno_to_pcacheno(pgno);
-    if (pgno == pcache_idx[pcno]) {
-      // Page#pgno is already on cache
-      return &the_cache[pcno * pgsz];
-    }
-    else {
-      // Page#pgno should be read(2) from DB file
-      // TODO: cache eviction algorithm is necessary after writing support.
-      // TODO: currently just overwrite the cache page without checking if the page is dirty.
-      // TODO: now only read from file, and doesn't cache it on pcache.
-      my_assert(f_db);
-      errstat res = mysqlite_fread(&the_cache[pcno * pgsz], (pgno - 1) * pgsz, pgsz, f_db);
-      my_assert(res == MYSQLITE_OK);
-      pcache_idx[pcno] = pgno;
-      return &the_cache[pcno * pgsz];
-    }
-  }
+  u8 *fetch(Pgno pgno);
+  void release(Pgno pgno);
 
   /**
-   * Whether page cache is ready to use
+   * Drop all pages when the file change counter has changed.
    */
- public:
-  bool is_ready() const {
-    return f_db != NULL;
-  }
+  public:
+  void revalidate();
 
   /**
-   * Hash function to map SQLite DB page number -> pcache number
+   * posix_fadvise(POSIX_FADV_WILLNEED) unless the page is on the pool,
+   * so that the pread(2) of a later fetch() finds it in the OS page cache.
    */
+  public:
+  void prefetch(Pgno pgno);
+
+  public:
+  u32 n_frames() const { return frames.size(); }
+  bool is_cached(Pgno pgno);
+
   private:
-  Pgno pgno_to_pcacheno(Pgno pgno) const {
-    if (pgno == 1) return 0;  // page#1 should be always on pcache
-    return 1 + (pgno - 2) % n_pg;
-  }
+  u8 *frame_data(u32 i) const { return &the_cache[(size_t)i * pgsz]; }
+  errstat read_page(u32 i, Pgno pgno);
+  u32 find_victim();
 
 private:
-  // Prohibit any way to create instance from outsiders
-  PageCache()
-   : pcache_sz(0), n_pg(0), pgsz(0),
-    the_cache(NULL), pcache_idx(NULL), f_db(NULL)
-    {}
-  PageCache(const PageCache&);
-  PageCache& operator=(const PageCache&);
+  PageCacheMalloc();
+  PageCacheMalloc(const PageCacheMalloc&);
+  PageCacheMalloc& operator=(const PageCacheMalloc&);
 };
 
 
@@ -1,35 +1,36 @@
 #include <sys/mman.h>
-#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
 
-#include "pcache.h"
+#include "pcache_mmap.h"
 
 
 /***********************************************************************
- ** PageCache class
+ ** PageCacheMmap class
  ***********************************************************************/
-PageCache::PageCache()
-  : sqlite_db(), p_mapped(NULL), lock_state(UNLOCKED), n_reader(0), pgsz(0)
+PageCacheMmap::PageCacheMmap()
+  : p_mapped(NULL), mapped_sz(0), pgsz(0)
 {
 }
 
-PageCache::~PageCache()
+PageCacheMmap::~PageCacheMmap()
 {
+  if (p_mapped) close();
 }
 
-errstat PageCache::open(const char * const path)
+errstat PageCacheMmap::open(const SqliteDb &db, db_access access)
 {
-  std::lock_guard<std::mutex> lock(mutex);
-
-  assert(!is_opened());  // TODO: support 2 or more DB open
-  sqlite_db.reset(new SqliteDb(path));
-
-  if (sqlite_db->mode() == SqliteDb::FAIL) {
-    return MYSQLITE_CANNOT_OPEN_DB_FILE;
-  }
-
   // TODO: DB file can be updated.
   // Needs larger memory than file size?
-  p_mapped = (u8 *)mmap(0, sqlite_db->file_size(), PROT_READ | PROT_WRITE, MAP_SHARED, sqlite_db->fd(), 0);
+  int prot = access == DB_READ_WRITE ? PROT_READ | PROT_WRITE : PROT_READ;
+  void *p = mmap(0, db.file_size(), prot, MAP_SHARED, db.fd(), 0);
+  if (p == MAP_FAILED) {
+    char err[256];
+    log_msg("mmap() fails. %s\n", strerror_r(errno, err, 256));
+    return MYSQLITE_IO_ERR;
+  }
+  p_mapped = (u8 *)p;
+  mapped_sz = db.file_size();
 
   // Check page size of db_path.
   pgsz = u8s_to_val<Pgsz>(&p_mapped[DBHDR_PGSZ_OFFSET], DBHDR_PGSZ_LEN);
@@ -37,81 +38,25 @@ errstat PageCache::open(const char * const path)
   return MYSQLITE_OK;
 }
 
-void PageCache::close()
+void PageCacheMmap::close()
 {
-  std::lock_guard<std::mutex> lock(mutex);
-
-  assert(is_opened());
-  munmap(p_mapped, sqlite_db->file_size());
+  munmap(p_mapped, mapped_sz);
   p_mapped = NULL;
-  sqlite_db.reset();  // TODO: そもそもこんなの書かないで済むようにするためのRAII．
-                     // pcache自体がRAIIじゃないとうまみがない
+  mapped_sz = 0;
 }
 
-bool PageCache::is_opened() const
+u8 *PageCacheMmap::fetch(Pgno pgno)
 {
-  return sqlite_db && sqlite_db->mode() != SqliteDb::FAIL;
+  return &p_mapped[(size_t)pgsz * (pgno - 1)];
 }
 
-u8 * PageCache::fetch(Pgno pgno) const
+void PageCacheMmap::prefetch(Pgno pgno)
 {
-  my_assert(pgno >= 1);
-  my_assert(is_rd_locked());
-  return &p_mapped[pgsz * (pgno - 1)];
-}
-
-/**
- * @TODO  Shares flock with other threads using reference counter?
- */
-void PageCache::rd_lock()
-{
-  struct flock flock;
-  flock.l_whence = SEEK_SET;
-  flock.l_start = 0;
-  flock.l_len = 0;
-  flock.l_type = F_RDLCK;
+  size_t offset = (size_t)pgsz * (pgno - 1);
+  if (offset >= mapped_sz) return;
 
-  std::lock_guard<std::mutex> lock(mutex);
-  fcntl(sqlite_db->fd(), F_SETLKW, &flock);
-  lock_state = RD_LOCKED;
-  ++n_reader;
-}
-
-void PageCache::upgrade_lock()
-{
-  assert(is_rd_locked());
-  struct flock flock;
-  flock.l_whence = SEEK_SET;
-  flock.l_start = 0;
-  flock.l_len = 0;
-  flock.l_type = F_RDLCK;
-
-  std::lock_guard<std::mutex> lock(mutex);
-  fcntl(sqlite_db->fd(), F_SETLKW, &flock);
-  lock_state = WR_LOCKED;
-}
-
-void PageCache::unlock()
-{
-  assert(is_rd_locked() || is_wr_locked());
-  struct flock flock;
-  flock.l_whence = SEEK_SET;
-  flock.l_start = 0;
-  flock.l_len = 0;
-  flock.l_type = F_UNLCK;
-
-  std::lock_guard<std::mutex> lock(mutex);
-  fcntl(sqlite_db->fd(), F_SETLKW, &flock);
-  --n_reader;
-  if (n_reader == 0) lock_state = UNLOCKED;
-}
-
-bool PageCache::is_rd_locked() const
-{
-  return lock_state == PageCache::RD_LOCKED;
-}
-
-bool PageCache::is_wr_locked() const
-{
-  return lock_state == PageCache::WR_LOCKED;
+  // madvise() takes an address aligned to the system page size
+  size_t sys_pgsz = sysconf(_SC_PAGESIZE);
+  size_t aligned = offset - offset % sys_pgsz;
+  madvise(&p_mapped[aligned], offset + pgsz - aligned, MADV_WILLNEED);
 }
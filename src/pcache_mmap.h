@@ -2,78 +2,48 @@
 #define _PCACHE_MMAP_H_
 
 
-#if (__GNUC__ >= 4 && __GNUC_MINOR__ >= 5)  // See: http://www.mail-archive.com/gcc-bugs@gcc.gnu.org/msg270025.html
-#include <memory>
-#else // (gcc < 4.5)
-#include <bits/unique_ptr.h>
-#endif
-
-#include <mutex>
-
 #include "mysqlite_types.h"
 #include "utils.h"
+#include "pcache_backend.h"
 
 
 /**
  * PageCache by mmap
+ *
+ * Whole DB file is mapped. Pages are never copied so fetch() and
+ * release() cost nothing, and other processes' writes are seen
+ * through MAP_SHARED.
  */
-class PageCache {
+class PageCacheMmap : public PageCacheBackend {
 private:
-  std::unique_ptr<SqliteDb> sqlite_db;
   u8 *p_mapped;
-  enum {
-    UNLOCKED,
-    RD_LOCKED,
-    WR_LOCKED,
-  } lock_state;
-  int n_reader;  // reference counter for read locks
+  size_t mapped_sz;
   Pgsz pgsz;
-  std::mutex mutex;
 
   public:
-  static PageCache *get_instance() {
-    static PageCache instance;
-    return &instance;
-  }
+  errstat open(const SqliteDb &db, db_access access);
+  void close();
 
-  /**
-   * Initialization
-   *
-   * Called when new SQLite DB is attached
-   */
   public:
-  errstat open(const char * const path);
-  void close();
-  bool is_opened() const;
+  u8 *fetch(Pgno pgno);
+  void release(Pgno pgno) {}
 
-  /**
-   * Fetch a page.
-   * Locks must be held before reading/writing to returned pointer.
-   * This function does not check the lock state since caller can freely
-   * use the returned pointer at any time after this call.
-   *
-   * @return pointer to mmaped-page.
-   */
   public:
-  u8 *fetch(Pgno pgno) const;
+  void revalidate() {}
 
   /**
-   * Locks
+   * madvise(MADV_WILLNEED)
    */
   public:
-  void rd_lock();
-  void upgrade_lock();  // rd_lock -> wr_lock
-  void unlock();
-  bool is_rd_locked() const;
-  bool is_wr_locked() const;
+  void prefetch(Pgno pgno);
 
   public:
-  PageCache();
-  ~PageCache();
+  PageCacheMmap();
+  ~PageCacheMmap();
 
   private:
-  PageCache(const PageCache&);
-  PageCache& operator=(const PageCache&);
+  PageCacheMmap(const PageCacheMmap&);
+  PageCacheMmap& operator=(const PageCacheMmap&);
 };
 
 
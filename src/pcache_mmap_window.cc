@@ -0,0 +1,115 @@
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <cerrno>
+
+#include "pcache_mmap_window.h"
+
+
+/***********************************************************************
+ ** PageCacheMmapWindow class
+ ***********************************************************************/
+PageCacheMmapWindow::PageCacheMmapWindow(u64 chunk_sz, u32 max_chunks)
+  : chunk_sz(chunk_sz), max_chunks(max_chunks), pgsz(0), fd(-1), prot(PROT_READ),
+    n_mapped(0), clock_hand(0)
+{
+  my_assert(chunk_sz % sysconf(_SC_PAGESIZE) == 0);
+  my_assert(max_chunks > 0);
+}
+
+PageCacheMmapWindow::~PageCacheMmapWindow()
+{
+  if (fd != -1) close();
+}
+
+errstat PageCacheMmapWindow::open(const SqliteDb &db, db_access access)
+{
+  u8 pgsz_data[DBHDR_PGSZ_LEN];
+  if (pread(db.fd(), pgsz_data, DBHDR_PGSZ_LEN, DBHDR_PGSZ_OFFSET) != DBHDR_PGSZ_LEN)
+    return MYSQLITE_IO_ERR;
+  pgsz = u8s_to_val<Pgsz>(pgsz_data, DBHDR_PGSZ_LEN);
+  my_assert(chunk_sz % pgsz == 0);  // A page never spans 2 chunks
+
+  fd = db.fd();
+  prot = access == DB_READ_WRITE ? PROT_READ | PROT_WRITE : PROT_READ;
+  Chunk unmapped = {NULL, 0, false};
+  chunks.assign((db.file_size() + chunk_sz - 1) / chunk_sz, unmapped);
+  n_mapped = 0;
+  clock_hand = 0;
+  return MYSQLITE_OK;
+}
+
+void PageCacheMmapWindow::close()
+{
+  for (u32 i = 0; i < chunks.size(); ++i) {
+    if (chunks[i].p_mapped) munmap(chunks[i].p_mapped, chunk_sz);
+  }
+  chunks.clear();
+  n_mapped = 0;
+  fd = -1;
+}
+
+/*
+** Unmap an unpinned chunk by CLOCK. mutex must be held.
+** Does nothing if all mapped chunks are pinned.
+*/
+void PageCacheMmapWindow::unmap_cold_chunk()
+{
+  for (u32 step = 0; step < 2 * chunks.size(); ++step) {
+    Chunk &c = chunks[clock_hand];
+    clock_hand = (clock_hand + 1) % chunks.size();
+    if (!c.p_mapped || c.n_pin > 0) continue;
+    if (c.referenced) {
+      c.referenced = false;
+      continue;
+    }
+    munmap(c.p_mapped, chunk_sz);
+    c.p_mapped = NULL;
+    --n_mapped;
+    return;
+  }
+}
+
+u8 *PageCacheMmapWindow::fetch(Pgno pgno)
+{
+  u32 i = chunk_of(pgno);
+  u64 offset_in_chunk = (u64)pgsz * (pgno - 1) - (u64)i * chunk_sz;
+
+  std::lock_guard<std::mutex> lock(mutex);
+
+  if (i >= chunks.size()) {
+    // File has grown since open()
+    Chunk unmapped = {NULL, 0, false};
+    chunks.resize(i + 1, unmapped);
+  }
+
+  Chunk &c = chunks[i];
+  if (!c.p_mapped) {
+    if (n_mapped >= max_chunks) unmap_cold_chunk();
+    void *p = mmap(0, chunk_sz, prot, MAP_SHARED, fd, (off_t)i * chunk_sz);
+    if (p == MAP_FAILED) {
+      char err[256];
+      log_msg("mmap() fails for chunk#%u. %s\n", i, strerror_r(errno, err, 256));
+      return NULL;
+    }
+    c.p_mapped = (u8 *)p;
+    c.n_pin = 0;
+    ++n_mapped;
+  }
+  ++c.n_pin;
+  c.referenced = true;
+  return &c.p_mapped[offset_in_chunk];
+}
+
+void PageCacheMmapWindow::prefetch(Pgno pgno)
+{
+  posix_fadvise(fd, (off_t)pgsz * (pgno - 1), pgsz, POSIX_FADV_WILLNEED);
+}
+
+void PageCacheMmapWindow::release(Pgno pgno)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+
+  Chunk &c = chunks[chunk_of(pgno)];
+  my_assert(c.p_mapped && c.n_pin > 0);
+  --c.n_pin;
+}
@@ -0,0 +1,83 @@
+#ifndef _PCACHE_MMAP_WINDOW_H_
+#define _PCACHE_MMAP_WINDOW_H_
+
+
+#include <mutex>
+
+#include "mysqlite_types.h"
+#include "utils.h"
+#include "pcache_backend.h"
+
+
+/**
+ * PageCache by windowed mmap
+ *
+ * DB file is mapped chunk by chunk on demand, for files too large to be
+ * mapped whole (HUGE=1). A chunk is pinned while any of its pages is
+ * fetched. Unpinned chunks are unmapped by CLOCK when more than
+ * max_chunks chunks are mapped.
+ *
+ * max_chunks is a soft limit: when all mapped chunks are pinned,
+ * another chunk is mapped anyway.
+ */
+class PageCacheMmapWindow : public PageCacheBackend {
+private:
+  struct Chunk {
+    u8 *p_mapped;     // NULL if not mapped
+    u32 n_pin;
+    bool referenced;  // CLOCK reference bit
+  };
+
+  u64 chunk_sz;     // Multiple of both page size and pgsz
+  u32 max_chunks;
+  Pgsz pgsz;
+  int fd;
+  int prot;
+  vector<Chunk> chunks;  // chunks[i] maps [i * chunk_sz, (i+1) * chunk_sz)
+  u32 n_mapped;
+  u32 clock_hand;
+  std::mutex mutex;
+
+  /**
+   * @param chunk_sz  Bytes mapped at a time.
+   * @param max_chunks  Soft limit of the number of mapped chunks.
+   */
+  public:
+  PageCacheMmapWindow(u64 chunk_sz, u32 max_chunks);
+  ~PageCacheMmapWindow();
+
+  public:
+  errstat open(const SqliteDb &db, db_access access);
+  void close();
+
+  /**
+   * @return NULL if mmap() fails.
+   */
+  public:
+  u8 *fetch(Pgno pgno);
+  void release(Pgno pgno);
+
+  public:
+  void revalidate() {}
+
+  /**
+   * posix_fadvise(POSIX_FADV_WILLNEED). Chunks are not mapped.
+   */
+  public:
+  void prefetch(Pgno pgno);
+
+  public:
+  u32 n_mapped_chunks() const { return n_mapped; }
+
+  private:
+  u32 chunk_of(Pgno pgno) const { return ((u64)pgsz * (pgno - 1)) / chunk_sz; }
+  void unmap_cold_chunk();
+
+private:
+  PageCacheMmapWindow();
+  PageCacheMmapWindow(const PageCacheMmapWindow&);
+  PageCacheMmapWindow& operator=(const PageCacheMmapWindow&);
+};
+
+
+#endif /* _PCACHE_MMAP_WINDOW_H_ */
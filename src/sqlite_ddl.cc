@@ -0,0 +1,617 @@
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <strings.h>
+#include <stdio.h>
+
+#include "sqlite_ddl.h"
+
+
+/***********************************************************************
+** Tokenizer
+***********************************************************************/
+namespace {
+
+struct Token {
+  enum {
+    END,
+    IDENT,     // Bare identifiers and keywords
+    QUOTED,    // "name", `name`, [name]
+    STRING,    // 'literal'
+    NUMBER,
+    PUNCT,     // Any other single character
+  } kind;
+  string text;   // Unquoted
+};
+
+class Lexer {
+private:
+  const string &sql;
+  size_t pos;
+  Token cur;
+
+  public:
+  Lexer(const string &sql)
+    : sql(sql), pos(0)
+  { advance(); }
+
+  public:
+  const Token &peek() const { return cur; }
+
+  public:
+  Token next() {
+    Token t = cur;
+    advance();
+    return t;
+  }
+
+  /*
+  ** Whether the current token is the keyword (case insensitive).
+  ** Quoted identifiers are never keywords.
+  */
+  public:
+  bool at(const char *keyword) const {
+    return cur.kind == Token::IDENT && strcasecmp(cur.text.c_str(), keyword) == 0;
+  }
+
+  public:
+  bool at_punct(char c) const {
+    return cur.kind == Token::PUNCT && cur.text[0] == c;
+  }
+
+  public:
+  bool accept(const char *keyword) {
+    if (!at(keyword)) return false;
+    advance();
+    return true;
+  }
+
+  public:
+  bool accept_punct(char c) {
+    if (!at_punct(c)) return false;
+    advance();
+    return true;
+  }
+
+  /*
+  ** Offset of the current token in sql.
+  */
+  public:
+  size_t offset() const { return tok_start; }
+
+  /*
+  ** Offset just after the last consumed token.
+  */
+  public:
+  size_t last_end() const { return prev_end; }
+
+  /*
+  ** Skip tokens up to (not including) ',' or ')' outside parentheses.
+  */
+  public:
+  void skip_to_delimiter() {
+    int depth = 0;
+    while (cur.kind != Token::END) {
+      if (at_punct('(')) ++depth;
+      else if (at_punct(')')) {
+        if (depth == 0) return;
+        --depth;
+      }
+      else if (at_punct(',') && depth == 0) return;
+      advance();
+    }
+  }
+
+private:
+  size_t tok_start, prev_end;
+
+  void advance();
+  void skip_space_and_comments();
+  string read_quoted(char close);
+};
+
+void Lexer::skip_space_and_comments()
+{
+  while (pos < sql.size()) {
+    if (isspace((unsigned char)sql[pos])) {
+      ++pos;
+    } else if (sql.compare(pos, 2, "--") == 0) {
+      size_t eol = sql.find('\n', pos);
+      pos = eol == string::npos ? sql.size() : eol + 1;
+    } else if (sql.compare(pos, 2, "/*") == 0) {
+      size_t end = sql.find("*/", pos + 2);
+      pos = end == string::npos ? sql.size() : end + 2;
+    } else {
+      break;
+    }
+  }
+}
+
+/*
+** Read a quoted string starting at pos (opening quote). A doubled closing
+** quote stands for the quote character itself.
+*/
+string Lexer::read_quoted(char close)
+{
+  string s;
+  for (++pos; pos < sql.size(); ++pos) {
+    if (sql[pos] == close) {
+      if (close != ']' && pos + 1 < sql.size() && sql[pos + 1] == close) {
+        s += close;
+        ++pos;
+      } else {
+        ++pos;
+        break;
+      }
+    } else {
+      s += sql[pos];
+    }
+  }
+  return s;
+}
+
+void Lexer::advance()
+{
+  prev_end = pos;
+  skip_space_and_comments();
+  tok_start = pos;
+  cur.text.clear();
+
+  if (pos >= sql.size()) {
+    cur.kind = Token::END;
+    return;
+  }
+
+  char c = sql[pos];
+  if (isalpha((unsigned char)c) || c == '_' || (c & 0x80)) {
+    size_t start = pos;
+    while (pos < sql.size() &&
+           (isalnum((unsigned char)sql[pos]) || sql[pos] == '_' || sql[pos] == '$' ||
+            (sql[pos] & 0x80)))
+      ++pos;
+    cur.kind = Token::IDENT;
+    cur.text = sql.substr(start, pos - start);
+  } else if (c == '"' || c == '`') {
+    cur.kind = Token::QUOTED;
+    cur.text = read_quoted(c);
+  } else if (c == '[') {
+    cur.kind = Token::QUOTED;
+    cur.text = read_quoted(']');
+  } else if (c == '\'') {
+    cur.kind = Token::STRING;
+    cur.text = read_quoted('\'');
+  } else if (isdigit((unsigned char)c) || (c == '.' && isdigit((unsigned char)sql[pos + 1]))) {
+    size_t start = pos;
+    bool hex = sql.compare(pos, 2, "0x") == 0 || sql.compare(pos, 2, "0X") == 0;
+    while (pos < sql.size() &&
+           (isalnum((unsigned char)sql[pos]) || sql[pos] == '.' ||
+            // Signed exponent: 1e-5
+            (!hex && (sql[pos] == '-' || sql[pos] == '+') &&
+             (sql[pos - 1] == 'e' || sql[pos - 1] == 'E'))))
+      ++pos;
+    cur.kind = Token::NUMBER;
+    cur.text = sql.substr(start, pos - start);
+  } else {
+    cur.kind = Token::PUNCT;
+    cur.text = string(1, c);
+    ++pos;
+  }
+}
+
+
+/***********************************************************************
+** Parser helpers
+***********************************************************************/
+
+/*
+** Identifier or string literal used as a name.
+*/
+bool parse_name(Lexer &lex, string *name)
+{
+  const Token &t = lex.peek();
+  if (t.kind != Token::IDENT && t.kind != Token::QUOTED && t.kind != Token::STRING)
+    return false;
+  *name = lex.next().text;
+  return true;
+}
+
+/*
+** [schema-name.]name
+*/
+bool parse_qualified_name(Lexer &lex, string *name)
+{
+  if (!parse_name(lex, name)) return false;
+  if (lex.accept_punct('.')) return parse_name(lex, name);
+  return true;
+}
+
+bool parse_collation(Lexer &lex, sqlite_collation *coll)
+{
+  string name;
+  if (!parse_name(lex, &name)) return false;
+  if (strcasecmp(name.c_str(), "BINARY") == 0) *coll = COLL_BINARY;
+  else if (strcasecmp(name.c_str(), "NOCASE") == 0) *coll = COLL_NOCASE;
+  else if (strcasecmp(name.c_str(), "RTRIM") == 0) *coll = COLL_RTRIM;
+  else return false;
+  return true;
+}
+
+bool is_column_constraint_start(const Lexer &lex)
+{
+  static const char *keywords[] = {
+    "CONSTRAINT", "PRIMARY", "NOT", "NULL", "UNIQUE", "CHECK", "DEFAULT",
+    "COLLATE", "REFERENCES", "GENERATED", "AS", NULL,
+  };
+  for (const char **kw = keywords; *kw; ++kw)
+    if (lex.at(*kw)) return true;
+  return false;
+}
+
+bool is_table_constraint_start(const Lexer &lex)
+{
+  return lex.at("CONSTRAINT") || lex.at("PRIMARY") || lex.at("UNIQUE") ||
+    lex.at("CHECK") || lex.at("FOREIGN");
+}
+
+/*
+** Column list of a PRIMARY KEY or UNIQUE table constraint or of
+** CREATE INDEX.
+**
+** indexed-column := column-name [COLLATE collation-name] [ASC | DESC]
+**
+** An expression in place of column-name, or an unknown collation,
+** makes idx unusable.
+*/
+bool parse_indexed_columns(Lexer &lex, const TableDef &tbl,
+                           /* out */
+                           IndexDef *idx)
+{
+  if (!lex.accept_punct('(')) return false;
+  do {
+    IndexColumnDef col;
+    string name;
+    bool is_column = false;
+    col.colno = -1;
+    col.desc = false;
+
+    if (lex.peek().kind != Token::STRING && parse_name(lex, &name)) {
+      col.colno = tbl.find_col(name);
+      is_column = col.colno >= 0 && (lex.at_punct(',') || lex.at_punct(')') ||
+                                     lex.at("COLLATE") || lex.at("ASC") || lex.at("DESC"));
+    }
+    if (!is_column) {
+      idx->usable = false;
+      lex.skip_to_delimiter();
+      continue;
+    }
+
+    col.coll = tbl.cols[col.colno].coll;
+    if (lex.accept("COLLATE") && !parse_collation(lex, &col.coll)) idx->usable = false;
+    if (lex.accept("DESC")) col.desc = true;
+    else lex.accept("ASC");
+    idx->cols.push_back(col);
+
+    lex.skip_to_delimiter();
+  } while (lex.accept_punct(','));
+
+  return lex.accept_punct(')');
+}
+
+/*
+** Register an index for a PRIMARY KEY or UNIQUE constraint.
+**
+** SQLite does not create an index identical to an existing one.
+** Such a constraint does not consume an autoindex number.
+*/
+void add_autoindex(TableDef *tbl, IndexDef *idx)
+{
+  for (size_t i = 0; i < tbl->indexes.size(); ++i) {
+    const IndexDef &other = tbl->indexes[i];
+    if (other.cols.size() != idx->cols.size()) continue;
+    bool same = true;
+    for (size_t j = 0; j < idx->cols.size(); ++j) {
+      same &= other.cols[j].colno == idx->cols[j].colno &&
+        other.cols[j].coll == idx->cols[j].coll;
+    }
+    if (same) return;
+  }
+
+  char n[16];
+  snprintf(n, sizeof(n), "%zu", tbl->indexes.size() + 1);
+  idx->name = "sqlite_autoindex_" + tbl->name + "_" + n;
+  idx->unique = true;
+  tbl->indexes.push_back(*idx);
+}
+
+/*
+** Whether a column declared as type with PRIMARY KEY is an alias for rowid.
+**
+** @see http://www.sqlite.org/lang_createtable.html#rowid
+*/
+bool is_rowid_alias_type(const string &type)
+{
+  return strcasecmp(type.c_str(), "INTEGER") == 0;
+}
+
+/*
+** Numeric literal: integer, hexadecimal integer or real. Integers too
+** large for 64 bits are real, as in SQLite.
+*/
+void parse_number(const string &text, bool neg,
+                  /* out */
+                  ColumnDef *col)
+{
+  const char *s = text.c_str();
+  char *end;
+  errno = 0;
+  if (s[0] == '0' && (s[1] == 'x' || s[1] == 'X')) {
+    u64 v = strtoull(s + 2, &end, 16);
+    if (end == s + 2 || *end || errno) return;
+    col->dflt_type = MYSQLITE_INTEGER;
+    col->dflt_int = (s64)(neg ? 0 - v : v);
+  } else if (text.find_first_of(".eE") == string::npos) {
+    u64 v = strtoull(s, &end, 10);
+    if (*end) return;
+    if (errno == 0 && v <= (u64)LLONG_MAX + neg) {
+      col->dflt_type = MYSQLITE_INTEGER;
+      col->dflt_int = (s64)(neg ? 0 - v : v);
+    } else {
+      col->dflt_type = MYSQLITE_FLOAT;
+      col->dflt_double = neg ? -strtod(s, NULL) : strtod(s, NULL);
+    }
+  } else {
+    double d = strtod(s, &end);
+    if (*end) return;
+    col->dflt_type = MYSQLITE_FLOAT;
+    col->dflt_double = neg ? -d : d;
+  }
+}
+
+/*
+** DEFAULT value: [+|-] number, 'string', X'hex', NULL, TRUE or FALSE.
+** Others ((expr), CURRENT_TIMESTAMP ...) are left to the caller to skip,
+** with dflt_type MYSQLITE_NULL.
+**
+** @see http://www.sqlite.org/syntax/literal-value.html
+*/
+void parse_default(Lexer &lex,
+                   /* out */
+                   ColumnDef *col)
+{
+  bool neg = lex.accept_punct('-');
+  if (!neg) lex.accept_punct('+');
+  const Token &t = lex.peek();
+
+  if (t.kind == Token::NUMBER) {
+    parse_number(lex.next().text, neg, col);
+  } else if (t.kind == Token::STRING) {
+    col->dflt_type = MYSQLITE_TEXT;
+    col->dflt_bytes = lex.next().text;
+  } else if (lex.at("TRUE") || lex.at("FALSE")) {
+    col->dflt_type = MYSQLITE_INTEGER;
+    col->dflt_int = lex.at("TRUE");
+    lex.next();
+  } else if (lex.at("NULL")) {
+    lex.next();
+  } else if (lex.at("X")) {
+    lex.next();
+    // X'...' is a blob only when the string follows without space
+    if (lex.peek().kind != Token::STRING || lex.offset() != lex.last_end()) return;
+    string hex = lex.next().text;
+    if (hex.size() % 2) return;
+    string bytes;
+    for (size_t i = 0; i < hex.size(); i += 2) {
+      if (!isxdigit((unsigned char)hex[i]) || !isxdigit((unsigned char)hex[i + 1]))
+        return;
+      bytes += (char)strtol(hex.substr(i, 2).c_str(), NULL, 16);
+    }
+    col->dflt_type = MYSQLITE_BLOB;
+    col->dflt_bytes = bytes;
+  }
+}
+
+/*
+** column-def := column-name [type-name] [column-constraint ...]
+**
+** A column constraint creating an index is stored into *constraint_idx
+** (with its column number filled later).
+*/
+bool parse_column_def(Lexer &lex, const string &sql,
+                      /* out */
+                      ColumnDef *col,
+                      vector<pair<IndexDef, bool> > *constraint_indexes,
+                      bool *is_ipk)
+{
+  if (!parse_name(lex, &col->name)) return false;
+  col->coll = COLL_BINARY;
+  col->not_null = false;
+  col->dflt_type = MYSQLITE_NULL;
+  col->dflt_int = 0;
+  col->dflt_double = 0;
+  col->dflt_bytes.clear();
+  *is_ipk = false;
+
+  // type-name: name ... [(signed-number [, signed-number])]
+  size_t type_start = lex.offset();
+  bool has_type = false;
+  while ((lex.peek().kind == Token::IDENT || lex.peek().kind == Token::QUOTED) &&
+         !is_column_constraint_start(lex)) {
+    lex.next();
+    has_type = true;
+  }
+  if (has_type && lex.at_punct('(')) {
+    lex.next();
+    lex.skip_to_delimiter();
+    while (lex.accept_punct(',')) lex.skip_to_delimiter();
+    if (!lex.accept_punct(')')) return false;
+  }
+  col->type = has_type ? sql.substr(type_start, lex.last_end() - type_start) : "";
+
+  // column-constraint ...
+  while (!lex.at_punct(',') && !lex.at_punct(')')) {
+    if (lex.peek().kind == Token::END) return false;
+
+    if (lex.accept("PRIMARY")) {
+      if (!lex.accept("KEY")) return false;
+      bool desc = lex.accept("DESC");
+      if (!desc) lex.accept("ASC");
+      IndexDef idx;
+      IndexColumnDef idx_col = {-1, COLL_BINARY, desc};
+      idx.cols.push_back(idx_col);
+      constraint_indexes->push_back(make_pair(idx, true));
+      *is_ipk = !desc && is_rowid_alias_type(col->type);
+    }
+    else if (lex.accept("UNIQUE")) {
+      IndexDef idx;
+      IndexColumnDef idx_col = {-1, COLL_BINARY, false};
+      idx.cols.push_back(idx_col);
+      constraint_indexes->push_back(make_pair(idx, false));
+    }
+    else if (lex.accept("NOT")) {
+      if (lex.accept("NULL")) col->not_null = true;
+    }
+    else if (lex.accept("COLLATE")) {
+      if (!parse_collation(lex, &col->coll)) return false;
+    }
+    else if (lex.accept("DEFAULT")) {
+      parse_default(lex, col);
+    }
+    else if (lex.accept_punct('(')) {
+      lex.skip_to_delimiter();
+      while (lex.accept_punct(',')) lex.skip_to_delimiter();
+      if (!lex.accept_punct(')')) return false;
+    }
+    else {
+      lex.next();
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+
+/***********************************************************************
+** TableDef
+***********************************************************************/
+int TableDef::find_col(const string &name) const
+{
+  for (size_t i = 0; i < cols.size(); ++i)
+    if (strcasecmp(cols[i].name.c_str(), name.c_str()) == 0) return i;
+  return -1;
+}
+
+const IndexDef *TableDef::find_index(const string &name) const
+{
+  for (size_t i = 0; i < indexes.size(); ++i)
+    if (strcasecmp(indexes[i].name.c_str(), name.c_str()) == 0) return &indexes[i];
+  return NULL;
+}
+
+
+/***********************************************************************
+** Functions
+***********************************************************************/
+bool parse_create_table(const string &sql,
+                        /* out */
+                        TableDef *tbl)
+{
+  Lexer lex(sql);
+
+  // CREATE [TEMP | TEMPORARY] TABLE [IF NOT EXISTS] [schema-name.]table-name
+  if (!lex.accept("CREATE")) return false;
+  if (!lex.accept("TEMP")) lex.accept("TEMPORARY");
+  if (!lex.accept("TABLE")) return false;
+  if (lex.accept("IF")) {
+    if (!lex.accept("NOT") || !lex.accept("EXISTS")) return false;
+  }
+  if (!parse_qualified_name(lex, &tbl->name)) return false;
+  if (!lex.accept_punct('(')) return false;  // CREATE TABLE ... AS SELECT is not supported
+
+  tbl->cols.clear();
+  tbl->indexes.clear();
+  tbl->rowid_colno = -1;
+
+  do {
+    if (is_table_constraint_start(lex)) {
+      if (lex.accept("CONSTRAINT")) {
+        string constraint_name;
+        if (!parse_name(lex, &constraint_name)) return false;
+      }
+      if (lex.accept("PRIMARY")) {
+        if (!lex.accept("KEY")) return false;
+        IndexDef idx;
+        if (!parse_indexed_columns(lex, *tbl, &idx)) return false;
+        if (idx.usable && idx.cols.size() == 1 &&
+            is_rowid_alias_type(tbl->cols[idx.cols[0].colno].type))
+          tbl->rowid_colno = idx.cols[0].colno;
+        else
+          add_autoindex(tbl, &idx);
+      }
+      else if (lex.accept("UNIQUE")) {
+        IndexDef idx;
+        if (!parse_indexed_columns(lex, *tbl, &idx)) return false;
+        add_autoindex(tbl, &idx);
+      }
+      lex.skip_to_delimiter();  // CHECK (...), FOREIGN KEY ..., ON CONFLICT ...
+    }
+    else {
+      ColumnDef col;
+      vector<pair<IndexDef, bool> > constraint_indexes;  // (index, is PRIMARY KEY)
+      bool is_ipk;
+      if (!parse_column_def(lex, sql, &col, &constraint_indexes, &is_ipk)) return false;
+      int colno = tbl->cols.size();
+      tbl->cols.push_back(col);
+
+      for (size_t i = 0; i < constraint_indexes.size(); ++i) {
+        IndexDef &idx = constraint_indexes[i].first;
+        if (constraint_indexes[i].second && is_ipk) {
+          tbl->rowid_colno = colno;
+          continue;
+        }
+        idx.cols[0].colno = colno;
+        idx.cols[0].coll = col.coll;  // COLLATE may follow PRIMARY KEY or UNIQUE
+        add_autoindex(tbl, &idx);
+      }
+    }
+  } while (lex.accept_punct(','));
+
+  if (!lex.accept_punct(')')) return false;
+
+  // [WITHOUT ROWID]
+  tbl->without_rowid = false;
+  if (lex.accept("WITHOUT")) {
+    if (!lex.accept("ROWID")) return false;
+    tbl->without_rowid = true;
+    tbl->rowid_colno = -1;
+  }
+  return !tbl->cols.empty();
+}
+
+bool parse_create_index(const string &sql, const TableDef &tbl,
+                        /* out */
+                        IndexDef *idx)
+{
+  Lexer lex(sql);
+
+  // CREATE [UNIQUE] INDEX [IF NOT EXISTS] [schema-name.]index-name ON table-name
+  if (!lex.accept("CREATE")) return false;
+  idx->unique = lex.accept("UNIQUE");
+  if (!lex.accept("INDEX")) return false;
+  if (lex.accept("IF")) {
+    if (!lex.accept("NOT") || !lex.accept("EXISTS")) return false;
+  }
+  if (!parse_qualified_name(lex, &idx->name)) return false;
+  if (!lex.accept("ON")) return false;
+  string tbl_name;
+  if (!parse_name(lex, &tbl_name)) return false;
+
+  idx->usable = true;
+  idx->cols.clear();
+  if (!parse_indexed_columns(lex, tbl, idx)) return false;
+
+  // [WHERE expr]: a partial index lacks rows
+  if (lex.at("WHERE")) idx->usable = false;
+  return true;
+}
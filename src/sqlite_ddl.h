@@ -0,0 +1,127 @@
+/* Copyright (c) Sho Nakatani 2013. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+
+#ifndef _SQLITE_DDL_H_
+#define _SQLITE_DDL_H_
+
+
+using namespace std;
+#include <string>
+#include <vector>
+
+#include "mysqlite_types.h"
+
+
+/*
+** Schema of SQLite tables and indexes, parsed from sqlite_master.sql.
+**
+** Only what is needed to read B-trees is parsed: column names, declared
+** types, collations, constant DEFAULT values (of columns added by ALTER
+** TABLE ADD COLUMN, missing in older records), INTEGER PRIMARY KEY and
+** indexed columns. Other constraints (CHECK, REFERENCES ...) are skipped.
+**
+** @see http://www.sqlite.org/lang_createtable.html
+** @see http://www.sqlite.org/lang_createindex.html
+*/
+
+struct ColumnDef {
+  string name;
+  string type;            // Declared type as written. Empty if omitted.
+  sqlite_collation coll;
+  bool not_null;
+  mysqlite_type dflt_type;  // Literal DEFAULT as written (column affinity
+                            // is not applied). MYSQLITE_NULL if omitted,
+                            // NULL or not a literal.
+  s64 dflt_int;             // MYSQLITE_INTEGER
+  double dflt_double;       // MYSQLITE_FLOAT
+  string dflt_bytes;        // MYSQLITE_TEXT and MYSQLITE_BLOB
+};
+
+struct IndexColumnDef {
+  int colno;              // Column number in the table
+  sqlite_collation coll;
+  bool desc;
+};
+
+struct IndexDef {
+  string name;
+  Pgno root_pgno;         // 0 if not found in sqlite_master
+  bool unique;
+  bool usable;            // false for partial indexes, indexes on expressions
+                          // and unknown collations. Such indexes do not
+                          // have an entry for every row in the known order.
+  vector<IndexColumnDef> cols;
+
+  public:
+  IndexDef()
+    : root_pgno(0), unique(false), usable(true)
+  {}
+};
+
+struct TableDef {
+  string name;
+  Pgno root_pgno;
+  vector<ColumnDef> cols;
+  int rowid_colno;        // INTEGER PRIMARY KEY column. -1 if none.
+  bool without_rowid;
+  vector<IndexDef> indexes;  // Indexes of UNIQUE and PRIMARY KEY constraints
+                             // (sqlite_autoindex_<table>_<N>) and
+                             // CREATE INDEX'ed ones.
+
+  public:
+  TableDef()
+    : root_pgno(0), rowid_colno(-1), without_rowid(false)
+  {}
+
+  /*
+  ** @return -1 if no column has the name (case insensitive).
+  */
+  public:
+  int find_col(const string &name) const;
+
+  /*
+  ** @return NULL if no index has the name.
+  */
+  public:
+  const IndexDef *find_index(const string &name) const;
+};
+
+
+/*
+** Parse CREATE TABLE statement.
+**
+** Fills tbl->name, cols, rowid_colno, without_rowid and indexes
+** for UNIQUE and PRIMARY KEY constraints in the order SQLite numbers
+** them (root_pgno is left 0).
+**
+** @return false if sql is not a CREATE TABLE statement parsable here.
+*/
+bool parse_create_table(const string &sql,
+                        /* out */
+                        TableDef *tbl);
+
+/*
+** Parse CREATE INDEX statement on tbl.
+**
+** @return false if sql is not a CREATE INDEX statement parsable here.
+**   Unusable indexes (see IndexDef::usable) are parsed successfully.
+*/
+bool parse_create_index(const string &sql, const TableDef &tbl,
+                        /* out */
+                        IndexDef *idx);
+
+
+#endif /* _SQLITE_DDL_H_ */
@@ -7,35 +7,49 @@
 ***********************************************************************/
 Pgsz DbHeader::get_pg_sz()
 {
-  PageCache *pcache = PageCache::get_instance();
-  assert(pcache->is_rd_locked());
-  u8 *hdr_data = pcache->fetch(SQLITE_MASTER_ROOTPGNO);
-  return u8s_to_val<Pgsz>(&hdr_data[DBHDR_PGSZ_OFFSET], DBHDR_PGSZ_LEN);
+  assert(PageCache::get_instance()->is_rd_locked());
+  Page hdr(SQLITE_MASTER_ROOTPGNO);
+  errstat res = hdr.fetch();
+  my_assert(res == MYSQLITE_OK);
+  return u8s_to_val<Pgsz>(&hdr.pg_data[DBHDR_PGSZ_OFFSET], DBHDR_PGSZ_LEN);
 }
 
 Pgsz DbHeader::get_reserved_space()
 {
-  PageCache *pcache = PageCache::get_instance();
-  assert(pcache->is_rd_locked());
-  u8 *hdr_data = pcache->fetch(SQLITE_MASTER_ROOTPGNO);
-  return u8s_to_val<Pgsz>(&hdr_data[DBHDR_RESERVEDSPACE_OFFSET], DBHDR_RESERVEDSPACE_LEN);
+  assert(PageCache::get_instance()->is_rd_locked());
+  Page hdr(SQLITE_MASTER_ROOTPGNO);
+  errstat res = hdr.fetch();
+  my_assert(res == MYSQLITE_OK);
+  return u8s_to_val<Pgsz>(&hdr.pg_data[DBHDR_RESERVEDSPACE_OFFSET], DBHDR_RESERVEDSPACE_LEN);
 }
 
 u32 DbHeader::get_file_change_counter()
 {
-  PageCache *pcache = PageCache::get_instance();
-  assert(pcache->is_rd_locked());
-  u8 *hdr_data = pcache->fetch(SQLITE_MASTER_ROOTPGNO);
-  return u8s_to_val<Pgsz>(&hdr_data[DBHDR_FCC_OFFSET], DBHDR_FCC_LEN);
+  assert(PageCache::get_instance()->is_rd_locked());
+  Page hdr(SQLITE_MASTER_ROOTPGNO);
+  errstat res = hdr.fetch();
+  my_assert(res == MYSQLITE_OK);
+  return u8s_to_val<u32>(&hdr.pg_data[DBHDR_FCC_OFFSET], DBHDR_FCC_LEN);
+}
+
+u32 DbHeader::get_schema_cookie()
+{
+  assert(PageCache::get_instance()->is_rd_locked());
+  Page hdr(SQLITE_MASTER_ROOTPGNO);
+  errstat res = hdr.fetch();
+  my_assert(res == MYSQLITE_OK);
+  return u8s_to_val<u32>(&hdr.pg_data[DBHDR_SCHEMA_COOKIE_OFFSET], DBHDR_SCHEMA_COOKIE_LEN);
 }
 
 errstat DbHeader::inc_file_change_counter()
 {
-  PageCache *pcache = PageCache::get_instance();
-  if (!pcache->is_wr_locked()) return MYSQLITE_FLOCK_NEEDED;
-  u8 *hdr_data = pcache->fetch(SQLITE_MASTER_ROOTPGNO);
-  u32 fcc = u8s_to_val<Pgsz>(&hdr_data[DBHDR_FCC_OFFSET], DBHDR_FCC_LEN);
-  *(&hdr_data[DBHDR_FCC_OFFSET]) = fcc + 1;
+  if (!PageCache::get_instance()->is_wr_locked()) return MYSQLITE_FLOCK_NEEDED;
+  Page hdr(SQLITE_MASTER_ROOTPGNO);
+  errstat res = hdr.fetch();
+  if (res != MYSQLITE_OK) return res;
+  u8 *p = &hdr.pg_data[DBHDR_FCC_OFFSET];
+  u32 fcc = u8s_to_val<u32>(p, DBHDR_FCC_LEN) + 1;
+  for (int i = DBHDR_FCC_LEN - 1; i >= 0; --i, fcc >>= 8) p[i] = (u8)fcc;
   return MYSQLITE_OK;
 }
 
@@ -45,6 +59,51 @@ errstat DbHeader::inc_file_change_counter()
 errstat Page::fetch()
 {
   PageCache *pcache = PageCache::get_instance();
+  if (pg_data) pcache->release(pgno);
   pg_data = pcache->fetch(pgno);
-  return MYSQLITE_OK;  // TODO: page cache should return status
+  return pg_data ? MYSQLITE_OK : MYSQLITE_IO_ERR;
+}
+
+Page::~Page()
+{
+  if (pg_data) PageCache::get_instance()->release(pgno);
+}
+
+
+/***********************************************************************
+** Functions
+***********************************************************************/
+void copy_overflown_payload(/* inout */
+                            RecordCell *cell,
+                            /* out */
+                            u8 *buf_overflown_payload)
+{
+  my_assert(buf_overflown_payload);
+  my_assert(cell->overflow_pgno != 0);
+  my_assert(cell->payload_sz_in_origpg > 0);
+  my_assert(cell->payload_sz_in_origpg < cell->payload_sz);
+
+  // Copy payload from the original page and overflow pages
+  u64 offset = 0;
+  memcpy(&buf_overflown_payload[offset], cell->payload.data, cell->payload_sz_in_origpg);
+  offset += cell->payload_sz_in_origpg;
+  Pgsz usable_sz = DbHeader::get_pg_sz() - DbHeader::get_reserved_space();
+  u64 payload_sz_rem = cell->payload_sz - cell->payload_sz_in_origpg;
+
+  for (Pgno overflow_pgno = cell->overflow_pgno; overflow_pgno != 0; ) {
+    Page ovpg(overflow_pgno);
+    errstat res = ovpg.fetch();
+    my_assert(res == MYSQLITE_OK);
+    overflow_pgno = u8s_to_val<Pgno>(&ovpg.pg_data[0], sizeof(Pgno));
+    Pgsz payload_sz_inpg = min<u64>(usable_sz - sizeof(Pgno), payload_sz_rem);
+    payload_sz_rem -= payload_sz_inpg;
+    memcpy(&buf_overflown_payload[offset],
+           &ovpg.pg_data[sizeof(Pgno)],
+           payload_sz_inpg);
+    offset += payload_sz_inpg;
+  }
+  my_assert(payload_sz_rem == 0);
+
+  cell->payload.data = buf_overflown_payload;
+  cell->payload.digest_data();
 }
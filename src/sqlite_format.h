@@ -57,7 +57,9 @@ static inline u64 stype2len(u64 stype) {
 
   case ST_INT8:  return 1;
   case ST_INT16: return 2;
+  case ST_INT24: return 3;
   case ST_INT32: return 4;
+  case ST_INT48: return 6;
 
   case ST_INT64:
   case ST_FLOAT:
@@ -86,6 +88,12 @@ class DbHeader {
   public:
   static errstat inc_file_change_counter();
 
+  /*
+  ** Incremented whenever the schema (sqlite_master) changes.
+  */
+  public:
+  static u32 get_schema_cookie();
+
 private:
   // Prohibit any way to create instance
   DbHeader();
@@ -105,20 +113,23 @@ public:
   ** @note
   ** Constructor does not read(2) page contents.
   ** Call this->fetch() after object is constructed.
+  ** The page stays pinned on PageCache until destructed.
   */
   public:
   Page(Pgno pgno)
     : pg_data(NULL), pgno(pgno)
   {}
   public:
-  virtual ~Page() {}
+  virtual ~Page();
 
   public:
   errstat fetch();
 
-  // Prohibit default constructor
+  // Prohibit default constructor and copy (pg_data is pinned)
  private:
   Page();
+  Page(const Page&);
+  Page& operator=(const Page&);
 };
 
 /*
@@ -296,6 +307,8 @@ public:
   vector<u64> cols_offset;    // Can be longer than Pgsz (overflow page)
   vector<u64> cols_len;
   vector<sqlite_type> cols_type;
+  vector<u64> null_mask;    // Bit colno % 64 of [colno / 64] is set
+                            // when cols_type[colno] is ST_NULL
   u8 *data;                 // When payload has no overflow page,
                             // it points to a BtreePage's pg_data.
                             // Otherwise, new space is allocated
@@ -304,7 +317,7 @@ public:
 
   public:
   Payload()
-    : cols_offset(0), cols_len(0), cols_type(0), data(NULL)
+    : cols_offset(0), cols_len(0), cols_type(0), null_mask(0), data(NULL)
   {}
 
 
@@ -326,6 +339,9 @@ public:
       offset += len;
       read_hdr_sz += len;
 
+      size_t colno = cols_type.size();
+      if (colno % 64 == 0) null_mask.push_back(0);
+      null_mask.back() |= (u64)(stype == ST_NULL) << (colno % 64);
       if (stype <= 9) {
         cols_type.push_back(static_cast<sqlite_type>(stype));
       } else if (stype >= 12) {
@@ -348,6 +364,43 @@ public:
     return true;
   }
 
+  /*
+  ** Integer value of colno.
+  ** Column type must be one of ST_INT8 ... ST_INT64, ST_C0 and ST_C1.
+  */
+  public:
+  s64 get_int(int colno) const {
+    switch (cols_type[colno]) {
+    case ST_C0: return 0;
+    case ST_C1: return 1;
+    default: break;
+    }
+    const u8 *p = &data[cols_offset[colno]];
+    u64 len = cols_len[colno];
+    switch (len) {
+    case 1: return (s8)p[0];
+    case 2: return (s16)be16_to_u16(p);
+    case 4: return (s32)be32_to_u32(p);
+    case 8: return (s64)be64_to_u64(p);
+    default: break;
+    }
+    my_assert(len == 3 || len == 6);
+    u64 v = u8s_to_val<u64>(p, len);
+    if (p[0] & 0x80) v |= ~0ULL << (8 * len);  // sign extension
+    return (s64)v;
+  }
+
+  /*
+  ** Float value of colno. Column type must be ST_FLOAT.
+  */
+  public:
+  double get_double(int colno) const {
+    u64 v = be64_to_u64(&data[cols_offset[colno]]);
+    double d;
+    memcpy(&d, &v, sizeof(d));
+    return d;
+  }
+
 };
 
 struct RecordCell {
@@ -361,6 +414,31 @@ struct RecordCell {
   inline bool has_overflow_pg() const { return overflow_pgno != 0; }
 };
 
+/*
+** Split a payload of payload_sz into the local part and overflow pages.
+**
+** @return Bytes of the payload stored in the B-tree page itself.
+**
+** @see http://www.sqlite.org/fileformat2.html - B-tree Pages
+*/
+static inline u64 payload_sz_in_origpg(u64 payload_sz, Pgsz usable_sz, Pgsz max_local)
+{
+  if (payload_sz <= max_local) return payload_sz;
+  Pgsz min_local = (usable_sz - 12) * 32/255 - 23;
+  Pgsz local_sz = min_local + (payload_sz - min_local) % (usable_sz - 4);
+  return local_sz > max_local ? min_local : local_sz;
+}
+
+/*
+** Copy a payload which spans overflow pages into buf_overflown_payload,
+** and digest it.
+** cell->payload.data must point to the part in the original page.
+*/
+void copy_overflown_payload(/* inout */
+                            RecordCell *cell,
+                            /* out */
+                            u8 *buf_overflown_payload);
+
 class TableLeafPage : public BtreePage {
   public:
   TableLeafPage(Pgno pgno)
@@ -404,9 +482,7 @@ class TableLeafPage : public BtreePage {
       cell->overflow_pgno = 0;
     } else {
       // overflow page exists
-      Pgsz min_local = (usable_sz - 12) * 32/255 - 23;
-      Pgsz local_sz = min_local + (cell->payload_sz - min_local) % (usable_sz - 4);
-      cell->payload_sz_in_origpg = local_sz > max_local ? min_local : local_sz;
+      cell->payload_sz_in_origpg = payload_sz_in_origpg(cell->payload_sz, usable_sz, max_local);
 
       cell->overflow_pgno = u8s_to_val<Pgno>(&pg_data[offset + cell->payload_sz_in_origpg],
                                              BTREECELL_OVERFLOWPGNO_LEN);
@@ -437,34 +513,7 @@ class TableLeafPage : public BtreePage {
                     u8 *buf_overflown_payload) const
   {
     // Asserted get_ith_cell(Pgsz i, RecordCell *cell) is called first
-    my_assert(buf_overflown_payload);
-    my_assert(cell->overflow_pgno != 0);
-    my_assert(cell->payload_sz_in_origpg > 0);
-    my_assert(cell->payload_sz_in_origpg < cell->payload_sz);
-
-    // Copy payload from this page and overflow pages
-    u64 offset = 0;
-    memcpy(&buf_overflown_payload[offset], cell->payload.data, cell->payload_sz_in_origpg);
-    offset += cell->payload_sz_in_origpg;
-    Pgsz usable_sz = DbHeader::get_pg_sz() - DbHeader::get_reserved_space();
-    u64 payload_sz_rem = cell->payload_sz - cell->payload_sz_in_origpg;
-
-    for (Pgno overflow_pgno = cell->overflow_pgno; overflow_pgno != 0; ) {
-      Page ovpg(overflow_pgno);
-      errstat res = ovpg.fetch();
-      my_assert(res == MYSQLITE_OK);
-      overflow_pgno = u8s_to_val<Pgno>(&ovpg.pg_data[0], sizeof(Pgno));
-      Pgsz payload_sz_inpg = min<u64>(usable_sz - sizeof(Pgno), payload_sz_rem);
-      payload_sz_rem -= payload_sz_inpg;
-      memcpy(&buf_overflown_payload[offset],
-             &ovpg.pg_data[sizeof(Pgno)],
-             payload_sz_inpg);
-      offset += payload_sz_inpg;
-    }
-    my_assert(payload_sz_rem == 0);
-
-    cell->payload.data = buf_overflown_payload;
-    cell->payload.digest_data();
+    copy_overflown_payload(cell, buf_overflown_payload);
     return true;
   }
 
@@ -514,4 +563,86 @@ class TableInteriorPage : public BtreePage {
 };
 
 
+/*
+** Index leaf and interior page
+**
+** A cell is a record of indexed columns followed by rowid.
+** Unlike table B-trees, records in interior cells are index entries too:
+** in index order, an interior cell comes after its left child and
+** before the left child of the next cell (or the rightmost child).
+*/
+class IndexPage : public BtreePage {
+  public:
+  IndexPage(Pgno pgno)
+   : BtreePage(pgno)
+  {}
+
+  public:
+  bool is_leaf() const { return get_btree_type() == INDEX_LEAF; }
+
+  /*
+  ** Same as TableLeafPage::get_ith_cell(Pgsz i, RecordCell *cell).
+  ** cell->rowid is set from the last column of the record
+  ** (only when this returns true).
+  */
+  public:
+  bool get_ith_cell(Pgsz i,
+                    /*out*/
+                    RecordCell *cell) const
+  {
+    assert(PageCache::get_instance()->is_rd_locked());
+    u8 len;
+    Pgsz offset = get_ith_cell_offset(i);
+    if (offset == 0) return false;
+    if (!is_leaf()) offset += BTREECELL_LECTCHILD_LEN;
+
+    cell->payload_sz = get_payload_sz(offset, &len);
+    offset += len;
+    cell->payload.data = &pg_data[offset];
+
+    Pgsz usable_sz = DbHeader::get_pg_sz() - DbHeader::get_reserved_space();
+    Pgsz max_local = (usable_sz - 12) * 64/255 - 23;
+    if (cell->payload_sz <= max_local) {
+      cell->overflow_pgno = 0;
+    } else {
+      cell->payload_sz_in_origpg = payload_sz_in_origpg(cell->payload_sz, usable_sz, max_local);
+      cell->overflow_pgno = u8s_to_val<Pgno>(&pg_data[offset + cell->payload_sz_in_origpg],
+                                             BTREECELL_OVERFLOWPGNO_LEN);
+      return false;  // caller should call
+                     // get_ith_cell(Pgsz i, RecordCell *cell,
+                     //              u8 *buf_overflown_payload)
+                     // later.
+    }
+
+    cell->payload.digest_data();
+    cell->rowid = cell->payload.get_int(cell->payload.cols_type.size() - 1);
+    return true;
+  }
+
+  /*
+  ** Same as TableLeafPage::get_ith_cell(Pgsz i, RecordCell *cell,
+  **                                     u8 *buf_overflown_payload).
+  */
+  public:
+  bool get_ith_cell(Pgsz i,
+                    /*out*/
+                    RecordCell *cell,
+                    u8 *buf_overflown_payload) const
+  {
+    copy_overflown_payload(cell, buf_overflown_payload);
+    cell->rowid = cell->payload.get_int(cell->payload.cols_type.size() - 1);
+    return true;
+  }
+
+  /*
+  ** @note Only for INDEX_INTERIOR.
+  */
+  public:
+  Pgno get_ith_cell_left_child(Pgsz i) const {
+    my_assert(get_btree_type() == INDEX_INTERIOR);
+    return get_leftchild_pgno(get_ith_cell_offset(i));
+  }
+};
+
+
 #endif /* _SQLITE_FORMAT_H_ */
@@ -0,0 +1,50 @@
+#include <gtest/gtest.h>
+
+#include "../lock_stats.h"
+
+
+TEST(LatencyHistogram, bucket_of)
+{
+  using namespace mysqlite;
+  EXPECT_EQ(0, LatencyHistogram::bucket_of(0));
+  EXPECT_EQ(1, LatencyHistogram::bucket_of(1));
+  EXPECT_EQ(2, LatencyHistogram::bucket_of(2));
+  EXPECT_EQ(2, LatencyHistogram::bucket_of(3));
+  EXPECT_EQ(3, LatencyHistogram::bucket_of(4));
+  EXPECT_EQ(11, LatencyHistogram::bucket_of(1024));
+  EXPECT_EQ(LatencyHistogram::N_BUCKETS - 1, LatencyHistogram::bucket_of(~0ULL));
+}
+
+TEST(LatencyHistogram, bucket_upper_usec)
+{
+  using namespace mysqlite;
+  EXPECT_EQ(1u, LatencyHistogram::bucket_upper_usec(0));
+  EXPECT_EQ(2u, LatencyHistogram::bucket_upper_usec(1));
+  EXPECT_EQ(1024u, LatencyHistogram::bucket_upper_usec(10));
+  EXPECT_EQ(0u, LatencyHistogram::bucket_upper_usec(LatencyHistogram::N_BUCKETS - 1));
+
+  // Every sample is less than upper bound of its bucket
+  for (u64 usec = 0; usec < 100000; usec += 7) {
+    int i = LatencyHistogram::bucket_of(usec);
+    EXPECT_LT(usec, LatencyHistogram::bucket_upper_usec(i));
+    if (i > 0) {
+      EXPECT_GE(usec, LatencyHistogram::bucket_upper_usec(i - 1));
+    }
+  }
+}
+
+TEST(LatencyHistogram, add)
+{
+  using namespace mysqlite;
+  LatencyHistogram hist;
+  hist.add(0);
+  hist.add(3);
+  hist.add(3);
+  hist.add(1000);
+
+  EXPECT_EQ(4u, hist.count());
+  EXPECT_EQ(1006u, hist.total_usec());
+  EXPECT_EQ(1u, hist.bucket(0));
+  EXPECT_EQ(2u, hist.bucket(2));
+  EXPECT_EQ(1u, hist.bucket(10));
+}
@@ -217,3 +217,1259 @@ TEST(CheckAllData, SmallData)
 //   rows->close();
 //   conn.close();
 // }
+
+TEST(Connection, get_table_def)
+{
+  using namespace mysqlite;
+
+  Connection conn;
+  ASSERT_EQ(MYSQLITE_OK, conn.open(MYSQLITE_TEST_DB_DIR "/IndexCursor-events.sqlite"));
+  conn.rdlock_db();
+
+  TableDef tbl;
+  ASSERT_EQ(MYSQLITE_OK, conn.get_table_def("Event", &tbl));
+  ASSERT_EQ(5u, tbl.root_pgno);
+  ASSERT_EQ(4u, tbl.cols.size());
+  ASSERT_EQ(0, tbl.rowid_colno);
+  ASSERT_EQ(3u, tbl.indexes.size());
+
+  const IndexDef *autoindex = tbl.find_index("sqlite_autoindex_Event_1");
+  ASSERT_TRUE(autoindex != NULL);
+  ASSERT_EQ(6u, autoindex->root_pgno);
+  ASSERT_TRUE(autoindex->usable);
+  ASSERT_EQ(2u, autoindex->cols.size());
+  ASSERT_EQ(COLL_NOCASE, autoindex->cols[0].coll);
+
+  const IndexDef *val_desc = tbl.find_index("Event_val_desc");
+  ASSERT_TRUE(val_desc != NULL);
+  ASSERT_EQ(8u, val_desc->root_pgno);
+  ASSERT_TRUE(val_desc->cols[0].desc);
+
+  ASSERT_EQ(MYSQLITE_NO_SUCH_TABLE, conn.get_table_def("NoSuchTable", &tbl));
+
+  conn.unlock_db();
+  conn.close();
+}
+
+/*
+** Copy a test DB over path, as another process writing it would.
+*/
+static void write_db(const char *src, const char *path)
+{
+  int out = open(path, O_WRONLY | O_CREAT, 0600);
+  int in = open(src, O_RDONLY);
+  char buf[4096];
+  ssize_t n;
+  off_t offset = 0;
+  while ((n = read(in, buf, sizeof(buf))) > 0) {
+    if (pwrite(out, buf, n, offset) != n) break;
+    offset += n;
+  }
+  close(in);
+  close(out);
+}
+
+TEST(Connection, catalog_reload)
+{
+  using namespace mysqlite;
+
+  char path[] = "/tmp/mysqlite_apiTest_XXXXXX";
+  close(mkstemp(path));
+  write_db(MYSQLITE_TEST_DB_DIR "/Catalog-v1.sqlite", path);
+
+  Connection conn;
+  ASSERT_EQ(MYSQLITE_OK, conn.open(path, DB_READ_WRITE, PCACHE_PREAD));
+  conn.rdlock_db();
+  TableDef tbl;
+  ASSERT_EQ(MYSQLITE_OK, conn.get_table_def("A", &tbl));
+  ASSERT_EQ(1u, tbl.cols.size());
+  ASSERT_EQ(MYSQLITE_NO_SUCH_TABLE, conn.get_table_def("B", &tbl));
+  ASSERT_TRUE(conn.table_fullscan("B") == NULL);
+  conn.unlock_db();
+
+  // A is recreated with another column and B is created
+  write_db(MYSQLITE_TEST_DB_DIR "/Catalog-v2.sqlite", path);
+
+  conn.rdlock_db();
+  ASSERT_EQ(MYSQLITE_OK, conn.get_table_def("A", &tbl));
+  ASSERT_EQ(2u, tbl.cols.size());
+  ASSERT_EQ(1u, tbl.indexes.size());
+  ASSERT_EQ(MYSQLITE_OK, conn.get_table_def("B", &tbl));
+  ASSERT_EQ(3u, tbl.root_pgno);
+
+  RowCursor *rows = conn.table_fullscan("B");
+  ASSERT_TRUE(rows != NULL);
+  ASSERT_TRUE(rows->next());
+  ASSERT_EQ("b", rows->get_text(0));
+  rows->close();
+  conn.unlock_db();
+
+  conn.close();
+  unlink(path);
+}
+
+class IndexCursorTest : public ::testing::Test {
+protected:
+  mysqlite::Connection conn;
+  TableDef tbl;
+
+  void SetUp() {
+    ASSERT_EQ(MYSQLITE_OK, conn.open(MYSQLITE_TEST_DB_DIR "/IndexCursor-events.sqlite"));
+    conn.rdlock_db();
+  }
+  void TearDown() {
+    conn.unlock_db();
+    conn.close();
+  }
+
+  mysqlite::IndexCursor *index_scan(const char *table, const char *index) {
+    if (conn.get_table_def(table, &tbl) != MYSQLITE_OK) return NULL;
+    const IndexDef *idx = tbl.find_index(index);
+    return idx ? conn.index_scan(tbl, *idx) : NULL;
+  }
+};
+
+TEST_F(IndexCursorTest, fullscan_in_index_order)
+{
+  using namespace mysqlite;
+
+  // Event.ts is a permutation of 1..3000. The index has interior pages.
+  IndexCursor *rows = index_scan("Event", "Event_ts");
+  ASSERT_TRUE(rows);
+  int n_rows = 0;
+  for (bool found = rows->first(); found; found = rows->next()) {
+    ++n_rows;
+    ASSERT_EQ(n_rows, rows->get_int(1));
+    ASSERT_EQ((u64)n_rows, (rows->get_rowid() * 7919) % 3001);
+  }
+  ASSERT_EQ(3000, n_rows);
+  ASSERT_FALSE(rows->next());
+  rows->close();
+}
+
+TEST_F(IndexCursorTest, seek)
+{
+  using namespace mysqlite;
+
+  IndexCursor *rows = index_scan("Event", "Event_ts");
+  ASSERT_TRUE(rows);
+  vector<KeyValue> key(1);
+
+  key[0] = KeyValue::of_int(1234);
+  ASSERT_TRUE(rows->seek(key, SEEK_EQ));
+  ASSERT_EQ(1145u, rows->get_rowid());
+  ASSERT_EQ(1234, rows->get_int(1));
+  ASSERT_FALSE(rows->next_same());
+
+  key[0] = KeyValue::of_int(2990);
+  ASSERT_TRUE(rows->seek(key, SEEK_GE));
+  ASSERT_EQ(2990, rows->get_int(1));
+  int n_rows = 1;
+  while (rows->next()) ++n_rows;
+  ASSERT_EQ(11, n_rows);
+
+  key[0] = KeyValue::of_int(2990);
+  ASSERT_TRUE(rows->seek(key, SEEK_GT));
+  ASSERT_EQ(2991, rows->get_int(1));
+
+  key[0] = KeyValue::of_double(2989.5);
+  ASSERT_TRUE(rows->seek(key, SEEK_GE));
+  ASSERT_EQ(2990, rows->get_int(1));
+
+  key[0] = KeyValue::of_int(3000);
+  ASSERT_FALSE(rows->seek(key, SEEK_GT));
+  key[0] = KeyValue::of_int(0);
+  ASSERT_FALSE(rows->seek(key, SEEK_EQ));
+  key[0] = KeyValue::null_value();
+  ASSERT_TRUE(rows->seek(key, SEEK_GT));  // NULL is the smallest
+  ASSERT_EQ(1, rows->get_int(1));
+
+  rows->close();
+}
+
+TEST_F(IndexCursorTest, seek_rowid)
+{
+  using namespace mysqlite;
+
+  // Event has rowids 1..3000 in a table B-tree with interior pages
+  RowCursor *rows = conn.table_fullscan("Event");
+  ASSERT_TRUE(rows);
+
+  ASSERT_TRUE(rows->seek_rowid(1145));
+  ASSERT_EQ(1145u, rows->get_rowid());
+  ASSERT_EQ(1234, rows->get_int(1));
+  ASSERT_TRUE(rows->next());
+  ASSERT_EQ(1146u, rows->get_rowid());
+
+  // Revisit rows in random order
+  for (Rowid rowid = 1; rowid <= 3000; rowid += 7) {
+    Rowid r = (rowid * 7919) % 3001;
+    ASSERT_TRUE(rows->seek_rowid(r));
+    ASSERT_EQ(r, rows->get_rowid());
+    ASSERT_EQ((s64)((r * 7919) % 3001), rows->get_int(1));
+  }
+
+  ASSERT_TRUE(rows->seek_rowid(3000));
+  ASSERT_FALSE(rows->next());
+  ASSERT_FALSE(rows->seek_rowid(0));
+  ASSERT_TRUE(rows->next());  // Continues from the next larger rowid
+  ASSERT_EQ(1u, rows->get_rowid());
+  ASSERT_FALSE(rows->seek_rowid(3001));
+  ASSERT_FALSE(rows->next());
+
+  rows->close();
+}
+
+TEST_F(IndexCursorTest, rowid_scan)
+{
+  using namespace mysqlite;
+
+  ASSERT_EQ(MYSQLITE_OK, conn.get_table_def("Event", &tbl));
+  RowidCursor *rows = conn.rowid_scan(tbl);
+  ASSERT_TRUE(rows);
+  vector<KeyValue> key(1);
+
+  int n_rows = 0;
+  for (bool found = rows->first(); found; found = rows->next()) {
+    ++n_rows;
+    ASSERT_EQ((Rowid)n_rows, rows->get_rowid());
+  }
+  ASSERT_EQ(3000, n_rows);
+
+  key[0] = KeyValue::of_int(1145);
+  ASSERT_TRUE(rows->seek(key, SEEK_EQ));
+  ASSERT_EQ(1234, rows->get_int(1));
+  ASSERT_FALSE(rows->next_same());
+
+  key[0] = KeyValue::of_int(2990);
+  ASSERT_TRUE(rows->seek(key, SEEK_GE));
+  ASSERT_EQ(2990u, rows->get_rowid());
+  n_rows = 1;
+  while (rows->next()) ++n_rows;
+  ASSERT_EQ(11, n_rows);
+
+  ASSERT_TRUE(rows->seek(key, SEEK_GT));
+  ASSERT_EQ(2991u, rows->get_rowid());
+
+  key[0] = KeyValue::of_int(3000);
+  ASSERT_FALSE(rows->seek(key, SEEK_GT));
+  key[0] = KeyValue::of_int(0);
+  ASSERT_FALSE(rows->seek(key, SEEK_EQ));
+  ASSERT_TRUE(rows->seek(key, SEEK_GE));
+  ASSERT_EQ(1u, rows->get_rowid());
+
+  key[0] = KeyValue::of_double(2.5);
+  ASSERT_FALSE(rows->seek(key, SEEK_EQ));
+  ASSERT_TRUE(rows->seek(key, SEEK_GT));
+  ASSERT_EQ(3u, rows->get_rowid());
+  key[0] = KeyValue::null_value();
+  ASSERT_FALSE(rows->seek(key, SEEK_EQ));
+  ASSERT_TRUE(rows->seek(key, SEEK_GT));
+  ASSERT_EQ(1u, rows->get_rowid());
+  key[0] = KeyValue::of_text("1", 1);
+  ASSERT_FALSE(rows->seek(key, SEEK_GE));
+
+  rows->close();
+}
+
+TEST_F(IndexCursorTest, finger_search)
+{
+  using namespace mysqlite;
+
+  ASSERT_EQ(MYSQLITE_OK, conn.get_table_def("Event", &tbl));
+  RowidCursor *rows = conn.rowid_scan(tbl);
+  IndexCursor *idx_rows = index_scan("Event", "Event_ts");
+  ASSERT_TRUE(rows);
+  ASSERT_TRUE(idx_rows);
+  vector<KeyValue> key(1);
+
+  // Sorted probes (same or neighbouring leaves), then random ones
+  // mixed with scans moving the paths.
+  for (int i = 0; i < 2 * 3000; ++i) {
+    s64 k = i < 3000 ? i / 2 + 1 : ((i * 7919) % 3003) - 1;  // Includes misses
+    seek_mode mode = (seek_mode)(i % 3);
+    key[0] = KeyValue::of_int(k);
+
+    s64 expected = mode == SEEK_GT ? k + 1 : k;
+    bool found = (mode == SEEK_EQ) ? (1 <= k && k <= 3000) : expected <= 3000;
+    if (mode != SEEK_EQ && expected < 1) expected = 1;
+
+    ASSERT_EQ(found, rows->seek(key, mode)) << k << " " << mode;
+    if (found) {
+      ASSERT_EQ((Rowid)expected, rows->get_rowid());
+    }
+    ASSERT_EQ(found, idx_rows->seek(key, mode)) << k << " " << mode;
+    if (found) {
+      ASSERT_EQ(expected, idx_rows->get_int(1));
+    }
+
+    if (i % 100 == 0) {
+      for (int j = 0; j < 100 && rows->next(); ++j) ;
+      for (int j = 0; j < 100 && idx_rows->next(); ++j) ;
+    }
+  }
+
+  idx_rows->close();
+  rows->close();
+}
+
+TEST_F(IndexCursorTest, reverse_rowid_scan)
+{
+  using namespace mysqlite;
+
+  ASSERT_EQ(MYSQLITE_OK, conn.get_table_def("Event", &tbl));
+  RowidCursor *rows = conn.rowid_scan(tbl);
+  ASSERT_TRUE(rows);
+  vector<KeyValue> key(1);
+
+  int n_rows = 0;
+  for (bool found = rows->last(); found; found = rows->prev()) {
+    ASSERT_EQ((Rowid)(3000 - n_rows), rows->get_rowid());
+    ++n_rows;
+  }
+  ASSERT_EQ(3000, n_rows);
+
+  // Direction can change at any row
+  key[0] = KeyValue::of_int(1145);
+  ASSERT_TRUE(rows->seek(key, SEEK_LAST_EQ));
+  ASSERT_EQ(1234, rows->get_int(1));
+  for (int i = 1; i <= 200; ++i) {
+    ASSERT_TRUE(rows->prev());
+    ASSERT_EQ((Rowid)(1145 - i), rows->get_rowid());
+  }
+  for (int i = 199; i >= -200; --i) {
+    ASSERT_TRUE(rows->next());
+    ASSERT_EQ((Rowid)(1145 - i), rows->get_rowid());
+  }
+
+  ASSERT_TRUE(rows->seek(key, SEEK_LE));
+  ASSERT_EQ(1145u, rows->get_rowid());
+  ASSERT_TRUE(rows->seek(key, SEEK_LT));
+  ASSERT_EQ(1144u, rows->get_rowid());
+  key[0] = KeyValue::of_int(5000);
+  ASSERT_TRUE(rows->seek(key, SEEK_LE));
+  ASSERT_EQ(3000u, rows->get_rowid());
+  ASSERT_FALSE(rows->seek(key, SEEK_LAST_EQ));
+  key[0] = KeyValue::of_int(1);
+  ASSERT_FALSE(rows->seek(key, SEEK_LT));
+  ASSERT_TRUE(rows->seek(key, SEEK_LE));
+  ASSERT_FALSE(rows->prev());
+  key[0] = KeyValue::of_double(2.5);
+  ASSERT_TRUE(rows->seek(key, SEEK_LE));
+  ASSERT_EQ(2u, rows->get_rowid());
+
+  rows->close();
+}
+
+TEST_F(IndexCursorTest, reverse_index_scan)
+{
+  using namespace mysqlite;
+
+  IndexCursor *rows = index_scan("Event", "Event_ts");
+  ASSERT_TRUE(rows);
+  int n_rows = 0;
+  for (bool found = rows->last(); found; found = rows->prev()) {
+    ASSERT_EQ(3000 - n_rows, rows->get_int(1));
+    ++n_rows;
+  }
+  ASSERT_EQ(3000, n_rows);
+
+  vector<KeyValue> key(1);
+  key[0] = KeyValue::of_int(1234);
+  ASSERT_TRUE(rows->seek(key, SEEK_LE));
+  ASSERT_EQ(1234, rows->get_int(1));
+  ASSERT_TRUE(rows->seek(key, SEEK_LT));
+  ASSERT_EQ(1233, rows->get_int(1));
+  for (int ts = 1234; ts <= 1500; ++ts) {
+    ASSERT_TRUE(rows->next());
+    ASSERT_EQ(ts, rows->get_int(1));
+  }
+  for (int ts = 1499; ts >= 1; --ts) {
+    ASSERT_TRUE(rows->prev());
+    ASSERT_EQ(ts, rows->get_int(1));
+  }
+  ASSERT_FALSE(rows->prev());
+  rows->close();
+
+  // Last entries of a NOCASE prefix, and before it
+  rows = index_scan("Event", "sqlite_autoindex_Event_1");
+  ASSERT_TRUE(rows);
+  key[0] = KeyValue::of_text("click", 5);
+  ASSERT_TRUE(rows->seek(key, SEEK_LAST_EQ));
+  ASSERT_EQ(3000, rows->get_int(1));
+  n_rows = 1;
+  int last_ts = 3000;
+  while (rows->prev() && (rows->get_text(2) == "click" || rows->get_text(2) == "Click")) {
+    ASSERT_LT(rows->get_int(1), last_ts);
+    last_ts = rows->get_int(1);
+    ++n_rows;
+  }
+  ASSERT_EQ(1200, n_rows);
+  ASSERT_EQ("buy", rows->get_text(2));
+  ASSERT_EQ(2996, rows->get_int(1));
+
+  ASSERT_TRUE(rows->seek(key, SEEK_LT));
+  ASSERT_EQ("buy", rows->get_text(2));
+  ASSERT_EQ(2996, rows->get_int(1));
+
+  key.push_back(KeyValue::of_int(2995));
+  key[0] = KeyValue::of_text("buy", 3);
+  ASSERT_TRUE(rows->seek(key, SEEK_LE));
+  ASSERT_EQ(2994, rows->get_int(1));
+  key[0] = KeyValue::of_text("zzz", 3);
+  ASSERT_FALSE(rows->seek(key, SEEK_LAST_EQ));
+  ASSERT_TRUE(rows->seek(key, SEEK_LE));
+  ASSERT_EQ("View", rows->get_text(2));
+  ASSERT_EQ(2990, rows->get_int(1));
+  rows->close();
+}
+
+TEST_F(IndexCursorTest, estimate_rowid_range)
+{
+  ASSERT_EQ(MYSQLITE_OK, conn.get_table_def("Event", &tbl));
+
+  // Ranges within a leaf are exact
+  ASSERT_EQ(1u, conn.estimate_rowid_range(tbl, 1145, 1145));
+  ASSERT_EQ(2u, conn.estimate_rowid_range(tbl, 2999, 3005));
+  ASSERT_EQ(0u, conn.estimate_rowid_range(tbl, 3001, INT64_MAX));
+  ASSERT_EQ(0u, conn.estimate_rowid_range(tbl, 5, 4));
+
+  // Ranges over leaves are estimated
+  u64 n = conn.estimate_rowid_range(tbl, 100, 199);
+  ASSERT_GE(n, 50u);
+  ASSERT_LE(n, 250u);
+  n = conn.estimate_rowid_range(tbl, INT64_MIN, INT64_MAX);
+  ASSERT_GE(n, 2000u);
+  ASSERT_LE(n, 4500u);
+}
+
+TEST_F(IndexCursorTest, prefetch_rowids)
+{
+  ASSERT_EQ(MYSQLITE_OK, conn.get_table_def("Event", &tbl));
+
+  // Event has 55 leaves of about 55 rows
+  vector<Rowid> rowids;
+  ASSERT_EQ(0u, conn.prefetch_rowids(tbl, rowids));
+  rowids.push_back(1);
+  rowids.push_back(2);
+  rowids.push_back(3);
+  ASSERT_EQ(1u, conn.prefetch_rowids(tbl, rowids));
+  rowids.assign(1, 1);
+  rowids.push_back(1145);
+  rowids.push_back(3000);
+  rowids.push_back(5000);  // Not in table. Falls in the last leaf.
+  ASSERT_EQ(3u, conn.prefetch_rowids(tbl, rowids));
+  rowids.clear();
+  for (Rowid rowid = 1; rowid <= 3000; rowid += 2) rowids.push_back(rowid);
+  ASSERT_EQ(55u, conn.prefetch_rowids(tbl, rowids));
+}
+
+TEST_F(IndexCursorTest, count_rows)
+{
+  ASSERT_EQ(MYSQLITE_OK, conn.get_table_def("Event", &tbl));
+  ASSERT_EQ(3000u, conn.count_rows(tbl));  // Interior pages and 55 leaves
+  ASSERT_EQ(MYSQLITE_OK, conn.get_table_def("Beer", &tbl));
+  ASSERT_EQ(7u, conn.count_rows(tbl));     // Root leaf
+  ASSERT_EQ(MYSQLITE_OK, conn.get_table_def("Doc", &tbl));
+  ASSERT_EQ(200u, conn.count_rows(tbl));   // Overflow pages are not read
+}
+
+TEST_F(IndexCursorTest, entries_only)
+{
+  using namespace mysqlite;
+
+  IndexCursor *rows = index_scan("Event", "Event_ts");
+  ASSERT_TRUE(rows);
+  rows->set_entries_only(true);
+
+  vector<KeyValue> key(1, KeyValue::of_int(1234));
+  ASSERT_TRUE(rows->seek(key, SEEK_EQ));
+  ASSERT_EQ(1145u, rows->get_rowid());
+  ASSERT_TRUE(rows->next());
+  Rowid next_rowid = rows->get_rowid();
+
+  // Rows are read by rowid afterwards
+  ASSERT_TRUE(rows->seek_rowid(1145));
+  ASSERT_EQ(1234, rows->get_int(1));
+  ASSERT_TRUE(rows->seek_rowid(next_rowid));
+  ASSERT_EQ(1235, rows->get_int(1));
+
+  // get_rowid() follows the row read by rowid
+  ASSERT_TRUE(rows->read_row(1145));
+  ASSERT_EQ(1145u, rows->get_rowid());
+  ASSERT_EQ(1234, rows->get_int(1));
+  ASSERT_FALSE(rows->read_row(100000));
+  ASSERT_EQ(1145u, rows->get_rowid());
+
+  rows->set_entries_only(false);
+  ASSERT_TRUE(rows->seek(key, SEEK_EQ));
+  ASSERT_EQ(1234, rows->get_int(1));
+  rows->close();
+}
+
+TEST_F(IndexCursorTest, read_row)
+{
+  using namespace mysqlite;
+
+  // UNIQUE (kind COLLATE NOCASE, ts): check ts in entries, then read rows
+  IndexCursor *rows = index_scan("Event", "sqlite_autoindex_Event_1");
+  ASSERT_TRUE(rows);
+  rows->set_entries_only(true);
+
+  vector<KeyValue> key(1, KeyValue::of_text("buy", 3));
+  int n_rows = 0, n_read = 0;
+  for (bool found = rows->seek(key, SEEK_EQ); found; found = rows->next_same()) {
+    ++n_rows;
+    s64 ts = rows->get_entry_values()[1].i;
+    if (ts % 100 != 0) continue;
+    ASSERT_TRUE(rows->read_row());
+    ASSERT_EQ(ts, rows->get_int(1));
+    ++n_read;
+  }
+  ASSERT_EQ(600, n_rows);
+  ASSERT_EQ(7, n_read);
+
+  // Backward in the entries of a key
+  key[0] = KeyValue::of_text("VIEW", 4);
+  n_rows = 0;
+  for (bool found = rows->seek(key, SEEK_LAST_EQ); found; found = rows->prev_same()) ++n_rows;
+  ASSERT_EQ(600, n_rows);
+
+  rows->close();
+}
+
+TEST_F(IndexCursorTest, seek_prefix_with_collation)
+{
+  using namespace mysqlite;
+
+  // UNIQUE (kind COLLATE NOCASE, ts)
+  IndexCursor *rows = index_scan("Event", "sqlite_autoindex_Event_1");
+  ASSERT_TRUE(rows);
+
+  vector<KeyValue> key(1, KeyValue::of_text("CLICK", 5));
+  ASSERT_TRUE(rows->seek(key, SEEK_EQ));
+  int n_rows = 1;
+  while (rows->next_same()) {
+    string kind = rows->get_text(2);
+    ASSERT_TRUE(kind == "click" || kind == "Click");
+    ++n_rows;
+  }
+  ASSERT_EQ(1200, n_rows);
+
+  key[0] = KeyValue::of_text("view", 4);
+  key.push_back(KeyValue::of_int(5));
+  ASSERT_TRUE(rows->seek(key, SEEK_GE));
+  ASSERT_EQ(526u, rows->get_rowid());
+  ASSERT_TRUE(rows->next());
+  ASSERT_EQ(2666u, rows->get_rowid());
+  ASSERT_EQ(19, rows->get_int(1));
+  ASSERT_FALSE(rows->seek(key, SEEK_EQ));
+
+  rows->close();
+}
+
+TEST_F(IndexCursorTest, desc_index)
+{
+  using namespace mysqlite;
+
+  IndexCursor *rows = index_scan("Event", "Event_val_desc");
+  ASSERT_TRUE(rows);
+
+  ASSERT_TRUE(rows->first());
+  ASSERT_EQ(635u, rows->get_rowid());   // val=1000
+  ASSERT_TRUE(rows->next());
+  ASSERT_EQ(1354u, rows->get_rowid());  // val=999
+
+  // First entry not greater than -3 in index order
+  vector<KeyValue> key(1, KeyValue::of_int(-3));
+  ASSERT_TRUE(rows->seek(key, SEEK_GE));
+  ASSERT_EQ(812u, rows->get_rowid());
+  ASSERT_TRUE(rows->next_same());
+  ASSERT_EQ(1407u, rows->get_rowid());
+  ASSERT_FALSE(rows->next_same());
+
+  // NULLs come last
+  key[0] = KeyValue::null_value();
+  ASSERT_TRUE(rows->seek(key, SEEK_EQ));
+  int n_nulls = 1;
+  while (rows->next()) {
+    ASSERT_EQ(MYSQLITE_NULL, rows->get_type(3));
+    ++n_nulls;
+  }
+  ASSERT_EQ(300, n_nulls);
+
+  rows->close();
+}
+
+TEST_F(IndexCursorTest, overflow_pages)
+{
+  using namespace mysqlite;
+
+  // Titles up to 1089 bytes span overflow pages of the index
+  IndexCursor *rows = index_scan("Doc", "Doc_title");
+  ASSERT_TRUE(rows);
+
+  int n_rows = 0;
+  for (bool found = rows->first(); found; found = rows->next()) ++n_rows;
+  ASSERT_EQ(200, n_rows);
+
+  string title;
+  for (int i = 0; i < 121; ++i) title += "title006 ";
+  vector<KeyValue> key(1, KeyValue::of_text(title.data(), title.size()));
+  ASSERT_TRUE(rows->seek(key, SEEK_EQ));
+  ASSERT_EQ(7u, rows->get_rowid());
+  ASSERT_EQ("body6", rows->get_text(1));
+
+  // Prefix key
+  key[0] = KeyValue::of_text("title006", 8, 8);
+  ASSERT_TRUE(rows->seek(key, SEEK_EQ));
+  ASSERT_EQ(7u, rows->get_rowid());
+  ASSERT_FALSE(rows->next_same());
+
+  rows->close();
+}
+
+TEST_F(IndexCursorTest, get_entry_values)
+{
+  using namespace mysqlite;
+
+  // Index-only scan in the index order
+  IndexCursor *rows = index_scan("Event", "Event_ts");
+  ASSERT_TRUE(rows);
+  rows->set_entries_only(true);
+  ASSERT_TRUE(rows->get_entry_values().empty());
+  int n_rows = 0;
+  for (bool found = rows->first(); found; found = rows->next()) {
+    const vector<KeyValue> &values = rows->get_entry_values();
+    ASSERT_EQ(1u, values.size());
+    ASSERT_EQ(MYSQLITE_INTEGER, values[0].type);
+    ASSERT_EQ(++n_rows, values[0].i);
+  }
+  ASSERT_EQ(3000, n_rows);
+  rows->close();
+
+  // Same values as in the table, also for records on overflow pages
+  rows = index_scan("Doc", "Doc_title");
+  ASSERT_TRUE(rows);
+  n_rows = 0;
+  for (bool found = rows->first(); found; found = rows->next()) {
+    vector<KeyValue> values = rows->get_entry_values();
+    ASSERT_EQ(1u, values.size());
+    ASSERT_EQ(MYSQLITE_TEXT, values[0].type);
+    string title((const char *)values[0].p, values[0].len);
+    ASSERT_EQ(rows->get_text(0), title);
+    ++n_rows;
+  }
+  ASSERT_EQ(200, n_rows);
+  rows->close();
+}
+
+/*
+** Rows of a fullscan passing filter.
+*/
+static int count_filtered(mysqlite::Connection &conn, const mysqlite::RowFilter &filter)
+{
+  mysqlite::RowCursor *rows = conn.table_fullscan("Event");
+  rows->set_filter(&filter);
+  int n_rows = 0;
+  while (rows->next()) ++n_rows;
+  rows->close();
+  return n_rows;
+}
+
+TEST_F(IndexCursorTest, fullscan_filter)
+{
+  using namespace mysqlite;
+
+  RowFilter filter;
+  ASSERT_EQ(3000, count_filtered(conn, filter));
+
+  // ts < 100 AND kind IN ('buy', 'View')
+  ColumnFilter ts_lt(1, FILTER_LT);
+  ts_lt.values.push_back(KeyValue::of_int(100));
+  filter.add(ts_lt);
+  ColumnFilter kind_in(2, FILTER_IN);
+  string buy = "buy", view = "View";
+  kind_in.values.push_back(KeyValue::of_text(buy.data(), buy.size()));
+  kind_in.values.push_back(KeyValue::of_text(view.data(), view.size()));
+  filter.add(kind_in);
+  buy = view = "xxxx";  // Values are copied
+  ASSERT_EQ(41, count_filtered(conn, filter));
+  RowCursor *rows = conn.table_fullscan("Event");
+  rows->set_filter(&filter);
+  while (rows->next()) {
+    ASSERT_LT(rows->get_int(1), 100);
+    string kind = rows->get_text(2);
+    ASSERT_TRUE(kind == "buy" || kind == "View");
+  }
+  rows->close();
+
+  // NULL is neither equal nor unequal
+  filter.clear();
+  ColumnFilter val_ne(3, FILTER_NE);
+  val_ne.values.push_back(KeyValue::of_int(0));
+  filter.add(val_ne);
+  ASSERT_EQ(2697, count_filtered(conn, filter));
+  filter.clear();
+  filter.add(ColumnFilter(3, FILTER_IS_NULL));
+  ASSERT_EQ(300, count_filtered(conn, filter));
+  filter.clear();
+  ColumnFilter val_ge(3, FILTER_GE);
+  val_ge.values.push_back(KeyValue::of_double(989.5));
+  filter.add(val_ge);
+  ASSERT_EQ(16, count_filtered(conn, filter));
+
+  // LIKE 'cl%' is case sensitive
+  filter.clear();
+  ColumnFilter kind_prefix(2, FILTER_PREFIX);
+  kind_prefix.values.push_back(KeyValue::of_text("cl", 2));
+  filter.add(kind_prefix);
+  ASSERT_EQ(600, count_filtered(conn, filter));
+
+  // Trailing spaces
+  filter.clear();
+  ColumnFilter kind_eq(2, FILTER_EQ);
+  kind_eq.values.push_back(KeyValue::of_text("buy  ", 5));
+  filter.add(kind_eq);
+  ASSERT_EQ(0, count_filtered(conn, filter));
+  filter.clear();
+  kind_eq.pad_space = true;
+  filter.add(kind_eq);
+  ASSERT_EQ(600, count_filtered(conn, filter));
+
+  // Values out of the judged range always pass
+  filter.clear();
+  kind_eq.max_chars = 4;  // 'Click', 'click' and 'search' are not judged
+  filter.add(kind_eq);
+  ASSERT_EQ(2400, count_filtered(conn, filter));
+  filter.clear();
+  ColumnFilter ts_lt_10(1, FILTER_LT);
+  ts_lt_10.values.push_back(KeyValue::of_int(10));
+  ts_lt_10.max_int = 50;
+  filter.add(ts_lt_10);
+  ASSERT_EQ(9 + 2950, count_filtered(conn, filter));
+
+  // Numbers and TEXT are not compared
+  filter.clear();
+  ColumnFilter ts_eq(1, FILTER_EQ);
+  ts_eq.values.push_back(KeyValue::of_text("1", 1));
+  filter.add(ts_eq);
+  ASSERT_EQ(3000, count_filtered(conn, filter));
+}
+
+TEST_F(IndexCursorTest, parallel_scan)
+{
+  using namespace mysqlite;
+
+  ASSERT_EQ(MYSQLITE_OK, conn.get_table_def("Event", &tbl));
+
+  // Every row once, in no particular order
+  ParallelScanCursor *rows = static_cast<ParallelScanCursor *>(conn.table_parallel_scan(tbl, 4));
+  ASSERT_EQ(55u, rows->get_n_subtrees());  // Children of the root
+  vector<int> seen(3001);
+  int n_rows = 0;
+  while (rows->next()) {
+    Rowid rowid = rows->get_rowid();
+    ASSERT_TRUE(rowid >= 1 && rowid <= 3000);
+    ASSERT_EQ(0, seen[rowid]++);
+    ASSERT_EQ((s64)(rowid * 7919 % 3001), rows->get_int(1));
+    ++n_rows;
+  }
+  ASSERT_EQ(3000, n_rows);
+  ASSERT_FALSE(rows->next());
+  rows->close();
+
+  // Workers test the filter
+  RowFilter filter;
+  ColumnFilter ts_lt(1, FILTER_LT);
+  ts_lt.values.push_back(KeyValue::of_int(100));
+  filter.add(ts_lt);
+  rows = static_cast<ParallelScanCursor *>(conn.table_parallel_scan(tbl, 4));
+  rows->set_filter(&filter);
+  n_rows = 0;
+  while (rows->next()) {
+    ASSERT_LT(rows->get_int(1), 100);
+    ++n_rows;
+  }
+  ASSERT_EQ(99, n_rows);
+  rows->close();
+
+  // Rows are revisited by rowid. Closed before the end.
+  rows = static_cast<ParallelScanCursor *>(conn.table_parallel_scan(tbl, 2));
+  ASSERT_TRUE(rows->next());
+  ASSERT_TRUE(rows->seek_rowid(1145));
+  ASSERT_EQ(1234, rows->get_int(1));
+  ASSERT_TRUE(rows->next());
+  rows->close();
+
+  // Table of a single leaf
+  ASSERT_EQ(MYSQLITE_OK, conn.get_table_def("Beer", &tbl));
+  rows = static_cast<ParallelScanCursor *>(conn.table_parallel_scan(tbl, 4));
+  ASSERT_EQ(1u, rows->get_n_subtrees());
+  n_rows = 0;
+  while (rows->next()) ++n_rows;
+  ASSERT_EQ(7, n_rows);
+  rows->close();
+}
+
+TEST_F(IndexCursorTest, leaf_order_scan)
+{
+  using namespace mysqlite;
+
+  ASSERT_EQ(MYSQLITE_OK, conn.get_table_def("Event", &tbl));
+
+  // Leaves are the children of the root, in page number order
+  vector<Pgno> leaves = conn.get_table_leaves(tbl);
+  ASSERT_EQ(55u, leaves.size());
+  for (size_t i = 1; i < leaves.size(); ++i) ASSERT_LT(leaves[i - 1], leaves[i]);
+  ASSERT_EQ(leaves, conn.get_table_leaves(tbl));  // Cached
+
+  // Every row once
+  RowCursor *rows = conn.table_leaf_order_scan(tbl);
+  vector<int> seen(3001);
+  int n_rows = 0;
+  while (rows->next()) {
+    Rowid rowid = rows->get_rowid();
+    ASSERT_TRUE(rowid >= 1 && rowid <= 3000);
+    ASSERT_EQ(0, seen[rowid]++);
+    ASSERT_EQ((s64)(rowid * 7919 % 3001), rows->get_int(1));
+    ++n_rows;
+  }
+  ASSERT_EQ(3000, n_rows);
+  ASSERT_FALSE(rows->next());
+  rows->close();
+
+  // Filter, and rows revisited by rowid
+  RowFilter filter;
+  ColumnFilter ts_lt(1, FILTER_LT);
+  ts_lt.values.push_back(KeyValue::of_int(100));
+  filter.add(ts_lt);
+  rows = conn.table_leaf_order_scan(tbl);
+  rows->set_filter(&filter);
+  n_rows = 0;
+  while (rows->next()) {
+    ASSERT_LT(rows->get_int(1), 100);
+    ++n_rows;
+  }
+  ASSERT_EQ(99, n_rows);
+  ASSERT_TRUE(rows->seek_rowid(1145));
+  ASSERT_EQ(1234, rows->get_int(1));
+  rows->close();
+
+  // Table of a single leaf
+  ASSERT_EQ(MYSQLITE_OK, conn.get_table_def("Beer", &tbl));
+  ASSERT_EQ(vector<Pgno>(1, tbl.root_pgno), conn.get_table_leaves(tbl));
+  rows = conn.table_leaf_order_scan(tbl);
+  n_rows = 0;
+  while (rows->next()) ++n_rows;
+  ASSERT_EQ(7, n_rows);
+  rows->close();
+}
+
+TEST_F(IndexCursorTest, shared_scan)
+{
+  using namespace mysqlite;
+
+  ASSERT_EQ(MYSQLITE_OK, conn.get_table_def("Event", &tbl));
+
+  // Alone, a shared scan starts at the first leaf
+  RowCursor *rows = conn.table_shared_scan(tbl);
+  ASSERT_TRUE(rows->next());
+  ASSERT_EQ(1u, rows->get_rowid());
+  for (int i = 0; i < 199; ++i) ASSERT_TRUE(rows->next());
+  Rowid rowid_at_join = rows->get_rowid();
+
+  // Another one joins it at its leaf, and wraps around
+  RowCursor *rows2 = conn.table_shared_scan(tbl);
+  ASSERT_TRUE(rows2->next());
+  Rowid first_rowid = rows2->get_rowid();
+  ASSERT_GT(first_rowid, 1u);
+  ASSERT_LE(first_rowid, rowid_at_join);
+  vector<int> seen(3001);
+  int n_rows = 0, n_wraps = 0;
+  Rowid last_rowid = 0;
+  do {
+    Rowid rowid = rows2->get_rowid();
+    ASSERT_EQ(0, seen[rowid]++);
+    ASSERT_EQ((s64)(rowid * 7919 % 3001), rows2->get_int(1));
+    if (rowid < last_rowid) ++n_wraps;
+    last_rowid = rowid;
+    ++n_rows;
+
+    // Both proceed
+    rows->next();
+  } while (rows2->next());
+  ASSERT_EQ(3000, n_rows);
+  ASSERT_EQ(1, n_wraps);
+  ASSERT_EQ(first_rowid - 1, last_rowid);
+  ASSERT_FALSE(rows2->next());
+  rows2->close();
+  rows->close();
+
+  // Scans are over: start at the first leaf again
+  rows = conn.table_shared_scan(tbl);
+  ASSERT_TRUE(rows->next());
+  ASSERT_EQ(1u, rows->get_rowid());
+  rows->close();
+}
+
+TEST_F(IndexCursorTest, row_pipeline)
+{
+  using namespace mysqlite;
+
+  // Same rows as the cursor, decoded by the producer
+  vector<int> colnos;
+  colnos.push_back(3);  // val, NULL in some rows
+  colnos.push_back(2);  // kind
+  RowCursor *rows = conn.table_fullscan("Event");
+  RowCursor *expected = conn.table_fullscan("Event");
+  RowPipeline *pipeline = new RowPipeline(rows, colnos);
+  int n_rows = 0, n_nulls = 0;
+  while (const DecodedRow *row = pipeline->next()) {
+    ASSERT_TRUE(expected->next());
+    ASSERT_EQ(expected->get_rowid(), row->rowid);
+    ASSERT_EQ(2u, row->values.size());
+    ASSERT_EQ(expected->get_type(3), row->values[0].type);
+    if (row->values[0].type == MYSQLITE_NULL) ++n_nulls;
+    else ASSERT_EQ(expected->get_int(3), row->values[0].i);
+    ASSERT_EQ(MYSQLITE_TEXT, row->values[1].type);
+    ASSERT_EQ(expected->get_text(2), row->values[1].text);
+    size_t n_cols;
+    const u64 *mask = expected->get_null_mask(&n_cols);
+    ASSERT_EQ(n_cols, row->n_rec_cols);
+    ASSERT_EQ(mask[0], row->null_mask[0]);
+    ++n_rows;
+  }
+  ASSERT_EQ(3000, n_rows);
+  ASSERT_EQ(300, n_nulls);
+  ASSERT_FALSE(expected->next());
+  ASSERT_TRUE(pipeline->next() == NULL);
+  delete pipeline;
+  rows->close();
+  expected->close();
+
+  // Filter is tested by the producer. Deleted before the end.
+  RowFilter filter;
+  ColumnFilter ts_lt(1, FILTER_LT);
+  ts_lt.values.push_back(KeyValue::of_int(100));
+  filter.add(ts_lt);
+  rows = conn.table_fullscan("Event");
+  rows->set_filter(&filter);
+  pipeline = new RowPipeline(rows, vector<int>(1, 1));
+  for (int i = 0; i < 10; ++i) {
+    const DecodedRow *row = pipeline->next();
+    ASSERT_TRUE(row != NULL);
+    ASSERT_LT(row->values[0].i, 100);
+  }
+  delete pipeline;
+  rows->close();
+}
+
+TEST_F(IndexCursorTest, get_blob)
+{
+  using namespace mysqlite;
+
+  // Same as get_text(), whether rows have overflow pages (long titles)
+  RowCursor *rows = conn.table_fullscan("Doc");
+  int n_rows = 0, n_on_page = 0;
+  while (rows->next()) {
+    u64 title_len, body_len;
+    bool on_page = false;
+    const u8 *title = rows->get_blob(0, &title_len, &on_page);
+    const u8 *body = rows->get_blob(1, &body_len);
+    ASSERT_EQ(rows->get_text(0), string((const char *)title, title_len));
+    ASSERT_EQ(rows->get_text(1), string((const char *)body, body_len));
+    if (on_page) ++n_on_page;
+    ++n_rows;
+  }
+  ASSERT_EQ(200, n_rows);
+  ASSERT_GT(n_on_page, 0);
+  ASSERT_LT(n_on_page, 200);
+  rows->close();
+}
+
+TEST(RowCursor, get_blob_overflow)
+{
+  using namespace mysqlite;
+
+  Connection conn;
+  ASSERT_EQ(MYSQLITE_OK, conn.open(MYSQLITE_TEST_DB_DIR "/TableLeafPage-overflowpage10000.sqlite"));
+  conn.rdlock_db();
+
+  // Assembled from overflow pages into the cursor
+  RowCursor *rows = conn.table_fullscan("T");
+  ASSERT_TRUE(rows->next());
+  u64 len;
+  bool on_page = true;
+  const u8 *p = rows->get_blob(0, &len, &on_page);
+  ASSERT_FALSE(on_page);
+  ASSERT_EQ(string(10000, 'a'), string((const char *)p, len));
+  ASSERT_EQ(p, rows->get_blob(0, &len));  // Assembled once per row
+  ASSERT_FALSE(rows->next());
+  rows->close();
+
+  conn.unlock_db();
+  conn.close();
+}
+
+TEST(RowCursor, typed_values)
+{
+  using namespace mysqlite;
+
+  Connection conn;
+  ASSERT_EQ(MYSQLITE_OK, conn.open(MYSQLITE_TEST_DB_DIR "/RowCursor-types.sqlite"));
+  conn.rdlock_db();
+
+  // V(id INTEGER PRIMARY KEY, i BIGINT, r REAL, b BLOB, t TEXT), and x INT
+  // added after rows 1-11
+  const s64 ints[] = {0, 1, -128, -32768, -8388608, -2147483648LL,
+                      140737488355327LL, -140737488355328LL,
+                      INT64_MAX, INT64_MIN};
+  RowCursor *rows = conn.table_fullscan("V");
+  for (int id = 1; id <= 10; ++id) {
+    ASSERT_TRUE(rows->next());
+    ASSERT_EQ(MYSQLITE_INTEGER, rows->get_type(1));
+    ASSERT_EQ(ints[id - 1], rows->get_int64(1));
+    ASSERT_EQ((int)ints[id - 1], rows->get_int(1));
+    ASSERT_TRUE(rows->is_null(5));  // Not in the record
+    ASSERT_EQ(id == 1 || id == 3 ? MYSQLITE_BLOB : MYSQLITE_NULL, rows->get_type(3));
+
+    switch (id) {
+    case 1:
+      {
+        ASSERT_EQ(MYSQLITE_FLOAT, rows->get_type(2));
+        ASSERT_EQ(1.5, rows->get_double(2));
+        u64 len;
+        const u8 *p = rows->get_blob(3, &len);
+        ASSERT_EQ(string("\x00\xff\x10", 3), string((const char *)p, len));
+        ASSERT_EQ("a", rows->get_text(4));
+      }
+      break;
+    case 2:
+      ASSERT_EQ(-2.25, rows->get_double(2));
+      ASSERT_TRUE(rows->is_null(4));
+      break;
+    case 3:
+      ASSERT_EQ(3.141592653589793, rows->get_double(2));
+      ASSERT_EQ(MYSQLITE_TEXT, rows->get_type(4));
+      ASSERT_EQ("", rows->get_text(4));
+      break;
+    case 4:
+      // REAL 2.0 is stored as an integer
+      ASSERT_EQ(MYSQLITE_INTEGER, rows->get_type(2));
+      ASSERT_EQ(2.0, rows->get_double(2));
+      break;
+    case 7:
+      ASSERT_EQ(1e300, rows->get_double(2));
+      break;
+    case 8:
+      ASSERT_EQ(-1e-300, rows->get_double(2));
+      break;
+    default:
+      ASSERT_TRUE(rows->is_null(2));
+      break;
+    }
+  }
+
+  ASSERT_TRUE(rows->next());
+  ASSERT_TRUE(rows->is_null(1));
+  ASSERT_TRUE(rows->next());
+  ASSERT_FALSE(rows->is_null(1));
+  ASSERT_EQ(42, rows->get_int64(1));
+  ASSERT_EQ(0.5, rows->get_double(2));
+  ASSERT_EQ(MYSQLITE_INTEGER, rows->get_type(5));
+  ASSERT_EQ(7, rows->get_int64(5));
+  ASSERT_FALSE(rows->next());
+  rows->close();
+
+  conn.unlock_db();
+  conn.close();
+}
+
+TEST(RowCursor, null_mask)
+{
+  using namespace mysqlite;
+
+  Connection conn;
+  ASSERT_EQ(MYSQLITE_OK, conn.open(MYSQLITE_TEST_DB_DIR "/RowCursor-types.sqlite"));
+  conn.rdlock_db();
+
+  // INTEGER PRIMARY KEY (column 0) is NULL in records
+  const u64 masks[] = {0x01, 0x19, 0x01, 0x19, 0x1d, 0x1d, 0x19, 0x19, 0x1d, 0x1d, 0x1f};
+  RowCursor *rows = conn.table_fullscan("V");
+  for (int id = 1; id <= 11; ++id) {
+    ASSERT_TRUE(rows->next());
+    size_t n_cols;
+    const u64 *mask = rows->get_null_mask(&n_cols);
+    ASSERT_EQ(5u, n_cols);
+    ASSERT_EQ(masks[id - 1], mask[0]) << "id=" << id;
+    for (int colno = 0; colno < 6; ++colno)
+      ASSERT_EQ(colno >= 5 || ((mask[0] >> colno) & 1), rows->is_null(colno));
+  }
+  ASSERT_TRUE(rows->next());
+  size_t n_cols;
+  ASSERT_EQ(0x01u, rows->get_null_mask(&n_cols)[0]);
+  ASSERT_EQ(6u, n_cols);
+  rows->close();
+
+  conn.unlock_db();
+  conn.close();
+}
+
+TEST(RowCursor, column_defaults)
+{
+  using namespace mysqlite;
+
+  Connection conn;
+  ASSERT_EQ(MYSQLITE_OK, conn.open(MYSQLITE_TEST_DB_DIR "/RowCursor-defaults.sqlite"));
+  conn.rdlock_db();
+
+  // D(id INTEGER PRIMARY KEY, v INT), and n INT NOT NULL DEFAULT 7,
+  // s TEXT DEFAULT 'it''s', r REAL DEFAULT -1.5e-3, b BLOB DEFAULT x'00ff',
+  // h INT DEFAULT -0x10 and z INT added after rows 1-2
+  TableDef tbl;
+  ASSERT_EQ(MYSQLITE_OK, conn.get_table_def("D", &tbl));
+  ASSERT_EQ(8u, tbl.cols.size());
+
+  // NULL without the columns
+  RowCursor *rows = conn.table_fullscan("D");
+  ASSERT_TRUE(rows->next());
+  ASSERT_EQ(MYSQLITE_NULL, rows->get_type(2));
+  ASSERT_TRUE(rows->is_null(2));
+  rows->close();
+
+  rows = conn.table_fullscan("D");
+  rows->set_columns(&tbl.cols);
+  for (int id = 1; id <= 2; ++id) {
+    ASSERT_TRUE(rows->next());
+    ASSERT_EQ(id * 10, rows->get_int64(1));
+    ASSERT_EQ(MYSQLITE_INTEGER, rows->get_type(2));
+    ASSERT_FALSE(rows->is_null(2));
+    ASSERT_EQ(7, rows->get_int64(2));
+    ASSERT_EQ(7.0, rows->get_double(2));
+    ASSERT_EQ(MYSQLITE_TEXT, rows->get_type(3));
+    ASSERT_EQ("it's", rows->get_text(3));
+    ASSERT_EQ(MYSQLITE_FLOAT, rows->get_type(4));
+    ASSERT_EQ(-1.5e-3, rows->get_double(4));
+    ASSERT_EQ(MYSQLITE_BLOB, rows->get_type(5));
+    u64 len;
+    bool on_page = true;
+    const u8 *p = rows->get_blob(5, &len, &on_page);
+    ASSERT_EQ(string("\x00\xff", 2), string((const char *)p, len));
+    ASSERT_FALSE(on_page);
+    ASSERT_EQ(-16, rows->get_int64(6));
+    ASSERT_EQ(MYSQLITE_NULL, rows->get_type(7));
+    ASSERT_TRUE(rows->is_null(7));
+
+    size_t n_cols;
+    rows->get_null_mask(&n_cols);
+    ASSERT_EQ(2u, n_cols);
+  }
+
+  // Values in the record
+  ASSERT_TRUE(rows->next());
+  ASSERT_EQ(5, rows->get_int64(2));
+  ASSERT_EQ("x", rows->get_text(3));
+  ASSERT_EQ(2.5, rows->get_double(4));
+  ASSERT_EQ(1, rows->get_int64(6));
+  ASSERT_EQ(0, rows->get_int64(7));
+  ASSERT_FALSE(rows->next());
+  rows->close();
+
+  conn.unlock_db();
+  conn.close();
+}
+
+TEST(LeafOrderCursor, shuffled_leaves)
+{
+  using namespace mysqlite;
+
+  // Rows inserted in random rowid order: leaves split into pages
+  // appended to the file, so page numbers are not in rowid order.
+  Connection conn;
+  ASSERT_EQ(MYSQLITE_OK, conn.open(MYSQLITE_TEST_DB_DIR "/LeafOrderCursor-shuffled.sqlite"));
+  conn.rdlock_db();
+  TableDef tbl;
+  ASSERT_EQ(MYSQLITE_OK, conn.get_table_def("Item", &tbl));
+  ASSERT_EQ(22u, conn.get_table_leaves(tbl).size());
+
+  RowCursor *rows = conn.table_leaf_order_scan(tbl);
+  vector<int> seen(2001);
+  int n_rows = 0, n_descents = 0;
+  Rowid last_rowid = 0;
+  while (rows->next()) {
+    Rowid rowid = rows->get_rowid();
+    ASSERT_TRUE(rowid >= 1 && rowid <= 2000);
+    ASSERT_EQ(0, seen[rowid]++);
+    ASSERT_EQ((s64)(rowid * 7 % 2001), rows->get_int(1));
+    if (rowid < last_rowid) ++n_descents;  // Only between leaves
+    last_rowid = rowid;
+    ++n_rows;
+  }
+  ASSERT_EQ(2000, n_rows);
+  ASSERT_GT(n_descents, 0);
+  ASSERT_LT(n_descents, 22);
+  rows->close();
+
+  conn.unlock_db();
+  conn.close();
+}
+
+TEST(RowFilter, pad_space_order)
+{
+  using namespace mysqlite;
+
+  // "ab\t" < "ab" (= "ab ") < "ab!" when padded with spaces
+  Payload payload;
+  u8 data[] = {2, 13 + 2 * 3, 'a', 'b', '\t'};
+  payload.data = data;
+  ASSERT_TRUE(payload.digest_data());
+
+  RowFilter filter;
+  ColumnFilter lt(0, FILTER_LT);
+  lt.values.push_back(KeyValue::of_text("ab", 2));
+  filter.add(lt);
+  ASSERT_TRUE(filter.rejects(payload));
+  filter.clear();
+  lt.pad_space = true;
+  filter.add(lt);
+  ASSERT_FALSE(filter.rejects(payload));
+
+  filter.clear();
+  ColumnFilter gt(0, FILTER_GT);
+  gt.pad_space = true;
+  gt.values.push_back(KeyValue::of_text("ab!", 3));
+  filter.add(gt);
+  ASSERT_TRUE(filter.rejects(payload));
+}
+
+TEST(compare_key_value, sqlite_order)
+{
+  using namespace mysqlite;
+
+  KeyValue null = KeyValue::null_value();
+  KeyValue i = KeyValue::of_int(-5);
+  KeyValue d = KeyValue::of_double(-4.5);
+  KeyValue t = KeyValue::of_text("abc", 3);
+  KeyValue b = KeyValue::of_blob("\x00", 1);
+
+  ASSERT_EQ(0, compare_key_value(null, null, COLL_BINARY));
+  ASSERT_LT(compare_key_value(null, i, COLL_BINARY), 0);
+  ASSERT_LT(compare_key_value(i, d, COLL_BINARY), 0);
+  ASSERT_GT(compare_key_value(d, i, COLL_BINARY), 0);
+  ASSERT_LT(compare_key_value(d, t, COLL_BINARY), 0);
+  ASSERT_LT(compare_key_value(t, b, COLL_BINARY), 0);
+  ASSERT_EQ(0, compare_key_value(KeyValue::of_int(3), KeyValue::of_double(3.0), COLL_BINARY));
+
+  KeyValue upper = KeyValue::of_text("ABC", 3);
+  ASSERT_LT(compare_key_value(upper, t, COLL_BINARY), 0);
+  ASSERT_EQ(0, compare_key_value(upper, t, COLL_NOCASE));
+  KeyValue spaces = KeyValue::of_text("abc  ", 5);
+  ASSERT_GT(compare_key_value(spaces, t, COLL_BINARY), 0);
+  ASSERT_EQ(0, compare_key_value(spaces, t, COLL_RTRIM));
+
+  // Prefix of 2 characters (3 bytes of UTF-8 each)
+  KeyValue jp = KeyValue::of_text("\xe3\x81\x82\xe3\x81\x84\xe3\x81\x86", 9);
+  ASSERT_EQ(0, compare_key_value(jp, KeyValue::of_text("\xe3\x81\x82\xe3\x81\x84", 6, 2), COLL_BINARY));
+  ASSERT_GT(compare_key_value(jp, KeyValue::of_text("\xe3\x81\x82\xe3\x81\x84", 6), COLL_BINARY), 0);
+}
@@ -1,63 +1,306 @@
 #include <gtest/gtest.h>
+#include <sys/wait.h>
+
+using namespace std;
+#include <string>
 
 #include "../pcache.h"
 #include "../sqlite_format.h"
 #include "../mysqlite_config.h"
 
 
-TEST(pcache, correct_DBHeader)
+/*
+** Copy a test DB to a temporary file, which tests can modify.
+*/
+static string copy_db(const char *src)
+{
+  char path[] = "/tmp/mysqlite_pcacheTest_XXXXXX";
+  int out = mkstemp(path);
+  int in = open(src, O_RDONLY);
+  char buf[4096];
+  ssize_t n;
+  while ((n = read(in, buf, sizeof(buf))) > 0)
+    if (write(out, buf, n) != n) break;
+  close(in);
+  close(out);
+  return path;
+}
+
+
+class pcache_strategies : public ::testing::TestWithParam<pcache_strategy> {};
+
+TEST_P(pcache_strategies, correct_DBHeader)
 {
   errstat res;
   PageCache *pcache = PageCache::get_instance();
-  pcache->alloc(1024 * 100);
 
-  FILE *f = fopen(MYSQLITE_TEST_DB_DIR "/TableLeafPage-2tables.sqlite", "r");
-  res = pcache->refresh(f);
+  res = pcache->open(MYSQLITE_TEST_DB_DIR "/TableLeafPage-2tables.sqlite",
+                     DB_READ_WRITE, GetParam());
   ASSERT_EQ(res, MYSQLITE_OK);
+  ASSERT_EQ(GetParam(), pcache->get_strategy());
+
+  pcache->rd_lock();
 
   ASSERT_STREQ(SQLITE3_SIGNATURE, (char *)pcache->fetch(1));
+  pcache->release(1);
   ASSERT_EQ(DbHeader::get_pg_sz(), 1024);
 
-  pcache->free();
+  pcache->unlock();
+
+  pcache->close();
+}
+
+TEST_P(pcache_strategies, lock)
+{
+  errstat res;
+  PageCache *pcache = PageCache::get_instance();
+  string path = copy_db(MYSQLITE_TEST_DB_DIR "/TableLeafPage-2tables.sqlite");
+
+  res = pcache->open(path.c_str(), DB_READ_WRITE, GetParam());
+  ASSERT_EQ(res, MYSQLITE_OK);
+
+  pcache->rd_lock();
+  u32 fcc = DbHeader::get_file_change_counter();
+  pcache->unlock();
+
+  pcache->rd_lock();
+  u32 fcc2 = DbHeader::get_file_change_counter();
+  ASSERT_GE(fcc2, fcc);
+
+  ASSERT_EQ(MYSQLITE_FLOCK_NEEDED, DbHeader::inc_file_change_counter()); // write lock is necessary
+
+  pcache->upgrade_lock();
+  ASSERT_EQ(MYSQLITE_OK, DbHeader::inc_file_change_counter());
+  pcache->unlock();
+
+  pcache->close();
+  unlink(path.c_str());
 }
 
-TEST(pcache, SmallerPageCacheThanDbFile)
+TEST_P(pcache_strategies, read_only)
 {
   errstat res;
   PageCache *pcache = PageCache::get_instance();
-  pcache->alloc(PCACHE_MIN_SZ);
 
-  FILE *f = fopen(MYSQLITE_TEST_DB_DIR "/wikipedia.sqlite", "r");
-  res = pcache->refresh(f);
+  res = pcache->open(MYSQLITE_TEST_DB_DIR "/TableLeafPage-2tables.sqlite",
+                     DB_READ_ONLY, GetParam());
   ASSERT_EQ(res, MYSQLITE_OK);
+  ASSERT_TRUE(pcache->is_read_only());
+  ASSERT_FALSE(pcache->is_immutable());
 
+  ASSERT_FALSE(pcache->is_rd_locked());
+  ASSERT_EQ(MYSQLITE_OK, pcache->rd_lock());
   ASSERT_STREQ(SQLITE3_SIGNATURE, (char *)pcache->fetch(1));
+  pcache->release(1);
+  ASSERT_EQ(MYSQLITE_READONLY, pcache->upgrade_lock());
+  ASSERT_EQ(MYSQLITE_FLOCK_NEEDED, DbHeader::inc_file_change_counter());
+  pcache->unlock();
+  ASSERT_FALSE(pcache->is_rd_locked());
 
-  pcache->free();
+  pcache->close();
+  ASSERT_FALSE(pcache->is_read_only());
 }
 
-TEST(pcache, refresh)
+TEST_P(pcache_strategies, prefetch)
 {
   errstat res;
   PageCache *pcache = PageCache::get_instance();
-  pcache->alloc(1024 * 100);
 
-  u8 first_page2[1024], second_page2[1024];
+  res = pcache->open(MYSQLITE_TEST_DB_DIR "/TableLeafPage-2tables.sqlite",
+                     DB_READ_ONLY, GetParam());
+  ASSERT_EQ(res, MYSQLITE_OK);
+
+  // Only a hint: pages read afterwards are the same
+  pcache->rd_lock();
+  u8 before = pcache->fetch(2)[1000];
+  pcache->release(2);
+  pcache->prefetch(1);
+  pcache->prefetch(2);
+  ASSERT_STREQ(SQLITE3_SIGNATURE, (char *)pcache->fetch(1));
+  pcache->release(1);
+  ASSERT_EQ(before, pcache->fetch(2)[1000]);
+  pcache->release(2);
+  pcache->unlock();
+
+  pcache->close();
+}
+
+INSTANTIATE_TEST_CASE_P(pcache, pcache_strategies,
+                        ::testing::Values(PCACHE_MMAP, PCACHE_PREAD, PCACHE_MMAP_WINDOW));
 
-  FILE *f = fopen(MYSQLITE_TEST_DB_DIR "/TableLeafPage-2tables.sqlite", "r");
 
-  { // 1st fetch
-    res = pcache->refresh(f);
-    ASSERT_EQ(res, MYSQLITE_OK);
-    memcpy(first_page2, pcache->fetch(2), 1024);
+TEST(pcache, lock_timeout)
+{
+  errstat res;
+  PageCache *pcache = PageCache::get_instance();
+  const char *path = MYSQLITE_TEST_DB_DIR "/TableLeafPage-2tables.sqlite";
+
+  res = pcache->open(path);
+  ASSERT_EQ(res, MYSQLITE_OK);
+
+  // Another process holds write lock
+  int to_parent[2], to_child[2];
+  ASSERT_EQ(0, pipe(to_parent));
+  ASSERT_EQ(0, pipe(to_child));
+  pid_t pid = fork();
+  if (pid == 0) {
+    int fd = open(path, O_RDWR);
+    struct flock flock;
+    flock.l_whence = SEEK_SET;
+    flock.l_start = 0;
+    flock.l_len = 0;
+    flock.l_type = F_WRLCK;
+    fcntl(fd, F_SETLKW, &flock);
+    char c = 0;
+    if (write(to_parent[1], &c, 1) != 1) _exit(1);
+    if (read(to_child[0], &c, 1) != 1) _exit(1);  // wait for parent
+    _exit(0);
   }
-  { // 2nd fetch
-    res = pcache->refresh(f);
-    ASSERT_EQ(res, MYSQLITE_OK);
-    memcpy(second_page2, pcache->fetch(2), 1024);
+  char c;
+  ASSERT_EQ(1, read(to_parent[0], &c, 1));
+
+  u64 start = mysqlite_now_usec();
+  ASSERT_EQ(MYSQLITE_LOCK_TIMEOUT, pcache->rd_lock(50 * 1000));
+  ASSERT_GE(mysqlite_now_usec() - start, 50u * 1000);
+  ASSERT_FALSE(pcache->is_rd_locked());
+
+  // Lock is acquired after the other process releases it
+  ASSERT_EQ(1, write(to_child[1], &c, 1));
+  waitpid(pid, NULL, 0);
+  ASSERT_EQ(MYSQLITE_OK, pcache->rd_lock(50 * 1000));
+  ASSERT_TRUE(pcache->is_rd_locked());
+  pcache->unlock();
+
+  pcache->close();
+}
+
+TEST(pcache, shared_rd_lock)
+{
+  errstat res;
+  PageCache *pcache = PageCache::get_instance();
+
+  res = pcache->open(MYSQLITE_TEST_DB_DIR "/TableLeafPage-2tables.sqlite");
+  ASSERT_EQ(res, MYSQLITE_OK);
+
+  // The fcntl() lock is kept until the last reader unlocks
+  ASSERT_EQ(MYSQLITE_OK, pcache->rd_lock());
+  ASSERT_EQ(MYSQLITE_OK, pcache->rd_lock());
+  pcache->unlock();
+  ASSERT_TRUE(pcache->is_rd_locked());
+  ASSERT_STREQ(SQLITE3_SIGNATURE, (char *)pcache->fetch(1));
+  pcache->release(1);
+  pcache->unlock();
+  ASSERT_FALSE(pcache->is_rd_locked());
+
+  pcache->close();
+}
+
+TEST(pcache, immutable)
+{
+  errstat res;
+  PageCache *pcache = PageCache::get_instance();
+  const char *path = MYSQLITE_TEST_DB_DIR "/TableLeafPage-2tables.sqlite";
+
+  res = pcache->open(path, DB_IMMUTABLE);
+  ASSERT_EQ(res, MYSQLITE_OK);
+  ASSERT_TRUE(pcache->is_read_only());
+  ASSERT_TRUE(pcache->is_immutable());
+
+  // Readable without any lock
+  ASSERT_TRUE(pcache->is_rd_locked());
+  ASSERT_STREQ(SQLITE3_SIGNATURE, (char *)pcache->fetch(1));
+  pcache->release(1);
+
+  // No fcntl() lock is taken even if another process holds write lock
+  int to_parent[2], to_child[2];
+  ASSERT_EQ(0, pipe(to_parent));
+  ASSERT_EQ(0, pipe(to_child));
+  pid_t pid = fork();
+  if (pid == 0) {
+    int fd = open(path, O_RDWR);
+    struct flock flock;
+    flock.l_whence = SEEK_SET;
+    flock.l_start = 0;
+    flock.l_len = 0;
+    flock.l_type = F_WRLCK;
+    fcntl(fd, F_SETLKW, &flock);
+    char c = 0;
+    if (write(to_parent[1], &c, 1) != 1) _exit(1);
+    if (read(to_child[0], &c, 1) != 1) _exit(1);  // wait for parent
+    _exit(0);
   }
+  char c;
+  ASSERT_EQ(1, read(to_parent[0], &c, 1));
+
+  ASSERT_EQ(MYSQLITE_OK, pcache->rd_lock(50 * 1000));
+  ASSERT_EQ(MYSQLITE_READONLY, pcache->upgrade_lock());
+  pcache->unlock();
+  ASSERT_TRUE(pcache->is_rd_locked());
+
+  ASSERT_EQ(1, write(to_child[1], &c, 1));
+  waitpid(pid, NULL, 0);
 
-  ASSERT_EQ(memcmp(first_page2, second_page2, 1024), 0);
+  pcache->close();
+  ASSERT_FALSE(pcache->is_rd_locked());
+  ASSERT_FALSE(pcache->is_immutable());
+}
+
+TEST(pcache, pread_sees_other_process_write)
+{
+  errstat res;
+  PageCache *pcache = PageCache::get_instance();
+  string path = copy_db(MYSQLITE_TEST_DB_DIR "/TableLeafPage-2tables.sqlite");
+
+  res = pcache->open(path.c_str(), DB_READ_WRITE, PCACHE_PREAD);
+  ASSERT_EQ(res, MYSQLITE_OK);
+
+  pcache->rd_lock();
+  u8 before = pcache->fetch(2)[1000];
+  pcache->release(2);
+  pcache->unlock();
+
+  // Another writer modifies page#2 and increments file change counter
+  int fd = open(path.c_str(), O_RDWR);
+  u8 after = before + 1;
+  ASSERT_EQ(1, pwrite(fd, &after, 1, 1024 + 1000));
+  u8 fcc[DBHDR_FCC_LEN];
+  ASSERT_EQ(DBHDR_FCC_LEN, pread(fd, fcc, DBHDR_FCC_LEN, DBHDR_FCC_OFFSET));
+  ++fcc[DBHDR_FCC_LEN - 1];
+  ASSERT_EQ(DBHDR_FCC_LEN, pwrite(fd, fcc, DBHDR_FCC_LEN, DBHDR_FCC_OFFSET));
+  close(fd);
+
+  pcache->rd_lock();
+  ASSERT_EQ(after, pcache->fetch(2)[1000]);
+  pcache->release(2);
+  pcache->unlock();
+
+  pcache->close();
+  unlink(path.c_str());
+}
+
+TEST(pcache, file_change_counter_32bit)
+{
+  errstat res;
+  PageCache *pcache = PageCache::get_instance();
+  string path = copy_db(MYSQLITE_TEST_DB_DIR "/TableLeafPage-2tables.sqlite");
+
+  // Counter past 16 bits
+  int fd = open(path.c_str(), O_RDWR);
+  u8 fcc[DBHDR_FCC_LEN] = {0x00, 0x01, 0x00, 0xff};
+  ASSERT_EQ(DBHDR_FCC_LEN, pwrite(fd, fcc, DBHDR_FCC_LEN, DBHDR_FCC_OFFSET));
+  close(fd);
+
+  res = pcache->open(path.c_str(), DB_READ_WRITE, PCACHE_PREAD);
+  ASSERT_EQ(res, MYSQLITE_OK);
+  pcache->rd_lock();
+  ASSERT_EQ(0x100ffu, DbHeader::get_file_change_counter());
+  pcache->upgrade_lock();
+  ASSERT_EQ(MYSQLITE_OK, DbHeader::inc_file_change_counter());
+  pcache->unlock();
+  pcache->rd_lock();
+  ASSERT_EQ(0x10100u, DbHeader::get_file_change_counter());
+  pcache->unlock();
 
-  pcache->free();
+  pcache->close();
+  unlink(path.c_str());
 }
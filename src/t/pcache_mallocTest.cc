@@ -0,0 +1,83 @@
+#include <gtest/gtest.h>
+
+#include "../pcache_malloc.h"
+#include "../mysqlite_config.h"
+
+
+TEST(pcache_malloc, fetch)
+{
+  const char *path = MYSQLITE_TEST_DB_DIR "/TableLeafPage-2tables.sqlite";
+  SqliteDb db(path);
+
+  PageCacheMalloc pcache(1024 * 100);
+  ASSERT_EQ(MYSQLITE_OK, pcache.open(db, DB_READ_WRITE));
+  ASSERT_EQ((u32)PCACHE_MIN_FRAMES, pcache.n_frames());
+
+  ASSERT_TRUE(pcache.is_cached(1));  // DB header is always cached
+  ASSERT_STREQ(SQLITE3_SIGNATURE, (char *)pcache.fetch(1));
+  pcache.release(1);
+
+  ASSERT_FALSE(pcache.is_cached(3));
+  u8 page3[1024];
+  ASSERT_EQ(1024, pread(db.fd(), page3, 1024, 2 * 1024));
+  ASSERT_EQ(0, memcmp(page3, pcache.fetch(3), 1024));
+  pcache.release(3);
+  ASSERT_TRUE(pcache.is_cached(3));
+
+  pcache.close();
+}
+
+TEST(pcache_malloc, SmallerPageCacheThanDbFile)
+{
+  const char *path = MYSQLITE_TEST_DB_DIR "/wikipedia.sqlite";
+  SqliteDb db(path);
+
+  PageCacheMalloc pcache(1024);
+  ASSERT_EQ(MYSQLITE_OK, pcache.open(db, DB_READ_WRITE));
+  Pgno n_pages = db.file_size() / 1024;
+  ASSERT_GT(n_pages, pcache.n_frames());
+
+  // Every page is read correctly although pages are evicted
+  u8 page[1024];
+  for (Pgno pgno = 1; pgno <= n_pages; ++pgno) {
+    ASSERT_EQ(1024, pread(db.fd(), page, 1024, (off_t)(pgno - 1) * 1024));
+    u8 *p = pcache.fetch(pgno);
+    ASSERT_TRUE(p != NULL);
+    ASSERT_EQ(0, memcmp(page, p, 1024));
+    pcache.release(pgno);
+  }
+  ASSERT_TRUE(pcache.is_cached(1));
+  ASSERT_FALSE(pcache.is_cached(2));
+
+  pcache.close();
+}
+
+TEST(pcache_malloc, pinned_pages_are_not_evicted)
+{
+  const char *path = MYSQLITE_TEST_DB_DIR "/wikipedia.sqlite";
+  SqliteDb db(path);
+
+  PageCacheMalloc pcache(1024);
+  ASSERT_EQ(MYSQLITE_OK, pcache.open(db, DB_READ_WRITE));
+
+  u8 *p2 = pcache.fetch(2);
+  u8 page2[1024];
+  memcpy(page2, p2, 1024);
+
+  // Page#1 and page#2 are pinned. Others fill the rest of frames.
+  Pgno pgno;
+  for (pgno = 3; pgno < pcache.n_frames() + 1; ++pgno)
+    ASSERT_TRUE(pcache.fetch(pgno) != NULL);
+  ASSERT_TRUE(pcache.fetch(pgno) == NULL);  // All frames are pinned
+
+  for (pgno = 3; pgno < pcache.n_frames() + 1; ++pgno) pcache.release(pgno);
+  for (pgno = 3; pgno < pcache.n_frames() * 2; ++pgno) {
+    ASSERT_TRUE(pcache.fetch(pgno) != NULL);
+    pcache.release(pgno);
+  }
+  ASSERT_TRUE(pcache.is_cached(2));
+  ASSERT_EQ(0, memcmp(page2, p2, 1024));
+  pcache.release(2);
+
+  pcache.close();
+}
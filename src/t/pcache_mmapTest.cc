@@ -1,52 +1,39 @@
 #include <gtest/gtest.h>
 
 #include "../pcache_mmap.h"
-#include "../sqlite_format.h"
 #include "../mysqlite_config.h"
 
 
-TEST(pcache, correct_DBHeader)
+TEST(pcache_mmap, fetch)
 {
-  errstat res;
-  PageCache *pcache = PageCache::get_instance();
+  const char *path = MYSQLITE_TEST_DB_DIR "/TableLeafPage-2tables.sqlite";
+  SqliteDb db(path);
+  ASSERT_EQ(SqliteDb::READ_WRITE, db.mode());
 
-  res = pcache->open(MYSQLITE_TEST_DB_DIR "/TableLeafPage-2tables.sqlite");
-  ASSERT_EQ(res, MYSQLITE_OK);
+  PageCacheMmap pcache;
+  ASSERT_EQ(MYSQLITE_OK, pcache.open(db, DB_READ_WRITE));
 
-  pcache->rd_lock();
+  ASSERT_STREQ(SQLITE3_SIGNATURE, (char *)pcache.fetch(1));
+  pcache.release(1);
 
-  ASSERT_STREQ(SQLITE3_SIGNATURE, (char *)pcache->fetch(1));
-  ASSERT_EQ(DbHeader::get_pg_sz(), 1024);
+  // Pages are consecutive on the mapping
+  u8 page3[1024];
+  ASSERT_EQ(1024, pread(db.fd(), page3, 1024, 2 * 1024));
+  ASSERT_EQ(0, memcmp(page3, pcache.fetch(3), 1024));
+  ASSERT_EQ(pcache.fetch(1) + 2 * 1024, pcache.fetch(3));
 
-  pcache->unlock();
-
-  pcache->close();
+  pcache.close();
 }
 
-TEST(pcache, lock)
+TEST(pcache_mmap, read_only)
 {
-  errstat res;
-  PageCache *pcache = PageCache::get_instance();
-
-  res = pcache->open(MYSQLITE_TEST_DB_DIR "/TableLeafPage-2tables.sqlite");
-  ASSERT_EQ(res, MYSQLITE_OK);
-
-  pcache->rd_lock();
-  u16 fcc = DbHeader::get_file_change_counter();
-  pcache->unlock();
-
-  pcache->rd_lock();
-  u16 fcc2 = DbHeader::get_file_change_counter();
-  ASSERT_GE(fcc2, fcc);
-
-  printf("fcc=%d, fcc2=%d\n", fcc, fcc2);
-
-  ASSERT_EQ(MYSQLITE_FLOCK_NEEDED, DbHeader::inc_file_change_counter()); // write lock is necessary
-
-  pcache->upgrade_lock();
-  ASSERT_EQ(MYSQLITE_OK, DbHeader::inc_file_change_counter());
-  pcache->unlock();
-
-  pcache->close();
+  const char *path = MYSQLITE_TEST_DB_DIR "/TableLeafPage-2tables.sqlite";
+  SqliteDb db(path, true);
+  ASSERT_EQ(SqliteDb::READ_ONLY, db.mode());
+
+  // O_RDONLY fd can only be mapped PROT_READ
+  PageCacheMmap pcache;
+  ASSERT_EQ(MYSQLITE_OK, pcache.open(db, DB_READ_ONLY));
+  ASSERT_STREQ(SQLITE3_SIGNATURE, (char *)pcache.fetch(1));
+  pcache.close();
 }
-
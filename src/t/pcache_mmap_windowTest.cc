@@ -0,0 +1,85 @@
+#include <gtest/gtest.h>
+
+#include "../pcache_mmap_window.h"
+#include "../mysqlite_config.h"
+
+
+#define CHUNK_SZ (4 * 1024)  // 4 pages of 1024 bytes
+
+
+TEST(pcache_mmap_window, fetch)
+{
+  const char *path = MYSQLITE_TEST_DB_DIR "/wikipedia.sqlite";
+  SqliteDb db(path);
+
+  PageCacheMmapWindow pcache(CHUNK_SZ, 4);
+  ASSERT_EQ(MYSQLITE_OK, pcache.open(db, DB_READ_WRITE));
+  ASSERT_EQ(0u, pcache.n_mapped_chunks());
+
+  // Every page is read correctly
+  Pgno n_pages = db.file_size() / 1024;
+  u8 page[1024];
+  for (Pgno pgno = 1; pgno <= n_pages; ++pgno) {
+    ASSERT_EQ(1024, pread(db.fd(), page, 1024, (off_t)(pgno - 1) * 1024));
+    u8 *p = pcache.fetch(pgno);
+    ASSERT_TRUE(p != NULL);
+    ASSERT_EQ(0, memcmp(page, p, 1024));
+    pcache.release(pgno);
+    ASSERT_LE(pcache.n_mapped_chunks(), 4u);  // Cold chunks are unmapped
+  }
+
+  pcache.close();
+  ASSERT_EQ(0u, pcache.n_mapped_chunks());
+}
+
+TEST(pcache_mmap_window, same_chunk)
+{
+  const char *path = MYSQLITE_TEST_DB_DIR "/wikipedia.sqlite";
+  SqliteDb db(path);
+
+  PageCacheMmapWindow pcache(CHUNK_SZ, 4);
+  ASSERT_EQ(MYSQLITE_OK, pcache.open(db, DB_READ_WRITE));
+
+  // Page#5-8 are on chunk#1
+  u8 *p5 = pcache.fetch(5);
+  u8 *p8 = pcache.fetch(8);
+  ASSERT_EQ(p5 + 3 * 1024, p8);
+  ASSERT_EQ(1u, pcache.n_mapped_chunks());
+  pcache.release(5);
+  pcache.release(8);
+
+  pcache.close();
+}
+
+TEST(pcache_mmap_window, pinned_chunks_are_not_unmapped)
+{
+  const char *path = MYSQLITE_TEST_DB_DIR "/wikipedia.sqlite";
+  SqliteDb db(path);
+
+  PageCacheMmapWindow pcache(CHUNK_SZ, 2);
+  ASSERT_EQ(MYSQLITE_OK, pcache.open(db, DB_READ_WRITE));
+
+  u8 *p1 = pcache.fetch(1);
+  u8 *p5 = pcache.fetch(5);
+
+  // All chunks are pinned. Mapped beyond max_chunks.
+  u8 *p9 = pcache.fetch(9);
+  ASSERT_TRUE(p9 != NULL);
+  ASSERT_EQ(3u, pcache.n_mapped_chunks());
+  pcache.release(9);
+
+  // Unpinned chunks are unmapped. Pinned ones are still readable.
+  for (Pgno pgno = 13; pgno <= 40; pgno += 4) {
+    ASSERT_TRUE(pcache.fetch(pgno) != NULL);
+    pcache.release(pgno);
+  }
+  ASSERT_EQ(3u, pcache.n_mapped_chunks());
+  ASSERT_STREQ(SQLITE3_SIGNATURE, (char *)p1);
+  u8 page5[1024];
+  ASSERT_EQ(1024, pread(db.fd(), page5, 1024, 4 * 1024));
+  ASSERT_EQ(0, memcmp(page5, p5, 1024));
+
+  pcache.release(1);
+  pcache.release(5);
+  pcache.close();
+}
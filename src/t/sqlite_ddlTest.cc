@@ -0,0 +1,195 @@
+#include <gtest/gtest.h>
+
+using namespace std;
+#include <string>
+
+#include "../sqlite_ddl.h"
+
+
+TEST(parse_create_table, simple)
+{
+  TableDef tbl;
+  ASSERT_TRUE(parse_create_table("CREATE TABLE Beer (maker TEXT, name TEXT, price INT)", &tbl));
+  ASSERT_EQ("Beer", tbl.name);
+  ASSERT_EQ(3u, tbl.cols.size());
+  ASSERT_EQ("maker", tbl.cols[0].name);
+  ASSERT_EQ("TEXT", tbl.cols[0].type);
+  ASSERT_EQ("price", tbl.cols[2].name);
+  ASSERT_EQ("INT", tbl.cols[2].type);
+  ASSERT_EQ(-1, tbl.rowid_colno);
+  ASSERT_FALSE(tbl.without_rowid);
+  ASSERT_TRUE(tbl.indexes.empty());
+}
+
+TEST(parse_create_table, types_and_constraints)
+{
+  TableDef tbl;
+  ASSERT_TRUE(parse_create_table(
+    "create table if not exists main.\"T 1\" (\n"
+    "  a VARCHAR(10, 2) NOT NULL DEFAULT 'x,)' CHECK (a <> ','),  -- comment, \n"
+    "  [b] UNSIGNED BIG INT COLLATE nocase,\n"
+    "  `c`,\n"
+    "  d DOUBLE PRECISION REFERENCES other(x) ON DELETE CASCADE /* , */\n"
+    ")", &tbl));
+  ASSERT_EQ("T 1", tbl.name);
+  ASSERT_EQ(4u, tbl.cols.size());
+  ASSERT_EQ("VARCHAR(10, 2)", tbl.cols[0].type);
+  ASSERT_TRUE(tbl.cols[0].not_null);
+  ASSERT_EQ(COLL_BINARY, tbl.cols[0].coll);
+  ASSERT_EQ("b", tbl.cols[1].name);
+  ASSERT_EQ("UNSIGNED BIG INT", tbl.cols[1].type);
+  ASSERT_FALSE(tbl.cols[1].not_null);
+  ASSERT_EQ(COLL_NOCASE, tbl.cols[1].coll);
+  ASSERT_EQ("c", tbl.cols[2].name);
+  ASSERT_EQ("", tbl.cols[2].type);
+  ASSERT_EQ("DOUBLE PRECISION", tbl.cols[3].type);
+}
+
+TEST(parse_create_table, defaults)
+{
+  TableDef tbl;
+  ASSERT_TRUE(parse_create_table(
+    "CREATE TABLE t (a INT NOT NULL DEFAULT -7, b TEXT DEFAULT 'it''s',\n"
+    "  c REAL DEFAULT +1.5e-3, d BLOB DEFAULT x'00fF', e DEFAULT 0x10,\n"
+    "  f DEFAULT 18446744073709551616, g DEFAULT TRUE, h DEFAULT NULL,\n"
+    "  i DEFAULT (1 + 2), j DEFAULT CURRENT_TIMESTAMP, k DEFAULT X 'ab', l)", &tbl));
+  ASSERT_EQ(12u, tbl.cols.size());
+  ASSERT_EQ(MYSQLITE_INTEGER, tbl.cols[0].dflt_type);
+  ASSERT_EQ(-7, tbl.cols[0].dflt_int);
+  ASSERT_TRUE(tbl.cols[0].not_null);
+  ASSERT_EQ(MYSQLITE_TEXT, tbl.cols[1].dflt_type);
+  ASSERT_EQ("it's", tbl.cols[1].dflt_bytes);
+  ASSERT_EQ(MYSQLITE_FLOAT, tbl.cols[2].dflt_type);
+  ASSERT_EQ(1.5e-3, tbl.cols[2].dflt_double);
+  ASSERT_EQ(MYSQLITE_BLOB, tbl.cols[3].dflt_type);
+  ASSERT_EQ(string("\x00\xff", 2), tbl.cols[3].dflt_bytes);
+  ASSERT_EQ(MYSQLITE_INTEGER, tbl.cols[4].dflt_type);
+  ASSERT_EQ(16, tbl.cols[4].dflt_int);
+  // Too large for 64 bits
+  ASSERT_EQ(MYSQLITE_FLOAT, tbl.cols[5].dflt_type);
+  ASSERT_EQ(18446744073709551616.0, tbl.cols[5].dflt_double);
+  ASSERT_EQ(MYSQLITE_INTEGER, tbl.cols[6].dflt_type);
+  ASSERT_EQ(1, tbl.cols[6].dflt_int);
+  // NULL, not literals and none
+  for (size_t i = 7; i < 12; ++i)
+    ASSERT_EQ(MYSQLITE_NULL, tbl.cols[i].dflt_type) << tbl.cols[i].name;
+  ASSERT_EQ("l", tbl.cols[11].name);
+
+  ASSERT_TRUE(parse_create_table("CREATE TABLE t (a INT DEFAULT -9223372036854775808)", &tbl));
+  ASSERT_EQ(MYSQLITE_INTEGER, tbl.cols[0].dflt_type);
+  ASSERT_EQ(INT64_MIN, tbl.cols[0].dflt_int);
+}
+
+TEST(parse_create_table, integer_primary_key)
+{
+  TableDef tbl;
+  ASSERT_TRUE(parse_create_table("CREATE TABLE t (x TEXT, id INTEGER PRIMARY KEY AUTOINCREMENT)", &tbl));
+  ASSERT_EQ(1, tbl.rowid_colno);
+  ASSERT_TRUE(tbl.indexes.empty());
+
+  ASSERT_TRUE(parse_create_table("CREATE TABLE t (id integer, x TEXT, PRIMARY KEY (id))", &tbl));
+  ASSERT_EQ(0, tbl.rowid_colno);
+  ASSERT_TRUE(tbl.indexes.empty());
+
+  // Not aliases for rowid
+  ASSERT_TRUE(parse_create_table("CREATE TABLE t (id INT PRIMARY KEY)", &tbl));
+  ASSERT_EQ(-1, tbl.rowid_colno);
+  ASSERT_EQ(1u, tbl.indexes.size());
+  ASSERT_TRUE(parse_create_table("CREATE TABLE t (id INTEGER PRIMARY KEY DESC)", &tbl));
+  ASSERT_EQ(-1, tbl.rowid_colno);
+  ASSERT_EQ(1u, tbl.indexes.size());
+  ASSERT_TRUE(tbl.indexes[0].cols[0].desc);
+  ASSERT_TRUE(parse_create_table("CREATE TABLE t (id INTEGER PRIMARY KEY, x) WITHOUT ROWID", &tbl));
+  ASSERT_EQ(-1, tbl.rowid_colno);
+  ASSERT_TRUE(tbl.without_rowid);
+}
+
+TEST(parse_create_table, autoindexes)
+{
+  TableDef tbl;
+  ASSERT_TRUE(parse_create_table(
+    "CREATE TABLE Event (id INTEGER PRIMARY KEY, name TEXT UNIQUE COLLATE NOCASE,"
+    " ts INT, kind TEXT,"
+    " CONSTRAINT uq UNIQUE (kind COLLATE RTRIM, ts DESC),"
+    " UNIQUE (name),"    // same as the index of column constraint
+    " UNIQUE (ts))", &tbl));
+  ASSERT_EQ(0, tbl.rowid_colno);
+  ASSERT_EQ(3u, tbl.indexes.size());
+
+  ASSERT_EQ("sqlite_autoindex_Event_1", tbl.indexes[0].name);
+  ASSERT_TRUE(tbl.indexes[0].unique);
+  ASSERT_EQ(1u, tbl.indexes[0].cols.size());
+  ASSERT_EQ(1, tbl.indexes[0].cols[0].colno);
+  ASSERT_EQ(COLL_NOCASE, tbl.indexes[0].cols[0].coll);  // COLLATE after UNIQUE
+
+  ASSERT_EQ("sqlite_autoindex_Event_2", tbl.indexes[1].name);
+  ASSERT_EQ(2u, tbl.indexes[1].cols.size());
+  ASSERT_EQ(3, tbl.indexes[1].cols[0].colno);
+  ASSERT_EQ(COLL_RTRIM, tbl.indexes[1].cols[0].coll);
+  ASSERT_FALSE(tbl.indexes[1].cols[0].desc);
+  ASSERT_EQ(2, tbl.indexes[1].cols[1].colno);
+  ASSERT_TRUE(tbl.indexes[1].cols[1].desc);
+
+  ASSERT_EQ("sqlite_autoindex_Event_3", tbl.indexes[2].name);
+  ASSERT_EQ(2, tbl.indexes[2].cols[0].colno);
+
+  ASSERT_TRUE(tbl.find_index("SQLITE_AUTOINDEX_EVENT_2") == &tbl.indexes[1]);
+  ASSERT_TRUE(tbl.find_index("no_such_index") == NULL);
+}
+
+TEST(parse_create_table, invalid)
+{
+  TableDef tbl;
+  ASSERT_FALSE(parse_create_table("", &tbl));
+  ASSERT_FALSE(parse_create_table("CREATE INDEX i ON t (a)", &tbl));
+  ASSERT_FALSE(parse_create_table("CREATE TABLE t AS SELECT 1", &tbl));
+  ASSERT_FALSE(parse_create_table("CREATE TABLE t (a INT", &tbl));
+}
+
+TEST(parse_create_index, simple)
+{
+  TableDef tbl;
+  ASSERT_TRUE(parse_create_table("CREATE TABLE Event (id INTEGER PRIMARY KEY, ts INT, kind TEXT COLLATE NOCASE)", &tbl));
+
+  IndexDef idx;
+  ASSERT_TRUE(parse_create_index("CREATE UNIQUE INDEX IF NOT EXISTS main.Event_kind_ts ON Event (kind, TS DESC)",
+                                 tbl, &idx));
+  ASSERT_EQ("Event_kind_ts", idx.name);
+  ASSERT_TRUE(idx.unique);
+  ASSERT_TRUE(idx.usable);
+  ASSERT_EQ(2u, idx.cols.size());
+  ASSERT_EQ(2, idx.cols[0].colno);
+  ASSERT_EQ(COLL_NOCASE, idx.cols[0].coll);  // Inherits column's collation
+  ASSERT_FALSE(idx.cols[0].desc);
+  ASSERT_EQ(1, idx.cols[1].colno);
+  ASSERT_TRUE(idx.cols[1].desc);
+
+  ASSERT_TRUE(parse_create_index("CREATE INDEX i ON Event (kind COLLATE BINARY)", tbl, &idx));
+  ASSERT_FALSE(idx.unique);
+  ASSERT_EQ(COLL_BINARY, idx.cols[0].coll);
+}
+
+TEST(parse_create_index, unusable)
+{
+  TableDef tbl;
+  ASSERT_TRUE(parse_create_table("CREATE TABLE t (a INT, b TEXT)", &tbl));
+
+  IndexDef idx;
+  // Partial index
+  ASSERT_TRUE(parse_create_index("CREATE INDEX i ON t (a) WHERE a > 0", tbl, &idx));
+  ASSERT_FALSE(idx.usable);
+  // Index on expression
+  ASSERT_TRUE(parse_create_index("CREATE INDEX i ON t (lower(b), a)", tbl, &idx));
+  ASSERT_FALSE(idx.usable);
+  ASSERT_TRUE(parse_create_index("CREATE INDEX i ON t (a + 1)", tbl, &idx));
+  ASSERT_FALSE(idx.usable);
+  // User defined collation
+  ASSERT_TRUE(parse_create_index("CREATE INDEX i ON t (b COLLATE my_coll)", tbl, &idx));
+  ASSERT_FALSE(idx.usable);
+  // Usable again
+  ASSERT_TRUE(parse_create_index("CREATE INDEX i ON t (b, a)", tbl, &idx));
+  ASSERT_TRUE(idx.usable);
+  ASSERT_EQ(2u, idx.cols.size());
+
+  ASSERT_FALSE(parse_create_index("CREATE TABLE t (a)", tbl, &idx));
+}
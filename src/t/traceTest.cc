@@ -0,0 +1,128 @@
+#include <gtest/gtest.h>
+
+using namespace std;
+#include <string>
+
+#include "../trace.h"
+#include "../utils.h"
+
+
+static string dump_to_string()
+{
+  FILE *f = tmpfile();
+  mysqlite::trace_dump(fileno(f));
+  fflush(f);
+  rewind(f);
+  string s;
+  char buf[4096];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0) s.append(buf, n);
+  fclose(f);
+  return s;
+}
+
+static size_t count(const string &s, const string &pat)
+{
+  size_t n = 0;
+  for (size_t pos = s.find(pat); pos != string::npos; pos = s.find(pat, pos + 1)) ++n;
+  return n;
+}
+
+TEST(trace, level)
+{
+  using namespace mysqlite;
+  set_trace_level(TRACE_WARN);
+  EXPECT_EQ(TRACE_WARN, get_trace_level());
+  EXPECT_TRUE(trace_enabled(TRACE_ERROR));
+  EXPECT_TRUE(trace_enabled(TRACE_WARN));
+  EXPECT_FALSE(trace_enabled(TRACE_INFO));
+  EXPECT_FALSE(trace_enabled(TRACE_DEBUG));
+
+  set_trace_level(TRACE_OFF);
+  EXPECT_FALSE(trace_enabled(TRACE_ERROR));
+}
+
+TEST(trace, record_and_dump)
+{
+  using namespace mysqlite;
+  set_trace_level(TRACE_INFO);
+  trace_event(TRACE_INFO, TRACE_EV_LOCK_RD, 123, 0);
+  trace_event(TRACE_DEBUG, TRACE_EV_UNLOCK, 456, 0);  // not recorded
+  log_msg_at(TRACE_INFO, "traceTest message %d\n", 1);
+
+  string dump = dump_to_string();
+  EXPECT_NE(string::npos, dump.find("INFO lock_rd"));
+  EXPECT_NE(string::npos, dump.find("arg0=123 arg1=0"));
+  EXPECT_EQ(string::npos, dump.find("arg0=456"));
+  EXPECT_NE(string::npos, dump.find("traceTest message %d"));
+  EXPECT_NE(string::npos, dump.find("dump end"));
+}
+
+TEST(trace, ring_wraps_around)
+{
+  using namespace mysqlite;
+  set_trace_level(TRACE_DEBUG);
+  for (u32 i = 0; i < TraceRing::N_EVENTS * 3; ++i)
+    trace_event(TRACE_DEBUG, TRACE_EV_RND_POS, 7777, i);
+
+  string dump = dump_to_string();
+  EXPECT_EQ((size_t)TraceRing::N_EVENTS, count(dump, "arg0=7777"));
+  // Oldest events are overwritten
+  EXPECT_EQ(string::npos, dump.find("arg0=7777 arg1=0\n"));
+  EXPECT_NE(string::npos, dump.find("arg0=7777 arg1=3071\n"));
+}
+
+static void *record_in_thread(void *)
+{
+  trace_event(mysqlite::TRACE_DEBUG, mysqlite::TRACE_EV_LOCK_WR, 8888, 0);
+  return NULL;
+}
+
+TEST(trace, per_thread_ring)
+{
+  using namespace mysqlite;
+  set_trace_level(TRACE_DEBUG);
+  pthread_t th;
+  ASSERT_EQ(0, pthread_create(&th, NULL, record_in_thread, NULL));
+  pthread_join(th, NULL);
+
+  // Events of exited threads are still dumped
+  string dump = dump_to_string();
+  EXPECT_EQ(1u, count(dump, "arg0=8888"));
+}
+
+static int shutdown_pipe[2];
+
+static void *record_and_wait(void *)
+{
+  trace_event(mysqlite::TRACE_DEBUG, mysqlite::TRACE_EV_LOCK_WR, 7777, 0);
+  char c;
+  if (read(shutdown_pipe[0], &c, 1) != 1) return NULL;  // until shutdown
+  return NULL;
+}
+
+TEST(trace, shutdown)
+{
+  using namespace mysqlite;
+  set_trace_level(TRACE_DEBUG);
+  trace_event(TRACE_DEBUG, TRACE_EV_LOCK_RD, 6666, 0);
+  ASSERT_EQ(0, pipe(shutdown_pipe));
+  pthread_t th;
+  ASSERT_EQ(0, pthread_create(&th, NULL, record_and_wait, NULL));
+  while (count(dump_to_string(), "arg0=7777") == 0) usleep(1000);
+
+  // The thread exits after its ring is freed
+  trace_shutdown();
+  EXPECT_EQ(0u, count(dump_to_string(), "arg0="));
+  char c = 0;
+  ASSERT_EQ(1, write(shutdown_pipe[1], &c, 1));
+  pthread_join(th, NULL);
+
+  // Recorded to a new ring
+  trace_event(TRACE_DEBUG, TRACE_EV_LOCK_RD, 5555, 0);
+  string dump = dump_to_string();
+  EXPECT_EQ(1u, count(dump, "arg0=5555"));
+  EXPECT_EQ(0u, count(dump, "arg0=6666"));
+  close(shutdown_pipe[0]);
+  close(shutdown_pipe[1]);
+}
@@ -0,0 +1,265 @@
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <mutex>
+
+#include "trace.h"
+#include "utils.h"
+
+
+#define TRACE_ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+
+namespace mysqlite {
+
+std::atomic<int> current_trace_level(TRACE_ERROR);
+
+void set_trace_level(trace_level level)
+{
+  current_trace_level.store(level, std::memory_order_relaxed);
+}
+
+trace_level get_trace_level()
+{
+  return (trace_level)current_trace_level.load(std::memory_order_relaxed);
+}
+
+
+/***********************************************************************
+** Ring buffers
+**
+** Rings are registered to a fixed size array without locks so that
+** trace_dump() can walk them from a signal handler.
+** A ring is released (not freed) when its thread exits and reused by
+** a new thread, so events of exited threads are kept until reused.
+** Rings are freed by trace_shutdown().
+***********************************************************************/
+#define TRACE_MAX_RINGS 4096
+
+static TraceRing *rings[TRACE_MAX_RINGS];
+static std::atomic<u32> n_rings(0);
+static std::atomic<u64> n_threads(0);
+
+static __thread TraceRing *my_ring = NULL;
+static pthread_key_t ring_key;
+static bool ring_key_created = false;
+static std::mutex ring_key_mutex;  // Protects ring_key*
+
+static void release_ring(void *p)
+{
+  static_cast<TraceRing *>(p)->in_use.store(false, std::memory_order_release);
+}
+
+static void create_ring_key()
+{
+  std::lock_guard<std::mutex> lock(ring_key_mutex);
+  if (ring_key_created) return;
+  pthread_key_create(&ring_key, release_ring);
+  ring_key_created = true;
+}
+
+static TraceRing *acquire_ring()
+{
+  create_ring_key();
+
+  TraceRing *ring = NULL;
+
+  // Reuse a ring released by an exited thread
+  u32 n = min<u32>(n_rings.load(std::memory_order_acquire), TRACE_MAX_RINGS);
+  for (u32 i = 0; i < n && !ring; ++i) {
+    bool expected = false;
+    if (rings[i] && rings[i]->in_use.compare_exchange_strong(expected, true)) {
+      ring = rings[i];
+      ring->n_recorded = 0;
+    }
+  }
+
+  if (!ring) {
+    u32 i = n_rings.fetch_add(1);
+    if (i >= TRACE_MAX_RINGS) return NULL;  // Too many threads. Not traced.
+    ring = new TraceRing;
+    ring->n_recorded = 0;
+    ring->in_use = true;
+    rings[i] = ring;
+  }
+  ring->thread_id = n_threads.fetch_add(1) + 1;
+  pthread_setspecific(ring_key, ring);
+  return ring;
+}
+
+void trace_shutdown()
+{
+  {
+    std::lock_guard<std::mutex> lock(ring_key_mutex);
+    if (ring_key_created) pthread_key_delete(ring_key);
+    ring_key_created = false;
+  }
+
+  u32 n = min<u32>(n_rings.exchange(0), TRACE_MAX_RINGS);
+  for (u32 i = 0; i < n; ++i) {
+    delete rings[i];
+    rings[i] = NULL;
+  }
+  my_ring = NULL;
+}
+
+void trace_record(trace_level level, trace_event_id event_id,
+                  const char *file, u32 line, u64 arg0, u64 arg1)
+{
+  TraceRing *ring = my_ring;
+  if (!ring && !(ring = my_ring = acquire_ring())) return;
+
+  u64 seq = ring->n_recorded.load(std::memory_order_relaxed);
+  TraceEvent *ev = &ring->events[seq & (TraceRing::N_EVENTS - 1)];
+  ev->timestamp_usec = mysqlite_now_usec();
+  ev->file = file;
+  ev->line = line;
+  ev->event_id = event_id;
+  ev->level = level;
+  ev->arg0 = arg0;
+  ev->arg1 = arg1;
+  ring->n_recorded.store(seq + 1, std::memory_order_release);
+}
+
+
+/***********************************************************************
+** Dump
+**
+** Only async-signal-safe functions are allowed here.
+***********************************************************************/
+static const char *level_names[] = {
+  "OFF", "ERROR", "WARN", "INFO", "DEBUG",
+};
+
+static const char *event_names[TRACE_EV_N_EVENTS] = {
+  "log", "lock_rd", "lock_wr", "unlock", "rnd_pos",
+};
+
+class DumpBuf {
+  char buf[1024];
+  size_t len;
+  int fd;
+
+  public:
+  DumpBuf(int fd) : len(0), fd(fd) {}
+  ~DumpBuf() { flush(); }
+
+  public:
+  void str(const char *s) {
+    for (; s && *s; ++s) {
+      if (len == sizeof(buf)) flush();
+      buf[len++] = *s;
+    }
+  }
+
+  public:
+  void num(u64 v) {
+    char digits[21];
+    int i = sizeof(digits) - 1;
+    digits[i] = '\0';
+    do { digits[--i] = '0' + v % 10; v /= 10; } while (v);
+    str(&digits[i]);
+  }
+
+  public:
+  void flush() {
+    for (size_t off = 0; off < len; ) {
+      ssize_t n = write(fd, &buf[off], len - off);
+      if (n <= 0) break;
+      off += n;
+    }
+    len = 0;
+  }
+};
+
+static void dump_event(DumpBuf &out, u64 thread_id, const TraceEvent &ev)
+{
+  out.str("mysqlite trace: thread=");
+  out.num(thread_id);
+  out.str(" ts=");
+  out.num(ev.timestamp_usec);
+  out.str(" ");
+  out.str(ev.level < TRACE_ARRAY_SIZE(level_names) ? level_names[ev.level] : "?");
+  out.str(" ");
+  out.str(ev.event_id < TRACE_EV_N_EVENTS ? event_names[ev.event_id] : "?");
+  out.str(" ");
+  out.str(ev.file);
+  out.str(":");
+  out.num(ev.line);
+  if (ev.event_id == TRACE_EV_LOG) {
+    // Format string only. Arguments are not recorded.
+    out.str(" ");
+    out.str((const char *)ev.arg0);
+    size_t l = strlen((const char *)ev.arg0);
+    if (l == 0 || ((const char *)ev.arg0)[l - 1] != '\n') out.str("\n");
+  } else {
+    out.str(" arg0=");
+    out.num(ev.arg0);
+    out.str(" arg1=");
+    out.num(ev.arg1);
+    out.str("\n");
+  }
+}
+
+void trace_dump(int fd)
+{
+  DumpBuf out(fd);
+  out.str("mysqlite trace: ---- dump begin ----\n");
+
+  u32 n = min<u32>(n_rings.load(std::memory_order_acquire), TRACE_MAX_RINGS);
+  for (u32 i = 0; i < n; ++i) {
+    const TraceRing *ring = rings[i];
+    if (!ring) continue;
+    u64 end = ring->n_recorded.load(std::memory_order_acquire);
+    u64 begin = end > TraceRing::N_EVENTS ? end - TraceRing::N_EVENTS : 0;
+    for (u64 seq = begin; seq < end; ++seq)
+      dump_event(out, ring->thread_id, ring->events[seq & (TraceRing::N_EVENTS - 1)]);
+  }
+
+  out.str("mysqlite trace: ---- dump end ----\n");
+}
+
+
+/***********************************************************************
+** Crash handler
+***********************************************************************/
+static const int crash_signals[] = {SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT};
+static struct sigaction old_actions[TRACE_ARRAY_SIZE(crash_signals)];
+static bool crash_handler_installed = false;
+
+static void crash_handler(int sig)
+{
+  trace_dump(STDERR_FILENO);
+
+  // Give the signal to the previous handler (e.g. mysqld's stack trace)
+  for (size_t i = 0; i < TRACE_ARRAY_SIZE(crash_signals); ++i) {
+    if (crash_signals[i] == sig) sigaction(sig, &old_actions[i], NULL);
+  }
+  raise(sig);
+}
+
+void trace_install_crash_handler()
+{
+  if (crash_handler_installed) return;
+
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = crash_handler;
+  sigemptyset(&sa.sa_mask);
+  sa.sa_flags = SA_RESETHAND | SA_NODEFER;
+  for (size_t i = 0; i < TRACE_ARRAY_SIZE(crash_signals); ++i)
+    sigaction(crash_signals[i], &sa, &old_actions[i]);
+  crash_handler_installed = true;
+}
+
+void trace_uninstall_crash_handler()
+{
+  if (!crash_handler_installed) return;
+
+  for (size_t i = 0; i < TRACE_ARRAY_SIZE(crash_signals); ++i)
+    sigaction(crash_signals[i], &old_actions[i], NULL);
+  crash_handler_installed = false;
+}
+
+}
@@ -0,0 +1,130 @@
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+
+#include <atomic>
+
+#include "mysqlite_types.h"
+
+
+/*
+** Trace events with severity higher than this are compiled out.
+** e.g. -DMYSQLITE_TRACE_MAX_LEVEL=TRACE_INFO removes all TRACE_DEBUG events.
+*/
+#ifndef MYSQLITE_TRACE_MAX_LEVEL
+#define MYSQLITE_TRACE_MAX_LEVEL TRACE_DEBUG
+#endif
+
+
+namespace mysqlite {
+
+/*
+** Severity of trace events.
+** An event is recorded when its level <= current trace level.
+*/
+typedef enum trace_level {
+  TRACE_OFF   = 0,
+  TRACE_ERROR = 1,
+  TRACE_WARN  = 2,
+  TRACE_INFO  = 3,
+  TRACE_DEBUG = 4,
+} trace_level;
+
+/*
+** Trace event ids.
+** Meaning of arg0 and arg1 is described for each id.
+*/
+typedef enum trace_event_id {
+  TRACE_EV_LOG = 0,        // arg0: format string of log_msg()
+  TRACE_EV_LOCK_RD,        // arg0: wait usec, arg1: errstat
+  TRACE_EV_LOCK_WR,        // arg0: 0, arg1: 0
+  TRACE_EV_UNLOCK,         // arg0: hold usec, arg1: 0
+  TRACE_EV_RND_POS,        // arg0: 0, arg1: 0
+  TRACE_EV_N_EVENTS,
+} trace_event_id;
+
+/*
+** Binary trace event. No formatting is done when recorded.
+*/
+struct TraceEvent {
+  u64 timestamp_usec;   // mysqlite_now_usec()
+  const char *file;     // __FILE__ (string literal)
+  u32 line;             // __LINE__
+  u16 event_id;         // trace_event_id
+  u8 level;             // trace_level
+  u64 arg0;
+  u64 arg1;
+};
+
+/*
+** Ring buffer of trace events owned by a thread.
+** Old events are overwritten.
+*/
+struct TraceRing {
+  static const u32 N_EVENTS = 1024;  // Must be power of 2
+
+  TraceEvent events[N_EVENTS];
+  std::atomic<u64> n_recorded;       // Total number of recorded events
+  std::atomic<bool> in_use;          // Whether a living thread owns this ring
+  u64 thread_id;
+};
+
+
+extern std::atomic<int> current_trace_level;
+
+static inline bool trace_enabled(trace_level level)
+{
+  return level <= current_trace_level.load(std::memory_order_relaxed);
+}
+
+void set_trace_level(trace_level level);
+trace_level get_trace_level();
+
+/*
+** Record an event to the ring buffer of current thread.
+** Use trace_event() macro instead, which checks trace level first.
+*/
+void trace_record(trace_level level, trace_event_id event_id,
+                  const char *file, u32 line, u64 arg0, u64 arg1);
+
+/*
+** Write all recorded events of all threads to fd.
+**
+** Async-signal-safe (only write(2) is used) so that it can be called
+** from a signal handler.
+*/
+void trace_dump(int fd);
+
+/*
+** Dump trace events to stderr on SIGSEGV, SIGBUS, SIGILL, SIGFPE and SIGABRT.
+** Previously installed signal handlers are called afterwards.
+*/
+void trace_install_crash_handler();
+void trace_uninstall_crash_handler();
+
+/*
+** Free the rings and delete the thread-specific key that releases them,
+** so that no thread calls into the unloaded plugin when it exits.
+** Other threads must not record events meanwhile. Events recorded
+** afterwards go to new rings.
+*/
+void trace_shutdown();
+
+}
+
+
+/*
+** Record a binary trace event.
+** Cheap when the level is off and compiled out when level > MYSQLITE_TRACE_MAX_LEVEL.
+*/
+#define trace_event(level, event_id, arg0, arg1)                         \
+  do {                                                                  \
+    if ((level) > mysqlite::MYSQLITE_TRACE_MAX_LEVEL ||                 \
+        !mysqlite::trace_enabled(level))                                \
+      break;                                                            \
+    mysqlite::trace_record((level), (event_id), __FILE__, __LINE__,     \
+                           (u64)(arg0), (u64)(arg1));                   \
+  } while (0)
+
+
+#endif /* _TRACE_H_ */
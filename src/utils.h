@@ -32,6 +32,7 @@ using namespace std;
 #include <fcntl.h>
 
 #include "mysqlite_types.h"
+#include "trace.h"
 
 
 /*
@@ -43,9 +44,23 @@ using namespace std;
 
 /*
 ** Logger
+**
+** log_msg() is for errors. Messages are written to stderr (mysqld error log)
+** and recorded to the trace ring buffer unless trace level is TRACE_OFF.
+** Use log_msg_at(mysqlite::TRACE_DEBUG, ...) or trace_event() for messages
+** on hot paths. They cost only a level check unless the level is raised.
+**
+** @note fmt must be a string literal.
 */
-#define log_msg(fmt, ...)                                                   \
+#define log_msg(fmt, ...) log_msg_at(mysqlite::TRACE_ERROR, fmt, ## __VA_ARGS__)
+
+#define log_msg_at(level, fmt, ...)                                     \
   do {                                                                  \
+    if ((level) > mysqlite::MYSQLITE_TRACE_MAX_LEVEL ||                 \
+        !mysqlite::trace_enabled(level))                                \
+      break;                                                            \
+    mysqlite::trace_record((level), mysqlite::TRACE_EV_LOG, __FILE__, __LINE__, \
+                           (u64)(fmt), 0);                              \
     time_t _t = time(NULL);                                             \
     tm _tm;                                                             \
     localtime_r(&_t, &_tm);                                             \
@@ -77,6 +92,8 @@ using namespace std;
     case_log_errstat(MYSQLITE_CONNECTION_ALREADY_OPEN, "Connection is already open\n"); \
     case_log_errstat(MYSQLITE_FLOCK_NEEDED, "File lock is necessary\n");        \
     case_log_errstat(MYSQLITE_CANNOT_OPEN_DB_FILE, "Failed to open file as SQLite3 DB\n"); \
+    case_log_errstat(MYSQLITE_LOCK_TIMEOUT, "Lock wait timeout exceeded\n"); \
+    case_log_errstat(MYSQLITE_READONLY, "Attempt to write a readonly database\n"); \
                                                                         \
     default:                                                            \
       log_msg("!!! errstat=%d has no corresponding message !!!\n", errstat); \
@@ -85,6 +102,18 @@ using namespace std;
   } while (0)
 
 
+/*
+** Monotonic clock in microseconds.
+** Used for measuring latencies (not for wall clock time).
+*/
+static inline u64 mysqlite_now_usec()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (u64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+
 /*
 ** Read (v[0] | v[1] ...) as a variant.
 ** If MSB of v[i] is 0, then v[i+1] is ignored.
@@ -133,6 +162,35 @@ T u8s_to_val(const u8 * const p_sequence, u8 len_sequence) {
   return v;
 }
 
+/*
+** Read 2, 4 or 8 u8 values as big-endian value by a single load,
+** byte-swapped on little-endian hosts. p needs no alignment.
+*/
+static inline u16 be16_to_u16(const u8 *p) {
+  u16 v;
+  memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  v = __builtin_bswap16(v);
+#endif
+  return v;
+}
+static inline u32 be32_to_u32(const u8 *p) {
+  u32 v;
+  memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  v = __builtin_bswap32(v);
+#endif
+  return v;
+}
+static inline u64 be64_to_u64(const u8 *p) {
+  u64 v;
+  memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  v = __builtin_bswap64(v);
+#endif
+  return v;
+}
+
 
 static inline errstat mysqlite_fread(void *ptr, long offset, size_t nbyte, FILE * const f) {
   if ((ssize_t)nbyte != pread(fileno(f), ptr, nbyte, offset)) {
@@ -0,0 +1,43 @@
+#! /usr/bin/perl
+
+use strict;
+use warnings;
+
+use DBI;
+
+use Test::More tests => 10;
+
+use File::Basename;
+use Cwd 'realpath';
+my $testdir = realpath(dirname(__FILE__));
+
+my $db = $ENV{DB} || "test";
+my $cnf = $ENV{CNF} || "/etc/my.cnf";
+my $dbh = DBI->connect(
+    $ENV{DBI} || "dbi:mysql:$db;mysql_read_default_file=$cnf",
+    $ENV{DBI_USER} || 'root',
+    $ENV{DBI_PASSWORD} || '',
+    {PrintError => 0},
+) or die 'connection failed:';
+
+my $expected = [
+    ['Kuro-Label', 'Sapporo'],
+    ['Ichiban Shibori', 'Kirin'],
+    ['Super Dry', 'Asahi'],
+];
+
+## READONLY: opened O_RDONLY, locked as usual
+ok($dbh->do("drop table if exists japan"));
+ok($dbh->do("create table japan engine=mysqlite file_name='$testdir/db/03-simple-beer.sqlite' readonly=1"));
+is_deeply($dbh->selectall_arrayref("select * from japan"), $expected);
+ok(!$dbh->do("insert into japan values ('Premium Malts', 'Suntory')"));
+is($dbh->selectrow_array("select count(*) from japan"), 3);
+
+## IMMUTABLE: no file locks
+ok($dbh->do("drop table if exists japan"));
+ok($dbh->do("create table japan engine=mysqlite file_name='$testdir/db/03-simple-beer.sqlite' immutable=1"));
+is_deeply($dbh->selectall_arrayref("select * from japan"), $expected);
+ok(!$dbh->do("insert into japan values ('Premium Malts', 'Suntory')"));
+is($dbh->selectrow_array("select count(*) from japan"), 3);
+
+$dbh->do("drop table if exists japan");
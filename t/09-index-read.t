@@ -0,0 +1,60 @@
+#! /usr/bin/perl
+
+use strict;
+use warnings;
+
+use DBI;
+
+use Test::More tests => 15;
+
+use File::Basename;
+use Cwd 'realpath';
+my $testdir = realpath(dirname(__FILE__));
+
+my $db = $ENV{DB} || "test";
+my $cnf = $ENV{CNF} || "/etc/my.cnf";
+my $dbh = DBI->connect(
+    $ENV{DBI} || "dbi:mysql:$db;mysql_read_default_file=$cnf",
+    $ENV{DBI_USER} || 'root',
+    $ENV{DBI_PASSWORD} || '',
+) or die 'connection failed:';
+
+my $sqlite_db = "$testdir/db/IndexCursor-events.sqlite";
+
+
+## Keys are discovered from SQLite indexes
+ok($dbh->do("drop table if exists Beer"));
+ok($dbh->do("create table Beer engine=mysqlite file_name='$sqlite_db'"));
+is_deeply(
+    [map { $_->[2] } @{$dbh->selectall_arrayref("show index from Beer")}],
+    ['Beer_maker', 'Beer_price_name', 'Beer_price_name'],
+);
+is_deeply(
+    $dbh->selectall_arrayref("select name from Beer force index (Beer_maker) where maker = 'Anchor' order by name"),
+    [['Liberty Ale'], ['Porter']],
+);
+
+## Lookups and ranges on an INT index
+ok($dbh->do("drop table if exists Event"));
+ok($dbh->do("create table Event engine=mysqlite file_name='$sqlite_db'"));
+is_deeply(
+    $dbh->selectall_arrayref("select kind, val from Event force index (Event_ts) where ts = 1234"),
+    [['click', -6]],
+);
+is($dbh->selectrow_array("select count(*) from Event force index (Event_ts) where ts between 100 and 199"), 100);
+is_deeply(
+    $dbh->selectall_arrayref("select ts from Event force index (Event_ts) where ts > 2995 order by ts"),
+    [[2996], [2997], [2998], [2999], [3000]],
+);
+
+## NOCASE index finds both cases; MySQL (utf8_bin) filters them
+is($dbh->selectrow_array("select count(*) from Event force index (sqlite_autoindex_Event_1) where kind = 'click'"), 600);
+
+## DESC index and NULL keys
+is($dbh->selectrow_array("select count(*) from Event force index (Event_val_desc) where val = 5"), 1);
+is($dbh->selectrow_array("select count(*) from Event force index (Event_val_desc) where val is null"), 300);
+
+## Prefix key on long TEXT spanning overflow pages
+ok($dbh->do("drop table if exists Doc"));
+ok($dbh->do("create table Doc engine=mysqlite file_name='$sqlite_db'"));
+is($dbh->selectrow_array("select count(*) from Doc force index (Doc_title) where title = repeat('title040 ', 101)"), 1);
@@ -0,0 +1,38 @@
+#! /usr/bin/perl
+
+use strict;
+use warnings;
+
+use DBI;
+
+use Test::More tests => 7;
+
+use File::Basename;
+use Cwd 'realpath';
+my $testdir = realpath(dirname(__FILE__));
+
+my $db = $ENV{DB} || "test";
+my $cnf = $ENV{CNF} || "/etc/my.cnf";
+my $dbh = DBI->connect(
+    $ENV{DBI} || "dbi:mysql:$db;mysql_read_default_file=$cnf",
+    $ENV{DBI_USER} || 'root',
+    $ENV{DBI_PASSWORD} || '',
+) or die 'connection failed:';
+
+my $sqlite_db = "$testdir/db/IndexCursor-events.sqlite";
+
+ok($dbh->do("drop table if exists Beer"));
+ok($dbh->do("create table Beer engine=mysqlite file_name='$sqlite_db'"));
+ok($dbh->do("drop table if exists Event"));
+ok($dbh->do("create table Event engine=mysqlite file_name='$sqlite_db'"));
+
+## Filesort sorting rowids (position()) and reading rows back (rnd_pos())
+ok($dbh->do("set max_length_for_sort_data = 4"));
+is_deeply(
+    $dbh->selectall_arrayref("select name, price from Beer order by price desc, name limit 3"),
+    [['Liberty Ale', 550], ['Porter', 500], ['Golden Ale', 450]],
+);
+is_deeply(
+    $dbh->selectall_arrayref("select ts, kind from Event where ts <= 5 order by kind, ts"),
+    [[1, 'Click'], [3, 'Click'], [2, 'View'], [4, 'View'], [5, 'search']],
+);
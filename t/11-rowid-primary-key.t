@@ -0,0 +1,48 @@
+#! /usr/bin/perl
+
+use strict;
+use warnings;
+
+use DBI;
+
+use Test::More tests => 9;
+
+use File::Basename;
+use Cwd 'realpath';
+my $testdir = realpath(dirname(__FILE__));
+
+my $db = $ENV{DB} || "test";
+my $cnf = $ENV{CNF} || "/etc/my.cnf";
+my $dbh = DBI->connect(
+    $ENV{DBI} || "dbi:mysql:$db;mysql_read_default_file=$cnf",
+    $ENV{DBI_USER} || 'root',
+    $ENV{DBI_PASSWORD} || '',
+) or die 'connection failed:';
+
+ok($dbh->do("drop table if exists Event"));
+ok($dbh->do("create table Event engine=mysqlite file_name='$testdir/db/IndexCursor-events.sqlite'"));
+
+## INTEGER PRIMARY KEY is discovered as PRIMARY KEY
+is_deeply(
+    [map { [$_->[2], $_->[4]] } grep { $_->[2] eq 'PRIMARY' } @{$dbh->selectall_arrayref("show index from Event")}],
+    [['PRIMARY', 'id']],
+);
+
+## Its value is rowid
+is_deeply(
+    $dbh->selectall_arrayref("select id, ts from Event force index (Event_ts) where ts = 1234"),
+    [[1145, 1234]],
+);
+
+## Rowid seeks and ranges
+is_deeply($dbh->selectall_arrayref("select ts from Event where id = 1145"), [[1234]]);
+is($dbh->selectrow_array("select count(*) from Event where id between 100 and 199"), 100);
+is_deeply(
+    $dbh->selectall_arrayref("select id from Event where id > 2995 order by id"),
+    [[2996], [2997], [2998], [2999], [3000]],
+);
+is($dbh->selectrow_array("select count(*) from Event where id < 1 or id > 3000"), 0);
+
+## Estimated from interior pages, not a full scan
+my $plan = $dbh->selectrow_hashref("explain select * from Event where id between 100 and 199");
+is_deeply([$plan->{type}, $plan->{key}], ['range', 'PRIMARY']);
@@ -0,0 +1,45 @@
+#! /usr/bin/perl
+
+use strict;
+use warnings;
+
+use DBI;
+
+use Test::More tests => 8;
+
+use File::Basename;
+use Cwd 'realpath';
+my $testdir = realpath(dirname(__FILE__));
+
+my $db = $ENV{DB} || "test";
+my $cnf = $ENV{CNF} || "/etc/my.cnf";
+my $dbh = DBI->connect(
+    $ENV{DBI} || "dbi:mysql:$db;mysql_read_default_file=$cnf",
+    $ENV{DBI_USER} || 'root',
+    $ENV{DBI_PASSWORD} || '',
+) or die 'connection failed:';
+
+ok($dbh->do("drop table if exists Event"));
+ok($dbh->do("create table Event engine=mysqlite file_name='$testdir/db/IndexCursor-events.sqlite'"));
+
+## Rowid order read backwards without filesort
+is_deeply(
+    $dbh->selectall_arrayref("select id from Event order by id desc limit 3"),
+    [[3000], [2999], [2998]],
+);
+my $plan = $dbh->selectrow_hashref("explain select id from Event order by id desc limit 3");
+unlike($plan->{Extra} || '', qr/filesort/);
+
+## Backward ranges
+is_deeply(
+    $dbh->selectall_arrayref("select id from Event where id < 1146 order by id desc limit 2"),
+    [[1145], [1144]],
+);
+is_deeply(
+    $dbh->selectall_arrayref("select ts from Event force index (Event_ts) where ts <= 1234 order by ts desc limit 2"),
+    [[1234], [1233]],
+);
+
+## MAX() from the last entry
+is($dbh->selectrow_array("select max(ts) from Event"), 3000);
+is($dbh->selectrow_array("select max(id) from Event where id < 2000"), 1999);
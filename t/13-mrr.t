@@ -0,0 +1,48 @@
+#! /usr/bin/perl
+
+use strict;
+use warnings;
+
+use DBI;
+
+use Test::More tests => 11;
+
+use File::Basename;
+use Cwd 'realpath';
+my $testdir = realpath(dirname(__FILE__));
+
+my $db = $ENV{DB} || "test";
+my $cnf = $ENV{CNF} || "/etc/my.cnf";
+my $dbh = DBI->connect(
+    $ENV{DBI} || "dbi:mysql:$db;mysql_read_default_file=$cnf",
+    $ENV{DBI_USER} || 'root',
+    $ENV{DBI_PASSWORD} || '',
+) or die 'connection failed:';
+
+ok($dbh->do("drop table if exists Event"));
+ok($dbh->do("create table Event engine=mysqlite file_name='$testdir/db/IndexCursor-events.sqlite'"));
+ok($dbh->do("set optimizer_switch='mrr=on,join_cache_bka=on'"));
+ok($dbh->do("set join_cache_level=6"));
+
+## Batched Key Access by rowid
+my $q = "select count(*), sum(e2.ts) from Event e1 join Event e2 on e2.id = e1.ts where e1.id <= 100";
+my $plan = $dbh->selectall_arrayref("explain $q", { Slice => {} });
+like($plan->[1]{Extra}, qr/BKA/);
+is_deeply($dbh->selectall_arrayref($q), [[100, 155500]]);
+
+## Batched Key Access by a SQLite index
+$q = "select count(*), sum(e2.id) from Event e1 join Event e2 force index (Event_ts) on e2.ts = e1.id where e1.id <= 50";
+is_deeply($dbh->selectall_arrayref($q), [[50, 75763]]);
+
+# With a column not in the index, rows are read from the table in batches.
+# id of each row is its own rowid, not that of the last entry batched.
+my $q2 = "select count(*), sum(e2.id), sum(e2.val), sum(e2.id % 7 * e2.val)"
+    . " from Event e1 join Event e2 force index (Event_ts) on e2.ts = e1.id where e1.id <= 50";
+$plan = $dbh->selectall_arrayref("explain $q2", { Slice => {} });
+like($plan->[1]{Extra}, qr/BKA/);
+is_deeply($dbh->selectall_arrayref($q2), [[50, 75763, -2291, -19418]]);
+
+## Default MRR when batches are disabled
+ok($dbh->do("set global mysqlite_mrr_batch_rows = 0"));
+is_deeply($dbh->selectall_arrayref($q), [[50, 75763]]);
+$dbh->do("set global mysqlite_mrr_batch_rows = default");
@@ -0,0 +1,59 @@
+#! /usr/bin/perl
+
+use strict;
+use warnings;
+
+use DBI;
+
+use Test::More tests => 13;
+
+use File::Basename;
+use File::Temp qw(tempdir);
+use Cwd 'realpath';
+my $testdir = realpath(dirname(__FILE__));
+
+my $db = $ENV{DB} || "test";
+my $cnf = $ENV{CNF} || "/etc/my.cnf";
+my $dbh = DBI->connect(
+    $ENV{DBI} || "dbi:mysql:$db;mysql_read_default_file=$cnf",
+    $ENV{DBI_USER} || 'root',
+    $ENV{DBI_PASSWORD} || '',
+) or die 'connection failed:';
+
+ok($dbh->do("drop table if exists Event"));
+ok($dbh->do("create table Event engine=mysqlite file_name='$testdir/db/IndexCursor-events.sqlite'"));
+
+## Covering index: rows come from index entries
+my $q = "select ts from Event force index (Event_ts) where ts between 100 and 104";
+like($dbh->selectrow_hashref("explain $q")->{Extra}, qr/Using index/);
+is_deeply($dbh->selectall_arrayref($q), [[100], [101], [102], [103], [104]]);
+
+## Index entries also hold rowid (INTEGER PRIMARY KEY)
+$q = "select id, ts from Event force index (Event_ts) where ts = 1234";
+like($dbh->selectrow_hashref("explain $q")->{Extra}, qr/Using index/);
+is_deeply($dbh->selectall_arrayref($q), [[1145, 1234]]);
+
+## GROUP BY an indexed column reads the index only
+$q = "select kind, count(*) from Event group by kind";
+like($dbh->selectrow_hashref("explain $q")->{Extra}, qr/Using index/);
+is_deeply(
+    $dbh->selectall_arrayref($q),
+    [['Click', 600], ['View', 600], ['buy', 600], ['click', 600], ['search', 600]],
+);
+
+## UNIQUE key of a NOT NULL column made primary_key by the server, without
+## INTEGER PRIMARY KEY: other index entries do not hold its column
+my $dbpath = tempdir(CLEANUP => 1) . "/unique-pk.sqlite";
+my $dbh_sqlite = DBI->connect("dbi:SQLite:dbname=$dbpath", '', '');
+$dbh_sqlite->do("create table U (code INT NOT NULL UNIQUE, name TEXT, other INT)");
+$dbh_sqlite->do("create index U_other on U (other)");
+$dbh_sqlite->do("insert into U values (?, ?, ?)", undef, $_ * 10, "n$_", $_) for 1 .. 5;
+$dbh_sqlite->disconnect;
+
+ok($dbh->do("drop table if exists U"));
+ok($dbh->do("create table U engine=mysqlite file_name='$dbpath'"));
+is_deeply($dbh->selectall_arrayref("select code, name from U where code = 30"), [[30, "n3"]]);
+$q = "select other, code from U force index (U_other) where other between 2 and 3";
+unlike($dbh->selectrow_hashref("explain $q")->{Extra} || '', qr/Using index/);
+is_deeply($dbh->selectall_arrayref($q), [[2, 20], [3, 30]]);
+$dbh->do("drop table U");
@@ -0,0 +1,50 @@
+#! /usr/bin/perl
+
+use strict;
+use warnings;
+
+use DBI;
+
+use Test::More tests => 12;
+
+use File::Basename;
+use Cwd 'realpath';
+my $testdir = realpath(dirname(__FILE__));
+
+my $db = $ENV{DB} || "test";
+my $cnf = $ENV{CNF} || "/etc/my.cnf";
+my $dbh = DBI->connect(
+    $ENV{DBI} || "dbi:mysql:$db;mysql_read_default_file=$cnf",
+    $ENV{DBI_USER} || 'root',
+    $ENV{DBI_PASSWORD} || '',
+) or die 'connection failed:';
+
+ok($dbh->do("drop table if exists Event"));
+ok($dbh->do("create table Event engine=mysqlite file_name='$testdir/db/IndexCursor-events.sqlite'"));
+ok($dbh->do("drop table if exists Beer"));
+ok($dbh->do("create table Beer engine=mysqlite file_name='$testdir/db/IndexCursor-events.sqlite'"));
+
+## ORDER BY ... LIMIT streams the first entries of an index
+my $q = "select * from Event order by ts limit 5";
+unlike($dbh->selectrow_hashref("explain $q")->{Extra} || '', qr/filesort/);
+is_deeply(
+    [map { [$_->[0], $_->[1]] } @{$dbh->selectall_arrayref($q)}],
+    [[1088, 1], [2176, 2], [263, 3], [1351, 4], [2439, 5]],
+);
+is_deeply(
+    $dbh->selectall_arrayref("select id, ts from Event order by ts desc limit 2"),
+    [[1913, 3000], [825, 2999]],
+);
+
+## Multi-column key with a BINARY text column
+$q = "select name from Beer order by price, name limit 3";
+unlike($dbh->selectrow_hashref("explain $q")->{Extra} || '', qr/filesort/);
+is_deeply($dbh->selectall_arrayref($q), [['Kuro Label'], ['Ebisu'], ['Golden Ale']]);
+
+## NOCASE and DESC columns are not in MySQL's order
+like($dbh->selectrow_hashref("explain select * from Event order by kind limit 1")->{Extra}, qr/filesort/);
+like($dbh->selectrow_hashref("explain select * from Event order by val limit 1")->{Extra}, qr/filesort/);
+is_deeply(
+    [map { $_->[-1] } grep { $_->[2] eq 'sqlite_autoindex_Event_1' } @{$dbh->selectall_arrayref("show index from Event")}],
+    ['SQLite collations: NOCASE, BINARY', 'SQLite collations: NOCASE, BINARY'],
+);
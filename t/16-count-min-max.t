@@ -0,0 +1,40 @@
+#! /usr/bin/perl
+
+use strict;
+use warnings;
+
+use DBI;
+
+use Test::More tests => 10;
+
+use File::Basename;
+use Cwd 'realpath';
+my $testdir = realpath(dirname(__FILE__));
+
+my $db = $ENV{DB} || "test";
+my $cnf = $ENV{CNF} || "/etc/my.cnf";
+my $dbh = DBI->connect(
+    $ENV{DBI} || "dbi:mysql:$db;mysql_read_default_file=$cnf",
+    $ENV{DBI_USER} || 'root',
+    $ENV{DBI_PASSWORD} || '',
+) or die 'connection failed:';
+
+ok($dbh->do("drop table if exists Event"));
+ok($dbh->do("create table Event engine=mysqlite file_name='$testdir/db/IndexCursor-events.sqlite'"));
+
+## COUNT(*) from the numbers of leaf cells
+my $q = "select count(*) from Event";
+like($dbh->selectrow_hashref("explain $q")->{Extra}, qr/Select tables optimized away/);
+is($dbh->selectrow_array($q), 3000);
+
+## MIN/MAX from the ends of rowid and index B-trees
+$q = "select min(id), max(id) from Event";
+like($dbh->selectrow_hashref("explain $q")->{Extra}, qr/Select tables optimized away/);
+is_deeply($dbh->selectall_arrayref($q), [[1, 3000]]);
+$q = "select min(ts), max(ts) from Event";
+like($dbh->selectrow_hashref("explain $q")->{Extra}, qr/Select tables optimized away/);
+is_deeply($dbh->selectall_arrayref($q), [[1, 3000]]);
+is($dbh->selectrow_array("select max(ts) from Event where ts < 1234"), 1233);
+
+## Counted rows are the scanned rows
+is($dbh->selectrow_array("select count(*) from Event where val is null or val is not null"), 3000);
@@ -0,0 +1,81 @@
+#! /usr/bin/perl
+
+use strict;
+use warnings;
+
+use DBI;
+
+use Test::More tests => 35;
+
+use File::Basename;
+use File::Temp qw(tempdir);
+use Cwd 'realpath';
+my $testdir = realpath(dirname(__FILE__));
+
+my $db = $ENV{DB} || "test";
+my $cnf = $ENV{CNF} || "/etc/my.cnf";
+my $dbh = DBI->connect(
+    $ENV{DBI} || "dbi:mysql:$db;mysql_read_default_file=$cnf",
+    $ENV{DBI_USER} || 'root',
+    $ENV{DBI_PASSWORD} || '',
+) or die 'connection failed:';
+
+ok($dbh->do("drop table if exists Event"));
+ok($dbh->do("create table Event engine=mysqlite file_name='$testdir/db/IndexCursor-events.sqlite'"));
+
+sub scan {
+    my ($where) = @_;
+    # USE INDEX () for full table scans
+    return $dbh->selectrow_arrayref("select count(*), sum(id) from Event use index () where $where");
+}
+
+sub rnd_next_count {
+    my ($where) = @_;
+    $dbh->do("flush status");
+    scan($where);
+    my (undef, $n) = $dbh->selectrow_array("show session status like 'Handler_read_rnd_next'");
+    return $n;
+}
+
+## Same rows with and without pushed conditions
+my @conds = (
+    ["ts < 100 and kind in ('buy', 'View')", 41],
+    ["100 > ts and kind = 'buy  '", 19],     # Trailing spaces are ignored
+    ["kind like 'cl%'", 600],                # Case sensitive
+    ["kind like 'c_ick'", 600],
+    ["val is null", 300],
+    ["val <> 0", 2697],
+    ["val >= 989.5e0", 16],
+    ["kind = 'buy' or ts = 5", 601],         # OR is not pushed
+    ["ts = '5'", 1],                         # Nor numbers compared with strings
+    # Nor strings compared in another collation
+    ["kind = 'CLICK' collate utf8_general_ci", 1200],
+    ["kind like 'cl%' collate utf8_general_ci", 1200],
+    ["kind < _binary'buy '", 1800],
+);
+for my $cond (@conds) {
+    my ($where, $n) = @$cond;
+    $dbh->do("set optimizer_switch='engine_condition_pushdown=off'");
+    my $expected = scan($where);
+    $dbh->do("set optimizer_switch='engine_condition_pushdown=on'");
+    is($expected->[0], $n, $where);
+    is_deeply(scan($where), $expected, "$where (pushed)");
+}
+
+## Rejected rows are not returned to the server
+is(rnd_next_count("ts < 100 and kind in ('buy', 'View')"), 41 + 1);  # + end of scan
+
+ok($dbh->do("set optimizer_switch='engine_condition_pushdown=off'"));
+
+## Negative REAL in a DOUBLE UNSIGNED column is 0 for the server
+my $dbpath = tempdir(CLEANUP => 1) . "/cond-push.sqlite";
+my $dbh_sqlite = DBI->connect("dbi:SQLite:dbname=$dbpath", '', '');
+ok($dbh_sqlite->do("create table U (r DOUBLE UNSIGNED)"));
+ok($dbh_sqlite->do("insert into U values (-1.5), (2.5)"));
+$dbh_sqlite->disconnect;
+ok($dbh->do("drop table if exists U"));
+ok($dbh->do("create table U engine=mysqlite file_name='$dbpath'"));
+ok($dbh->do("set optimizer_switch='engine_condition_pushdown=on'"));
+is($dbh->selectrow_array("select count(*) from U where r = 0"), 1);
+ok($dbh->do("set optimizer_switch='engine_condition_pushdown=off'"));
+$dbh->do("drop table U");
@@ -0,0 +1,54 @@
+#! /usr/bin/perl
+
+use strict;
+use warnings;
+
+use DBI;
+
+use Test::More tests => 9;
+
+use File::Basename;
+use Cwd 'realpath';
+my $testdir = realpath(dirname(__FILE__));
+
+my $db = $ENV{DB} || "test";
+my $cnf = $ENV{CNF} || "/etc/my.cnf";
+my $dbh = DBI->connect(
+    $ENV{DBI} || "dbi:mysql:$db;mysql_read_default_file=$cnf",
+    $ENV{DBI_USER} || 'root',
+    $ENV{DBI_PASSWORD} || '',
+) or die 'connection failed:';
+
+ok($dbh->do("drop table if exists Event"));
+ok($dbh->do("create table Event engine=mysqlite file_name='$testdir/db/IndexCursor-events.sqlite'"));
+
+sub status {
+    my ($name) = @_;
+    my (undef, $n) = $dbh->selectrow_array("show session status like '$name'");
+    return $n;
+}
+
+## Conditions on key columns out of the range are checked on index entries
+like($dbh->selectrow_hashref("explain select val from Event force index (Event_ts)"
+                             . " where ts between 100 and 400 and ts % 7 = 0")->{Extra},
+     qr/Using index condition/);
+
+$dbh->do("flush status");
+is_deeply($dbh->selectall_arrayref(
+    "select count(*), sum(id), count(val) from Event force index (Event_ts)"
+    . " where ts between 100 and 400 and ts % 7 = 0"), [[43, 64661, 39]]);
+is(status('Handler_icp_attempts'), 301);
+is(status('Handler_icp_match'), 43);
+
+## Backward
+is_deeply($dbh->selectall_arrayref(
+    "select id, ts, val is not null from Event force index (Event_ts)"
+    . " where ts between 100 and 400 and ts % 7 = 0 order by ts desc limit 3"),
+    [[1968, 399, 1], [354, 392, 1], [1741, 385, 1]]);
+
+## Same rows without pushdown
+ok($dbh->do("set optimizer_switch='index_condition_pushdown=off'"));
+is_deeply($dbh->selectall_arrayref(
+    "select count(*), sum(id), count(val) from Event force index (Event_ts)"
+    . " where ts between 100 and 400 and ts % 7 = 0"), [[43, 64661, 39]]);
+$dbh->do("set optimizer_switch='index_condition_pushdown=on'");
@@ -0,0 +1,44 @@
+#! /usr/bin/perl
+
+use strict;
+use warnings;
+
+use DBI;
+
+use Test::More tests => 8;
+
+use File::Basename;
+use Cwd 'realpath';
+my $testdir = realpath(dirname(__FILE__));
+
+my $db = $ENV{DB} || "test";
+my $cnf = $ENV{CNF} || "/etc/my.cnf";
+my $dbh = DBI->connect(
+    $ENV{DBI} || "dbi:mysql:$db;mysql_read_default_file=$cnf",
+    $ENV{DBI_USER} || 'root',
+    $ENV{DBI_PASSWORD} || '',
+) or die 'connection failed:';
+
+ok($dbh->do("drop table if exists Event"));
+ok($dbh->do("create table Event engine=mysqlite file_name='$testdir/db/IndexCursor-events.sqlite'"));
+ok($dbh->do("set global mysqlite_parallel_scan_threads = 4"));
+
+## Every row once
+is_deeply($dbh->selectall_arrayref("select count(*), sum(ts), sum(val) from Event use index () where id > 0"),
+          [[3000, 4501500, -4841]]);
+is_deeply($dbh->selectall_arrayref("select kind, count(*), sum(val) from Event use index () group by kind"),
+          [['Click', 600, -8004], ['View', 600, 18909], ['buy', 600, -15163],
+           ['click', 600, 272], ['search', 600, -855]]);
+
+## Pushed conditions are tested by the workers
+ok($dbh->do("set optimizer_switch='engine_condition_pushdown=on'"));
+is_deeply($dbh->selectall_arrayref("select count(*), sum(id) from Event use index ()"
+                                   . " where ts < 100 and kind in ('buy', 'View')"),
+          [[41, 61430]]);
+$dbh->do("set optimizer_switch='engine_condition_pushdown=off'");
+
+## Rows are read again by position (filesort)
+is_deeply($dbh->selectall_arrayref("select id, ts from Event use index () order by val, id limit 2"),
+          $dbh->selectall_arrayref("select id, ts from Event force index (PRIMARY) order by val, id limit 2"));
+
+$dbh->do("set global mysqlite_parallel_scan_threads = default");
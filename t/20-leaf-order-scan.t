@@ -0,0 +1,36 @@
+#! /usr/bin/perl
+
+use strict;
+use warnings;
+
+use DBI;
+
+use Test::More tests => 7;
+
+use File::Basename;
+use Cwd 'realpath';
+my $testdir = realpath(dirname(__FILE__));
+
+my $db = $ENV{DB} || "test";
+my $cnf = $ENV{CNF} || "/etc/my.cnf";
+my $dbh = DBI->connect(
+    $ENV{DBI} || "dbi:mysql:$db;mysql_read_default_file=$cnf",
+    $ENV{DBI_USER} || 'root',
+    $ENV{DBI_PASSWORD} || '',
+) or die 'connection failed:';
+
+## Rows were inserted in random order, so leaves are not in rowid order in the file
+ok($dbh->do("drop table if exists Item"));
+ok($dbh->do("create table Item engine=mysqlite file_name='$testdir/db/LeafOrderCursor-shuffled.sqlite'"));
+
+ok($dbh->do("set global mysqlite_leaf_order_scan = on"));
+is_deeply($dbh->selectall_arrayref("select count(*), sum(id), sum(v), min(v), max(v) from Item use index ()"),
+          [[2000, 2001000, 2001000, 1, 2000]]);
+my $leaf_order = $dbh->selectcol_arrayref("select id from Item use index ()");
+is_deeply([sort { $a <=> $b } @$leaf_order], [1 .. 2000]);
+
+## Rowid order without it
+ok($dbh->do("set global mysqlite_leaf_order_scan = off"));
+is_deeply($dbh->selectcol_arrayref("select id from Item use index ()"), [1 .. 2000]);
+
+$dbh->do("set global mysqlite_leaf_order_scan = default");
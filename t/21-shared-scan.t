@@ -0,0 +1,49 @@
+#! /usr/bin/perl
+
+use strict;
+use warnings;
+
+use DBI;
+
+use Test::More tests => 8;
+
+use File::Basename;
+use Cwd 'realpath';
+my $testdir = realpath(dirname(__FILE__));
+
+my $db = $ENV{DB} || "test";
+my $cnf = $ENV{CNF} || "/etc/my.cnf";
+sub connect_db {
+    return DBI->connect(
+        $ENV{DBI} || "dbi:mysql:$db;mysql_read_default_file=$cnf",
+        $ENV{DBI_USER} || 'root',
+        $ENV{DBI_PASSWORD} || '',
+    ) or die 'connection failed:';
+}
+my $dbh = connect_db();
+
+ok($dbh->do("drop table if exists Event"));
+ok($dbh->do("create table Event engine=mysqlite file_name='$testdir/db/IndexCursor-events.sqlite'"));
+ok($dbh->do("set global mysqlite_shared_scan = on"));
+
+## Every row once
+is_deeply($dbh->selectall_arrayref("select count(*), sum(ts), sum(val) from Event use index ()"),
+          [[3000, 4501500, -4841]]);
+
+## Scans joining others in progress wrap around
+my $dbh2 = connect_db();
+my $sth = $dbh2->prepare("select id from Event use index ()", {mysql_use_result => 1});
+ok($sth->execute);
+$sth->fetchrow_arrayref for 1 .. 100;
+is_deeply($dbh->selectall_arrayref("select count(*), count(distinct id), sum(id) from Event use index ()"),
+          [[3000, 3000, 4501500]]);
+my $n_rows = 100;
+$n_rows++ while $sth->fetchrow_arrayref;
+is($n_rows, 3000);
+
+## Self join: the inner scan restarts while the outer one is in progress
+is_deeply($dbh->selectall_arrayref("select count(*) from Event a use index (), Event b use index ()"
+                                   . " where a.id = b.id and a.ts < 100"),
+          [[99]]);
+
+$dbh->do("set global mysqlite_shared_scan = default");
@@ -0,0 +1,49 @@
+#! /usr/bin/perl
+
+use strict;
+use warnings;
+
+use DBI;
+
+use Test::More tests => 9;
+
+use File::Basename;
+use Cwd 'realpath';
+my $testdir = realpath(dirname(__FILE__));
+
+my $db = $ENV{DB} || "test";
+my $cnf = $ENV{CNF} || "/etc/my.cnf";
+my $dbh = DBI->connect(
+    $ENV{DBI} || "dbi:mysql:$db;mysql_read_default_file=$cnf",
+    $ENV{DBI_USER} || 'root',
+    $ENV{DBI_PASSWORD} || '',
+) or die 'connection failed:';
+
+ok($dbh->do("drop table if exists Event"));
+ok($dbh->do("create table Event engine=mysqlite file_name='$testdir/db/IndexCursor-events.sqlite'"));
+
+my @queries = (
+    "select count(*), sum(ts), sum(val), count(val) from Event use index ()",
+    "select kind, count(*), sum(val) from Event use index () group by kind",
+    # Rows are read again by position (filesort)
+    "select id, ts, kind from Event use index () order by val desc, id limit 5",
+    # Inner scan restarted for each row of the outer one
+    "select count(*) from Event a use index (), Event b use index ()"
+    . " where a.id = b.id + 1 and a.ts < 50",
+);
+my @expected = map { $dbh->selectall_arrayref($_) } @queries;
+
+## Same rows with the decode thread
+ok($dbh->do("set global mysqlite_decode_thread = on"));
+for my $i (0 .. $#queries) {
+    is_deeply($dbh->selectall_arrayref($queries[$i]), $expected[$i], $queries[$i]);
+}
+
+## Pushed conditions are tested by the decode thread
+ok($dbh->do("set optimizer_switch='engine_condition_pushdown=on'"));
+is_deeply($dbh->selectall_arrayref("select count(*), sum(id) from Event use index ()"
+                                   . " where ts < 100 and kind in ('buy', 'View')"),
+          [[41, 61430]]);
+$dbh->do("set optimizer_switch='engine_condition_pushdown=off'");
+
+$dbh->do("set global mysqlite_decode_thread = default");
@@ -0,0 +1,54 @@
+#! /usr/bin/perl
+
+use strict;
+use warnings;
+
+use DBI;
+
+use Test::More tests => 12;
+
+use File::Temp qw(tempdir);
+
+my $db = $ENV{DB} || "test";
+my $cnf = $ENV{CNF} || "/etc/my.cnf";
+my $dbh = DBI->connect(
+    $ENV{DBI} || "dbi:mysql:$db;mysql_read_default_file=$cnf",
+    $ENV{DBI_USER} || 'root',
+    $ENV{DBI_PASSWORD} || '',
+    {mysql_enable_utf8 => 1},
+) or die 'connection failed:';
+
+## Values written into the record directly, and those left to Field::store()
+my $dbpath = tempdir(CLEANUP => 1) . "/row-plan.sqlite";
+my $dbh_sqlite = DBI->connect("dbi:SQLite:dbname=$dbpath", '', '', {sqlite_unicode => 1});
+ok($dbh_sqlite->do("create table T (id INTEGER PRIMARY KEY, t TINYINT, u TINYINT UNSIGNED,"
+                   . " b BIGINT, v VARCHAR(3), txt TEXT, bin VARBINARY(4))"));
+my $ins = $dbh_sqlite->prepare("insert into T values (?, ?, ?, ?, ?, ?, ?)");
+ok($ins->execute(1, 100, 200, -70000, "abc", "h\x{e9}llo", "ab"));
+ok($ins->execute(2, 300, -5, 2147483647, "abcdef", "\x{1f37a}", "abcdef"));
+ok($ins->execute(3, -128, 255, 0, "\x{3042}\x{3044}", "", ""));
+$dbh_sqlite->disconnect;
+
+ok($dbh->do("drop table if exists T"));
+ok($dbh->do("create table T engine=mysqlite file_name='$dbpath'"));
+
+# Fit the columns
+is_deeply($dbh->selectrow_arrayref("select id, t, u, b, v, txt, bin from T where id = 1"),
+          [1, 100, 200, -70000, "abc", "h\x{e9}llo", "ab"]);
+is_deeply($dbh->selectrow_arrayref("select id, t, u, b, v, txt, bin from T where id = 3"),
+          [3, -128, 255, 0, "\x{3042}\x{3044}", "", ""]);
+
+# Out of range or too long: clamped or truncated by the server
+$dbh->do("set sql_mode = ''");
+my $row = $dbh->selectrow_arrayref("select t, u, b, v, bin from T where id = 2");
+is_deeply($row, [127, 0, 2147483647, "abc", "abcd"]);
+# 4-byte UTF-8 character does not fit utf8 (3 bytes)
+isnt($dbh->selectrow_array("select txt from T where id = 2"), "\x{1f37a}");
+
+## Same rows by index entries and by position
+is_deeply($dbh->selectall_arrayref("select id, v from T force index (PRIMARY) order by id"),
+          [[1, "abc"], [2, "abc"], [3, "\x{3042}\x{3044}"]]);
+is_deeply($dbh->selectall_arrayref("select txt from T order by length(txt), id"),
+          $dbh->selectall_arrayref("select txt from T force index (PRIMARY) order by length(txt), id"));
+
+$dbh->do("drop table T");
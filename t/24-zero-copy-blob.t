@@ -0,0 +1,53 @@
+#! /usr/bin/perl
+
+use strict;
+use warnings;
+
+use DBI;
+
+use Test::More tests => 10;
+
+use File::Temp qw(tempdir);
+
+my $db = $ENV{DB} || "test";
+my $cnf = $ENV{CNF} || "/etc/my.cnf";
+my $dbh = DBI->connect(
+    $ENV{DBI} || "dbi:mysql:$db;mysql_read_default_file=$cnf",
+    $ENV{DBI_USER} || 'root',
+    $ENV{DBI_PASSWORD} || '',
+    {mysql_enable_utf8 => 1},
+) or die 'connection failed:';
+
+## TEXT values on leaves, and those continued to overflow pages
+my $dbpath = tempdir(CLEANUP => 1) . "/zero-copy-blob.sqlite";
+my $dbh_sqlite = DBI->connect("dbi:SQLite:dbname=$dbpath", '', '', {sqlite_unicode => 1});
+ok($dbh_sqlite->do("pragma page_size = 1024"));
+ok($dbh_sqlite->do("create table T (id INTEGER PRIMARY KEY, s TEXT, l TEXT)"));
+my $ins = $dbh_sqlite->prepare("insert into T values (?, ?, ?)");
+$dbh_sqlite->begin_work;
+my @expected;
+for my $id (1 .. 100) {
+    my $s = "short \x{e9}$id";
+    my $l = ($id % 3 ? "x" : "\x{3042}") x ($id * 37);  # some overflow
+    $ins->execute($id, $s, $l);
+    push @expected, [$id, $s, length($l)];
+}
+$dbh_sqlite->commit;
+$dbh_sqlite->disconnect;
+
+for my $mapped (1, 0) {
+    ok($dbh->do("drop table if exists T"));
+    ok($dbh->do("create table T engine=mysqlite file_name='$dbpath' mapped=$mapped"));
+
+    # Each row overwrites the fields of the row before
+    is_deeply($dbh->selectall_arrayref("select id, s, char_length(l) from T"),
+              \@expected, "mapped=$mapped");
+
+    # Values compared after the scan moved to later rows
+    my $rows = $dbh->selectall_arrayref(
+        "select a.id from T a join T b on b.id = 101 - a.id where a.l = repeat(if(a.id % 3, 'x', '\x{3042}'), a.id * 37)"
+        . " and b.s = concat('short \x{e9}', b.id)");
+    is(scalar @$rows, 100);
+}
+
+$dbh->do("drop table T");
@@ -0,0 +1,45 @@
+#! /usr/bin/perl
+
+use strict;
+use warnings;
+
+use DBI;
+
+use Test::More tests => 10;
+
+use File::Temp qw(tempdir);
+
+my $db = $ENV{DB} || "test";
+my $cnf = $ENV{CNF} || "/etc/my.cnf";
+my $dbh = DBI->connect(
+    $ENV{DBI} || "dbi:mysql:$db;mysql_read_default_file=$cnf",
+    $ENV{DBI_USER} || 'root',
+    $ENV{DBI_PASSWORD} || '',
+    {mysql_enable_utf8 => 1},
+) or die 'connection failed:';
+
+## 64-bit integers, REAL, BLOB and NULL
+my $dbpath = tempdir(CLEANUP => 1) . "/typed-values.sqlite";
+my $dbh_sqlite = DBI->connect("dbi:SQLite:dbname=$dbpath", '', '');
+ok($dbh_sqlite->do("create table T (id INTEGER PRIMARY KEY, big BIGINT, r DOUBLE,"
+                   . " f FLOAT, bin BLOB, vb VARBINARY(2))"));
+ok($dbh_sqlite->do("insert into T values (1, 9223372036854775807, 1.5, 0.25, x'00ff', x'0102')"));
+ok($dbh_sqlite->do("insert into T values (2, -140737488355328, -1e300, 2, x'', x'010203')"));
+ok($dbh_sqlite->do("insert into T values (3, NULL, NULL, NULL, NULL, NULL)"));
+$dbh_sqlite->disconnect;
+
+ok($dbh->do("drop table if exists T"));
+ok($dbh->do("create table T engine=mysqlite file_name='$dbpath'"));
+
+is_deeply($dbh->selectall_arrayref("select id, big, r, f, hex(bin), hex(vb) from T where id < 3"),
+          [[1, "9223372036854775807", 1.5, 0.25, "00FF", "0102"],
+           [2, "-140737488355328", -1e300, 2, "", "0102"]]);
+is_deeply($dbh->selectrow_arrayref("select big, r, f, bin, vb from T where id = 3"),
+          [undef, undef, undef, undef, undef]);
+is($dbh->selectrow_array("select count(*) from T where big > 4294967296"), 1);
+
+## Same values by the index on rowid
+is_deeply($dbh->selectall_arrayref("select big, r from T force index (PRIMARY) order by id"),
+          $dbh->selectall_arrayref("select big, r from T order by id"));
+
+$dbh->do("drop table T");
@@ -0,0 +1,67 @@
+#! /usr/bin/perl
+
+use strict;
+use warnings;
+
+use DBI;
+
+use Test::More tests => 18;
+
+use File::Temp qw(tempdir);
+
+my $db = $ENV{DB} || "test";
+my $cnf = $ENV{CNF} || "/etc/my.cnf";
+my $dbh = DBI->connect(
+    $ENV{DBI} || "dbi:mysql:$db;mysql_read_default_file=$cnf",
+    $ENV{DBI_USER} || 'root',
+    $ENV{DBI_PASSWORD} || '',
+    {mysql_enable_utf8 => 1},
+) or die 'connection failed:';
+
+## Sparse rows, and a column added after some rows
+my $dbpath = tempdir(CLEANUP => 1) . "/null-bits.sqlite";
+my $dbh_sqlite = DBI->connect("dbi:SQLite:dbname=$dbpath", '', '');
+ok($dbh_sqlite->do("create table T (id INTEGER PRIMARY KEY, "
+                   . join(", ", map { "c$_ INT" } 1 .. 70) . ")"));
+my $ins = $dbh_sqlite->prepare("insert into T (id, c1, c35, c70) values (?, ?, ?, ?)");
+$dbh_sqlite->begin_work;
+$ins->execute($_, $_ % 2 ? $_ : undef, $_ % 3 ? undef : $_, $_ % 5 ? undef : $_) for 1 .. 300;
+$dbh_sqlite->commit;
+ok($dbh_sqlite->do("alter table T add column added TEXT"));
+ok($dbh_sqlite->do("insert into T (id, c70, added) values (301, 70, 'x')"));
+$dbh_sqlite->disconnect;
+
+ok($dbh->do("drop table if exists T"));
+ok($dbh->do("create table T engine=mysqlite file_name='$dbpath'"));
+
+is($dbh->selectrow_array("select count(c1) + count(c35) + count(c70) + count(c2) from T"),
+   150 + 100 + 61 + 0);
+is_deeply($dbh->selectall_arrayref("select id, c1, c35, c70, added from T where id in (15, 30, 301)"),
+          [[15, 15, 15, 15, undef], [30, undef, 30, 30, undef], [301, undef, undef, 70, "x"]]);
+is($dbh->selectrow_array("select count(*) from T where added is null"), 300);
+
+# Previous row values do not leak into NULL columns
+is_deeply($dbh->selectcol_arrayref("select c1 from T where id between 1 and 4"),
+          [1, undef, 3, undef]);
+
+$dbh->do("drop table T");
+
+## NOT NULL column added after some rows, read by the decode thread
+$dbh_sqlite = DBI->connect("dbi:SQLite:dbname=$dbpath", '', '');
+ok($dbh_sqlite->do("create table U (id INTEGER PRIMARY KEY, v INT)"));
+ok($dbh_sqlite->do("insert into U (id, v) values (2, 20), (4, 40)"));
+ok($dbh_sqlite->do("alter table U add column n INT NOT NULL DEFAULT 7"));
+ok($dbh_sqlite->do("insert into U (id, v, n) values (1, 10, 5), (3, 30, 5)"));
+$dbh_sqlite->disconnect;
+
+ok($dbh->do("drop table if exists U"));
+ok($dbh->do("create table U engine=mysqlite file_name='$dbpath'"));
+ok($dbh->do("set global mysqlite_decode_thread = on"));
+# Rows are read by position after filesort. Rows 2 and 4 lack the
+# column: they have its DEFAULT, not the values of rows 1 and 3.
+is_deeply($dbh->selectall_arrayref("select id, v, n from U use index () order by v desc"),
+          [[4, 40, 7], [3, 30, 5], [2, 20, 7], [1, 10, 5]]);
+$dbh->do("set global mysqlite_decode_thread = default");
+is_deeply($dbh->selectcol_arrayref("select n from U"), [5, 7, 5, 7]);
+
+$dbh->do("drop table U");
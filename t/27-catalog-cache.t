@@ -0,0 +1,39 @@
+#! /usr/bin/perl
+
+use strict;
+use warnings;
+
+use DBI;
+
+use Test::More tests => 9;
+
+use File::Temp qw(tempdir);
+
+my $db = $ENV{DB} || "test";
+my $cnf = $ENV{CNF} || "/etc/my.cnf";
+my $dbh = DBI->connect(
+    $ENV{DBI} || "dbi:mysql:$db;mysql_read_default_file=$cnf",
+    $ENV{DBI_USER} || 'root',
+    $ENV{DBI_PASSWORD} || '',
+    {mysql_enable_utf8 => 1},
+) or die 'connection failed:';
+
+## Tables found again after the schema of the file changes
+my $dbpath = tempdir(CLEANUP => 1) . "/catalog-cache.sqlite";
+my $dbh_sqlite = DBI->connect("dbi:SQLite:dbname=$dbpath", '', '');
+ok($dbh_sqlite->do("create table T (id INTEGER PRIMARY KEY, v INT)"));
+ok($dbh_sqlite->do("insert into T (v) values (1), (2), (3)"));
+
+ok($dbh->do("drop table if exists T"));
+ok($dbh->do("create table T engine=mysqlite file_name='$dbpath'"));
+is($dbh->selectrow_array("select sum(v) from T"), 6);
+
+# Another table's pages come before new pages of T
+ok($dbh_sqlite->do("create table U (x TEXT)"));
+ok($dbh_sqlite->do("insert into T (v) select v + 10 from T"));
+$dbh_sqlite->disconnect;
+
+is($dbh->selectrow_array("select sum(v) from T"), 6 + 36);
+is($dbh->selectrow_array("select count(*) from T where id > 3"), 3);
+
+$dbh->do("drop table T");
@@ -0,0 +1,47 @@
+#! /usr/bin/perl
+
+use strict;
+use warnings;
+
+use DBI;
+
+use Test::More tests => 13;
+
+use File::Temp qw(tempdir);
+
+my $db = $ENV{DB} || "test";
+my $cnf = $ENV{CNF} || "/etc/my.cnf";
+my $dbh = DBI->connect(
+    $ENV{DBI} || "dbi:mysql:$db;mysql_read_default_file=$cnf",
+    $ENV{DBI_USER} || 'root',
+    $ENV{DBI_PASSWORD} || '',
+) or die 'connection failed:';
+
+## Root pages move when another process recreates the table
+my $dbpath = tempdir(CLEANUP => 1) . "/schema-change.sqlite";
+my $dbh_sqlite = DBI->connect("dbi:SQLite:dbname=$dbpath", '', '');
+ok($dbh_sqlite->do("create table T (id INTEGER PRIMARY KEY, v INT)"));
+ok($dbh_sqlite->do("create index T_v on T (v)"));
+ok($dbh_sqlite->do("insert into T values (1, 10), (2, 20), (3, 30)"));
+
+ok($dbh->do("drop table if exists T"));
+ok($dbh->do("create table T engine=mysqlite file_name='$dbpath'"));
+is_deeply($dbh->selectcol_arrayref("select id from T force index (T_v) where v >= 20"), [2, 3]);
+is($dbh->selectrow_array("select sum(v) from T use index ()"), 60);
+is($dbh->selectrow_array("select count(*) from T"), 3);
+
+ok($dbh_sqlite->do("drop table T") && $dbh_sqlite->do("create table Other (x)")
+   && $dbh_sqlite->do("insert into Other values (1)")
+   && $dbh_sqlite->do("create table T (id INTEGER PRIMARY KEY, v INT)")
+   && $dbh_sqlite->do("create index T_v on T (v)")
+   && $dbh_sqlite->do("insert into T values (4, 40), (5, 50)"));
+$dbh_sqlite->disconnect;
+
+# Read by the roots of the recreated table and index. COUNT(*) comes
+# first: it is answered by records() before any scan.
+is($dbh->selectrow_array("select count(*) from T"), 2);
+is_deeply($dbh->selectcol_arrayref("select id from T force index (T_v) where v >= 20"), [4, 5]);
+is_deeply($dbh->selectcol_arrayref("select v from T force index (PRIMARY) where id > 0"), [40, 50]);
+is($dbh->selectrow_array("select sum(v) from T use index ()"), 90);
+
+$dbh->do("drop table T");